@@ -0,0 +1,161 @@
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "util_dwarf/debug_info.hpp"
+#include "util_dwarf/dwarf_analyzer.hpp"
+#include "util_dwarf/dwarf_info.hpp"
+
+// 解析処理のベンチマーク
+//
+// Usage: bench_analyze [--reps=N] [--json=<file>] <dwarf file>
+//
+// 下記フェーズを個別に計測する
+//   analyze      : dwarf_analyzer::analyze
+//   build        : debug_info::build
+//   get_var_info : debug_info::get_var_info で全行を走査
+// 計測結果はJSON形式で出力する(--json 未指定時は標準出力)
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+struct phase_result
+{
+    char const *name;
+    std::vector<double> samples_ms;
+
+    explicit phase_result(char const *name_) : name(name_), samples_ms() {
+    }
+
+    void add(bench_clock::time_point begin, bench_clock::time_point end) {
+        samples_ms.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+    }
+
+    void write_json(FILE *fp) const {
+        auto sorted = samples_ms;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0;
+        for (auto v : sorted) {
+            sum += v;
+        }
+        fprintf(fp, "    \"%s\": {\"min_ms\": %.3f, \"median_ms\": %.3f, \"mean_ms\": %.3f, \"max_ms\": %.3f, \"samples_ms\": [", name, sorted.front(),
+                sorted[sorted.size() / 2], sum / static_cast<double>(sorted.size()), sorted.back());
+        for (size_t i = 0; i < samples_ms.size(); i++) {
+            fprintf(fp, "%s%.3f", (i == 0) ? "" : ", ", samples_ms[i]);
+        }
+        fprintf(fp, "]}");
+    }
+};
+
+struct bench_counts
+{
+    size_t cu;
+    size_t var;
+    size_t type;
+    size_t func;
+    size_t rows;
+};
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc <= 1) {
+        printf("Usage: %s [--reps=N] [--json=<file>] <dwarf file>\n", argv[0]);
+        return -1;
+    }
+
+    int reps = 5;
+    std::string json_path;
+    for (int arg_idx = 1; arg_idx < argc - 1; arg_idx++) {
+        std::string_view arg(argv[arg_idx]);
+        if (arg.find("--reps=") == 0) {
+            reps = atoi(argv[arg_idx] + std::string_view("--reps=").size());
+        }
+        if (arg.find("--json=") == 0) {
+            json_path = arg.substr(std::string_view("--json=").size());
+        }
+    }
+    char const *file_path = argv[argc - 1];
+    if (reps <= 0) {
+        fprintf(stderr, "invalid --reps\n");
+        return -1;
+    }
+
+    phase_result analyze_result("analyze");
+    phase_result build_result("build");
+    phase_result var_info_result("get_var_info");
+    bench_counts counts{};
+
+    using da_opt = util_dwarf::dwarf_analyze_option;
+    da_opt daopt;
+    daopt.unset(da_opt::no_impl_warning);
+    daopt.set(da_opt::func_info_analyze);
+    using diopt = util_dwarf::debug_info::option;
+    diopt opt;
+
+    for (int rep = 0; rep < reps; rep++) {
+        // 毎回openからやり直して各フェーズを同条件で計測する
+        util_dwarf::dwarf_analyzer di;
+        if (!di.open(file_path)) {
+            fprintf(stderr, "cannot open : %s\n", file_path);
+            return -1;
+        }
+        util_dwarf::dwarf_info dw_info;
+
+        auto t0 = bench_clock::now();
+        di.analyze(dw_info, daopt);
+        auto t1 = bench_clock::now();
+        analyze_result.add(t0, t1);
+
+        auto debug_info = util_dwarf::debug_info(dw_info, opt);
+        t0              = bench_clock::now();
+        debug_info.build();
+        t1 = bench_clock::now();
+        build_result.add(t0, t1);
+
+        size_t rows = 0;
+        t0          = bench_clock::now();
+        debug_info.get_var_info([&rows](util_dwarf::debug_info::var_info_view &) -> bool {
+            rows++;
+            return true;
+        });
+        t1 = bench_clock::now();
+        var_info_result.add(t0, t1);
+
+        counts = bench_counts{dw_info.cu_tbl.container.size(), dw_info.var_tbl.container.size(), dw_info.type_tbl.container.size(),
+                              dw_info.func_tbl.container.size(), rows};
+        di.close();
+    }
+
+    FILE *fp = stdout;
+    if (!json_path.empty()) {
+        fp = fopen(json_path.c_str(), "w");
+        if (fp == nullptr) {
+            fprintf(stderr, "cannot open : %s\n", json_path.c_str());
+            return -1;
+        }
+    }
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"file\": \"%s\",\n", file_path);
+    fprintf(fp, "  \"repetitions\": %d,\n", reps);
+    fprintf(fp, "  \"counts\": {\"cu\": %zu, \"var\": %zu, \"type\": %zu, \"func\": %zu, \"rows\": %zu},\n", counts.cu, counts.var, counts.type,
+            counts.func, counts.rows);
+    fprintf(fp, "  \"phases\": {\n");
+    analyze_result.write_json(fp);
+    fprintf(fp, ",\n");
+    build_result.write_json(fp);
+    fprintf(fp, ",\n");
+    var_info_result.write_json(fp);
+    fprintf(fp, "\n  }\n}\n");
+    if (fp != stdout) {
+        fclose(fp);
+    }
+
+    return 0;
+}
@@ -0,0 +1,171 @@
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "util_dwarf/LEB128.hpp"
+
+// LEB128デコードのマイクロベンチマーク
+//
+// Usage: bench_leb128 [count] [reps]
+//
+// 下記の実装を値の分布ごとに比較する
+//   legacy : 変更前の1byteずつのデコード(32bit値)
+//   single : LEB128<T> で1値ずつデコード
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+// 変更前の実装
+template <typename T>
+struct legacy_LEB128
+{
+    T value;
+    size_t used_bytes;
+
+    legacy_LEB128(uint8_t *buff, size_t len) : value(0), used_bytes(0) {
+        size_t shift = 0;
+        for (size_t i = 0; i < len; i++) {
+            auto &data = buff[i];
+            value |= static_cast<T>((data & 0x7F) << shift);
+            used_bytes++;
+            if ((data & 0x80) == 0) {
+                break;
+            }
+            shift += 7;
+        }
+        if constexpr (std::is_signed_v<T>) {
+            shift += 7;
+            T mask = std::numeric_limits<T>::max();
+            mask   = static_cast<T>(mask << (shift - 1));
+            if ((value & mask) != 0) {
+                value |= mask;
+            }
+        }
+    }
+};
+
+void encode_u(std::vector<uint8_t> &out, uint64_t value) {
+    do {
+        uint8_t data = value & 0x7F;
+        value >>= 7;
+        if (value != 0) {
+            data |= 0x80;
+        }
+        out.push_back(data);
+    } while (value != 0);
+}
+
+void encode_s(std::vector<uint8_t> &out, int64_t value) {
+    bool more = true;
+    while (more) {
+        uint8_t data = value & 0x7F;
+        value >>= 7;
+        if ((value == 0 && (data & 0x40) == 0) || (value == -1 && (data & 0x40) != 0)) {
+            more = false;
+        } else {
+            data |= 0x80;
+        }
+        out.push_back(data);
+    }
+}
+
+// 値の分布
+struct dataset
+{
+    char const *name;
+    std::vector<uint8_t> ubuff;
+    std::vector<uint8_t> sbuff;
+    size_t count;
+};
+
+dataset make_dataset(char const *name, size_t count, unsigned int seed, int max_bits, int small_ratio) {
+    dataset ds{name, {}, {}, count};
+    std::mt19937_64 rng(seed);
+    for (size_t i = 0; i < count; i++) {
+        // small_ratio[%] は1byteに収まる値
+        int bits = (static_cast<int>(rng() % 100) < small_ratio) ? 6 : static_cast<int>(rng() % static_cast<uint64_t>(max_bits)) + 1;
+        uint64_t value = (bits >= 64) ? rng() : (rng() & ((1ull << bits) - 1));
+        encode_u(ds.ubuff, value);
+        int64_t svalue = static_cast<int64_t>(value >> 1);
+        encode_s(ds.sbuff, (rng() & 1) ? -svalue : svalue);
+    }
+    return ds;
+}
+
+template <typename Func>
+double measure(int reps, size_t count, Func &&func) {
+    double best = 0;
+    for (int rep = 0; rep < reps; rep++) {
+        auto t0 = bench_clock::now();
+        func();
+        auto t1 = bench_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / static_cast<double>(count);
+        if (rep == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+template <typename T>
+void run(dataset &ds, std::vector<uint8_t> &buff, char const *kind, int reps) {
+    uint64_t sum_legacy = 0;
+    uint64_t sum_single = 0;
+
+    using legacy_t = std::conditional_t<std::is_signed_v<T>, int32_t, uint32_t>;
+
+    double legacy = measure(reps, ds.count, [&]() {
+        size_t pos = 0;
+        for (size_t i = 0; i < ds.count; i++) {
+            legacy_LEB128<legacy_t> leb(&buff[pos], buff.size() - pos);
+            sum_legacy += static_cast<uint64_t>(leb.value);
+            pos += leb.used_bytes;
+        }
+    });
+    double single = measure(reps, ds.count, [&]() {
+        size_t pos = 0;
+        for (size_t i = 0; i < ds.count; i++) {
+            util_dwarf::LEB128<T> leb(&buff[pos], buff.size() - pos);
+            sum_single += static_cast<uint64_t>(leb.value);
+            pos += leb.used_bytes;
+        }
+    });
+
+    double bytes_per_value = static_cast<double>(buff.size()) / static_cast<double>(ds.count);
+    printf("%-8s %-6s %6.2f %10.3f %10.3f %8.2fx  %016llX\n", ds.name, kind, bytes_per_value, legacy, single, legacy / single,
+           static_cast<unsigned long long>(sum_legacy ^ sum_single));
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    size_t count = (argc > 1) ? static_cast<size_t>(atoll(argv[1])) : 1000000;
+    int reps     = (argc > 2) ? atoi(argv[2]) : 10;
+    if (count == 0 || reps <= 0) {
+        printf("Usage: %s [count] [reps]\n", argv[0]);
+        return -1;
+    }
+
+    std::vector<dataset> ds_list;
+    // DWARFで頻出するのは1-2byte(form, attribute, 小さいoffset)
+    ds_list.push_back(make_dataset("small", count, 1, 14, 90));
+    ds_list.push_back(make_dataset("mixed", count, 2, 32, 50));
+    // 32bitを超える値はlegacyでは正しくデコードできない(速度比較のみ)
+    ds_list.push_back(make_dataset("large", count, 3, 64, 0));
+
+    printf("%-8s %-6s %6s %10s %10s %9s  %s\n", "dataset", "kind", "B/val", "legacy", "single", "single", "checksum");
+    printf("%-8s %-6s %6s %10s %10s %9s\n", "", "", "", "[ns/val]", "[ns/val]", "speedup");
+    for (auto &ds : ds_list) {
+        run<uint64_t>(ds, ds.ubuff, "ULEB", reps);
+        run<int64_t>(ds, ds.sbuff, "SLEB", reps);
+    }
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+// ベンチマーク用の合成Cソースを生成する
+//
+// Usage: gen_corpus <out_dir> [cu_count] [nest_depth] [seed]
+//
+// 生成物:
+//   <out_dir>/common.h       : 全CUで共有する型定義(CU間で重複する型情報の再現)
+//   <out_dir>/cu_NNNNN.c     : CU毎のソース
+//   <out_dir>/main.c         : エントリーポイント
+//   <out_dir>/sources.rsp    : コンパイラに渡すソース一覧(gcc @file形式)
+//
+// result_abs_test_RX.txt に出現するような
+// 深いstructネスト, bitfield, 多次元配列, 関数ポインタ, union, enum, typedef, const/volatile を含む
+
+namespace {
+
+struct gen_config
+{
+    std::string out_dir;
+    int cu_count;
+    int nest_depth;
+    unsigned int seed;
+};
+
+char const *const base_types[] = {"uint8_t", "uint16_t", "uint32_t", "uint64_t", "int8_t", "int16_t", "int32_t", "char", "float", "double"};
+constexpr size_t base_types_count = sizeof(base_types) / sizeof(base_types[0]);
+
+// [lo, lo + n) の乱数
+unsigned int pick(std::mt19937 &rng, unsigned int lo, unsigned int n) {
+    return lo + static_cast<unsigned int>(rng() % n);
+}
+
+FILE *open_file(std::string const &path) {
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == nullptr) {
+        fprintf(stderr, "cannot open file : %s\n", path.c_str());
+        exit(1);
+    }
+    return fp;
+}
+
+void gen_common_header(gen_config const &cfg) {
+    FILE *fp = open_file(cfg.out_dir + "/common.h");
+    fprintf(fp, "#ifndef CORPUS_COMMON_H\n#define CORPUS_COMMON_H\n");
+    fprintf(fp, "#include <stdint.h>\n\n");
+    fprintf(fp, "typedef enum { Kind0, Kind1, Kind2, Kind3 } TestKind;\n");
+    fprintf(fp, "typedef int (*funcptr1_t)(unsigned char, uint8_t);\n");
+    fprintf(fp, "typedef void (*callback_t)(void *, uint32_t);\n\n");
+    fprintf(fp, "typedef struct {\n");
+    fprintf(fp, "    uint16_t b0 : 1;\n    uint16_t b1_5 : 5;\n    uint16_t byte1;\n");
+    fprintf(fp, "} bf_inner_type;\n\n");
+    fprintf(fp, "typedef struct {\n");
+    fprintf(fp, "    TestKind kind;\n");
+    fprintf(fp, "    uint16_t b0 : 1;\n    uint16_t b1_5 : 5;\n    uint16_t b6 : 1;\n    uint16_t b7_8 : 2;\n");
+    fprintf(fp, "    uint16_t b9_14 : 6;\n    uint16_t b15 : 1;\n    uint16_t b16 : 1;\n");
+    fprintf(fp, "    uint16_t byte2;\n");
+    fprintf(fp, "    funcptr1_t fp1_ary1[2];\n");
+    fprintf(fp, "    bf_inner_type inner;\n");
+    fprintf(fp, "    uint32_t *u32p_var;\n");
+    fprintf(fp, "    union { uint16_t u16[2]; uint32_t u32; } port_t[5];\n");
+    fprintf(fp, "    TestKind kinds[4];\n");
+    fprintf(fp, "} bf_t;\n\n");
+    fprintf(fp, "#endif\n");
+    fclose(fp);
+}
+
+void gen_struct_chain(FILE *fp, std::mt19937 &rng, int cu, int depth) {
+    // depth段のstructネストを作る
+    // nest_<cu>_0 が最内側、nest_<cu>_<depth-1> が最外側
+    for (int d = 0; d < depth; d++) {
+        fprintf(fp, "struct nest_%d_%d {\n", cu, d);
+        int member_count = static_cast<int>(pick(rng, 2, 5));
+        for (int m = 0; m < member_count; m++) {
+            auto type = base_types[rng() % base_types_count];
+            switch (rng() % 6) {
+                case 0:
+                    // 多次元配列
+                    fprintf(fp, "    %s m%d[%u][%u];\n", type, m, pick(rng, 1, 4), pick(rng, 1, 3));
+                    break;
+                case 1:
+                    // bitfield
+                    fprintf(fp, "    uint32_t bf%d_a : %u;\n    uint32_t bf%d_b : %u;\n", m, pick(rng, 1, 7), m, pick(rng, 1, 9));
+                    break;
+                case 2:
+                    // 関数ポインタ
+                    fprintf(fp, "    funcptr1_t fp%d;\n    void (*cb%d)(uint8_t, %s);\n", m, m, type);
+                    break;
+                case 3:
+                    // const/volatile, pointer
+                    fprintf(fp, "    const volatile %s cv%d;\n    %s **pp%d;\n", type, m, type, m);
+                    break;
+                default:
+                    fprintf(fp, "    %s m%d;\n", type, m);
+                    break;
+            }
+        }
+        if (d > 0) {
+            // 内側のstructを配列で保持する
+            fprintf(fp, "    struct nest_%d_%d inner[%u];\n", cu, d - 1, pick(rng, 1, 3));
+            fprintf(fp, "    union { uint32_t w; uint8_t b[4]; struct nest_%d_%d *self; } u;\n", cu, d);
+        }
+        fprintf(fp, "};\n");
+    }
+    fprintf(fp, "typedef struct nest_%d_%d nest_%d_t;\n\n", cu, depth - 1, cu);
+}
+
+void gen_cu(gen_config const &cfg, int cu) {
+    char name[64];
+    snprintf(name, sizeof(name), "/cu_%05d.c", cu);
+    FILE *fp = open_file(cfg.out_dir + name);
+    // CU毎に乱数系列を固定する
+    std::mt19937 rng(cfg.seed + static_cast<unsigned int>(cu));
+
+    fprintf(fp, "#include \"common.h\"\n\n");
+    gen_struct_chain(fp, rng, cu, cfg.nest_depth);
+
+    // 関数
+    fprintf(fp, "static int func_%d(unsigned char a, uint8_t b) { return a + b + %d; }\n", cu, cu);
+    fprintf(fp, "void cb_%d(void *p, uint32_t v) { (void)p; (void)v; }\n\n", cu);
+
+    // グローバル変数
+    fprintf(fp, "nest_%d_t g_nest_%d;\n", cu, cu);
+    fprintf(fp, "nest_%d_t g_nest_ary_%d[%u][%u];\n", cu, cu, pick(rng, 1, 4), pick(rng, 1, 4));
+    fprintf(fp, "bf_t g_port_%d;\n", cu);
+    fprintf(fp, "bf_t g_portN_%d[%u];\n", cu, pick(rng, 2, 8));
+    fprintf(fp, "funcptr1_t g_fp_%d = func_%d;\n", cu, cu);
+    fprintf(fp, "callback_t g_cb_ary_%d[2] = {cb_%d, cb_%d};\n", cu, cu, cu);
+    fprintf(fp, "int (*g_funcptr_%d)(unsigned char, uint8_t);\n", cu);
+    fprintf(fp, "const uint32_t g_const_%d = %d;\n", cu, cu);
+    fprintf(fp, "volatile uint8_t g_buff_%d[%u];\n", cu, pick(rng, 16, 240));
+    fprintf(fp, "static uint64_t s_local_%d[3][2];\n", cu);
+    fprintf(fp, "uint64_t *g_ref_%d = &s_local_%d[0][0];\n", cu, cu);
+    fclose(fp);
+}
+
+void gen_main(gen_config const &cfg) {
+    FILE *fp = open_file(cfg.out_dir + "/main.c");
+    fprintf(fp, "int main(void) { return 0; }\n");
+    fclose(fp);
+
+    FILE *rsp = open_file(cfg.out_dir + "/sources.rsp");
+    fprintf(rsp, "\"%s/main.c\"\n", cfg.out_dir.c_str());
+    for (int cu = 0; cu < cfg.cu_count; cu++) {
+        fprintf(rsp, "\"%s/cu_%05d.c\"\n", cfg.out_dir.c_str(), cu);
+    }
+    fclose(rsp);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s <out_dir> [cu_count] [nest_depth] [seed]\n", argv[0]);
+        return -1;
+    }
+
+    gen_config cfg;
+    cfg.out_dir    = argv[1];
+    cfg.cu_count   = (argc > 2) ? atoi(argv[2]) : 1000;
+    cfg.nest_depth = (argc > 3) ? atoi(argv[3]) : 6;
+    cfg.seed       = (argc > 4) ? static_cast<unsigned int>(atoi(argv[4])) : 1;
+    if (cfg.cu_count <= 0 || cfg.nest_depth <= 0) {
+        fprintf(stderr, "invalid argument\n");
+        return -1;
+    }
+
+    gen_common_header(cfg);
+    for (int cu = 0; cu < cfg.cu_count; cu++) {
+        gen_cu(cfg, cu);
+    }
+    gen_main(cfg);
+
+    return 0;
+}
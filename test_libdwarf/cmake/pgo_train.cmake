@@ -0,0 +1,29 @@
+# PGO学習実行スクリプト
+# cmake -DEXE=<test_libdwarf> -DELF=<学習用ELF> -DPGO_DIR=<プロファイル出力先> -DCOMPILER_ID=<GNU|Clang> [-DLLVM_PROFDATA=<llvm-profdata>] -P pgo_train.cmake
+
+if(NOT EXISTS "${ELF}")
+    message(FATAL_ERROR "PGO training ELF not found : ${ELF}")
+endif()
+
+# 通常出力はプロファイルに関係しないので捨てる
+execute_process(
+    COMMAND "${EXE}" "${ELF}"
+    OUTPUT_FILE "${PGO_DIR}/train_stdout.txt"
+    ERROR_FILE "${PGO_DIR}/train_stderr.txt"
+    RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "PGO training run failed (${result}) : see ${PGO_DIR}/train_stderr.txt")
+endif()
+
+# Clangは生データ(.profraw)をマージして.profdataを作る
+if(COMPILER_ID STREQUAL "Clang")
+    file(GLOB profraw_list "${PGO_DIR}/*.profraw")
+    execute_process(
+        COMMAND "${LLVM_PROFDATA}" merge -output=${PGO_DIR}/test_libdwarf.profdata ${profraw_list}
+        RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "llvm-profdata merge failed (${result})")
+    endif()
+endif()
+
+message(STATUS "PGO profile : ${PGO_DIR}")
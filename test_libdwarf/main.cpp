@@ -1,16 +1,34 @@
 
 #include <time.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
+#include <cstdlib>
 #include <format>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <tuple>
 #include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "util_dwarf/debug_info.hpp"
+#include "util_dwarf/dwarf_cu_filter.hpp"
 #include "util_dwarf/dwarf_analyzer.hpp"
+#include "util_dwarf/dwarf_async_analyzer.hpp"
 #include "util_dwarf/dwarf_info.hpp"
+#include "util_dwarf/dwarf_profile.hpp"
+#include "util_dwarf/memmap_batch.hpp"
+#include "util_dwarf/memmap_diff.hpp"
+#include "util_dwarf/memmap_export.hpp"
+#include "util_dwarf/memmap_table.hpp"
+#include "util_dwarf/memory_accounting.hpp"
 
 // void dump_memmap(util_dwarf::debug_info::var_info &var, util_dwarf::debug_info::type_info &type, std::string &prefix, int depth, size_t array_idx);
 // void dump_memmap_member(util_dwarf::debug_info::type_info &type, std::string &prefix, int depth, Dwarf_Off address);
@@ -83,7 +101,7 @@ void dump_memmap(util_dwarf::debug_info::var_info &var, util_dwarf::debug_info::
             //  pointerは展開しない
             //  function: 引数としてchildを持つ -> 展開しない
             if ((type.tag & util_dwarf::debug_info::type_tag::func_ptr) == 0) {
-                if (type.member_list != nullptr) {
+                if (!type.member_list.empty()) {
                     dump_memmap_member(type, name, depth, addr, std::forward<Func>(func));
                 }
             }
@@ -105,7 +123,7 @@ void dump_memmap(util_dwarf::debug_info::var_info &var, util_dwarf::debug_info::
         // pointerは展開しない
         // function: 引数としてchildを持つ -> 展開しない
         if ((type.tag & util_dwarf::debug_info::type_tag::func_ptr) == 0) {
-            if (type.member_list != nullptr) {
+            if (!type.member_list.empty()) {
                 dump_memmap_member(type, name, depth, addr, std::forward<Func>(func));
             }
         }
@@ -117,7 +135,7 @@ void dump_memmap_member(util_dwarf::debug_info::type_info &type, std::string &pr
     Dwarf_Off bit_offset = 0;
     std::string name;
 
-    for (auto &mem : *type.member_list) {
+    for (auto &mem : type.member_list) {
         auto &member = *mem;
         std::string tag;
         if (member.sub_info != nullptr) {
@@ -144,7 +162,7 @@ void dump_memmap_member(util_dwarf::debug_info::type_info &type, std::string &pr
                     //  pointerは展開しない
                     //  function: 引数としてchildを持つ -> 展開しない
                     if ((member.tag & util_dwarf::debug_info::type_tag::func_ptr) == 0) {
-                        if (member.member_list != nullptr) {
+                        if (!member.member_list.empty()) {
                             dump_memmap_member(member, name, depth, address, std::forward<Func>(func));
                         }
                     }
@@ -161,7 +179,7 @@ void dump_memmap_member(util_dwarf::debug_info::type_info &type, std::string &pr
                 //  pointerは展開しない
                 //  function: 引数としてchildを持つ -> 展開しない
                 if ((member.tag & util_dwarf::debug_info::type_tag::func_ptr) == 0) {
-                    if (member.member_list != nullptr) {
+                    if (!member.member_list.empty()) {
                         dump_memmap_member(member, name, depth, address, std::forward<Func>(func));
                     }
                 }
@@ -179,6 +197,132 @@ void dump_memmap_member(util_dwarf::debug_info::type_info &type, std::string &pr
     }
 }
 
+// 変数の合計サイズをdecl file/CU毎に集計して出力する
+// struct/unionのメンバは親変数のサイズに含まれるので除外する
+void print_report(util_dwarf::memmap_table const &table, std::string const &key) {
+    using table_t = util_dwarf::memmap_table;
+    bool is_cu    = (key == "cu");
+    if (!is_cu && key != "file") {
+        fprintf(stderr, "unknown report key : %s\n", key.c_str());
+        return;
+    }
+    auto sel = table.all();
+    sel.exclude(table.where_any_flag(table_t::flag::struct_member | table_t::flag::union_member));
+    auto &key_col = is_cu ? table.cu_id : table.file_id;
+    auto &dict    = is_cu ? table.cu_dict() : table.file_dict();
+    auto group    = table.group_by(key_col, table.byte_size, sel);
+    // 合計サイズの降順
+    std::vector<std::pair<table_t::id_type, table_t::aggregate>> list(group.begin(), group.end());
+    std::sort(list.begin(), list.end(), [](auto const &a, auto const &b) -> bool { return a.second.sum > b.second.sum; });
+    printf("== report : %s ==\n", key.c_str());
+    printf("%12s %8s %10s  %s\n", "bytes", "count", "max", key.c_str());
+    for (auto &[id, agg] : list) {
+        auto name = (id == table_t::no_id) ? std::string_view("<unknown>") : dict[id];
+        printf("%12llu %8llu %10llu  %.*s\n", static_cast<unsigned long long>(agg.sum), static_cast<unsigned long long>(agg.count),
+               static_cast<unsigned long long>(agg.max), static_cast<int>(name.size()), name.data());
+    }
+}
+
+// カラムナ形式memmap(--export-memmap)の参照
+// addr_begin < addr_end のときは [addr_begin, addr_end) の行だけを二分探索で切り出して出力する
+int run_read_memmap(char const *path, uint64_t addr_begin, uint64_t addr_end) {
+    util_dwarf::memmap_reader reader;
+    if (!reader.open(path)) {
+        return -1;
+    }
+    auto const &view = reader.view();
+    size_t first     = 0;
+    size_t last      = view.size();
+    if (addr_begin < addr_end) {
+        std::tie(first, last) = view.range(addr_begin, addr_end);
+    }
+    for (size_t i = first; i < last; i++) {
+        auto type = view.type(i);
+        auto name = view.name(i);
+        printf("0x%08llX\t%.*s\t%llu\t%.*s\n", static_cast<unsigned long long>(view.address(i)), static_cast<int>(type.size()), type.data(),
+               static_cast<unsigned long long>(view.byte_size(i)), static_cast<int>(name.size()), name.data());
+    }
+    return 0;
+}
+
+// 複数ELFの一括解析
+// list_pathは1行に1つELFのパスを記載したファイル。空行と#で始まる行は無視する
+int run_batch(char const *list_path, std::string const &out_dir, size_t job_count, bool is_batch_types, bool is_prior_typedef, bool is_c_declarator,
+              util_dwarf::dwarf_cu_filter const *cu_filter) {
+    std::vector<std::string> path_list;
+    {
+        std::ifstream ifs(list_path);
+        if (!ifs) {
+            fprintf(stderr, "cannot open file : %s\n", list_path);
+            return -1;
+        }
+        std::string line;
+        while (std::getline(ifs, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty() || line.front() == '#') {
+                continue;
+            }
+            path_list.push_back(line);
+        }
+    }
+
+    using da_opt = util_dwarf::dwarf_analyze_option;
+    da_opt daopt;
+    daopt.unset(da_opt::no_impl_warning | da_opt::func_info_analyze);
+    daopt.set(da_opt::symbol_location);
+    daopt.cu_filter = cu_filter;
+    // memmapの行(アドレス, 型, サイズ, 名前)だけを出力する
+    daopt.output_fields = util_dwarf::dwarf_attr_filter::none;
+    using diopt = util_dwarf::debug_info::option;
+    diopt opt;
+    if (is_prior_typedef) {
+        opt.set(diopt::prior_typedef);
+    }
+    if (is_c_declarator) {
+        opt.set(diopt::c_declarator);
+    }
+
+    util_dwarf::work_stealing_pool pool(job_count);
+    util_dwarf::memmap_batch batch(is_batch_types);
+    bool is_ok = batch.run(path_list, pool, daopt, opt);
+
+    if (!out_dir.empty()) {
+        auto get_file_name = [](std::string const &path) -> std::string {
+            auto pos = path.find_last_of("/\\");
+            return path.substr((pos == std::string::npos) ? 0 : pos + 1);
+        };
+        // 別ディレクトリの同名ELF(build/A/app.elf, build/B/app.elf等)は出力が衝突するので、リスト内の番号を前置する
+        auto &result_list = batch.results();
+        std::unordered_map<std::string, size_t> name_count;
+        for (auto const &result : result_list) {
+            name_count[get_file_name(result.path)]++;
+        }
+        for (size_t i = 0; i < result_list.size(); i++) {
+            auto const &result = result_list[i];
+            if (!result.is_ok) {
+                continue;
+            }
+            auto file_name = get_file_name(result.path);
+            if (name_count[file_name] > 1) {
+                file_name = std::to_string(i) + "_" + file_name;
+            }
+            auto out_path = out_dir + "/" + file_name + ".memmap.txt";
+            FILE *fp      = fopen(out_path.c_str(), "w");
+            if (fp == nullptr) {
+                fprintf(stderr, "cannot open file : %s\n", out_path.c_str());
+                is_ok = false;
+                continue;
+            }
+            batch.write_text(fp, result);
+            fclose(fp);
+        }
+    }
+    batch.print_summary(stdout);
+    return is_ok ? 0 : -1;
+}
+
 int main(int argc, char *argv[]) {
     if (argc <= 1) {
         std::cout << argv[0] << std::endl;
@@ -190,6 +334,23 @@ int main(int argc, char *argv[]) {
     char const *file_path = nullptr;
     bool is_cmdline_ok    = false;
     bool is_prior_typedef = false;
+    bool is_c_declarator  = false;
+    std::string export_memmap_path;
+    std::string diff_base_path;
+    bool is_profile = false;
+    std::string profile_trace_path;
+    bool is_mem_report = false;
+    size_t job_count   = 1;
+    std::string report_key;
+    bool is_batch       = false;
+    bool is_batch_types = false;
+    std::string batch_out_dir;
+    bool is_progress         = false;
+    bool is_read_memmap      = false;
+    uint64_t read_addr_begin = 0;
+    uint64_t read_addr_end   = 0;
+    std::string section_cache_dir;
+    util_dwarf::dwarf_cu_filter cu_filter;
     if (argc > 1) {
         int arg_idx = 1;
         // 末尾以外をチェック
@@ -198,22 +359,183 @@ int main(int argc, char *argv[]) {
             if (arg.find("--prior-typedef") == 0) {
                 is_prior_typedef = true;
             }
+            if (arg == "--c-declarator") {
+                is_c_declarator = true;
+            }
+            if (arg.find("--export-memmap=") == 0) {
+                export_memmap_path = arg.substr(std::string_view("--export-memmap=").size());
+            }
+            if (arg.find("--diff=") == 0) {
+                diff_base_path = arg.substr(std::string_view("--diff=").size());
+            }
+            if (arg == "--profile") {
+                is_profile = true;
+            }
+            if (arg == "--mem-report") {
+                is_mem_report = true;
+            }
+            if (arg.find("--jobs=") == 0) {
+                job_count = std::strtoul(argv[arg_idx] + std::string_view("--jobs=").size(), nullptr, 10);
+            }
+            if (arg == "--batch") {
+                is_batch = true;
+            }
+            if (arg.find("--batch-out=") == 0) {
+                is_batch      = true;
+                batch_out_dir = arg.substr(std::string_view("--batch-out=").size());
+            }
+            if (arg == "--batch-types") {
+                is_batch       = true;
+                is_batch_types = true;
+            }
+            if (arg == "--progress") {
+                is_progress = true;
+            }
+            if (arg == "--read-memmap") {
+                is_read_memmap = true;
+            }
+            if (arg.find("--addr-range=") == 0) {
+                // <begin>:<end>
+                char *end;
+                read_addr_begin = std::strtoull(argv[arg_idx] + std::string_view("--addr-range=").size(), &end, 0);
+                read_addr_end   = (*end == ':') ? std::strtoull(end + 1, nullptr, 0) : 0;
+            }
+            if (arg.find("--section-cache=") == 0) {
+                section_cache_dir = arg.substr(std::string_view("--section-cache=").size());
+            }
+            if (arg.find("--cu-include=") == 0) {
+                cu_filter.path_include.emplace_back(arg.substr(std::string_view("--cu-include=").size()));
+            }
+            if (arg.find("--cu-exclude=") == 0) {
+                cu_filter.path_exclude.emplace_back(arg.substr(std::string_view("--cu-exclude=").size()));
+            }
+            if (arg.find("--cu-producer=") == 0) {
+                cu_filter.producer_include.emplace_back(arg.substr(std::string_view("--cu-producer=").size()));
+            }
+            if (arg.find("--cu-exclude-producer=") == 0) {
+                cu_filter.producer_exclude.emplace_back(arg.substr(std::string_view("--cu-exclude-producer=").size()));
+            }
+            if (arg.find("--cu-lang=") == 0 || arg.find("--cu-exclude-lang=") == 0) {
+                bool is_exclude = (arg.find("--cu-exclude-lang=") == 0);
+                auto lang_name  = arg.substr(arg.find('=') + 1);
+                Dwarf_Unsigned lang;
+                if (!util_dwarf::dwarf_cu_filter::parse_language(lang_name, lang)) {
+                    fprintf(stderr, "unknown language : %.*s\n", static_cast<int>(lang_name.size()), lang_name.data());
+                    return -1;
+                }
+                (is_exclude ? cu_filter.language_exclude : cu_filter.language_include).push_back(lang);
+            }
+            if (arg.find("--report=") == 0) {
+                report_key = arg.substr(std::string_view("--report=").size());
+            }
+            if (arg.find("--profile-trace=") == 0) {
+                is_profile         = true;
+                profile_trace_path = arg.substr(std::string_view("--profile-trace=").size());
+            }
             arg_idx++;
         }
         // 末尾はファイル名
         file_path     = argv[argc - 1];
         is_cmdline_ok = true;
     }
+    auto cu_filter_ptr = cu_filter.empty() ? nullptr : &cu_filter;
     if (!is_cmdline_ok) {
         printf("Usage: %s [options] <dwarf file>\n", argv[0]);
         printf("\n");
         printf("options:\n");
         printf("  --prior-typedef : prior typedef name\n");
+        printf("  --c-declarator : print variable types as C declarators (const char *volatile, int (*)(void), uint8_t [4])\n");
+        printf("  --export-memmap=<file> : export memmap as columnar binary file\n");
+        printf("  --read-memmap : <dwarf file> is a file written by --export-memmap. print its rows\n");
+        printf("  --addr-range=<begin>:<end> : --read-memmap prints only rows in [begin, end)\n");
+        printf("  --diff=<old dwarf file> : compare memmap layout of <old dwarf file> and <dwarf file>\n");
+        printf("  --profile : print phase timing and counters to stderr\n");
+        printf("  --profile-trace=<file> : --profile and write Chrome trace event JSON\n");
+        printf("  --mem-report : print memory usage of each table after each phase to stderr\n");
+        printf("  --jobs=<n> : decompress debug sections and build type info with n threads (0: hardware threads)\n");
+        printf("  --section-cache=<dir> : cache decompressed debug sections in <dir>\n");
+        printf("  --progress : analyze on a worker thread and print progress to stderr\n");
+        printf("  --cu-include=<glob> : analyze only compile units whose DW_AT_name or DW_AT_comp_dir matches <glob> (repeatable)\n");
+        printf("  --cu-exclude=<glob> : skip compile units whose DW_AT_name or DW_AT_comp_dir matches <glob> (repeatable)\n");
+        printf("  --cu-lang=<lang> / --cu-exclude-lang=<lang> : filter compile units by DW_AT_language (e.g. C99, C_plus_plus_14)\n");
+        printf("  --cu-producer=<glob> / --cu-exclude-producer=<glob> : filter compile units by DW_AT_producer\n");
+        printf("  --report=<file|cu> : print total bytes of variables per decl file or compile unit\n");
+        printf("  --batch : <dwarf file> is a list of ELF paths (one per line). analyze them concurrently with --jobs threads\n");
+        printf("  --batch-out=<dir> : --batch and write memmap of each ELF to <dir>/<ELF file name>.memmap.txt\n");
+        printf("                      ELF file names listed more than once are prefixed with their index in the list: <index>_<ELF file name>\n");
+        printf("  --batch-types : --batch and count struct/union layouts shared between ELFs (uses extra memory)\n");
         return -1;
     }
 
+    // カラムナ形式memmapの参照モード
+    if (is_read_memmap) {
+        return run_read_memmap(file_path, read_addr_begin, read_addr_end);
+    }
+
+    // 2つのELFのmemmap比較モード
+    if (!diff_base_path.empty()) {
+        using da_opt = util_dwarf::dwarf_analyze_option;
+        da_opt daopt;
+        daopt.unset(da_opt::no_impl_warning | da_opt::func_info_analyze);
+        daopt.set(da_opt::symbol_location);
+        daopt.cu_filter = cu_filter_ptr;
+        // memmapの行(アドレス, 型, サイズ, 名前)だけを出力する
+        daopt.output_fields = util_dwarf::dwarf_attr_filter::none;
+        using diopt = util_dwarf::debug_info::option;
+        diopt opt;
+        if (is_prior_typedef) {
+            opt.set(diopt::prior_typedef);
+        }
+        if (is_c_declarator) {
+            opt.set(diopt::c_declarator);
+        }
+
+        util_dwarf::memmap_diff diff;
+        if (!diff.run(diff_base_path.c_str(), file_path, daopt, opt)) {
+            return -1;
+        }
+        diff.print(stdout);
+        return 0;
+    }
+
+    // 複数ELFの一括解析モード
+    if (is_batch) {
+        return run_batch(file_path, batch_out_dir, job_count, is_batch_types, is_prior_typedef, is_c_declarator, cu_filter_ptr);
+    }
+
+    // プロファイル
+    std::unique_ptr<util_dwarf::dwarf_profiler> profiler;
+    if (is_profile) {
+        profiler = std::make_unique<util_dwarf::dwarf_profiler>();
+    }
+
+    // メモリ使用量
+    std::unique_ptr<util_dwarf::memory_accounting> mem_report;
+    if (is_mem_report) {
+        mem_report = std::make_unique<util_dwarf::memory_accounting>();
+    }
+
+    // 圧縮セクションの展開と型情報の並列構築
+    std::unique_ptr<util_dwarf::work_stealing_pool> pool;
+    if (job_count != 1) {
+        pool = std::make_unique<util_dwarf::work_stealing_pool>(job_count);
+    }
+
     util_dwarf::dwarf_analyzer di;
+    if (pool || !section_cache_dir.empty()) {
+        util_dwarf::section_loader_option loader_opt;
+        loader_opt.pool      = pool.get();
+        loader_opt.cache_dir = section_cache_dir;
+        di.section_loader(loader_opt);
+    }
     auto result = di.open(file_path);
+    if (result && profiler && di.section_loader().is_open()) {
+        auto const &st = di.section_loader().get_stats();
+        fprintf(stderr, "section_loader : %zu sections, %zu tasks, %zu cache hits, %llu -> %llu bytes\n", st.section_count, st.task_count,
+                st.cache_hit_count, static_cast<unsigned long long>(st.compressed_bytes), static_cast<unsigned long long>(st.decompressed_bytes));
+    }
+    // 出力ファイルの書き込みに失敗したときは異常終了する
+    bool is_output_ok = true;
     if (result) {
         util_dwarf::dwarf_info dw_info;
 
@@ -224,10 +546,37 @@ int main(int argc, char *argv[]) {
         da_opt daopt;
         // daopt.unset(da_opt::func_info_analyze | da_opt::no_impl_warning);
         daopt.unset(da_opt::no_impl_warning);
-        daopt.set(da_opt::func_info_analyze);
-        di.analyze(dw_info, daopt);
+        daopt.set(da_opt::func_info_analyze | da_opt::symbol_location);
+        daopt.profiler  = profiler.get();
+        daopt.cu_filter = cu_filter_ptr;
+        // memmap出力とdecl file別の集計に宣言位置を使う
+        daopt.output_fields = util_dwarf::dwarf_attr_filter::decl_file;
+        if (is_progress) {
+            util_dwarf::dwarf_async_analyzer async_di(di, dw_info);
+            async_di.start(daopt);
+            while (async_di.is_running()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                auto progress = async_di.progress();
+                double percent = 0.0;
+                if (progress.total_bytes != 0) {
+                    percent = 100.0 * static_cast<double>(progress.done_bytes) / static_cast<double>(progress.total_bytes);
+                }
+                fprintf(stderr, "\ranalyze : %zu units, %llu / %llu bytes (%.1f%%)", progress.cu_count,
+                        static_cast<unsigned long long>(progress.done_bytes), static_cast<unsigned long long>(progress.total_bytes), percent);
+            }
+            fprintf(stderr, "\n");
+            async_di.wait();
+        } else {
+            di.analyze(dw_info, daopt);
+        }
+        if (cu_filter_ptr != nullptr) {
+            fprintf(stderr, "cu_filter : %zu compile units skipped\n", di.skipped_cu_count());
+        }
         t = clock();
         printf("%f\n", static_cast<double>(t - s) / CLOCKS_PER_SEC);
+        if (mem_report) {
+            mem_report->take("analyze", dw_info, nullptr);
+        }
 
         // 全optionは初期値でfalse
         using diopt = util_dwarf::debug_info::option;
@@ -235,12 +584,26 @@ int main(int argc, char *argv[]) {
         if (is_prior_typedef) {
             opt.set(diopt::prior_typedef);
         }
+        if (is_c_declarator) {
+            opt.set(diopt::c_declarator);
+        }
+        opt.profiler = profiler.get();
+        // 型情報の並列構築
+        opt.pool = pool.get();
         // opt.set(diopt::expand_array);
         // opt.set(diopt::through_typedef | diopt::expand_array);
         // opt.unset(diopt::through_typedef);
         // opt.unset(diopt::expand_array);
         auto debug_info = util_dwarf::debug_info(dw_info, opt);
-        debug_info.build();
+        if (mem_report) {
+            // フェーズ毎に計測するためbuild()を分割して実行する
+            debug_info.build_var_info();
+            mem_report->take("build_var", dw_info, &debug_info);
+            debug_info.build_type_info();
+            mem_report->take("build_type", dw_info, &debug_info);
+        } else {
+            debug_info.build();
+        }
         //
         // debug_info.memmap([](util_dwarf::debug_info::var_info &var, util_dwarf::debug_info::type_info &type) -> void {
         //     std::string prefix("");
@@ -263,9 +626,22 @@ int main(int argc, char *argv[]) {
             });
         }
         if constexpr (true) {
-            int typelen = static_cast<int>(debug_info.max_typename_len);
+            util_dwarf::dwarf_profiler::scope prof_scope(profiler.get(), util_dwarf::dwarf_profiler::output);
+            int typelen    = static_cast<int>(debug_info.max_typename_len);
+            bool is_export = !export_memmap_path.empty();
+            bool is_report = !report_key.empty();
+            util_dwarf::memmap_export exporter;
+            util_dwarf::memmap_table table;
 
-            debug_info.get_var_info([typelen](util_dwarf::debug_info::var_info_view &view) -> bool {
+            debug_info.get_var_info([typelen, is_export, is_report, &exporter, &table](util_dwarf::debug_info::var_info_view &view) -> bool {
+                // binary出力用に収集
+                if (is_export) {
+                    exporter.add(view);
+                }
+                // 集計用に収集
+                if (is_report) {
+                    table.add(view);
+                }
                 // 相対パスを作成
                 std::string decl_file_path_rel;
                 if (view.var_decl_file_path != nullptr && view.cu_info != nullptr) {
@@ -304,10 +680,29 @@ int main(int argc, char *argv[]) {
                 printf("]\n");
                 return true;
             });
+
+            if (is_export && !exporter.write(export_memmap_path.c_str())) {
+                fprintf(stderr, "cannot export memmap : %s\n", export_memmap_path.c_str());
+                is_output_ok = false;
+            }
+            if (is_report) {
+                print_report(table, report_key);
+            }
+        }
+        if (mem_report) {
+            mem_report->take("output", dw_info, &debug_info);
+            mem_report->print(stderr);
         }
 
         di.close();
     }
 
-    return 0;
+    if (profiler) {
+        profiler->print_summary(stderr);
+        if (!profile_trace_path.empty()) {
+            profiler->write_trace(profile_trace_path.c_str());
+        }
+    }
+
+    return is_output_ok ? 0 : -1;
 }
@@ -0,0 +1,239 @@
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "test/test_util.hpp"
+#include "util_dwarf/dwarf_cfi.hpp"
+
+// CFA命令列からのCFIテーブル構築のテスト
+//
+// Usage: test_dwarf_cfi
+//
+// libdwarfのFDEを経由せずに、CIE/FDEの命令列を直接 dwarf_cfi::build_table() に渡す
+
+namespace {
+
+using namespace util_dwarf;
+
+// x86-64 psABI のレジスタ番号
+constexpr uint16_t reg_rbx = 3;
+constexpr uint16_t reg_rbp = 6;
+constexpr uint16_t reg_rsp = 7;
+constexpr uint16_t reg_ra  = 16;
+
+constexpr Dwarf_Addr low_pc  = 0x1000;
+constexpr Dwarf_Addr high_pc = 0x1040;
+
+// GCCがx86-64で出力するCIE: CFA=rsp+8, 戻りアドレスはCFA-8
+std::vector<Dwarf_Small> cie_instr = {
+    DW_CFA_def_cfa, reg_rsp, 0x08,  // CFA = rsp+8
+    DW_CFA_offset | reg_ra, 0x01,   // ra = [CFA-8]
+};
+
+dwarf_cfi::cie_param make_cie() {
+    dwarf_cfi::cie_param param;
+    param.code_align     = 1;
+    param.data_align     = -8;
+    param.ra_reg         = reg_ra;
+    param.init_instr     = cie_instr.data();
+    param.init_instr_len = cie_instr.size();
+    return param;
+}
+
+std::unique_ptr<cfi_row_table> build(dwarf_cfi &cfi, dwarf_cfi::cie_param const &param, std::vector<Dwarf_Small> const &fde_instr) {
+    return cfi.build_table(param, low_pc, high_pc, fde_instr.data(), fde_instr.size());
+}
+
+cfi_rule const *find_rule(cfi_row_table const &table, cfi_row_table::row const &row, uint16_t reg_no) {
+    for (auto &rule : table.rules(row)) {
+        if (rule.reg_no == reg_no) {
+            return &rule;
+        }
+    }
+    return nullptr;
+}
+
+bool is_cfa(cfi_row_table::row const *row, uint16_t reg_no, int64_t offset) {
+    return row != nullptr && row->cfa_expr == nullptr && row->cfa_reg == reg_no && row->cfa_offset == offset;
+}
+
+bool is_saved(cfi_row_table const &table, cfi_row_table::row const *row, uint16_t reg_no, int64_t offset) {
+    if (row == nullptr) {
+        return false;
+    }
+    auto rule = find_rule(table, *row, reg_no);
+    return rule != nullptr && rule->type == cfi_rule::saved_offset && rule->offset == offset;
+}
+
+// push rbp; mov rbp,rsp; ... ; leave の典型的な関数
+void test_prologue() {
+    dwarf_cfi cfi;
+    std::vector<Dwarf_Small> fde_instr = {
+        DW_CFA_advance_loc | 1,            // 0x1001
+        DW_CFA_def_cfa_offset, 0x10,       // CFA = rsp+16
+        DW_CFA_offset | reg_rbp, 0x02,     // rbp = [CFA-16]
+        DW_CFA_advance_loc | 3,            // 0x1004
+        DW_CFA_def_cfa_register, reg_rbp,  // CFA = rbp+16
+        DW_CFA_advance_loc1, 0x20,         // 0x1024
+        DW_CFA_remember_state,             // 0x1024の状態を保存
+        DW_CFA_def_cfa, reg_rsp, 0x08,     // CFA = rsp+8
+        DW_CFA_restore | reg_rbp,          // rbp: CIEの初期状態(ルールなし)に戻す
+        DW_CFA_advance_loc | 1,            // 0x1025
+        DW_CFA_restore_state,              // CFA = rbp+16, rbp = [CFA-16]
+    };
+    auto table = build(cfi, make_cie(), fde_instr);
+    TEST_CHECK(table->low_pc == low_pc && table->high_pc == high_pc && table->ra_reg == reg_ra);
+    TEST_CHECK(table->row_list.size() == 5);
+
+    // 範囲外
+    TEST_CHECK(table->find(low_pc - 1) == nullptr);
+    TEST_CHECK(table->find(high_pc) == nullptr);
+
+    auto row = table->find(0x1000);
+    TEST_CHECK(is_cfa(row, reg_rsp, 8));
+    TEST_CHECK(is_saved(*table, row, reg_ra, -8));
+    TEST_CHECK(row != nullptr && find_rule(*table, *row, reg_rbp) == nullptr);
+
+    row = table->find(0x1003);
+    TEST_CHECK(row != nullptr && row->loc == 0x1001);
+    TEST_CHECK(is_cfa(row, reg_rsp, 16));
+    TEST_CHECK(is_saved(*table, row, reg_rbp, -16));
+    TEST_CHECK(is_saved(*table, row, reg_ra, -8));
+
+    // CFAだけ変わった行はルール配列を共有する
+    auto next = table->find(0x1004);
+    TEST_CHECK(is_cfa(next, reg_rbp, 16));
+    TEST_CHECK(row != nullptr && next != nullptr && row->rule_begin == next->rule_begin && row->rule_count == next->rule_count);
+
+    row = table->find(0x1024);
+    TEST_CHECK(is_cfa(row, reg_rsp, 8));
+    TEST_CHECK(row != nullptr && find_rule(*table, *row, reg_rbp) == nullptr);
+    TEST_CHECK(is_saved(*table, row, reg_ra, -8));
+
+    row = table->find(high_pc - 1);
+    TEST_CHECK(row != nullptr && row->loc == 0x1025);
+    TEST_CHECK(is_cfa(row, reg_rbp, 16));
+    TEST_CHECK(is_saved(*table, row, reg_rbp, -16));
+}
+
+// code_align/data_alignによる係数倍と、符号付きオペランドの命令
+void test_factored() {
+    dwarf_cfi cfi;
+    auto param       = make_cie();
+    param.code_align = 4;
+
+    std::vector<Dwarf_Small> fde_instr = {
+        DW_CFA_advance_loc | 2,                    // 0x1008
+        DW_CFA_def_cfa_sf, reg_rsp, 0x7E,          // CFA = rsp + (-2 * -8)
+        DW_CFA_offset_extended_sf, reg_rbx, 0x03,  // rbx = [CFA + 3 * -8]
+        DW_CFA_val_offset, reg_rbp, 0x04,          // rbp = CFA + 4 * -8
+        DW_CFA_register, reg_rsp, reg_rbx,         // rsp = rbx
+        DW_CFA_advance_loc | 1,                    // 0x100C
+        DW_CFA_undefined, reg_ra,
+        DW_CFA_same_value, reg_rbx,
+    };
+    auto table = build(cfi, param, fde_instr);
+    TEST_CHECK(table->row_list.size() == 3);
+
+    auto row = table->find(0x1007);
+    TEST_CHECK(row != nullptr && row->loc == low_pc);
+
+    row = table->find(0x1008);
+    TEST_CHECK(is_cfa(row, reg_rsp, 16));
+    TEST_CHECK(is_saved(*table, row, reg_rbx, -24));
+    auto rule = (row != nullptr) ? find_rule(*table, *row, reg_rbp) : nullptr;
+    TEST_CHECK(rule != nullptr && rule->type == cfi_rule::val_offset && rule->offset == -32);
+    rule = (row != nullptr) ? find_rule(*table, *row, reg_rsp) : nullptr;
+    TEST_CHECK(rule != nullptr && rule->type == cfi_rule::reg && rule->src_reg == reg_rbx);
+
+    row  = table->find(0x100C);
+    rule = (row != nullptr) ? find_rule(*table, *row, reg_ra) : nullptr;
+    TEST_CHECK(rule != nullptr && rule->type == cfi_rule::undefined);
+    rule = (row != nullptr) ? find_rule(*table, *row, reg_rbx) : nullptr;
+    TEST_CHECK(rule != nullptr && rule->type == cfi_rule::same_value);
+}
+
+// DW_CFA_*expression の式はコンパイルしてキャッシュする
+void test_expression() {
+    dwarf_cfi cfi;
+    std::vector<Dwarf_Small> fde_instr = {
+        DW_CFA_def_cfa_expression, 0x02, DW_OP_breg7, 0x10,       // CFA = rsp+16
+        DW_CFA_expression, reg_rbx, 0x02, DW_OP_breg6, 0x78,      // rbx = [rbp-8]
+        DW_CFA_val_expression, reg_rbp, 0x02, DW_OP_breg7, 0x10,  // rbp = rsp+16
+    };
+    auto table = build(cfi, make_cie(), fde_instr);
+    auto row   = table->find(low_pc);
+    TEST_CHECK(row != nullptr && row->cfa_expr != nullptr);
+    if (row == nullptr || row->cfa_expr == nullptr) {
+        return;
+    }
+    TEST_CHECK(row->cfa_expr->form == dw_expr_program::reg_offset && row->cfa_expr->fast_reg == reg_rsp && row->cfa_expr->fast_value == 16);
+    auto rule = find_rule(*table, *row, reg_rbx);
+    TEST_CHECK(rule != nullptr && rule->type == cfi_rule::expression && rule->expr != nullptr);
+    rule = find_rule(*table, *row, reg_rbp);
+    TEST_CHECK(rule != nullptr && rule->type == cfi_rule::val_expression && rule->expr != nullptr);
+    // 同じバイト列の式はキャッシュを共有する
+    TEST_CHECK(rule != nullptr && rule->expr == row->cfa_expr);
+    TEST_CHECK(cfi.expr_count() == 2);
+}
+
+// .eh_frame: DW_CFA_set_loc のアドレスはaugmentation 'R' のエンコードに従う
+void test_eh_set_loc() {
+    dwarf_cfi cfi;
+    auto param         = make_cie();
+    param.is_eh        = true;
+    param.fde_encoding = DW_EH_PE_pcrel | DW_EH_PE_sdata4;
+    // instr先頭 0x2000、オペランド位置 0x2001 からの相対値で 0x1010
+    constexpr Dwarf_Addr instr_addr = 0x2000;
+    auto rel                        = static_cast<uint32_t>(0x1010 - (instr_addr + 1));
+
+    std::vector<Dwarf_Small> fde_instr = {
+        DW_CFA_set_loc,
+        static_cast<Dwarf_Small>(rel),
+        static_cast<Dwarf_Small>(rel >> 8),
+        static_cast<Dwarf_Small>(rel >> 16),
+        static_cast<Dwarf_Small>(rel >> 24),
+        DW_CFA_def_cfa_offset, 0x20,
+    };
+    auto table = cfi.build_table(param, low_pc, high_pc, fde_instr.data(), fde_instr.size(), instr_addr);
+    TEST_CHECK(is_cfa(table->find(0x100F), reg_rsp, 8));
+    TEST_CHECK(is_cfa(table->find(0x1010), reg_rsp, 32));
+
+    // 基点が分からないときはそこで打ち切る
+    auto unknown = cfi.build_table(param, low_pc, high_pc, fde_instr.data(), fde_instr.size());
+    TEST_CHECK(unknown->row_list.size() == 1);
+    TEST_CHECK(is_cfa(unknown->find(high_pc - 1), reg_rsp, 8));
+}
+
+// 途切れた命令列はそこまでの結果でテーブルを作る
+void test_truncated() {
+    dwarf_cfi cfi;
+    std::vector<Dwarf_Small> fde_instr = {
+        DW_CFA_advance_loc | 4,
+        DW_CFA_def_cfa_offset, 0x10,
+        DW_CFA_advance_loc | 4,
+        DW_CFA_def_cfa_offset, 0x80,  // LEB128が途切れている
+    };
+    auto table = build(cfi, make_cie(), fde_instr);
+    TEST_CHECK(is_cfa(table->find(low_pc), reg_rsp, 8));
+    TEST_CHECK(is_cfa(table->find(0x1004), reg_rsp, 16));
+    TEST_CHECK(table->find(0x1008) != nullptr);
+
+    // high_pc以降の行は作らない
+    std::vector<Dwarf_Small> overrun = {DW_CFA_advance_loc1, 0x80, DW_CFA_def_cfa_offset, 0x10};
+    table = build(cfi, make_cie(), overrun);
+    TEST_CHECK(table->row_list.size() == 1);
+    TEST_CHECK(is_cfa(table->find(high_pc - 1), reg_rsp, 8));
+}
+
+}  // namespace
+
+int main() {
+    test_prologue();
+    test_factored();
+    test_expression();
+    test_eh_set_loc();
+    test_truncated();
+    return test_util::result("test_dwarf_cfi");
+}
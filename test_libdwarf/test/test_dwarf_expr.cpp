@@ -0,0 +1,200 @@
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "test/test_util.hpp"
+#include "util_dwarf/dwarf_expr_ir.hpp"
+
+// DWARF expression コンパイラ/評価器のテスト
+//
+// Usage: test_dwarf_expr
+
+namespace {
+
+using namespace util_dwarf;
+
+constexpr uint64_t int64_min = static_cast<uint64_t>(std::numeric_limits<int64_t>::min());
+
+std::unique_ptr<dw_expr_program> compile(std::vector<uint8_t> const &expr, size_t pointer_size = 8) {
+    return dw_expr_compiler::compile(expr.data(), expr.size(), pointer_size, 4);
+}
+
+// 式を評価してstack topの値を返す。評価できないときはnullopt
+std::optional<uint64_t> eval_value(std::vector<uint8_t> const &expr, size_t pointer_size, dw_expr_context const &ctx) {
+    auto prog = compile(expr, pointer_size);
+    dw_expr_evaluator evaluator;
+    evaluator.pointer_size(pointer_size);
+    auto result = evaluator.eval(*prog, ctx);
+    if (!result || !(result->is_address() || result->loc == dw_expr_result::stack_value)) {
+        return std::nullopt;
+    }
+    return result->value;
+}
+std::optional<uint64_t> eval_value(std::vector<uint8_t> const &expr, size_t pointer_size = 8) {
+    static dw_expr_context const empty_ctx;
+    return eval_value(expr, pointer_size, empty_ctx);
+}
+
+std::vector<uint8_t> const8u(uint64_t value) {
+    std::vector<uint8_t> expr = {DW_OP_const8u};
+    for (int i = 0; i < 8; i++) {
+        expr.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+    return expr;
+}
+
+std::vector<uint8_t> concat(std::vector<uint8_t> expr, std::initializer_list<uint8_t> tail) {
+    expr.insert(expr.end(), tail);
+    return expr;
+}
+
+// 頻出パターンは命令列を実行せずに評価する
+void test_shape() {
+    auto lit = compile({DW_OP_lit5});
+    TEST_CHECK(lit->is_valid() && lit->form == dw_expr_program::constant && lit->is_static());
+
+    auto member = compile({DW_OP_plus_uconst, 0x10});
+    TEST_CHECK(member->form == dw_expr_program::plus_uconst);
+    dw_expr_evaluator evaluator;
+    auto result = evaluator.eval(*member, {0x1000});
+    TEST_CHECK(result && result->is_address() && result->value == 0x1010);
+
+    // DW_OP_fbreg -16
+    auto fbreg = compile({DW_OP_fbreg, 0x70});
+    TEST_CHECK(fbreg->form == dw_expr_program::frame_offset && (fbreg->needs & dw_expr_program::req_frame_base) != 0);
+    dw_expr_context ctx;
+    TEST_CHECK(!evaluator.eval(*fbreg, ctx));
+    ctx.frame_base = 0x2000;
+    result         = evaluator.eval(*fbreg, ctx);
+    TEST_CHECK(result && result->is_address() && result->value == 0x1FF0);
+
+    // DW_OP_breg6 8
+    auto breg = compile({DW_OP_breg6, 0x08});
+    TEST_CHECK(breg->form == dw_expr_program::reg_offset && breg->fast_reg == 6);
+    ctx.read_reg = [](uint64_t reg_no) -> std::optional<uint64_t> {
+        if (reg_no == 6) {
+            return 0x3000;
+        }
+        return std::nullopt;
+    };
+    result = evaluator.eval(*breg, ctx);
+    TEST_CHECK(result && result->is_address() && result->value == 0x3008);
+
+    auto reg = compile({DW_OP_reg3});
+    TEST_CHECK(reg->form == dw_expr_program::reg);
+    result = evaluator.eval(*reg, ctx);
+    TEST_CHECK(result && result->loc == dw_expr_result::reg && result->value == 3);
+}
+
+void test_arithmetic() {
+    TEST_CHECK(eval_value({DW_OP_lit3, DW_OP_lit4, DW_OP_plus, DW_OP_stack_value}) == 7);
+    TEST_CHECK(eval_value({DW_OP_lit3, DW_OP_lit4, DW_OP_minus, DW_OP_stack_value}) == ~0ull);
+    TEST_CHECK(eval_value({DW_OP_lit6, DW_OP_lit7, DW_OP_mul, DW_OP_stack_value}) == 42);
+    TEST_CHECK(eval_value({DW_OP_lit1, DW_OP_lit4, DW_OP_shl, DW_OP_stack_value}) == 16);
+    // DW_OP_div は符号付き: -7 / 2 = -3
+    TEST_CHECK(eval_value({DW_OP_const1s, 0xF9, DW_OP_lit2, DW_OP_div, DW_OP_stack_value}) == static_cast<uint64_t>(-3));
+    // DW_OP_shra は算術シフト
+    TEST_CHECK(eval_value({DW_OP_const1s, 0xF0, DW_OP_lit2, DW_OP_shra, DW_OP_stack_value}) == static_cast<uint64_t>(-4));
+    // 比較は符号付き
+    TEST_CHECK(eval_value({DW_OP_const1s, 0xFF, DW_OP_lit0, DW_OP_lt, DW_OP_stack_value}) == 1);
+    // 0除算は評価失敗
+    TEST_CHECK(!eval_value({DW_OP_lit1, DW_OP_lit0, DW_OP_div, DW_OP_stack_value}));
+    TEST_CHECK(!eval_value({DW_OP_lit1, DW_OP_lit0, DW_OP_mod, DW_OP_stack_value}));
+    // スタック不足は評価失敗
+    TEST_CHECK(!eval_value({DW_OP_lit1, DW_OP_plus}));
+}
+
+// INT64_MINの符号反転/除算はオーバーフローせずに折り返す
+void test_int64_min() {
+    auto min = const8u(int64_min);
+    TEST_CHECK(eval_value(concat(min, {DW_OP_neg, DW_OP_stack_value})) == int64_min);
+    TEST_CHECK(eval_value(concat(min, {DW_OP_abs, DW_OP_stack_value})) == int64_min);
+    TEST_CHECK(eval_value(concat(min, {DW_OP_const1s, 0xFF, DW_OP_div, DW_OP_stack_value})) == int64_min);
+    TEST_CHECK(eval_value(concat(min, {DW_OP_lit2, DW_OP_div, DW_OP_stack_value})) == static_cast<uint64_t>(-(int64_t{1} << 62)));
+    TEST_CHECK(eval_value({DW_OP_const1s, 0xF9, DW_OP_abs, DW_OP_stack_value}) == 7);
+    TEST_CHECK(eval_value({DW_OP_lit7, DW_OP_neg, DW_OP_stack_value}) == static_cast<uint64_t>(-7));
+    TEST_CHECK(eval_value({DW_OP_lit7, DW_OP_const1s, 0xFF, DW_OP_div, DW_OP_stack_value}) == static_cast<uint64_t>(-7));
+}
+
+// 値はアドレスサイズで扱う
+void test_pointer_size() {
+    TEST_CHECK(eval_value({DW_OP_lit0, DW_OP_lit1, DW_OP_minus, DW_OP_stack_value}, 4) == 0xFFFFFFFF);
+    // 32bitのINT_MIN
+    TEST_CHECK(eval_value({DW_OP_const4u, 0x00, 0x00, 0x00, 0x80, DW_OP_neg, DW_OP_stack_value}, 4) == 0x80000000);
+    TEST_CHECK(eval_value({DW_OP_const4u, 0x00, 0x00, 0x00, 0x80, DW_OP_const1s, 0xFF, DW_OP_div, DW_OP_stack_value}, 4) == 0x80000000);
+    TEST_CHECK(eval_value({DW_OP_const1s, 0xFC, DW_OP_lit1, DW_OP_shra, DW_OP_stack_value}, 4) == 0xFFFFFFFE);
+}
+
+// DW_OP_bra/skip の分岐先はbyte offsetから命令indexに変換する
+void test_branch() {
+    // cond ? 9 : 7
+    for (uint8_t cond : {uint8_t{DW_OP_lit0}, uint8_t{DW_OP_lit1}}) {
+        std::vector<uint8_t> expr = {cond, DW_OP_bra, 0x04, 0x00, DW_OP_lit7, DW_OP_skip, 0x01, 0x00, DW_OP_lit9, DW_OP_stack_value};
+        TEST_CHECK(eval_value(expr) == ((cond == DW_OP_lit0) ? 7u : 9u));
+    }
+    // 命令の途中への分岐はコンパイルエラー
+    auto prog = compile({DW_OP_skip, 0x01, 0x00, DW_OP_const2u, 0x00, 0x00});
+    TEST_CHECK(!prog->is_valid() && prog->err == dw_expr_program::err_branch);
+    // 無限ループは評価失敗
+    TEST_CHECK(!eval_value({DW_OP_skip, 0xFD, 0xFF}));
+}
+
+void test_memory() {
+    dw_expr_context ctx;
+    ctx.read_mem = [](uint64_t addr, size_t size) -> std::optional<uint64_t> {
+        if (addr == 0x1000 && size == 8) {
+            return 0x123456789ABCDEF0;
+        }
+        if (addr == 0x1000 && size == 2) {
+            return 0xDEF0;
+        }
+        return std::nullopt;
+    };
+    auto addr = std::vector<uint8_t>{DW_OP_const2u, 0x00, 0x10};
+    TEST_CHECK(eval_value(concat(addr, {DW_OP_deref, DW_OP_stack_value}), 8, ctx) == 0x123456789ABCDEF0);
+    TEST_CHECK(eval_value(concat(addr, {DW_OP_deref_size, 2, DW_OP_stack_value}), 8, ctx) == 0xDEF0);
+    TEST_CHECK(!eval_value(concat(addr, {DW_OP_lit1, DW_OP_plus, DW_OP_deref}), 8, ctx));
+    TEST_CHECK(!eval_value(concat(addr, {DW_OP_deref})));
+}
+
+void test_piece() {
+    auto prog = compile({DW_OP_reg0, DW_OP_piece, 0x04, DW_OP_lit5, DW_OP_stack_value, DW_OP_piece, 0x04});
+    dw_expr_evaluator evaluator;
+    auto result = evaluator.eval(*prog);
+    TEST_CHECK(result && !result->is_address() && result->pieces.size() == 2);
+    if (result && result->pieces.size() == 2) {
+        auto &lo = result->pieces[0];
+        auto &hi = result->pieces[1];
+        TEST_CHECK(lo.loc == dw_expr_result::reg && lo.value == 0 && lo.size_bits == 32);
+        TEST_CHECK(hi.loc == dw_expr_result::stack_value && hi.value == 5 && hi.size_bits == 32);
+    }
+}
+
+// 途切れた式/未対応opeコードはコンパイルエラー
+void test_error() {
+    auto truncated = compile({DW_OP_const4u, 0x01, 0x02});
+    TEST_CHECK(!truncated->is_valid() && truncated->err == dw_expr_program::err_truncated);
+    auto leb = compile({DW_OP_constu, 0x80});
+    TEST_CHECK(!leb->is_valid() && leb->err == dw_expr_program::err_truncated);
+    auto unknown = compile({DW_OP_lit0, 0xDF});
+    TEST_CHECK(!unknown->is_valid() && unknown->err == dw_expr_program::err_no_impl && unknown->err_code == 0xDF);
+    dw_expr_evaluator evaluator;
+    TEST_CHECK(!evaluator.eval(*unknown));
+}
+
+}  // namespace
+
+int main() {
+    test_shape();
+    test_arithmetic();
+    test_int64_min();
+    test_pointer_size();
+    test_branch();
+    test_memory();
+    test_piece();
+    test_error();
+    return test_util::result("test_dwarf_expr");
+}
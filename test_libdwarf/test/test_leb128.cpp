@@ -0,0 +1,145 @@
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <limits>
+#include <vector>
+
+#include "test/test_util.hpp"
+#include "util_dwarf/LEB128.hpp"
+
+// LEB128デコードのテスト
+//
+// Usage: test_leb128
+//
+// デコードは長さで処理が分かれるので、同じバイト列を下記の2通りで確認する
+//   exact  : 値のbyte数ちょうどのバッファ(バッファ末尾付近の1byteずつの処理)
+//   padded : 後ろに0xFFを足して16byteにしたバッファ(8byteまとめて処理するワード単位の処理)
+
+namespace {
+
+using namespace util_dwarf;
+
+constexpr size_t padded_size = 16;
+
+std::vector<uint8_t> padded(std::vector<uint8_t> const &bytes) {
+    auto buff = bytes;
+    // 終端byteより後ろを読んでも値に混ざらないこと
+    while (buff.size() < padded_size) {
+        buff.push_back(0xFF);
+    }
+    return buff;
+}
+
+void check_unsigned(std::vector<uint8_t> const &bytes, uint64_t expect) {
+    for (auto const &buff : {bytes, padded(bytes)}) {
+        auto res = leb128::decode_unsigned(buff.data(), buff.size());
+        if (!TEST_CHECK(res.is_valid && res.value == expect && res.used_bytes == bytes.size())) {
+            fprintf(stderr, "  ULEB128 %llu : len=%zu value=%llu used=%zu\n", static_cast<unsigned long long>(expect), buff.size(),
+                    static_cast<unsigned long long>(res.value), res.used_bytes);
+        }
+    }
+}
+
+void check_signed(std::vector<uint8_t> const &bytes, int64_t expect) {
+    for (auto const &buff : {bytes, padded(bytes)}) {
+        auto res = leb128::decode_signed(buff.data(), buff.size());
+        if (!TEST_CHECK(res.is_valid && static_cast<int64_t>(res.value) == expect && res.used_bytes == bytes.size())) {
+            fprintf(stderr, "  SLEB128 %lld : len=%zu value=%lld used=%zu\n", static_cast<long long>(expect), buff.size(),
+                    static_cast<long long>(res.value), res.used_bytes);
+        }
+    }
+}
+
+// DWARF5 7.6 Figure 3, 4 の例
+void test_spec_examples() {
+    check_unsigned({0x02}, 2);
+    check_unsigned({0x7F}, 127);
+    check_unsigned({0x80, 0x01}, 128);
+    check_unsigned({0x81, 0x01}, 129);
+    check_unsigned({0x82, 0x01}, 130);
+    check_unsigned({0xB9, 0x64}, 12857);
+
+    check_signed({0x02}, 2);
+    check_signed({0x7E}, -2);
+    check_signed({0xFF, 0x00}, 127);
+    check_signed({0x81, 0x7F}, -127);
+    check_signed({0x80, 0x01}, 128);
+    check_signed({0x80, 0x7F}, -128);
+    check_signed({0x81, 0x01}, 129);
+    check_signed({0xFF, 0x7E}, -129);
+}
+
+// 7bit境界の前後と64bitの最大/最小をエンコードして戻す
+void test_round_trip() {
+    std::vector<uint64_t> ulist = {0, std::numeric_limits<uint64_t>::max()};
+    std::vector<int64_t> slist  = {0, -1, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max()};
+    for (unsigned int bit = 0; bit < 64; bit++) {
+        uint64_t value = 1ull << bit;
+        ulist.insert(ulist.end(), {value - 1, value, value + 1});
+        if (bit < 63) {
+            auto svalue = static_cast<int64_t>(value);
+            slist.insert(slist.end(), {svalue - 1, svalue, -svalue, -svalue - 1});
+        }
+    }
+    for (auto value : ulist) {
+        std::vector<uint8_t> bytes;
+        leb128::encode_unsigned(bytes, value);
+        TEST_CHECK(bytes.size() <= leb128::max_bytes);
+        check_unsigned(bytes, value);
+    }
+    for (auto value : slist) {
+        std::vector<uint8_t> bytes;
+        leb128::encode_signed(bytes, value);
+        TEST_CHECK(bytes.size() <= leb128::max_bytes);
+        check_signed(bytes, value);
+    }
+}
+
+// 冗長なエンコード(値に不要な0x80を続ける)
+void test_redundant() {
+    check_unsigned({0x80, 0x80, 0x80, 0x00}, 0);
+    check_unsigned({0xFF, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00}, 127);
+    check_signed({0xFF, 0xFF, 0xFF, 0x7F}, -1);
+}
+
+// 終端byteがないときはバッファ末尾(最大10byte)まで読んで無効にする
+void test_truncated() {
+    for (size_t len : {1, 2, 7, 8, 9}) {
+        std::vector<uint8_t> buff(len, 0x80);
+        auto res = leb128::decode_unsigned(buff.data(), buff.size());
+        TEST_CHECK(!res.is_valid);
+        TEST_CHECK(res.used_bytes == len);
+    }
+    std::vector<uint8_t> buff(padded_size, 0x80);
+    auto res = leb128::decode_unsigned(buff.data(), buff.size());
+    TEST_CHECK(!res.is_valid);
+    TEST_CHECK(res.used_bytes == leb128::max_bytes);
+
+    auto empty = leb128::decode_unsigned(buff.data(), 0);
+    TEST_CHECK(!empty.is_valid);
+    TEST_CHECK(empty.used_bytes == 0);
+}
+
+// LEB128<T>: 64bitでデコードしてTに変換する
+void test_wrapper() {
+    uint8_t buff[] = {0x7F, 0xE5, 0x8E, 0x26};
+    SLEB128 s(buff, 1);
+    TEST_CHECK(s.is_valid && s.value == -1 && s.used_bytes == 1);
+    LEB128<int32_t> s32(buff, 1);
+    TEST_CHECK(s32.is_valid && s32.value == -1);
+    ULEB128 u(buff + 1, 3);
+    TEST_CHECK(u.is_valid && u.value == 624485 && u.used_bytes == 3);
+    LEB128<uint16_t> u16(buff + 1, 2);
+    TEST_CHECK(!u16.is_valid && u16.used_bytes == 2);
+}
+
+}  // namespace
+
+int main() {
+    test_spec_examples();
+    test_round_trip();
+    test_redundant();
+    test_truncated();
+    test_wrapper();
+    return test_util::result("test_leb128");
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdio>
+
+// テスト用のチェックマクロ
+// 失敗しても中断せずに続け、最後にtest_util::result()で終了コードを返す
+namespace test_util {
+
+inline int &fail_count() {
+    static int count = 0;
+    return count;
+}
+
+inline bool check(bool cond, char const *expr, char const *file, int line) {
+    if (!cond) {
+        fprintf(stderr, "%s:%d: check failed : %s\n", file, line, expr);
+        fail_count()++;
+    }
+    return cond;
+}
+
+inline int result(char const *name) {
+    if (fail_count() != 0) {
+        printf("%s : %d check(s) failed\n", name, fail_count());
+        return 1;
+    }
+    printf("%s : ok\n", name);
+    return 0;
+}
+
+}  // namespace test_util
+
+#define TEST_CHECK(expr) test_util::check((expr), #expr, __FILE__, __LINE__)
@@ -1,62 +1,189 @@
 #pragma once
 
+#include <bit>
+#include <cstddef>
 #include <cstdint>
-#include <limits>
+#include <cstring>
 #include <type_traits>
 
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
 namespace util_dwarf {
 
-template <typename T>
-struct LEB128
+// LEB128デコード
+// 値は64bitで構築してからTに変換する
+//   1-2byte: 先頭2byteの判定だけで確定する高速パス
+//   3byte以上: 8byteをまとめて読み出して終端byteの検出と7bit詰めをワード単位で行う
+//   バッファ末尾付近: 1byteずつ処理
+namespace leb128 {
+
+struct result
 {
-    T value;
+    uint64_t value;
     size_t used_bytes;
+    bool is_valid;  // 終端byte(最上位bitが0)まで読めたときtrue
+};
 
-    LEB128(uint8_t *buff, size_t len) : value(0), used_bytes(0) {
-        decode(buff, len);
-    }
+// 64bit値に必要な最大byte数
+inline constexpr size_t max_bytes = 10;
 
-    void decode(uint8_t *buff, size_t len) {
-        size_t shift = 0;
-        value        = 0;
-        used_bytes   = 0;
+inline uint64_t load_le64(uint8_t const *buff) {
+    uint64_t word;
+    std::memcpy(&word, buff, sizeof(word));
+    if constexpr (std::endian::native == std::endian::big) {
+        word = __builtin_bswap64(word);
+    }
+    return word;
+}
 
-        for (size_t i = 0; i < len; i++) {
-            auto &data = buff[i];
+// 各byteの下位7bitを詰めて56bit値にする
+inline uint64_t pack_7bit(uint64_t word) {
+#if defined(__BMI2__)
+    return _pext_u64(word, 0x7F7F7F7F7F7F7F7Full);
+#else
+    word &= 0x7F7F7F7F7F7F7F7Full;
+    word = ((word & 0x7F007F007F007F00ull) >> 1) | (word & 0x007F007F007F007Full);
+    word = ((word & 0x3FFF00003FFF0000ull) >> 2) | (word & 0x00003FFF00003FFFull);
+    word = ((word & 0x0FFFFFFF00000000ull) >> 4) | (word & 0x000000000FFFFFFFull);
+    return word;
+#endif
+}
 
-            // 下位7bitを連結してデータを構築する
-            value |= (data & 0x7F) << shift;
-            used_bytes++;
+// 1byteずつデコードする
+// pos byte目から続きを処理する
+inline result decode_bytewise(uint8_t const *buff, size_t len, size_t pos, uint64_t value) {
+    size_t shift = pos * 7;
+    for (size_t i = pos; i < len; i++) {
+        uint8_t data = buff[i];
+        // 64bitを超える部分は捨てる
+        if (shift < 64) {
+            value |= static_cast<uint64_t>(data & 0x7F) << shift;
+        }
+        shift += 7;
+        // 最上位bitが0なら終了
+        if ((data & 0x80) == 0) {
+            return result{value, i + 1, true};
+        }
+    }
+    // 終端なし
+    return result{value, len, false};
+}
 
-            // 最上位bitが0なら終了
-            if ((data & 0x80) == 0) {
-                break;
-            }
+// 呼び出し箇所が多く展開しきれないので、inline指定しない(-Winline)
+result decode_unsigned(uint8_t const *buff, size_t len) {
+    // 1-2byte: DWARFで最頻出(form, attribute, 小さいoffset)
+    if (len >= 2) [[likely]] {
+        uint8_t b0 = buff[0];
+        if (b0 < 0x80) {
+            return result{b0, 1, true};
+        }
+        uint8_t b1 = buff[1];
+        if (b1 < 0x80) {
+            return result{static_cast<uint64_t>(b0 & 0x7F) | (static_cast<uint64_t>(b1) << 7), 2, true};
+        }
+    }
+    if (len >= 8) {
+        // ワード単位: 終端byteの検出と7bit詰めを分岐なしで行う
+        uint64_t word = load_le64(buff);
+        uint64_t term = ~word & 0x8080808080808080ull;
+        if (term != 0) [[likely]] {
+            // 終端byte位置
+            auto bits  = std::countr_zero(term) + 1;
+            auto bytes = static_cast<size_t>(bits / 8);
+            // 終端byteより後ろを捨てる
+            word &= ~0ull >> (64 - bits);
+            return result{pack_7bit(word), bytes, true};
+        }
+        // 57bit以上の値は残り(最大2byte)を1byteずつ処理
+        return decode_bytewise(buff, (len < max_bytes) ? len : max_bytes, 8, pack_7bit(word));
+    }
+    // バッファ末尾付近
+    return decode_bytewise(buff, len, 0, 0);
+}
 
-            //
-            shift += 7;
+// used_bytes byte分のLEB128値を符号拡張する(unsignedはそのまま)
+template <typename T>
+inline uint64_t sign_extend(uint64_t value, size_t used_bytes) {
+    if constexpr (std::is_signed_v<T>) {
+        // 算術右シフトで分岐なしに符号拡張する
+        size_t bits = used_bytes * 7;
+        if (bits > 0 && bits < 64) {
+            auto shift = static_cast<unsigned int>(64 - bits);
+            value      = static_cast<uint64_t>(static_cast<int64_t>(value << shift) >> shift);
         }
+    }
+    return value;
+}
 
-        if constexpr (std::is_unsigned_v<T>) {
-            // nothing
-        } else if constexpr (std::is_signed_v<T>) {
-            // signed用処理
-            // 最上位bit位置を作成
-            shift += 7;
-            // 最上位bitより上位のbitのマスク
-            T mask = std::numeric_limits<T>::max();
-            mask <<= shift - 1;
-            if ((value & mask) != 0) {
-                value |= mask;
-            }
+inline result decode_signed(uint8_t const *buff, size_t len) {
+    auto res  = decode_unsigned(buff, len);
+    res.value = sign_extend<int64_t>(res.value, res.used_bytes);
+    return res;
+}
+
+template <typename T>
+inline result decode(uint8_t const *buff, size_t len) {
+    if constexpr (std::is_unsigned_v<T>) {
+        return decode_unsigned(buff, len);
+    } else {
+        static_assert(std::is_signed_v<T>, "LEB128 requires integral type");
+        return decode_signed(buff, len);
+    }
+}
+
+// LEB128エンコード(最短byte数)
+template <typename Buffer>
+void encode_unsigned(Buffer &out, uint64_t value) {
+    do {
+        uint8_t data = value & 0x7F;
+        value >>= 7;
+        if (value != 0) {
+            data |= 0x80;
+        }
+        out.push_back(data);
+    } while (value != 0);
+}
+template <typename Buffer>
+void encode_signed(Buffer &out, int64_t value) {
+    bool more = true;
+    while (more) {
+        uint8_t data = value & 0x7F;
+        value >>= 7;
+        if ((value == 0 && (data & 0x40) == 0) || (value == -1 && (data & 0x40) != 0)) {
+            more = false;
         } else {
-            // 整数以外はNG
-            static_assert(false);
+            data |= 0x80;
         }
+        out.push_back(data);
+    }
+}
+
+}  // namespace leb128
+
+template <typename T>
+struct LEB128
+{
+    static_assert(std::is_integral_v<T>, "LEB128 requires integral type");
+
+    T value;
+    size_t used_bytes;
+    bool is_valid;  // falseのときバッファ末尾でLEB128が途切れている
+
+    LEB128(uint8_t const *buff, size_t len) : value(0), used_bytes(0), is_valid(false) {
+        decode(buff, len);
+    }
+
+    void decode(uint8_t const *buff, size_t len) {
+        auto res   = leb128::decode<T>(buff, len);
+        value      = static_cast<T>(res.value);
+        used_bytes = res.used_bytes;
+        is_valid   = res.is_valid;
     }
 };
 
-using ULEB128 = LEB128<uint32_t>;
-using SLEB128 = LEB128<int32_t>;
+using ULEB128 = LEB128<uint64_t>;
+using SLEB128 = LEB128<int64_t>;
 
-}  // namespace util_dwarf
\ No newline at end of file
+}  // namespace util_dwarf
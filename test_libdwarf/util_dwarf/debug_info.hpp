@@ -5,13 +5,23 @@
 #include <libdwarf.h>
 
 #include <algorithm>
+#include <atomic>
 #include <format>
 #include <functional>
 #include <iterator>
+#include <mutex>
+#include <span>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "dwarf_info.hpp"
+#include "dwarf_profile.hpp"
+#include "func_index.hpp"
+#include "graph_scc.hpp"
+#include "node_arena.hpp"
+#include "type_name.hpp"
+#include "work_stealing_pool.hpp"
 
 namespace util_dwarf {
 
@@ -26,12 +36,18 @@ public:
             none,
             prior_typedef = 1 << 0,
             expand_array  = 1 << 1,
+            c_declarator  = 1 << 2,
         };
 
         bool is_prior_typedef;  // typedefの名前を優先する
         bool is_expand_array;
+        bool is_c_declarator;  // 変数/memberの型名をC言語の宣言子表記にする
+        // 計測しないときはnullptr
+        dwarf_profiler *profiler;
+        // 型情報を並列構築するときのスレッドプール。nullptrのときはシングルスレッドで構築する
+        work_stealing_pool *pool;
 
-        option(type flags = none) : is_prior_typedef(false), is_expand_array(false) {
+        option(type flags = none) : is_prior_typedef(false), is_expand_array(false), is_c_declarator(false), profiler(nullptr), pool(nullptr) {
             set(flags);
         }
 
@@ -50,6 +66,9 @@ public:
             if (check_flag(flags, expand_array)) {
                 is_expand_array = value;
             }
+            if (check_flag(flags, c_declarator)) {
+                is_c_declarator = value;
+            }
         }
 
         bool check_flag(type flags, mode flag) {
@@ -84,6 +103,9 @@ public:
         std::optional<dw_op_value *> location;
         std::optional<Dwarf_Off> type;  // reference
         dwarf_info::compile_unit_info *cu_info;
+        // locationをシンボルテーブルから補完したときtrue
+        bool is_symbol_location;
+        Dwarf_Unsigned symbol_size;
 
         var_info()
             : name(nullptr),
@@ -98,7 +120,9 @@ public:
               endianity(0),
               location(),
               type(),
-              cu_info(nullptr) {
+              cu_info(nullptr),
+              is_symbol_location(false),
+              symbol_size(0) {
         }
         ~var_info() {
         }
@@ -121,15 +145,18 @@ public:
                 location = &(*info.location);
             if (info.cu_info != nullptr)
                 cu_info = info.cu_info;
+            is_symbol_location = info.is_symbol_location;
+            symbol_size        = info.symbol_size;
         }
     };
 
     // dwarf_info::type_infoを集約した型情報
     struct type_info
     {
+        Dwarf_Off offset;  // 自分自身のglobal offset
         uint16_t tag;
 
-        std::string *name;  // unnamedのときはnullptrになる
+        std::string const *name;  // unnamedのときはnullptrになる
         Dwarf_Unsigned byte_size;
         Dwarf_Unsigned bit_offset;
         Dwarf_Unsigned bit_size;
@@ -150,14 +177,15 @@ public:
         bool is_restrict;
         bool is_volatile;
 
+        // 子要素リストはdebug_info::arena上の連続領域
         using child_node_t = type_info *;
-        using child_list_t = std::list<child_node_t>;
+        using child_list_t = std::span<child_node_t>;
         // member
-        child_list_t *member_list;
+        child_list_t member_list;
         // parameter
-        child_list_t *param_list;
+        child_list_t param_list;
         // subrange[]
-        child_list_t *array_range_list;
+        child_list_t array_range_list;
         // array/member用
         type_info *sub_info;
 
@@ -168,7 +196,8 @@ public:
         build_type_state build_state;
 
         type_info()
-            : tag(0),
+            : offset(0),
+              tag(0),
               name(nullptr),
               byte_size(0),
               bit_offset(0),
@@ -188,15 +217,13 @@ public:
               is_const(false),
               is_restrict(false),
               is_volatile(false),
-              member_list(nullptr),
-              param_list(nullptr),
-              array_range_list(nullptr),
+              member_list(),
+              param_list(),
+              array_range_list(),
               sub_info(nullptr),
               has_bitfield(false),
               build_state(build_type_state::None) {
         }
-        ~type_info() {
-        }
     };
 
     // 変数情報
@@ -207,12 +234,13 @@ public:
     // 型情報
     using type_map_t = std::map<Dwarf_Unsigned, type_info>;
     type_map_t type_map;
-    std::list<type_info> sub_type_list;
-    std::list<type_info::child_list_t> child_list_list;
+    // 型情報構築で作成するノード(arrayの要素型)と子要素リスト
+    node_arena arena;
 
     // 固定情報
     std::string name_void;
     std::string name_unnamed;
+    std::string name_unknown;
 
     // その他解析情報
     std::size_t max_typename_len;  // 最大型名文字列長
@@ -223,10 +251,22 @@ private:
 
     // option
     option opt_;
+    // 型名(pointer/関数ポインタ等の合成名)
+    type_name_renderer type_names_;
+    // 並列構築時のno impl出力用
+    std::mutex no_impl_mtx_;
 
 public:
     debug_info(dwarf_info &dw_info, option opt)
-        : name_void("void"), name_unnamed("<unnamed>"), max_typename_len(0), max_varname_len(0), dw_info_(dw_info), opt_(opt) {
+        : name_void("void"),
+          name_unnamed("<unnamed>"),
+          name_unknown("<unknown>"),
+          max_typename_len(0),
+          max_varname_len(0),
+          dw_info_(dw_info),
+          opt_(opt),
+          type_names_(dw_info, opt.is_prior_typedef ? type_name_renderer::option::prior_typedef : type_name_renderer::option::none),
+          no_impl_mtx_() {
     }
     ~debug_info() {
     }
@@ -235,7 +275,12 @@ public:
         build_var_info();
         build_type_info();
     }
+    // 型名キャッシュ
+    type_name_renderer const &type_names() const {
+        return type_names_;
+    }
     void build_var_info() {
+        dwarf_profiler::scope prof_scope(opt_.profiler, dwarf_profiler::build_var);
         // 付加情報初期化
         // 最大変数名文字列長
         max_varname_len = 0;
@@ -253,7 +298,9 @@ public:
 
                     // DWARF上で同じ変数が複数のCU上に出現することがある
                     // 重複になるので除外する
-                    if (!var_tbl.contains(addr)) {
+                    // ただしシンボルテーブルから補完した宣言は、DWARFでlocationを持つ定義があればそちらで置き換える
+                    auto it = var_tbl.find(addr);
+                    if (it == var_tbl.end() || (it->second->is_symbol_location && !elem.is_symbol_location)) {
                         // dwarf_infoからデータコピー
                         auto info = std::make_unique<var_info>();
                         info->copy(elem);
@@ -268,17 +315,24 @@ public:
                         }
 
                         // map追加
-                        var_tbl.insert(std::make_pair(addr, std::move(info)));
+                        var_tbl.insert_or_assign(addr, std::move(info));
                     }
                 }
             }
         }
     }
     void build_type_info() {
+        dwarf_profiler::scope prof_scope(opt_.profiler, dwarf_profiler::build_type);
         // DIEから収集したデータは木構造で情報が分散している
         // ルートオブジェクトに情報を集約して型情報を単一にする
         auto &dw_type_map = dw_info_.type_tbl.container;
 
+        // 並列構築
+        // 並列構築しないとき、循環参照で不完全になった型は下のループで構築/再構築する
+        if (opt_.pool != nullptr) {
+            build_type_info_parallel(*opt_.pool);
+        }
+
         // 付加情報初期化
         // 最大型名文字列長
         max_typename_len = 0;
@@ -288,7 +342,9 @@ public:
             auto info = get_type_info(elem.first);
             // 付加情報作成
             // 最大型名文字列長
-            if (info->name != nullptr) {
+            if (opt_.is_c_declarator) {
+                max_typename_len = std::max(max_typename_len, type_names_.get_c(elem.first).size());
+            } else if (info->name != nullptr) {
                 if (max_typename_len < info->name->size()) {
                     max_typename_len = info->name->size();
                 }
@@ -317,62 +373,282 @@ private:
     type_info *get_type_info(Dwarf_Unsigned offset) {
         // 指定したoffsetのtype_infoを取得する
         // 作成済みデータがあれば終了
+        auto node = get_type_node(offset);
+        switch (node->build_state) {
+            case build_type_state::Building:
+            case build_type_state::Complete:
+                // Building: Dwarf定義内で循環参照している。arm_gccコンパイラで遭遇した。
+                // Complete: 情報構築済みなのでそのまま使用可能
+                return node;
+
+            case build_type_state::None:
+            case build_type_state::Incomplete:
+            default:
+                // None: 未作成
+                // Incomplete: Dwarf定義内循環参照等により途中で情報構築を打ち切っている。再構築する
+                break;
+        }
+        // 情報作成
+        // 逐次構築はdebug_info::arenaへ直接作成する
+        type_build_context ctx(arena);
+        build_type_graph(offset, ctx, true);
+        return node;
+    }
+
+    type_info *get_type_node(Dwarf_Unsigned offset) {
+        // 指定したoffsetのtype_infoを取得する
+        // 未作成なら空のノードを作成する。情報構築はしない
+        // 並列構築中は作成済みノードの参照のみになる(type_mapを変更しない)
         auto it = type_map.find(offset);
-        if (it != type_map.end()) {
-            switch (it->second.build_state) {
+        if (it == type_map.end()) {
+            it = type_map.try_emplace(offset, type_info()).first;
+        }
+        return &(it->second);
+    }
+
+    // 型情報構築中に作成するデータの格納先
+    // 並列構築時はスレッド間で共有しないようワーカー毎のarenaを指し、構築後にdebug_infoへ移す
+    struct type_build_context
+    {
+        node_arena &arena;
+
+        explicit type_build_context(node_arena &arena_) : arena(arena_) {
+        }
+    };
+
+    void build_type_info_parallel(work_stealing_pool &pool) {
+        // DW_AT_type/child_list(member, subrange, parameter)の参照を辺とした型の依存グラフ
+        // 強連結成分(自己参照structなど循環参照する型の集合)単位で、参照先の成分が構築済みになったら構築する
+        auto &dw_type_map = dw_info_.type_tbl.container;
+        auto node_count   = static_cast<uint32_t>(dw_type_map.size());
+
+        // ノード番号はoffset昇順
+        // type_mapのノードは並列構築中に追加しないよう先に作成しておく
+        std::vector<Dwarf_Unsigned> offset_list;
+        std::unordered_map<Dwarf_Unsigned, uint32_t> index_map;
+        offset_list.reserve(node_count);
+        index_map.reserve(node_count);
+        for (auto &[offset, dw_info] : dw_type_map) {
+            index_map.emplace(offset, static_cast<uint32_t>(offset_list.size()));
+            offset_list.push_back(offset);
+            get_type_node(offset);
+        }
+        // 参照先の型が解析されていないときは辺を作らない
+        // 参照先のノードは並列構築前に不明な型として作成しておく
+        auto add_edge = [&](std::vector<uint32_t> &edge_list, Dwarf_Unsigned offset) {
+            auto it = index_map.find(offset);
+            if (it == index_map.end()) {
+                set_unknown_type(*get_type_node(offset));
+                return;
+            }
+            edge_list.push_back(it->second);
+        };
+        std::vector<uint32_t> edge_begin;
+        std::vector<uint32_t> edge_list;
+        edge_begin.reserve(node_count + 1);
+        for (auto &[offset, dw_info] : dw_type_map) {
+            edge_begin.push_back(static_cast<uint32_t>(edge_list.size()));
+            // 宣言は型定義の情報で構築するので、型定義の参照先に依存する
+            auto &def_info = get_definition(dw_info);
+            if (def_info.type) {
+                add_edge(edge_list, *def_info.type);
+            }
+            for (auto child : def_info.child_list) {
+                add_edge(edge_list, child->offset);
+            }
+        }
+        edge_begin.push_back(static_cast<uint32_t>(edge_list.size()));
+
+        graph_scc scc;
+        scc.build(edge_begin, edge_list);
+        auto comp_count = scc.comp_count;
+
+        // 成分毎のノードリスト(offset昇順)
+        std::vector<uint32_t> comp_begin(comp_count + 1, 0);
+        std::vector<uint32_t> comp_node_list(node_count);
+        for (uint32_t i = 0; i < node_count; i++) {
+            comp_begin[scc.comp_of[i] + 1]++;
+        }
+        for (uint32_t c = 0; c < comp_count; c++) {
+            comp_begin[c + 1] += comp_begin[c];
+        }
+        {
+            auto pos = comp_begin;
+            for (uint32_t i = 0; i < node_count; i++) {
+                comp_node_list[pos[scc.comp_of[i]]++] = i;
+            }
+        }
+        // 成分間の依存: 参照先成分の数と、自成分を参照する成分のリスト
+        std::vector<std::atomic<uint32_t>> wait_count(comp_count);
+        std::vector<std::vector<uint32_t>> dependent_list(comp_count);
+        for (uint32_t c = 0; c < comp_count; c++) {
+            std::vector<uint32_t> dep_list;
+            for (auto pos = comp_begin[c]; pos < comp_begin[c + 1]; pos++) {
+                auto v = comp_node_list[pos];
+                for (auto e = edge_begin[v]; e < edge_begin[v + 1]; e++) {
+                    auto dep = scc.comp_of[edge_list[e]];
+                    if (dep != c) {
+                        dep_list.push_back(dep);
+                    }
+                }
+            }
+            std::sort(dep_list.begin(), dep_list.end());
+            dep_list.erase(std::unique(dep_list.begin(), dep_list.end()), dep_list.end());
+            wait_count[c].store(static_cast<uint32_t>(dep_list.size()));
+            for (auto dep : dep_list) {
+                dependent_list[dep].push_back(c);
+            }
+        }
+
+        // type_name_rendererはスレッドセーフでないので、構築中に参照する型名を先に作成しておく
+        for (auto &[offset, dw_info] : dw_type_map) {
+            if ((dw_info.tag == type_tag::pointer || dw_info.tag == type_tag::func) && dw_info.name.empty()) {
+                type_names_.get(offset);
+            }
+        }
+
+        // 成分毎に構築する
+        // 参照先成分は構築済みなので、成分内のノードのみを構築する
+        // 結果は参照先のみで決まるため、実行順によらず同じになる
+        // arenaはワーカー毎に持ち、ブロックを成分間で使い回す
+        std::vector<node_arena> arena_list(pool.size());
+        std::function<void(uint32_t)> build_comp = [&](uint32_t c) {
+            type_build_context ctx(arena_list[pool.worker_index()]);
+            for (auto pos = comp_begin[c]; pos < comp_begin[c + 1]; pos++) {
+                build_type_graph(offset_list[comp_node_list[pos]], ctx, false);
+            }
+            for (auto dependent : dependent_list[c]) {
+                if (wait_count[dependent].fetch_sub(1) == 1) {
+                    pool.submit([&build_comp, dependent] { build_comp(dependent); });
+                }
+            }
+        };
+        // 投入後はワーカーがwait_countを更新するので、参照先のない成分を先に列挙してから投入する
+        std::vector<uint32_t> ready_list;
+        for (uint32_t c = 0; c < comp_count; c++) {
+            if (wait_count[c].load() == 0) {
+                ready_list.push_back(c);
+            }
+        }
+        for (auto c : ready_list) {
+            pool.submit([&build_comp, c] { build_comp(c); });
+        }
+        pool.wait();
+
+        // 作成データを移す
+        // ブロック単位で移すので確保済みノードのアドレスは変わらない
+        for (auto &worker_arena : arena_list) {
+            arena.merge(worker_arena);
+        }
+    }
+
+    // 型情報構築のワークリスト要素
+    struct build_frame
+    {
+        Dwarf_Unsigned offset;
+        type_info *node;
+        dwarf_info::type_info *dw_info;
+        // 次にチェックする依存先
+        bool is_type_checked;
+        dwarf_info::type_info::child_list_t::iterator child_it;
+
+        build_frame(Dwarf_Unsigned offset_, type_info *node_, dwarf_info::type_info *dw_info_)
+            : offset(offset_), node(node_), dw_info(dw_info_), is_type_checked(false), child_it(dw_info_->child_list.begin()) {
+        }
+    };
+
+    void build_type_graph(Dwarf_Unsigned root, type_build_context &ctx, bool is_rebuild) {
+        // offsetの型情報を依存先から順に構築する
+        // 型情報は依存先(DW_AT_type, arrayのsubrange)のtype_infoをコピーしてから自身の情報を適用する
+        // typedef/const等の多段の型で再帰呼び出しが深くならないよう、明示的なスタックで帰りがけ順に構築する
+        // member/parameterのリストは参照用のポインタのみ保持するので依存先にしない(構築はbuild_type_infoの走査で行う)
+        auto &dw_type_map = dw_info_.type_tbl.container;
+        std::vector<build_frame> stack;
+        auto push = [&](Dwarf_Unsigned offset) {
+            auto node = get_type_node(offset);
+            switch (node->build_state) {
                 case build_type_state::Building:
                 case build_type_state::Complete:
-                    // Building: Dwarf定義内で循環参照している。arm_gccコンパイラで遭遇した。
-                    // Complete: 情報構築済みなのでそのまま使用可能
-                    return &(it->second);
+                    // Building: 循環参照。構築途中のデータを参照する
+                    return;
 
-                case build_type_state::None:
                 case build_type_state::Incomplete:
+                    // 未完成なら再構築
+                    // 並列構築中は他スレッドが参照している可能性があるので再構築しない
+                    if (!is_rebuild) {
+                        return;
+                    }
+                    *node = type_info();
+                    break;
+
+                case build_type_state::None:
                 default:
-                    // None: 未作成なのでありえない
-                    // Incomplete: Dwarf定義内循環参照等により途中で情報構築を打ち切っている。再構築する
                     break;
             }
-        }
-        bool result;
-        // itを上書きしているので注意
-        if (it == type_map.end()) {
-            // 未作成なら作成
-            std::tie(it, result) = type_map.try_emplace(offset, type_info());
-            if (!result) {
-                // 重複はありえない
+            // 参照先の型DIEが解析されていない
+            // cu_filterで除外したCUへのDW_FORM_ref_addr(LTO early debug, dwz等)は正常な入力でも発生する
+            auto it = dw_type_map.find(offset);
+            if (it == dw_type_map.end()) {
+                set_unknown_type(*node);
+                return;
             }
-        } else if (it->second.build_state == build_type_state::Incomplete) {
-            // 未完成なら再構築
-            using obj_type = decltype(it->second);
-            it->second     = obj_type();
+            // 情報構築開始
+            node->build_state = build_type_state::Building;
+            stack.emplace_back(offset, node, &get_definition(it->second));
+        };
+
+        push(root);
+        while (!stack.empty()) {
+            // pushでstackが再確保されるとtopは無効になるので、push後はtopを使わない
+            auto &top = stack.back();
+            if (!top.is_type_checked) {
+                top.is_type_checked = true;
+                if (top.dw_info->type) {
+                    push(*(top.dw_info->type));
+                    continue;
+                }
+            }
+            if (top.dw_info->tag == type_tag::array && top.child_it != top.dw_info->child_list.end()) {
+                // arrayはsubrangeの情報を更新するので先に構築する
+                auto child_offset = (*top.child_it)->offset;
+                top.child_it++;
+                push(child_offset);
+                continue;
+            }
+            // 依存先が構築済みになったので自身を構築する
+            auto frame = top;
+            stack.pop_back();
+            build_type_info(*frame.node, *frame.dw_info, ctx);
         }
-        // 情報作成
-        build_type_info(it->second, offset);
-        return &(it->second);
     }
 
-    void build_type_info(type_info &dbg_info, Dwarf_Unsigned offset) {
-        // 情報構築開始
-        dbg_info.build_state = build_type_state::Building;
-        //
-        auto &dw_type_map = dw_info_.type_tbl.container;
-        // 開始ノード存在チェック
-        auto it = dw_type_map.find(offset);
-        if (it == dw_type_map.end()) {
-            // 存在しなければ空のまま終了
-            // return;
-            throw std::runtime_error("logic error");
-        }
-        // 開始ノードが存在したらデータ作成開始
+    // type unitに定義がある型の宣言(DW_AT_declaration + DW_AT_signature)は型定義DIEを返す
+    // -fdebug-types-section のC++型はCU側に宣言だけが置かれ、変数等はこの宣言を参照する
+    dwarf_info::type_info &get_definition(dwarf_info::type_info &dw_info) {
+        if (!dw_info.declaration || !dw_info.definition) {
+            return dw_info;
+        }
+        auto it = dw_info_.type_tbl.container.find(*dw_info.definition);
+        if (it == dw_info_.type_tbl.container.end() || it->second.declaration) {
+            return dw_info;
+        }
+        return it->second;
+    }
+
+    // 解析されていない型は名前だけを持つ空の型として扱う
+    void set_unknown_type(type_info &node) {
+        node             = type_info();
+        node.name        = &name_unknown;
+        node.build_state = build_type_state::Complete;
+    }
+
+    void build_type_info(type_info &dbg_info, dwarf_info::type_info &root_dw_info, type_build_context &ctx) {
         // child typeの存在をチェック
-        auto &root_dw_info = it->second;
         if (root_dw_info.type) {
             // child typeが存在するとき、
             // child typeのtype_infoをまずコピーする
-            // ここでchild typeが未作成でも関数コールにより作成される
-            // 再帰呼び出しになるので注意
-            auto child_info = get_type_info(*(root_dw_info.type));
+            // child typeはbuild_type_graphで構築済み(循環参照時は構築途中)
+            auto child_info = get_type_node(*(root_dw_info.type));
             dbg_info        = *child_info;
             if (dbg_info.sub_info == nullptr) {
                 dbg_info.sub_info = child_info;
@@ -380,8 +656,9 @@ private:
         }
         // type_infoに今回対象となるoffsetの情報を適用する
         // データ構築完了したか、循環参照で中断したかを返す
-        auto result = adapt_info(dbg_info, root_dw_info);
-        adapt_info_fix(dbg_info);
+        dbg_info.offset = root_dw_info.offset;
+        auto result     = adapt_info(dbg_info, root_dw_info, ctx);
+        adapt_info_fix(dbg_info, ctx);
         //
         if (result) {
             dbg_info.build_state = build_type_state::Complete;
@@ -390,7 +667,7 @@ private:
         }
     }
 
-    bool adapt_info(type_info &dbg_info, dwarf_info::type_info &dw_info) {
+    bool adapt_info(type_info &dbg_info, dwarf_info::type_info &dw_info, type_build_context &ctx) {
         // CumpileUnit情報
         adapt_value(dbg_info.cu_info, dw_info.cu_info);
         // type情報
@@ -403,17 +680,17 @@ private:
                 return adapt_info_base(dbg_info, dw_info);
 
             case type_tag::func:
-                return adapt_info_func(dbg_info, dw_info);
+                return adapt_info_func(dbg_info, dw_info, ctx);
 
             case type_tag::typedef_:
                 return adapt_info_typedef(dbg_info, dw_info);
 
             case type_tag::struct_:
             case type_tag::union_:
-                return adapt_info_struct_union(dbg_info, dw_info);
+                return adapt_info_struct_union(dbg_info, dw_info, ctx);
 
             case type_tag::array:
-                return adapt_info_array(dbg_info, dw_info);
+                return adapt_info_array(dbg_info, dw_info, ctx);
 
             case type_tag::pointer:
                 return adapt_info_pointer(dbg_info, dw_info);
@@ -444,14 +721,20 @@ private:
 
             default:
                 // 実装忘れ
-                fprintf(stderr, "no impl : build_node : 0x%02X\n", dw_info.tag);
+                {
+                    std::lock_guard<std::mutex> lock(no_impl_mtx_);
+                    fprintf(stderr, "no impl : build_node : 0x%02X\n", dw_info.tag);
+                    if (opt_.profiler != nullptr) {
+                        opt_.profiler->count_no_impl("build_node", "type_tag", dw_info.tag);
+                    }
+                }
                 break;
         }
 
         return false;
     }
 
-    void adapt_info_fix(type_info &dbg_info) {
+    void adapt_info_fix(type_info &dbg_info, type_build_context &ctx) {
         // 後処理
         // void型ケア
         // tagがnoneのときはvoid型？
@@ -483,8 +766,7 @@ private:
         if (dbg_info.sub_info == nullptr) {
             if ((dbg_info.tag & type_tag::array) == type_tag::array) {
                 // arrayに関するデータをマスクしたデータが要素型のデータになる
-                sub_type_list.push_back(dbg_info);
-                auto &sub_type    = sub_type_list.back();
+                auto &sub_type    = *ctx.arena.create<type_info>(dbg_info);
                 dbg_info.sub_info = &sub_type;
                 //
                 sub_type.byte_size = sub_type.byte_size / sub_type.count;
@@ -549,7 +831,7 @@ private:
         // 型情報があれば取得
         // 不完全型かどうかを戻り値で返す
         if (dw_info.type) {
-            dbg_info.sub_info = get_type_info(*dw_info.type);
+            dbg_info.sub_info = get_type_node(*dw_info.type);
             is_comple         = dbg_info.sub_info->build_state == build_type_state::Complete;
         }
         //
@@ -565,7 +847,7 @@ private:
         // 型情報があれば取得
         // 不完全型かどうかを戻り値で返す
         if (dw_info.type) {
-            dbg_info.sub_info = get_type_info(*dw_info.type);
+            dbg_info.sub_info = get_type_node(*dw_info.type);
             is_comple         = dbg_info.sub_info->build_state == build_type_state::Complete;
         }
         //
@@ -574,80 +856,22 @@ private:
         return is_comple;
     }
 
-    bool adapt_info_func(type_info &dbg_info, dwarf_info::type_info &dw_info) {
-        bool is_comple = true;
+    bool adapt_info_func(type_info &dbg_info, dwarf_info::type_info &dw_info, type_build_context &ctx) {
         // 関数ポインタ型名前作成
+        // 引数型が循環参照しているときはtype_name_rendererが<funcptr>とする
+        // 関数ポインタ型名称を優先、無ければ 返り値型(*)(引数型, ...) を作成する
         if (dw_info.name.size() > 0) {
-            // 関数ポインタ型名称を優先
-            // adapt_value(dbg_info.name, dw_info.name);
+            dbg_info.name = &dw_info.name;
         } else {
-            auto inserter = std::back_inserter(dw_info.name);
-            // 返り値型適用
-            if (dbg_info.name == nullptr) {
-                std::format_to(inserter, "void");
-            } else {
-                std::format_to(inserter, "{}", *dbg_info.name);
-            }
-            // 関数ポインタ表示
-            std::format_to(inserter, "(*)(");
-            // 引数型
-            auto it = dw_info.param_list.begin();
-            if (it != dw_info.param_list.end()) {
-                auto param_offset = *it;
-                auto var_info_it  = dw_info_.var_tbl.container.find(param_offset);
-                if (var_info_it != dw_info_.var_tbl.container.end()) {
-                    auto dbg_param = get_type_info(*var_info_it->second.type);
-                    switch (dbg_param->build_state) {
-                        case build_type_state::Complete:
-                            // 構築済みデータが取得出来ればOK
-                            std::format_to(inserter, "{}", *dbg_param->name);
-                            break;
-
-                        case build_type_state::None:
-                        case build_type_state::Building:
-                        case build_type_state::Incomplete:
-                        default:
-                            // それ以外は終了
-                            is_comple = false;
-                            break;
-                    }
-                }
-                it++;
-                for (; is_comple && it != dw_info.param_list.end(); it++) {
-                    param_offset = *it;
-                    var_info_it  = dw_info_.var_tbl.container.find(param_offset);
-                    if (var_info_it != dw_info_.var_tbl.container.end()) {
-                        auto dbg_param = get_type_info(*var_info_it->second.type);
-                        switch (dbg_param->build_state) {
-                            case build_type_state::Complete:
-                                // 構築済みデータが取得出来ればOK
-                                std::format_to(inserter, ", {}", *dbg_param->name);
-                                break;
-
-                            case build_type_state::None:
-                            case build_type_state::Building:
-                            case build_type_state::Incomplete:
-                            default:
-                                // それ以外は終了
-                                is_comple = false;
-                                break;
-                        }
-                    }
-                }
-            }
-            std::format_to(inserter, ")");
+            dbg_info.name = type_names_.get(dw_info.offset);
         }
-        dbg_info.name = &dw_info.name;
         //
         adapt_value(dbg_info.byte_size, dw_info.byte_size);
-        adapt_value(dbg_info.param_list, dw_info.child_list);
+        adapt_value(dbg_info.param_list, dw_info.child_list, ctx);
         //
         dbg_info.tag |= dw_info.tag;
         //
-        if (!is_comple) {
-            dw_info.name = "<funcptr>";
-        }
-        return is_comple;
+        return true;
     }
 
     bool adapt_info_parameter(type_info &dbg_info, dwarf_info::type_info &dw_info) {
@@ -656,7 +880,7 @@ private:
         adapt_value(dbg_info.name, dw_info.name);
         //
         if (dw_info.type) {
-            dbg_info.sub_info = get_type_info(*dw_info.type);
+            dbg_info.sub_info = get_type_node(*dw_info.type);
             is_comple         = dbg_info.sub_info->build_state == build_type_state::Complete;
         }
         //
@@ -680,11 +904,11 @@ private:
         return true;
     }
 
-    bool adapt_info_struct_union(type_info &dbg_info, dwarf_info::type_info &dw_info) {
+    bool adapt_info_struct_union(type_info &dbg_info, dwarf_info::type_info &dw_info, type_build_context &ctx) {
         // 対象データが空ならdw_infoを反映する
         adapt_value(dbg_info.name, dw_info.name);
         adapt_value(dbg_info.byte_size, dw_info.byte_size);
-        adapt_value(dbg_info.member_list, dw_info.child_list);
+        adapt_value(dbg_info.member_list, dw_info.child_list, ctx);
         adapt_value(dbg_info.has_bitfield, dw_info.has_bitfield);
         //
         dbg_info.tag |= dw_info.tag;
@@ -692,20 +916,20 @@ private:
         return true;
     }
 
-    bool adapt_info_array(type_info &dbg_info, dwarf_info::type_info &dw_info) {
+    bool adapt_info_array(type_info &dbg_info, dwarf_info::type_info &dw_info, type_build_context &ctx) {
         // 対象データが空ならdw_infoを反映する
         adapt_value(dbg_info.name, dw_info.name);
         // arrayはsub_infoに型情報を保持している
         // dwarf_infoではchild_listにsubrangeを保持している
         // debug_infoではarray_range_listに参照を持たせる
-        adapt_value_force(dbg_info.array_range_list, dw_info.child_list);
+        adapt_value_force(dbg_info.array_range_list, dw_info.child_list, ctx);
         // array_range_list から配列の各次元のサイズ数を計算する
         // 最終次からループして、各次元の要素1つあたりのサイズを計算する
         Dwarf_Unsigned child_size;
-        auto it = dbg_info.array_range_list->rbegin();
+        auto it = dbg_info.array_range_list.rbegin();
         // 最終次はarrayの型サイズになる
         child_size = dbg_info.byte_size;
-        for (; it != dbg_info.array_range_list->rend(); it++) {
+        for (; it != dbg_info.array_range_list.rend(); it++) {
             (*it)->byte_size = child_size;
             // 上位次のサイズを計算
             // 現在次の型サイズ * 要素数 になる
@@ -724,7 +948,7 @@ private:
         adapt_value(dbg_info.count, dw_info.count);
         //
         if (dw_info.type) {
-            dbg_info.sub_info = get_type_info(*dw_info.type);
+            dbg_info.sub_info = get_type_node(*dw_info.type);
             is_comple         = dbg_info.sub_info->build_state == build_type_state::Complete;
         }
         //
@@ -760,14 +984,8 @@ private:
             dbg_info.name = &dw_info.name;
         } else {
             if ((dbg_info.tag & type_tag::func) == 0) {
-                auto it = std::back_inserter(dw_info.name);
-                if (dbg_info.name == nullptr) {
-                    std::format_to(it, "void");
-                } else {
-                    std::format_to(it, "{}", *dbg_info.name);
-                }
-                std::format_to(it, "*");
-                dbg_info.name = &dw_info.name;
+                // 参照先型名 + "*"
+                dbg_info.name = type_names_.get(dw_info.offset);
             }
         }
 
@@ -807,12 +1025,12 @@ private:
             dst = src;
         }
     }
-    void adapt_value(std::string *&dst, std::string &src) {
+    void adapt_value(std::string const *&dst, std::string const &src) {
         if (dst == nullptr && src.size() > 0) {
             dst = &src;
         }
     }
-    void adapt_value_force(std::string *&dst, std::string &src) {
+    void adapt_value_force(std::string const *&dst, std::string const &src) {
         if (src.size() > 0) {
             dst = &src;
         }
@@ -833,23 +1051,21 @@ private:
             dst = src;
         }
     }
-    void adapt_value(debug_info::type_info::child_list_t *&dst, dwarf_info::type_info::child_list_t &src) {
-        if (dst == nullptr && src.size() > 0) {
-            type_info::child_list_t list;
-
+    void adapt_value(debug_info::type_info::child_list_t &dst, dwarf_info::type_info::child_list_t &src, type_build_context &ctx) {
+        if (dst.empty() && src.size() > 0) {
+            auto list = ctx.arena.create_array<type_info::child_node_t>(src.size());
+            size_t idx = 0;
             for (auto &child : src) {
-                auto dbg_child = get_type_info(child->offset);
-                list.push_back(dbg_child);
+                // 参照のみ保持する。arrayのsubrangeはbuild_type_graphで構築済み
+                list[idx] = get_type_node(child->offset);
+                idx++;
             }
-
-            child_list_list.push_back(std::move(list));
-            auto &new_list = child_list_list.back();
-            dst            = &new_list;
+            dst = list;
         }
     }
-    void adapt_value_force(debug_info::type_info::child_list_t *&dst, dwarf_info::type_info::child_list_t &src) {
-        dst = nullptr;
-        adapt_value(dst, src);
+    void adapt_value_force(debug_info::type_info::child_list_t &dst, dwarf_info::type_info::child_list_t &src, type_build_context &ctx) {
+        dst = type_info::child_list_t();
+        adapt_value(dst, src, ctx);
     }
     void adapt_value(Dwarf_Unsigned &dst, std::optional<Dwarf_Unsigned> &src) {
         if (dst == 0 && src) {
@@ -865,7 +1081,7 @@ private:
 public:
     struct var_info_view
     {
-        std::string *tag_type;
+        std::string const *tag_type;
         std::string *tag_name;
 
         Dwarf_Off address;
@@ -1002,6 +1218,10 @@ public:
             view.cu_info            = func_info.cu_info;
             view.has_definition     = func_info.has_definition;
             view.is_declaration     = func_info.declaration;
+            if (auto range = get_func_pc_range(func_info)) {
+                view.low_pc  = range->first;
+                view.high_pc = range->second;
+            }
             //
             result = func(view);
             if (!result) {
@@ -1011,7 +1231,7 @@ public:
     }
 
 private:
-    void make_type_tag(var_info_view &view, type_info &type) {
+    void make_type_tag(var_info_view &view, type_info &type, Dwarf_Off decl_type) {
         // pointer
         view.pointer_depth = type.pointer_depth;
         // type情報タグを作成
@@ -1051,6 +1271,10 @@ private:
 
         //
         view.encoding = type.encoding;
+        // C言語の宣言子表記は変数/memberの宣言(decl_type)から作成する
+        if (opt_.is_c_declarator) {
+            view.tag_type = &type_names_.get_c(decl_type);
+        }
     }
 
     template <typename Func>
@@ -1059,7 +1283,7 @@ private:
         var_info_view view;
         Dwarf_Off address;
         // 型タグ作成
-        make_type_tag(view, type);
+        make_type_tag(view, type, *var.type);
         // 表示名作成
         std::format_to(std::back_inserter(var_name), "{}", *var.name);
         // アドレス計算
@@ -1083,7 +1307,13 @@ private:
         //
         view.cu_info = var.cu_info;
 
-        if ((type.tag & util_dwarf::debug_info::type_tag::array) != 0) {
+        if (var.is_symbol_location && var.symbol_size != 0 && get_var_size(type) == 0) {
+            // 型からサイズが決まらない変数(extern int buf[]; 不完全型の宣言等)はシンボルのサイズで1行にする
+            view.address   = address;
+            view.byte_size = var.symbol_size;
+            view.is_array  = ((type.tag & util_dwarf::debug_info::type_tag::array) != 0);
+            result         = func(view);
+        } else if ((type.tag & util_dwarf::debug_info::type_tag::array) != 0) {
             // 配列のとき
             result = lookup_var_impl_array(view, type, address, var_name, depth, func);
         } else {
@@ -1097,6 +1327,18 @@ private:
         return result;
     }
 
+    // 型から決まる変数全体のサイズ。要素数が不明な配列は0
+    static Dwarf_Unsigned get_var_size(type_info const &type) {
+        if ((type.tag & util_dwarf::debug_info::type_tag::array) != 0) {
+            if (type.array_range_list.empty()) {
+                return 0;
+            }
+            auto const &range = *type.array_range_list.front();
+            return range.byte_size * range.count;
+        }
+        return type.byte_size;
+    }
+
     template <typename Func>
     bool lookup_var_member(type_info &type, Dwarf_Off base_address, std::string &prefix, size_t depth, Func &func) {
         bool result;
@@ -1106,7 +1348,7 @@ private:
         if ((type.tag & util_dwarf::debug_info::type_tag::func_ptr) != 0) {
             return true;
         }
-        if (type.member_list == nullptr) {
+        if (type.member_list.empty()) {
             return true;
         }
 
@@ -1120,7 +1362,7 @@ private:
             // ありえない?
         }
 
-        for (auto &mem : *type.member_list) {
+        for (auto &mem : type.member_list) {
             // memberが変数名になる
             auto &member = *mem;
             // memberのchild要素がmemberの型情報を示しているはず
@@ -1144,7 +1386,7 @@ private:
         Dwarf_Off address;
         var_info_view view;
         // 型タグ作成
-        make_type_tag(view, type);
+        make_type_tag(view, type, member.offset);
         // アドレス計算
         address = base_address + member.data_member_location;
         // view作成
@@ -1240,9 +1482,9 @@ private:
         // 多次元配列ケアのために再帰的コールして変数名を作成する
         // 末尾まで到達したら変数の内容をコールバックする
         // arrayなら必ずsubrangeを持つはずだが一応チェック
-        if (type.array_range_list != nullptr && type.array_range_list->size() > 0) {
+        if (type.array_range_list.size() > 0) {
             // インデックス作成
-            auto it = type.array_range_list->begin();
+            auto it = type.array_range_list.begin();
             result  = lookup_var_impl_array_idx(view, type, base_address, var_name, depth, it, func);
         }
 
@@ -1274,7 +1516,7 @@ private:
                 std::format_to(std::back_inserter(var_name), "[{}]", curr_d->count);
             }
 
-            if (array_d_it == type.array_range_list->end()) {
+            if (array_d_it == type.array_range_list.end()) {
                 // 最終次なら変数内容を表示
                 result = lookup_var_impl_array_data(view, type, address, var_name, depth, func);
             } else {
@@ -4,8 +4,12 @@
 #include <dwarf.h>
 #include <libdwarf.h>
 
+#include "dwarf_attr_filter.hpp"
+#include "dwarf_cu_filter.hpp"
 #include "dwarf_expression.hpp"
 #include "dwarf_info.hpp"
+#include "dwarf_profile.hpp"
+#include "dwarf_unit_base.hpp"
 
 namespace util_dwarf {
 
@@ -18,12 +22,26 @@ struct dwarf_analyze_option
         none,
         func_info_analyze = 1 << 0,
         no_impl_warning   = 1 << 1,
+        symbol_location   = 1 << 2,
     };
 
     bool is_func_info_analyze;
     bool is_no_impl_warning;
+    bool is_symbol_location;  // DW_AT_locationを持たない変数のアドレスをシンボルテーブルから補完する
+    // 計測しないときはnullptr
+    dwarf_profiler* profiler;
+    // 解析対象のCU。nullptrのときはすべてのCUを解析する
+    dwarf_cu_filter const* cu_filter;
+    // 出力に使うフィールド(dwarf_attr_filter::field)。不要なattributeはデコードしない
+    dwarf_attr_filter::type output_fields;
 
-    dwarf_analyze_option(type flags = none) : is_func_info_analyze(false), is_no_impl_warning(false) {
+    dwarf_analyze_option(type flags = none)
+        : is_func_info_analyze(false),
+          is_no_impl_warning(false),
+          is_symbol_location(false),
+          profiler(nullptr),
+          cu_filter(nullptr),
+          output_fields(dwarf_attr_filter::all) {
         set(flags);
     }
 
@@ -42,6 +60,9 @@ private:
         if (check_flag(flags, no_impl_warning)) {
             is_no_impl_warning = value;
         }
+        if (check_flag(flags, symbol_location)) {
+            is_symbol_location = value;
+        }
     }
 
     bool check_flag(type flags, mode flag) {
@@ -62,8 +83,27 @@ struct dwarf_analyze_info
     dwarf_info::compile_unit_info* cu_info;
     dwarf_analyze_option option;
     std::vector<std::string> file_list;
+    // 解析中のunitが.debug_infoにあるか(falseなら.debug_types)
+    bool is_info;
+    // DW_FORM_ref_sig8 の解決に使う
+    dwarf_info::type_signature_index const* type_sig_tbl;
+    // DW_FORM_strx/addrx/rnglistx/loclistx の解決に使う
+    dwarf_unit_base unit_base;
+    // option.output_fieldsから作成したattributeの許可リスト
+    dwarf_attr_filter attr_filter;
 
-    dwarf_analyze_info() : dw_dbg(nullptr), dw_error(nullptr), dw_attr(nullptr), dw_expr(), cu_info(), option() {
+    dwarf_analyze_info()
+        : dw_dbg(nullptr),
+          dw_error(nullptr),
+          dw_attr(nullptr),
+          dw_expr(),
+          cu_info(),
+          option(),
+          file_list(),
+          is_info(true),
+          type_sig_tbl(nullptr),
+          unit_base(),
+          attr_filter() {
     }
 };
 
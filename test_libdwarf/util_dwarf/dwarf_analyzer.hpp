@@ -4,15 +4,24 @@
 #include <dwarf.h>
 #include <libdwarf.h>
 
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
 #include <memory>
+#include <optional>
+#include <stop_token>
 #include <string>
+#include <string_view>
 
 #include "dwarf_analyze_info.hpp"
 #include "dwarf_attribute.hpp"
+#include "dwarf_cfi.hpp"
 #include "dwarf_info.hpp"
+#include "dwarf_loclist.hpp"
+#include "dwarf_section_loader.hpp"
 #include "elf.hpp"
+#include "elf_section.hpp"
+#include "elf_symbol.hpp"
 
 // API examples
 // https://www.prevanders.net/libdwarfdoc/modules.html
@@ -44,6 +53,20 @@ public:
     // 関数情報
     using func_info = dwarf_info::func_info;
 
+    // 解析の進捗
+    // バイト数は.debug_info, .debug_typesの順に連結したときの位置
+    struct progress_info
+    {
+        size_t cu_count;             // 解析済みunit数(cu_filterで除外したものを含む)
+        Dwarf_Unsigned done_bytes;   // 解析済みunitの末尾
+        Dwarf_Unsigned total_bytes;  // .debug_info + .debug_types のサイズ
+        bool is_finished;
+        bool is_cancelled;  // stop_tokenで中断した
+
+        progress_info() : cu_count(0), done_bytes(0), total_bytes(0), is_finished(true), is_cancelled(false) {
+        }
+    };
+
 private:
     std::string dwarf_file_path;
     static constexpr size_t dw_true_path_buff_len = 512;
@@ -63,14 +86,61 @@ private:
     dwarf_analyze_info analyze_info_;
 
     // 解析情報
+    // 位置リストの遅延デコード
+    dwarf_location_resolver loc_resolver_;
+    // CFI(.debug_frame/.eh_frame)。初回参照時に読み込む
+    dwarf_cfi cfi_;
+    bool is_cfi_loaded_;
+    // DWARF5 index形式formの参照先セクション(mmap)
+    elf::section_reader sections_;
+    // 圧縮debugセクションの並列展開。有効時はdwarf_object_init_bで開く
+    dwarf_section_loader loader_;
+    section_loader_option loader_opt_;
+    bool is_loader_enabled_;
+    // DW_AT_locationを持たない変数のアドレス補完に使うシンボル索引
+    elf::symbol_table symbols_;
+    // dwarf_analyze_option::cu_filterで除外したCU数
+    size_t skipped_cu_count_;
+    // begin()からstep()で進める解析の状態
+    dwarf_info *target_info_;
+    Dwarf_Bool dw_is_info_;
+    Dwarf_Unsigned debug_info_size_;
+    std::stop_token stop_token_;
+    progress_info progress_;
 
 public:
-    dwarf_analyzer() : dw_dbg(nullptr) {
+    dwarf_analyzer()
+        : dw_dbg(nullptr),
+          loc_resolver_(),
+          cfi_(),
+          is_cfi_loaded_(false),
+          sections_(),
+          loader_(),
+          loader_opt_(),
+          is_loader_enabled_(false),
+          symbols_(),
+          skipped_cu_count_(0),
+          target_info_(nullptr),
+          dw_is_info_(true),
+          debug_info_size_(0),
+          stop_token_(),
+          progress_() {
     }
     ~dwarf_analyzer() {
         close();
     }
 
+    // 圧縮debugセクション(SHF_COMPRESSED/.zdebug_*)をopen時に並列に展開する
+    // open()より前に設定する
+    void section_loader(section_loader_option const &opt) {
+        loader_opt_        = opt;
+        is_loader_enabled_ = true;
+    }
+    // 展開結果の統計。open()からclose()まで有効
+    dwarf_section_loader const &section_loader() const {
+        return loader_;
+    }
+
     bool open(char const *dwarf_file_path_cstr) {
         if (dw_dbg != nullptr) {
             fprintf(stderr, "dwarf file is already open : %s\n", dwarf_file_path.c_str());
@@ -82,8 +152,25 @@ public:
         unsigned int dw_groupnumber = 0;
         Dwarf_Ptr dw_errarg         = nullptr;
 
-        auto result = dwarf_init_path(dwarf_file_path.c_str(), dw_true_path_buff, dw_true_path_buff_len, dw_groupnumber, err_handler, dw_errarg,
-                                      &dw_dbg, &dw_error);
+        int result = DW_DLV_NO_ENTRY;
+        // 圧縮debugセクションを展開済みのセクションとして渡す
+        // 対象外(圧縮セクション無し/ET_REL/ELF以外)のときはlibdwarfのファイル読み込みで開く
+        if (is_loader_enabled_ && loader_.open(dwarf_file_path.c_str(), loader_opt_)) {
+            result = dwarf_object_init_b(loader_.interface(), err_handler, dw_errarg, dw_groupnumber, &dw_dbg, &dw_error);
+            if (result == DW_DLV_OK) {
+                snprintf(dw_true_path_buff, dw_true_path_buff_len, "%s", dwarf_file_path.c_str());
+            } else {
+                if (result == DW_DLV_ERROR) {
+                    dwarf_dealloc_error(nullptr, dw_error);
+                }
+                dw_dbg = nullptr;
+                loader_.close();
+            }
+        }
+        if (!loader_.is_open()) {
+            result = dwarf_init_path(dwarf_file_path.c_str(), dw_true_path_buff, dw_true_path_buff_len, dw_groupnumber, err_handler, dw_errarg,
+                                     &dw_dbg, &dw_error);
+        }
         // printf("dwarf_init_path : result : %d\n", result);
         if (result == DW_DLV_NO_ENTRY) {
             // 情報なし？
@@ -94,27 +181,140 @@ public:
             utility::error_happen(&dw_error);
             return false;
         }
+        loc_resolver_.reset(dw_dbg);
+        // ELF以外(PE/Mach-O)や読めないときは各formをlibdwarfで解決する
+        // section_loaderで開いたときは展開済みのセクションを参照する
+        if (!loader_.is_open()) {
+            sections_.open(dw_true_path_buff);
+        }
 
         return true;
     }
 
     void analyze(dwarf_info &info, dwarf_analyze_option opt) {
-        Dwarf_Bool dw_is_info = true;
-        Dwarf_Die dw_cu_die;
-
-        int result;
-        bool finish = false;
+        dwarf_profiler::scope prof_scope(opt.profiler, dwarf_profiler::analyze);
+        begin(info, opt);
+        while (analyze_next_unit()) {
+        }
+    }
 
+    // 解析を開始する。以降はstep()でunit単位に進める
+    // 解析途中のinfoは解析済みunitの分だけ参照できる
+    // stopが要求されると次のunitへは進まない。解析中のunitは最後まで解析するので、infoには完結したunitだけが残る
+    void begin(dwarf_info &info, dwarf_analyze_option opt, std::stop_token stop = {}) {
         // 解析情報初期化
         analyze_info_          = dwarf_analyze_info();
         analyze_info_.dw_dbg   = dw_dbg;
         analyze_info_.dw_error = dw_error;
         analyze_info_.option   = opt;
+        analyze_info_.attr_filter.reset(opt.output_fields);
+        analyze_info_.dw_expr.profiler(opt.profiler);
+        skipped_cu_count_ = 0;
+        target_info_      = &info;
+        dw_is_info_       = true;
+        stop_token_       = std::move(stop);
+        progress_         = progress_info();
 
         // アーキテクチャ情報取得
         analyze_machine_architecture(info);
+        // DW_AT_locationを持たない変数の補完用にシンボル索引を作成する
+        symbols_.clear();
+        if (opt.is_symbol_location) {
+            build_symbol_table();
+        }
+        // type unitのsignature索引を先に作成する
+        // DW_FORM_ref_sig8 は後続のtype unitを参照することがある
+        analyze_type_signature(info);
+        analyze_info_.type_sig_tbl = &info.type_sig_tbl;
+
+        // 進捗の分母。analyze_type_signature()で両セクションは読み込み済み(圧縮セクションは展開後のサイズ)
+        Dwarf_Unsigned debug_types_size = 0;
+        Dwarf_Unsigned unused           = 0;
+        dwarf_get_section_max_offsets_d(dw_dbg, &debug_info_size_, &unused, &unused, &unused, &unused, &unused, &unused, &unused, &unused, &unused,
+                                        &unused, &debug_types_size, &unused, &unused, &unused, &unused, &unused, &unused, &unused, &unused);
+        progress_.total_bytes = debug_info_size_ + debug_types_size;
+        progress_.is_finished = false;
+    }
+
+    // budgetが経過するまでunitを解析する。少なくとも1unitは解析する
+    // unitの途中では区切らないので、大きなunitではbudgetを超えることがある
+    // 解析が残っていればtrueを返す
+    bool step(std::chrono::steady_clock::duration budget) {
+        dwarf_profiler::scope prof_scope(analyze_info_.option.profiler, dwarf_profiler::analyze);
+        auto deadline = std::chrono::steady_clock::now() + budget;
+        while (analyze_next_unit()) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    progress_info const &progress() const {
+        return progress_;
+    }
+
+    bool close() {
+        if (dw_dbg == nullptr) {
+            return true;
+        }
+
+        // step()での解析途中なら打ち切る
+        finish_analyze();
+        loc_resolver_.reset(nullptr);
+        cfi_.reset(nullptr);
+        is_cfi_loaded_ = false;
+        symbols_.clear();
+        sections_.close();
+        int result;
+        if (loader_.is_open()) {
+            result = dwarf_object_finish(dw_dbg);
+            loader_.close();
+        } else {
+            result = dwarf_finish(dw_dbg);
+        }
+        // printf("dwarf_finish : result : %d\n", result);
+        dw_dbg = nullptr;
+        return (result == DW_DLV_OK);
+    }
+
+    // 直前のanalyze()でcu_filterにより除外したCU数
+    size_t skipped_cu_count() const {
+        return skipped_cu_count_;
+    }
+
+    // 変数の場所(DW_AT_location)、関数のDW_AT_frame_baseのPC別検索
+    // var_info::location_list/func_info::frame_base_list を持つDIEは初回問い合わせ時にデコードする
+    // close()まで有効
+    dwarf_location_resolver &location_resolver() {
+        return loc_resolver_;
+    }
+
+    // スタック巻き戻し用のCFI
+    // close()まで有効
+    dwarf_cfi &call_frame_info() {
+        if (!is_cfi_loaded_ && dw_dbg != nullptr) {
+            cfi_.reset(dw_dbg);
+            is_cfi_loaded_ = true;
+        }
+        return cfi_;
+    }
 
-        while (!finish) {
+private:
+    // 次のunitを1つ解析する。解析するunitが無ければfalseを返す
+    bool analyze_next_unit() {
+        if (progress_.is_finished) {
+            return false;
+        }
+        if (stop_token_.stop_requested()) {
+            progress_.is_cancelled = true;
+            finish_analyze();
+            return false;
+        }
+
+        Dwarf_Die dw_cu_die;
+        int result;
+        while (true) {
             // init
             analyze_info_.file_list.clear();
             // compile_unit取得
@@ -122,74 +322,156 @@ public:
             // ★cu_infoは使い捨てている。必要に応じてinfo.cu_infoに保持する
             analyze_info_.cu_info_header = dwarf_info::cu_info_header();
             auto &cu_info                = analyze_info_.cu_info_header;
-            result = dwarf_next_cu_header_e(dw_dbg, dw_is_info, &dw_cu_die, &cu_info.cu_header_length, &cu_info.version_stamp, &cu_info.abbrev_offset,
-                                            &cu_info.address_size, &cu_info.length_size, &cu_info.extension_size, &cu_info.type_signature,
-                                            &cu_info.typeoffset, &cu_info.next_cu_header_offset, &cu_info.header_cu_type, &dw_error);
+            result = dwarf_next_cu_header_e(dw_dbg, dw_is_info_, &dw_cu_die, &cu_info.cu_header_length, &cu_info.version_stamp,
+                                            &cu_info.abbrev_offset, &cu_info.address_size, &cu_info.length_size, &cu_info.extension_size,
+                                            &cu_info.type_signature, &cu_info.typeoffset, &cu_info.next_cu_header_offset, &cu_info.header_cu_type,
+                                            &dw_error);
 
             // エラー
             if (result == DW_DLV_ERROR) {
                 utility::error_happen(&dw_error);
-                return;
+                finish_analyze();
+                return false;
             }
             //
             if (result == DW_DLV_NO_ENTRY) {
-                if (dw_is_info == true) {
+                if (dw_is_info_ == true) {
                     /*  Done with .debug_info, now check for
                         .debug_types. */
-                    dw_is_info = false;
+                    dw_is_info_ = false;
                     continue;
                 }
                 /*  No more CUs to read! Never found
                     what we were looking for in either
                     .debug_info or .debug_types. */
-                return;
-            }
-            // オフセットを取得
-            result = dwarf_CU_dieoffset_given_die(dw_cu_die, &cu_info.cu_offset, &dw_error);
-            if (result != DW_DLV_OK) {
-                /*  FAIL */
-                // return result;
-                utility::error_happen(&dw_error);
-                return;
-            }
-            // headerオフセット
-            result = dwarf_die_CU_offset_range(dw_cu_die, &cu_info.cu_header_offset, &cu_info.cu_length, &dw_error);
-            if (result != DW_DLV_OK) {
-                /*  FAIL */
-                // return result;
-                utility::error_happen(&dw_error);
-                return;
+                finish_analyze();
+                return false;
             }
+            break;
+        }
+        auto &info            = *target_info_;
+        auto &cu_info         = analyze_info_.cu_info_header;
+        analyze_info_.is_info = dw_is_info_;
+        // DW_OP_call_ref等のオペランドサイズはCUごとのoffsetサイズ
+        analyze_info_.dw_expr.offset_size(cu_info.length_size);
+        // オフセットを取得
+        result = dwarf_CU_dieoffset_given_die(dw_cu_die, &cu_info.cu_offset, &dw_error);
+        if (result != DW_DLV_OK) {
+            /*  FAIL */
+            // return result;
+            utility::error_happen(&dw_error);
+            finish_analyze();
+            return false;
+        }
+        // headerオフセット
+        result = dwarf_die_CU_offset_range(dw_cu_die, &cu_info.cu_header_offset, &cu_info.cu_length, &dw_error);
+        if (result != DW_DLV_OK) {
+            /*  FAIL */
+            // return result;
+            utility::error_happen(&dw_error);
+            finish_analyze();
+            return false;
+        }
 
-            // DW_TAG_compile_unitを取得できている
-            // 一応チェック
-            Dwarf_Half tag;
-            result = dwarf_tag(dw_cu_die, &tag, &dw_error);
-            if (result != DW_DLV_OK) {
-                utility::error_happen(&dw_error);
+        // DW_TAG_compile_unitを取得できている
+        // 一応チェック
+        Dwarf_Half tag;
+        result = dwarf_tag(dw_cu_die, &tag, &dw_error);
+        if (result != DW_DLV_OK) {
+            utility::error_happen(&dw_error);
+        }
+        if (tag == DW_TAG_compile_unit || tag == DW_TAG_type_unit) {
+            auto prof = analyze_info_.option.profiler;
+            if (prof != nullptr) {
+                prof->begin_cu(cu_info.cu_offset);
             }
-            if (tag == DW_TAG_compile_unit) {
-                analyze_cu(dw_cu_die, info);
+            analyze_cu(dw_cu_die, info);
+            if (prof != nullptr) {
+                prof->end_cu((analyze_info_.cu_info != nullptr) ? &analyze_info_.cu_info->name : nullptr);
             }
-
-            dwarf_dealloc_die(dw_cu_die);
         }
 
-        return;
+        dwarf_dealloc_die(dw_cu_die);
+
+        progress_.cu_count++;
+        progress_.done_bytes = (dw_is_info_ ? 0 : debug_info_size_) + cu_info.next_cu_header_offset;
+        return true;
     }
 
-    bool close() {
-        if (dw_dbg == nullptr) {
-            return true;
+    void finish_analyze() {
+        progress_.is_finished = true;
+        target_info_          = nullptr;
+    }
+
+    // 全unitのheaderを走査してtype unitのsignature -> 型DIE offset の索引を作成する
+    // DIEツリーは辿らない
+    void analyze_type_signature(dwarf_info &info) {
+        dwarf_info::cu_info_header cu_info;
+        Dwarf_Die dw_cu_die;
+        for (Dwarf_Bool dw_is_info : {true, false}) {
+            while (true) {
+                auto result = dwarf_next_cu_header_e(dw_dbg, dw_is_info, &dw_cu_die, &cu_info.cu_header_length, &cu_info.version_stamp,
+                                                     &cu_info.abbrev_offset, &cu_info.address_size, &cu_info.length_size, &cu_info.extension_size,
+                                                     &cu_info.type_signature, &cu_info.typeoffset, &cu_info.next_cu_header_offset,
+                                                     &cu_info.header_cu_type, &dw_error);
+                if (result == DW_DLV_ERROR) {
+                    // イテレータがセクション途中のままだと本解析がセクション先頭から始まらないので、末尾まで進めてから通知する
+                    auto error = dw_error;
+                    dw_error   = nullptr;
+                    skip_remaining_cu(dw_is_info);
+                    dw_error = error;
+                    utility::error_happen(&dw_error);
+                    return;
+                }
+                if (result == DW_DLV_NO_ENTRY) {
+                    // 次回呼び出しはセクション先頭から再開する
+                    break;
+                }
+                // .debug_typesのunitとDWARF5のDW_UT_type/DW_UT_split_type
+                bool is_type_unit = !dw_is_info || cu_info.header_cu_type == DW_UT_type || cu_info.header_cu_type == DW_UT_split_type;
+                if (is_type_unit) {
+                    result = dwarf_die_CU_offset_range(dw_cu_die, &cu_info.cu_header_offset, &cu_info.cu_length, &dw_error);
+                    if (result != DW_DLV_OK) {
+                        utility::error_happen(&dw_error);
+                    } else {
+                        // typeoffsetはunit先頭からのoffset
+                        Dwarf_Off offset = cu_info.cu_header_offset + cu_info.typeoffset;
+                        if (!dw_is_info) {
+                            offset |= dwarf_info::debug_types_offset;
+                        }
+                        info.type_sig_tbl.add(cu_info.type_signature, offset);
+                    }
+                }
+                dwarf_dealloc_die(dw_cu_die);
+            }
         }
+    }
 
-        auto result = dwarf_finish(dw_dbg);
-        // printf("dwarf_finish : result : %d\n", result);
-        dw_dbg = nullptr;
-        return (result == DW_DLV_OK);
+    // CUイテレータをセクション末尾(DW_DLV_NO_ENTRY)まで進める。次回の呼び出しはセクション先頭から始まる
+    // エラーが続いて進まないときは打ち切る
+    void skip_remaining_cu(Dwarf_Bool is_info) {
+        dwarf_info::cu_info_header cu_info;
+        Dwarf_Die dw_cu_die;
+        size_t error_count = 0;
+        while (error_count < 2) {
+            Dwarf_Error error = nullptr;
+            auto result = dwarf_next_cu_header_e(dw_dbg, is_info, &dw_cu_die, &cu_info.cu_header_length, &cu_info.version_stamp,
+                                                 &cu_info.abbrev_offset, &cu_info.address_size, &cu_info.length_size, &cu_info.extension_size,
+                                                 &cu_info.type_signature, &cu_info.typeoffset, &cu_info.next_cu_header_offset,
+                                                 &cu_info.header_cu_type, &error);
+            if (result == DW_DLV_NO_ENTRY) {
+                return;
+            }
+            if (result == DW_DLV_ERROR) {
+                dwarf_dealloc_error(dw_dbg, error);
+                error_count++;
+                continue;
+            }
+            error_count = 0;
+            dwarf_dealloc_die(dw_cu_die);
+        }
     }
 
-private:
     void analyze_machine_architecture(dwarf_info &info) {
         auto result = dwarf_machine_architecture(dw_dbg, &info.machine_arch.ftype, &info.machine_arch.obj_pointersize,
                                                  &info.machine_arch.obj_is_big_endian, &info.machine_arch.obj_machine, &info.machine_arch.obj_flags,
@@ -205,13 +487,34 @@ private:
     }
 
     void analyze_cu(Dwarf_Die dw_cu_die, dwarf_info &info) {
-        // .debug_line解析
-        analyze_debug_line(dw_cu_die);
+        auto prof = analyze_info_.option.profiler;
+        if (prof != nullptr) {
+            prof->count_die(DW_TAG_compile_unit);
+        }
         // 先にcompile_unitの情報を取得
-        analyze_die_TAG_compile_unit(dw_cu_die, info);
+        {
+            dwarf_profiler::scope prof_scope(prof, dwarf_profiler::compile_unit);
+            analyze_die_TAG_compile_unit(dw_cu_die, info);
+        }
+        // 解析対象外のCUは.debug_lineとDIEツリーを読まない
+        // 次のCUへはヘッダのunit長で進むので、残りのコストはCUのDIE1つ分だけになる
+        // type unitは他のCUからDW_FORM_ref_sig8で参照されるので対象外にしない
+        auto filter = analyze_info_.option.cu_filter;
+        if (filter != nullptr && !analyze_info_.cu_info->is_type_unit && !filter->match(*analyze_info_.cu_info)) {
+            info.cu_tbl.container.erase(get_die_offset(dw_cu_die));
+            analyze_info_.cu_info = nullptr;
+            skipped_cu_count_++;
+            return;
+        }
+        // .debug_line解析
+        {
+            dwarf_profiler::scope prof_scope(prof, dwarf_profiler::debug_line);
+            analyze_debug_line(dw_cu_die);
+        }
 
         // https://www.prevanders.net/libdwarfdoc/group__examplecuhdre.html
 
+        dwarf_profiler::scope prof_scope(prof, dwarf_profiler::die_tree);
         bool result = get_child_die(dw_cu_die, [this, &info](Dwarf_Die die) -> bool {
             analyze_die(die, info);
             return true;
@@ -371,6 +674,10 @@ private:
         // DIE offset取得
         Dwarf_Off offset = get_die_offset(die);
 
+        if (analyze_info_.option.profiler != nullptr) {
+            analyze_info_.option.profiler->count_die(tag);
+        }
+
         return die_info_t(tag, offset);
     }
 
@@ -383,6 +690,7 @@ private:
 
         switch (die_info.tag) {
             case DW_TAG_compile_unit:
+            case DW_TAG_type_unit:
                 // compile_unitはrootノードとして別扱いしている
                 // 上流で解析済み
                 return;
@@ -503,7 +811,6 @@ private:
                 // case DW_TAG_imported_unit:
                 // case DW_TAG_condition:
                 // case DW_TAG_shared_type:
-                // case DW_TAG_type_unit:
                 // case DW_TAG_rvalue_reference_type:
                 // case DW_TAG_template_alias:
                 // case DW_TAG_coarray_type:
@@ -521,6 +828,7 @@ private:
         const char *name = 0;
         dwarf_get_TAG_name(die_info.tag, &name);
         fprintf(stderr, "no impl : %s (%u)\n", name, die_info.tag);
+        count_no_impl("DW_TAG", name, die_info.tag);
     }
 
     template <typename T>
@@ -551,11 +859,17 @@ private:
     // }
 
     void analyze_die_TAG_compile_unit(Dwarf_Die die, dwarf_info &dw_info) {
+        // index形式formの参照テーブル
+        // DW_AT_name等がDW_FORM_strxのとき、DW_AT_str_offsets_baseより先に出現することがあるので先に取得する
+        setup_unit_base(die, dw_info);
         // 変数情報作成
-        auto &&info           = dw_info.cu_tbl.make_new_info(analyze_info_.cu_info_header.cu_offset);
+        auto &&info           = dw_info.cu_tbl.make_new_info(get_die_offset(die));
         analyze_info_.cu_info = &info;
         // cu情報取得
+        // DW_TAG_type_unitの属性(DW_AT_language, DW_AT_stmt_list等)はcompile_unitと同じ扱いで取得する
         analyze_DW_AT<DW_TAG_compile_unit>(die, analyze_info_, info);
+        auto cu_type      = analyze_info_.cu_info_header.header_cu_type;
+        info.is_type_unit = !analyze_info_.is_info || cu_type == DW_UT_type || cu_type == DW_UT_split_type;
         // comp_dir修正
         fix_path_separator(analyze_info_.cu_info->comp_dir);
     }
@@ -575,10 +889,16 @@ private:
             if (it != dw_info.var_tbl.container.end()) {
                 auto &base_var = (it->second);
 
-                if (info.location && !base_var.location) {
-                    base_var.location = *info.location;
+                // シンボルテーブルから補完したlocationよりDWARFのlocationを優先する
+                if (info.location && (!base_var.location || base_var.is_symbol_location)) {
+                    base_var.location           = info.location->clone();
+                    base_var.is_symbol_location = false;
                 }
             }
+        } else if (!info.location && !info.location_list && analyze_info_.option.is_symbol_location) {
+            // DW_AT_locationを持たない外部変数(宣言のみ等)はシンボルからアドレスを補完する
+            // 後続の定義DIEがDW_AT_specificationで参照してきたときはそちらのlocationで上書きする
+            fill_symbol_location(info);
         }
 
         return die_info.offset;
@@ -602,7 +922,7 @@ private:
         // 関数情報チェック
         // 関数定義を持つか？
         bool has_define = false;
-        if (info.low_pc || info.high_pc || info.frame_base) {
+        if (info.low_pc || info.high_pc || info.frame_base || info.frame_base_list) {
             // 関数定義を持つ場合、low_pc,high_pc,frame_baseを必ず持つと思われる
             // プログラム内から呼び出されない関数(main関数(エントリーポイント),定義のみ関数)はframe_baseが無いと思われる
             // 暫定でいずれかが出現していたらOKとしている
@@ -616,7 +936,9 @@ private:
         //
         return die_info.offset;
     }
-    void analyze_DW_TAG_subprogram_child(Dwarf_Die die, dwarf_info &dw_info, die_info_t &, func_info &parent_type) {
+    // blockはdieを含むDW_TAG_lexical_block(func_info::block_listのindex)。関数直下のときはnullopt
+    void analyze_DW_TAG_subprogram_child(Dwarf_Die die, dwarf_info &dw_info, die_info_t &, func_info &parent_type,
+                                         std::optional<size_t> block = std::nullopt) {
         // DW_TAG_subroutine_typeのchildとして出現するDW_TAG_*を処理する
         auto die_info = make_die_info(die);
         switch (die_info.tag) {
@@ -630,7 +952,11 @@ private:
 
             case DW_TAG_variable: {
                 auto local_var = analyze_DW_TAG_variable(die, dw_info, die_info);
-                parent_type.local_var_list.push_back(local_var);
+                if (block) {
+                    parent_type.block_list[*block].local_var_list.push_back(local_var);
+                } else {
+                    parent_type.local_var_list.push_back(local_var);
+                }
                 //
                 auto &local_var_item        = dw_info.var_tbl.container[local_var];
                 local_var_item.is_local_var = true;
@@ -642,6 +968,22 @@ private:
                 return;
             }
 
+            case DW_TAG_lexical_block: {
+                // ブロック内の変数はpcがブロックの範囲内のときだけ有効なので、関数直下の変数とは分けて登録する
+                auto index = parent_type.block_list.size();
+                parent_type.block_list.emplace_back();
+                parent_type.block_list[index].parent = block;
+                analyze_lexical_block_range(die, parent_type.block_list[index]);
+                bool result = get_child_die(die, [this, &dw_info, &die_info, &parent_type, index](Dwarf_Die child) -> bool {
+                    analyze_DW_TAG_subprogram_child(child, dw_info, die_info, parent_type, index);
+                    return true;
+                });
+                if (!result) {
+                    utility::error_happen(&dw_error);
+                }
+                return;
+            }
+
             default:
                 break;
         }
@@ -649,6 +991,36 @@ private:
         const char *name = 0;
         dwarf_get_TAG_name(die_info.tag, &name);
         fprintf(stderr, "no impl : DW_TAG_subprogram child : %s (%u)\n", name, die_info.tag);
+        count_no_impl("DW_TAG_subprogram child", name, die_info.tag);
+    }
+
+    // DW_TAG_lexical_blockのpc範囲(DW_AT_low_pc/high_pc/ranges)だけを取得する
+    void analyze_lexical_block_range(Dwarf_Die die, dwarf_info::lexical_block_info &info) {
+        static constexpr Dwarf_Half attr_list[] = {DW_AT_low_pc, DW_AT_high_pc, DW_AT_ranges};
+        for (auto attrnum : attr_list) {
+            Dwarf_Attribute attr = nullptr;
+            int result           = dwarf_attr(die, attrnum, &attr, &analyze_info_.dw_error);
+            if (result == DW_DLV_NO_ENTRY) {
+                continue;
+            }
+            if (result != DW_DLV_OK) {
+                utility::error_happen(&analyze_info_.dw_error);
+            }
+            analyze_info_.dw_attr = attr;
+            switch (attrnum) {
+                case DW_AT_low_pc:
+                    get_DW_AT_low_pc<DW_TAG_lexical_block>(analyze_info_, info);
+                    break;
+                case DW_AT_high_pc:
+                    get_DW_AT_high_pc<DW_TAG_lexical_block>(analyze_info_, info);
+                    break;
+                case DW_AT_ranges:
+                default:
+                    get_DW_AT_ranges<DW_TAG_lexical_block>(analyze_info_, info);
+                    break;
+            }
+            dwarf_dealloc_attribute(attr);
+        }
     }
 
     void analyze_DW_TAG_base_type(Dwarf_Die die, dwarf_info &dw_info, die_info_t &) {
@@ -710,6 +1082,7 @@ private:
         const char *name = 0;
         dwarf_get_TAG_name(die_info.tag, &name);
         fprintf(stderr, "no impl : DW_TAG_enumeration_type child : %s (%u)\n", name, die_info.tag);
+        count_no_impl("DW_TAG_enumeration_type child", name, die_info.tag);
     }
     // DW_TAG_enumerator
     type_child analyze_DW_TAG_enumerator(Dwarf_Die die, dwarf_info &dw_info, die_info_t &) {
@@ -825,6 +1198,7 @@ private:
         const char *name = 0;
         dwarf_get_TAG_name(die_info.tag, &name);
         fprintf(stderr, "no impl : DW_TAG_struct/union child : %s (%u)\n", name, die_info.tag);
+        count_no_impl("DW_TAG_struct/union child", name, die_info.tag);
     }
 
     type_child analyze_DW_TAG_member(Dwarf_Die die, dwarf_info &dw_info, die_info_t &) {
@@ -895,6 +1269,7 @@ private:
         const char *name = 0;
         dwarf_get_TAG_name(die_info.tag, &name);
         fprintf(stderr, "no impl : DW_TAG_array_type child : %s (%u)\n", name, die_info.tag);
+        count_no_impl("DW_TAG_array_type child", name, die_info.tag);
     }
 
     type_child analyze_DW_TAG_subrange_type(Dwarf_Die die, dwarf_info &dw_info, die_info_t &) {
@@ -970,6 +1345,7 @@ private:
         const char *name = 0;
         dwarf_get_TAG_name(die_info.tag, &name);
         fprintf(stderr, "no impl : DW_TAG_subroutine_type child : %s (%u)\n", name, die_info.tag);
+        count_no_impl("DW_TAG_subroutine_type child", name, die_info.tag);
     }
 
     // DW_TAG_formal_parameter
@@ -994,7 +1370,7 @@ private:
                 auto &base_var = (it->second);
 
                 if (info.location && !base_var.location) {
-                    base_var.location = *info.location;
+                    base_var.location = info.location->clone();
                 }
             }
         }
@@ -1054,6 +1430,93 @@ private:
         debug_dump_no_impl_child(die, "DW_TAG_typedef");
     }
 
+    void setup_unit_base(Dwarf_Die die, dwarf_info &dw_info) {
+        auto &unit_base         = analyze_info_.unit_base;
+        auto const &cu_info     = analyze_info_.cu_info_header;
+        unit_base               = dwarf_unit_base();
+        unit_base.is_big_endian = (dw_info.machine_arch.obj_is_big_endian != 0);
+        if (!sections_.is_open() && !loader_.is_open()) {
+            return;
+        }
+        // 再配置可能ファイル(.o)のテーブルは再配置前の値(RELAでは0)なので使わない。libdwarfで解決する
+        if (sections_.is_open() && sections_.file_type() == elf::section_reader::et_rel) {
+            return;
+        }
+        auto debug_str = find_section(".debug_str");
+        if (debug_str != nullptr && debug_str->data != nullptr && !debug_str->is_compressed) {
+            unit_base.debug_str      = reinterpret_cast<char const *>(debug_str->data);
+            unit_base.debug_str_size = static_cast<size_t>(debug_str->size);
+        }
+        // テーブル要素のoffsetサイズはunitのoffsetサイズ(32bit DWARF:4, 64bit DWARF:8)
+        size_t offset_size      = cu_info.length_size;
+        auto str_offsets_base   = get_base_attr(die, DW_AT_str_offsets_base);
+        auto addr_base          = get_base_attr(die, DW_AT_addr_base);
+        auto rnglists_base      = get_base_attr(die, DW_AT_rnglists_base);
+        auto loclists_base      = get_base_attr(die, DW_AT_loclists_base);
+        unit_base.str_offsets   = dwarf_unit_base::make_table(find_section(".debug_str_offsets"), str_offsets_base, offset_size);
+        unit_base.addr          = dwarf_unit_base::make_table(find_section(".debug_addr"), addr_base, cu_info.address_size);
+        unit_base.rnglists      = dwarf_unit_base::make_table(find_section(".debug_rnglists"), rnglists_base, offset_size);
+        unit_base.loclists      = dwarf_unit_base::make_table(find_section(".debug_loclists"), loclists_base, offset_size);
+        unit_base.rnglists_base = rnglists_base.value_or(0);
+        unit_base.loclists_base = loclists_base.value_or(0);
+    }
+
+    void build_symbol_table() {
+        // 再配置可能ファイル(ET_REL)のst_valueはセクション先頭からのoffsetでアドレスではないので補完に使わない
+        if (loader_.is_open()) {
+            if (loader_.reader().file_type() == elf::section_reader::et_rel) {
+                return;
+            }
+            symbols_.build(loader_.sections(), loader_.reader().is_64bit(), loader_.reader().is_big_endian());
+        } else if (sections_.is_open()) {
+            if (sections_.file_type() == elf::section_reader::et_rel) {
+                return;
+            }
+            symbols_.build(sections_.sections(), sections_.is_64bit(), sections_.is_big_endian());
+        }
+    }
+
+    void fill_symbol_location(var_info &info) {
+        if (!info.external || info.is_parameter || info.is_local_var) {
+            return;
+        }
+        // シンボル名はlinkage name(C++はmangled name)、Cは変数名と同じ
+        auto sym = symbols_.find(info.linkage_name);
+        if (sym == nullptr) {
+            sym = symbols_.find(info.name);
+        }
+        if (sym == nullptr) {
+            return;
+        }
+        info.location           = dw_op_value(static_cast<Dwarf_Unsigned>(sym->address));
+        info.is_symbol_location = true;
+        info.symbol_size        = sym->size;
+    }
+
+    elf::section_reader::section const *find_section(std::string_view name) const {
+        if (loader_.is_open()) {
+            return loader_.find(name);
+        }
+        return sections_.find(name);
+    }
+
+    // DW_AT_*_base(DW_FORM_sec_offset)を取得する
+    std::optional<Dwarf_Off> get_base_attr(Dwarf_Die die, Dwarf_Half attrnum) {
+        Dwarf_Attribute dw_attr = nullptr;
+        int result              = dwarf_attr(die, attrnum, &dw_attr, &dw_error);
+        if (result != DW_DLV_OK) {
+            return std::nullopt;
+        }
+        Dwarf_Off offset   = 0;
+        Dwarf_Bool is_info = true;
+        result             = dwarf_global_formref_b(dw_attr, &offset, &is_info, &dw_error);
+        dwarf_dealloc_attribute(dw_attr);
+        if (result != DW_DLV_OK) {
+            return std::nullopt;
+        }
+        return offset;
+    }
+
     Dwarf_Off get_die_offset(Dwarf_Die die) {
         int res;
         Dwarf_Off dw_global_offset = 0;
@@ -1063,7 +1526,10 @@ private:
         if (res != DW_DLV_OK) {
             utility::error_happen(&dw_error);
         }
-        //
+        // .debug_types内のoffsetは.debug_infoと区別する
+        if (!analyze_info_.is_info) {
+            dw_global_offset |= dwarf_info::debug_types_offset;
+        }
         return dw_global_offset;
     }
 
@@ -1075,6 +1541,12 @@ private:
         }
     }
 
+    void count_no_impl(char const *where, char const *name, unsigned int code) {
+        if (analyze_info_.option.profiler != nullptr) {
+            analyze_info_.option.profiler->count_no_impl(where, name, code);
+        }
+    }
+
     void debug_dump_no_impl_child(Dwarf_Die die, char const *parent_tag) {
         // child dieチェック
         bool result = get_child_die(die, [this, parent_tag](Dwarf_Die child) -> bool {
@@ -1089,6 +1561,9 @@ private:
             const char *name = 0;
             dwarf_get_TAG_name(tag, &name);
             fprintf(stderr, "no impl : %s child : %s (%u)\n", parent_tag, name, tag);
+            if (analyze_info_.option.profiler != nullptr) {
+                count_no_impl((std::string(parent_tag) + " child").c_str(), name, tag);
+            }
             return true;
         });
         // 異常が発生していたらfalseが返される
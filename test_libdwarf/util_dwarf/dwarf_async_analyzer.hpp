@@ -0,0 +1,163 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+#include "dwarf_analyze_info.hpp"
+#include "dwarf_analyzer.hpp"
+#include "dwarf_info.hpp"
+
+namespace util_dwarf {
+
+// dwarf_analyzer::analyze をワーカースレッドで実行する
+// unitを1つ解析する毎に進捗を更新する。cancel()またはデストラクタで中断する
+// ワーカーはunitの解析中だけinfoをロックするので、read()からは解析済みunitの分だけ揃った状態が見える
+// analyzer, infoは本オブジェクトより長く生存すること。実行中はanalyzerを直接操作しない
+class dwarf_async_analyzer {
+public:
+    using progress_info     = dwarf_analyzer::progress_info;
+    using progress_callback = std::function<void(progress_info const &)>;
+
+private:
+    dwarf_analyzer &analyzer_;
+    dwarf_info &info_;
+    // analyzer_, info_ の排他
+    mutable std::mutex mtx_;
+    // 進捗は解析中のunitを待たずに読めるように別のロックで保護する
+    mutable std::mutex progress_mtx_;
+    progress_info progress_;
+    bool is_running_;
+    // ワーカーで発生した例外。wait()で再送出する
+    std::exception_ptr error_;
+    progress_callback on_progress_;
+    // 他のメンバより先に破棄してワーカーを停止させる
+    std::jthread worker_;
+
+public:
+    dwarf_async_analyzer(dwarf_analyzer &analyzer, dwarf_info &info)
+        : analyzer_(analyzer),
+          info_(info),
+          mtx_(),
+          progress_mtx_(),
+          progress_(),
+          is_running_(false),
+          error_(),
+          on_progress_(),
+          worker_() {
+    }
+    ~dwarf_async_analyzer();
+
+    // unitを1つ解析する毎にワーカースレッドから呼ばれる
+    // start()より前に設定する
+    void on_progress(progress_callback callback) {
+        on_progress_ = std::move(callback);
+    }
+
+    // 解析を開始する。前回の解析が実行中ならfalseを返す
+    bool start(dwarf_analyze_option opt) {
+        if (is_running()) {
+            fprintf(stderr, "dwarf analysis is already running\n");
+            return false;
+        }
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+        {
+            std::lock_guard<std::mutex> lock(progress_mtx_);
+            progress_   = progress_info();
+            is_running_ = true;
+            error_      = nullptr;
+        }
+        worker_ = std::jthread([this, opt](std::stop_token stop) { run(opt, stop); });
+        return true;
+    }
+
+    // 中断を要求する。解析中のunitは最後まで解析してから停止する
+    void cancel() {
+        worker_.request_stop();
+    }
+
+    // 解析の終了を待つ。ワーカーで例外が発生していたら再送出する
+    void wait() {
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(progress_mtx_);
+            std::swap(error, error_);
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    bool is_running() const {
+        std::lock_guard<std::mutex> lock(progress_mtx_);
+        return is_running_;
+    }
+
+    progress_info progress() const {
+        std::lock_guard<std::mutex> lock(progress_mtx_);
+        return progress_;
+    }
+
+    // 解析途中の結果を参照する
+    // funcの実行中はワーカーが次のunitへ進まないので、長い処理は必要な情報をコピーしてから行う
+    template <typename Func>
+    decltype(auto) read(Func &&func) const {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return func(static_cast<dwarf_info const &>(info_));
+    }
+
+private:
+    void run(dwarf_analyze_option opt, std::stop_token stop) {
+        try {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                analyzer_.begin(info_, opt, stop);
+            }
+            publish();
+            bool is_continue = true;
+            while (is_continue) {
+                {
+                    // 1unitずつロックを手放してread()に譲る
+                    std::lock_guard<std::mutex> lock(mtx_);
+                    is_continue = analyzer_.step(std::chrono::steady_clock::duration::zero());
+                }
+                publish();
+                std::this_thread::yield();
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(progress_mtx_);
+            error_ = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(progress_mtx_);
+        progress_.is_finished = true;
+        is_running_           = false;
+    }
+
+    void publish() {
+        // analyzer_の進捗はワーカーだけが更新する
+        auto progress = analyzer_.progress();
+        {
+            std::lock_guard<std::mutex> lock(progress_mtx_);
+            progress_ = progress;
+        }
+        if (on_progress_) {
+            on_progress_(progress);
+        }
+    }
+};
+// jthreadの停止/joinを含み展開しきれないので、inline指定しない(-Winline)
+// worker_は最後に宣言しているので最初に破棄され、他のメンバより先にワーカーが停止する
+dwarf_async_analyzer::~dwarf_async_analyzer() {
+}
+
+}  // namespace util_dwarf
@@ -0,0 +1,137 @@
+#pragma once
+
+#define LIBDWARF_STATIC 1
+#include <dwarf.h>
+#include <libdwarf.h>
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+namespace util_dwarf {
+
+// 出力に必要なフィールドから、DIE種別毎に解析するattributeを決める
+// 全attributeを解析しないときは、許可したattributeだけをdwarf_attrで取得し、それ以外はDwarf_Attributeも作らない
+// アドレス/型/サイズ/名前等のメモリレイアウトに必要なattributeは常に解析する
+class dwarf_attr_filter {
+public:
+    using type = uint32_t;
+
+    // 出力フィールド
+    enum field : type
+    {
+        none,
+        decl_file   = 1 << 0,  // 宣言位置のファイル,行(DW_AT_decl_file, DW_AT_decl_line)
+        decl_column = 1 << 1,  // 宣言位置の桁(DW_AT_decl_column)
+        const_value = 1 << 2,  // 変数の定数値(DW_AT_const_value)
+        func_frame  = 1 << 3,  // 関数のDW_AT_frame_base/DW_AT_return_addr, 引数のDW_AT_location
+        misc        = 1 << 4,  // 上記以外のすべて(DW_AT_sibling, DW_AT_accessibility, ベンダー拡張等)
+        all         = ~type(0),
+    };
+
+    // attributeの許可リストを持つDIE種別
+    enum tag_class : uint8_t
+    {
+        unit,      // DW_TAG_compile_unit, DW_TAG_type_unit : CU毎に1つなので常に全attributeを解析する
+        variable,  // DW_TAG_variable
+        function,  // DW_TAG_subprogram, DW_TAG_formal_parameter
+        type_,     // 型情報とその子(member, subrange, enumerator等)
+        tag_class_max,
+    };
+
+    static constexpr tag_class classify(Dwarf_Half tag) {
+        switch (tag) {
+            case DW_TAG_compile_unit:
+            case DW_TAG_type_unit:
+                return unit;
+            case DW_TAG_variable:
+                return variable;
+            case DW_TAG_subprogram:
+            case DW_TAG_formal_parameter:
+                return function;
+            default:
+                return type_;
+        }
+    }
+
+private:
+    // DW_AT_lo_user(0x2000)以上のベンダー拡張はmisc扱い
+    static constexpr size_t attr_max = 0x100;
+
+    std::array<std::bitset<attr_max>, tag_class_max> allow_;
+    // allow_と同じ内容のリスト(追加順)
+    std::array<std::vector<Dwarf_Half>, tag_class_max> allow_list_;
+    bool is_misc_;
+
+public:
+    dwarf_attr_filter(type fields = all) : allow_(), allow_list_(), is_misc_(false) {
+        reset(fields);
+    }
+
+    void reset(type fields) {
+        is_misc_ = ((fields & misc) != 0);
+        for (auto &list : allow_list_) {
+            list.clear();
+        }
+        for (auto &allow : allow_) {
+            if (is_misc_) {
+                allow.set();
+            } else {
+                allow.reset();
+            }
+        }
+        if (is_misc_) {
+            return;
+        }
+        allow_[unit].set();
+        // メモリレイアウトの構築に必要なattribute
+        add(variable, {DW_AT_name, DW_AT_linkage_name, DW_AT_type, DW_AT_location, DW_AT_external, DW_AT_declaration, DW_AT_specification,
+                       DW_AT_endianity});
+        add(function, {DW_AT_name, DW_AT_linkage_name, DW_AT_type, DW_AT_external, DW_AT_declaration, DW_AT_low_pc, DW_AT_high_pc});
+        add(type_, {DW_AT_name, DW_AT_type, DW_AT_byte_size, DW_AT_bit_offset, DW_AT_bit_size, DW_AT_data_bit_offset, DW_AT_data_member_location,
+                    DW_AT_upper_bound, DW_AT_lower_bound, DW_AT_count, DW_AT_encoding, DW_AT_declaration, DW_AT_signature, DW_AT_endianity,
+                    DW_AT_address_class, DW_AT_prototyped, DW_AT_const_value});
+        // 出力フィールド毎のattribute
+        if ((fields & decl_file) != 0) {
+            for (auto cls : {variable, function, type_}) {
+                add(cls, {DW_AT_decl_file, DW_AT_decl_line});
+            }
+        }
+        if ((fields & decl_column) != 0) {
+            for (auto cls : {variable, function, type_}) {
+                add(cls, {DW_AT_decl_column});
+            }
+        }
+        if ((fields & const_value) != 0) {
+            add(variable, {DW_AT_const_value});
+        }
+        if ((fields & func_frame) != 0) {
+            add(function, {DW_AT_frame_base, DW_AT_return_addr, DW_AT_location});
+        }
+    }
+
+    // 全attributeを解析するか
+    bool is_all() const {
+        return is_misc_;
+    }
+
+    // 許可したattributeの一覧。is_all()またはunitのときは使わない(すべて許可)
+    template <Dwarf_Half DW_TAG>
+    std::vector<Dwarf_Half> const &allowed_list() const {
+        return allow_list_[classify(DW_TAG)];
+    }
+
+private:
+    void add(tag_class cls, std::initializer_list<Dwarf_Half> attr_list) {
+        for (auto attr : attr_list) {
+            if (!allow_[cls].test(attr)) {
+                allow_[cls].set(attr);
+                allow_list_[cls].push_back(attr);
+            }
+        }
+    }
+};
+
+}  // namespace util_dwarf
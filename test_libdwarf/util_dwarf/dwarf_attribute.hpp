@@ -21,9 +21,15 @@ namespace util_dwarf {
 // exprloc, loclistptr
 template <Dwarf_Half DW_TAG, typename T>
 void get_DW_AT_location(dwarf_analyze_info &dw_info, T &info) {
+    // 位置リストは参照だけ記録してデコードは dwarf_location_resolver で遅延実行する
+    auto list = get_DW_FORM_loclist(dw_info);
+    if (list) {
+        info.location_list = *list;
+        return;
+    }
     auto result = get_DW_FORM<Dwarf_Unsigned>(dw_info);
     if (result) {
-        info.location = *result;
+        info.location = std::move(*result);
     }
 }
 // DW_AT_data_member_location
@@ -56,6 +62,7 @@ void get_DW_AT_high_pc(dwarf_analyze_info &dw_info, T &info) {
     } else {
         info.high_pc = 0;
     }
+    info.high_pc_is_offset = is_DW_FORM_constant_class(dw_info);
 }
 
 // DW_AT_language
@@ -72,13 +79,10 @@ void get_DW_AT_language(dwarf_analyze_info &dw_info, T &info) {
 // DW_AT_comp_dir
 template <Dwarf_Half DW_TAG, typename T>
 void get_DW_AT_comp_dir(dwarf_analyze_info &dw_info, T &info) {
-    char *str = nullptr;
-    int result;
-    result = dwarf_formstring(dw_info.dw_attr, &str, &dw_info.dw_error);
-    if (result != DW_DLV_OK) {
-        utility::error_happen(&dw_info.dw_error);
+    auto str = get_DW_FORM_string(dw_info);
+    if (str != nullptr) {
+        info.comp_dir = str;
     }
-    info.comp_dir = str;
 }
 
 // DW_AT_const_value
@@ -95,13 +99,10 @@ void get_DW_AT_const_value(dwarf_analyze_info &dw_info, T &info) {
 // DW_AT_name
 template <Dwarf_Half DW_TAG, typename T>
 void get_DW_AT_name(dwarf_analyze_info &dw_info, T &info) {
-    char *str = nullptr;
-    int result;
-    result = dwarf_formstring(dw_info.dw_attr, &str, &dw_info.dw_error);
-    if (result != DW_DLV_OK) {
-        utility::error_happen(&dw_info.dw_error);
+    auto str = get_DW_FORM_string(dw_info);
+    if (str != nullptr) {
+        info.name = str;
     }
-    info.name = str;
 }
 // template <Dwarf_Half DW_TAG>
 // void get_DW_AT_name(Dwarf_Attribute dw_attr, var_info_t &info) {
@@ -169,23 +170,19 @@ void get_DW_AT_stmt_list(dwarf_analyze_info &dw_info, T &info) {
 // DW_AT_linkage_name
 template <Dwarf_Half DW_TAG, typename T>
 void get_DW_AT_linkage_name(dwarf_analyze_info &dw_info, T &info) {
-    char *str = nullptr;
-    int result;
-    result = dwarf_formstring(dw_info.dw_attr, &str, &dw_info.dw_error);
-    if (result != DW_DLV_OK) {
-        utility::error_happen(&dw_info.dw_error);
+    auto str = get_DW_FORM_string(dw_info);
+    if (str != nullptr) {
+        info.linkage_name = str;
     }
-    info.linkage_name = str;
 }
 
 // DW_AT_signature
+// DW_FORM_ref_sig8はtype unitの索引で型定義DIEのoffsetに変換済み
 template <Dwarf_Half DW_TAG, typename T>
 void get_DW_AT_signature(dwarf_analyze_info &dw_info, T &info) {
     auto result = get_DW_FORM<Dwarf_Unsigned>(dw_info);
     if (result && result->is_immediate) {
-        info.signature = std::get<Dwarf_Unsigned>(result->value);
-    } else {
-        info.signature = 0;
+        info.definition = std::get<Dwarf_Unsigned>(result->value);
     }
 }
 
@@ -226,29 +223,31 @@ template <Dwarf_Half DW_TAG, typename T>
 void get_DW_AT_return_addr(dwarf_analyze_info &dw_info, T &info) {
     auto result = get_DW_FORM<Dwarf_Unsigned>(dw_info);
     if (result) {
-        info.return_addr = *result;
+        info.return_addr = std::move(*result);
     }
 }
 
 // DW_AT_frame_base
 template <Dwarf_Half DW_TAG, typename T>
 void get_DW_AT_frame_base(dwarf_analyze_info &dw_info, T &info) {
+    auto list = get_DW_FORM_loclist(dw_info);
+    if (list) {
+        info.frame_base_list = *list;
+        return;
+    }
     auto result = get_DW_FORM<Dwarf_Unsigned>(dw_info);
     if (result) {
-        info.frame_base = *result;
+        info.frame_base = std::move(*result);
     }
 }
 
 // DW_AT_producer
 template <Dwarf_Half DW_TAG, typename T>
 void get_DW_AT_producer(dwarf_analyze_info &dw_info, T &info) {
-    char *str = nullptr;
-    int result;
-    result = dwarf_formstring(dw_info.dw_attr, &str, &dw_info.dw_error);
-    if (result != DW_DLV_OK) {
-        utility::error_happen(&dw_info.dw_error);
+    auto str = get_DW_FORM_string(dw_info);
+    if (str != nullptr) {
+        info.producer = str;
     }
-    info.producer = str;
 }
 
 // DW_AT_prototyped
@@ -393,11 +392,16 @@ void get_DW_AT_use_UTF8(dwarf_analyze_info &dw_info, T &info) {
 // DW_AT_ranges
 template <Dwarf_Half DW_TAG, typename T>
 void get_DW_AT_ranges(dwarf_analyze_info &dw_info, T &info) {
-    auto result = get_DW_FORM<Dwarf_Unsigned>(dw_info);
-    if (result && result->is_immediate) {
-        info.ranges = std::get<Dwarf_Unsigned>(result->value);
+    if constexpr (std::is_same_v<T, dwarf_info::lexical_block_info>) {
+        // lexical_blockはpcの判定に使うのでアドレス範囲に展開する
+        get_DW_FORM_rangelist(dw_info, info.range_list);
     } else {
-        info.ranges = 0;
+        auto result = get_DW_FORM<Dwarf_Unsigned>(dw_info);
+        if (result && result->is_immediate) {
+            info.ranges = std::get<Dwarf_Unsigned>(result->value);
+        } else {
+            info.ranges = 0;
+        }
     }
 }
 
@@ -767,12 +771,16 @@ void analyze_DW_AT_impl(Dwarf_Attribute dw_attr, Dwarf_Half attrnum, dwarf_analy
             }
             return;
 
-        case DW_AT_string_length_bit_size:
-        case DW_AT_string_length_byte_size:
-        case DW_AT_rank:
         case DW_AT_str_offsets_base:
         case DW_AT_addr_base:
         case DW_AT_rnglists_base:
+        case DW_AT_loclists_base:
+            // unitの解析開始時に取得済み(dwarf_unit_base)
+            return;
+
+        case DW_AT_string_length_bit_size:
+        case DW_AT_string_length_byte_size:
+        case DW_AT_rank:
         case DW_AT_dwo_id:
         case DW_AT_dwo_name:
         case DW_AT_reference:
@@ -796,7 +804,6 @@ void analyze_DW_AT_impl(Dwarf_Attribute dw_attr, Dwarf_Half attrnum, dwarf_analy
         case DW_AT_export_symbols:
         case DW_AT_deleted:
         case DW_AT_defaulted:
-        case DW_AT_loclists_base:
         default:
             break;
     }
@@ -805,6 +812,24 @@ void analyze_DW_AT_impl(Dwarf_Attribute dw_attr, Dwarf_Half attrnum, dwarf_analy
     const char *attrname = nullptr;
     dwarf_get_AT_name(attrnum, &attrname);
     fprintf(stderr, "no impl : analyze_DW_AT_impl : %s (%u)\n", attrname, attrnum);
+    if (dw_info.option.profiler != nullptr) {
+        dw_info.option.profiler->count_no_impl("DW_AT", attrname, attrnum);
+    }
+}
+
+// 1つのattributeを解析する
+template <Dwarf_Half DW_TAG, typename T>
+void analyze_DW_AT_attr(Dwarf_Attribute dw_attr, Dwarf_Half attrnum, dwarf_analyze_info &dw_info, T &info) {
+    // DW_FORM_*集計
+    if (dw_info.option.profiler != nullptr) {
+        Dwarf_Half form = 0;
+        if (dwarf_whatform(dw_attr, &form, &dw_info.dw_error) == DW_DLV_OK) {
+            dw_info.option.profiler->count_form(form);
+        }
+    }
+
+    // DW_AT_*解析
+    analyze_DW_AT_impl<DW_TAG>(dw_attr, attrnum, dw_info, info);
 }
 
 /// @brief 対象DIEに紐づくattributeを解析して情報を取得する
@@ -822,6 +847,24 @@ void analyze_DW_AT(Dwarf_Die die, dwarf_analyze_info &dw_info, T &info) {
     Dwarf_Signed i = 0;
     int errv;
 
+    // 一部のattributeだけを解析するときは、dwarf_attrlistで全attributeを作らずに許可したものだけを取得する
+    if (!dw_info.attr_filter.is_all() && dwarf_attr_filter::classify(DW_TAG) != dwarf_attr_filter::unit) {
+        for (auto attrnum : dw_info.attr_filter.allowed_list<DW_TAG>()) {
+            Dwarf_Attribute dw_attr = nullptr;
+            errv                    = dwarf_attr(die, attrnum, &dw_attr, &dw_info.dw_error);
+            if (errv == DW_DLV_NO_ENTRY) {
+                continue;
+            }
+            if (errv == DW_DLV_ERROR) {
+                utility::error_happen(&dw_info.dw_error);
+                return;
+            }
+            analyze_DW_AT_attr<DW_TAG>(dw_attr, attrnum, dw_info, info);
+            dwarf_dealloc_attribute(dw_attr);
+        }
+        return;
+    }
+
     errv = dwarf_attrlist(die, &atlist, &atcount, &dw_info.dw_error);
     if (errv == DW_DLV_NO_ENTRY) {
         // DW_AT_* なし
@@ -852,8 +895,7 @@ void analyze_DW_AT(Dwarf_Die die, dwarf_analyze_info &dw_info, T &info) {
         // dwarf_get_AT_name(attrnum, &attrname);
         // printf("Attribute[%ld], value %u name %s\n", (long int)i, attrnum, attrname);
 
-        // DW_AT_*解析
-        analyze_DW_AT_impl<DW_TAG>(atlist[i], attrnum, dw_info, info);
+        analyze_DW_AT_attr<DW_TAG>(atlist[i], attrnum, dw_info, info);
 
         dwarf_dealloc_attribute(atlist[i]);
         atlist[i] = 0;
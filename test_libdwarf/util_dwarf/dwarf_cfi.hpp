@@ -0,0 +1,1021 @@
+#pragma once
+
+#define LIBDWARF_STATIC 1
+#include <dwarf.h>
+#include <libdwarf.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "LEB128.hpp"
+#include "dwarf_expr_ir.hpp"
+#include "elf.hpp"
+#include "func_index.hpp"
+#include "target_snapshot.hpp"
+#include "utility.hpp"
+
+namespace util_dwarf {
+
+// レジスタ復元ルール(DWARF5 6.4.1)
+struct cfi_rule
+{
+    enum kind : uint8_t
+    {
+        undefined,       // 復元不可
+        same_value,      // 呼び出し先で変更なし
+        saved_offset,    // CFA+offset に保存されている
+        val_offset,      // CFA+offset が値
+        reg,             // src_reg の値
+        expression,      // exprの評価結果(CFAを積んで評価)のアドレスに保存されている
+        val_expression,  // exprの評価結果が値
+    };
+
+    uint16_t reg_no;
+    kind type;
+    uint16_t src_reg;
+    int64_t offset;
+    dw_expr_program const *expr;
+
+    cfi_rule(uint16_t reg_no_, kind type_) : reg_no(reg_no_), type(type_), src_reg(0), offset(0), expr(nullptr) {
+    }
+
+    bool operator==(cfi_rule const &rhs) const {
+        return reg_no == rhs.reg_no && type == rhs.type && src_reg == rhs.src_reg && offset == rhs.offset && expr == rhs.expr;
+    }
+};
+
+// FDE 1つ分のCFIテーブル
+// 行ごとにはCFAルールとルール配列の範囲だけを持ち、ルール本体はrule_listで共有する
+class cfi_row_table {
+public:
+    struct row
+    {
+        Dwarf_Addr loc;  // この行が有効になるアドレス
+        uint16_t cfa_reg;
+        int64_t cfa_offset;
+        dw_expr_program const *cfa_expr;  // DW_CFA_def_cfa_expression のとき
+        uint32_t rule_begin;
+        uint32_t rule_count;
+    };
+
+    Dwarf_Addr low_pc;
+    Dwarf_Addr high_pc;
+    uint16_t ra_reg;  // 戻りアドレスを表すレジスタ(CIEのreturn_address_register)
+    std::vector<row> row_list;
+    std::vector<cfi_rule> rule_list;
+
+    cfi_row_table() : low_pc(0), high_pc(0), ra_reg(0), row_list(), rule_list() {
+    }
+
+    // pcで有効な行を返す。範囲外のときはnullptr
+    row const *find(Dwarf_Addr pc) const {
+        if (pc < low_pc || high_pc <= pc) {
+            return nullptr;
+        }
+        auto it = std::upper_bound(row_list.begin(), row_list.end(), pc, [](Dwarf_Addr value, row const &elem) { return value < elem.loc; });
+        if (it == row_list.begin()) {
+            return nullptr;
+        }
+        return &*(it - 1);
+    }
+    std::span<cfi_rule const> rules(row const &r) const {
+        return std::span<cfi_rule const>(rule_list.data() + r.rule_begin, r.rule_count);
+    }
+};
+
+// バックトレースの1フレーム
+struct cfi_frame
+{
+    Dwarf_Addr pc;
+    Dwarf_Addr cfa;                 // 巻き戻せなかったフレームは0
+    func_index::entry const *func;  // 関数索引を指定しないとき、該当なしのときはnullptr
+    register_snapshot regs;         // このフレームで復元できたレジスタ
+
+    cfi_frame(Dwarf_Addr pc_, Dwarf_Addr cfa_, func_index::entry const *func_, register_snapshot const &regs_)
+        : pc(pc_), cfa(cfa_), func(func_), regs(regs_) {
+    }
+};
+
+// .debug_frame/.eh_frame のCFI(Call Frame Information)
+// 全FDEをPC範囲で索引化し、FDEごとのCFIテーブルは初回参照時に構築してキャッシュする
+class dwarf_cfi {
+public:
+    // レジスタ番号なし
+    static constexpr uint16_t no_reg = 0xFFFF;
+
+    // CIEの情報
+    struct cie_param
+    {
+        Dwarf_Unsigned code_align;
+        Dwarf_Signed data_align;
+        Dwarf_Half ra_reg;
+        Dwarf_Small *init_instr;
+        Dwarf_Unsigned init_instr_len;
+        bool is_eh;
+        // .eh_frame: FDE内アドレスのエンコード(augmentation 'R', DW_EH_PE_*)
+        uint8_t fde_encoding;
+        // CIEのoffsetサイズ(DW_CFA_*expressionの式のコンパイルに使う)
+        size_t offset_size;
+        // offsetサイズに対応する式キャッシュ。build_table()で設定する
+        dw_expr_cache *expr_cache;
+
+        cie_param()
+            : code_align(0),
+              data_align(0),
+              ra_reg(0),
+              init_instr(nullptr),
+              init_instr_len(0),
+              is_eh(false),
+              fde_encoding(DW_EH_PE_absptr),
+              offset_size(4),
+              expr_cache(nullptr) {
+        }
+    };
+
+private:
+    struct fde_entry
+    {
+        Dwarf_Addr low_pc;
+        Dwarf_Addr high_pc;
+        Dwarf_Fde fde;
+        bool is_eh;
+        // FDE先頭のセクションデータ上の位置とセクション内offset(pcrelエンコードの基点算出用)
+        Dwarf_Small const *fde_bytes;
+        Dwarf_Off fde_offset;
+        std::unique_ptr<cfi_row_table> table;
+
+        fde_entry(Dwarf_Addr low, Dwarf_Addr high, Dwarf_Fde fde_, bool is_eh_, Dwarf_Small const *fde_bytes_, Dwarf_Off fde_offset_)
+            : low_pc(low), high_pc(high), fde(fde_), is_eh(is_eh_), fde_bytes(fde_bytes_), fde_offset(fde_offset_), table() {
+        }
+    };
+    // dwarf_get_fde_list* の取得結果。解放用に保持する
+    struct fde_list
+    {
+        Dwarf_Cie *cie_data;
+        Dwarf_Signed cie_count;
+        Dwarf_Fde *fde_data;
+        Dwarf_Signed fde_count;
+
+        fde_list() : cie_data(nullptr), cie_count(0), fde_data(nullptr), fde_count(0) {
+        }
+    };
+    // CFIテーブル構築中の状態
+    struct cfa_state
+    {
+        uint16_t cfa_reg;
+        int64_t cfa_offset;
+        dw_expr_program const *cfa_expr;
+        std::vector<cfi_rule> rules;  // reg_no昇順
+
+        cfa_state() : cfa_reg(0), cfa_offset(0), cfa_expr(nullptr), rules() {
+        }
+    };
+    Dwarf_Debug dw_dbg_;
+    Dwarf_Error dw_error_;
+    fde_list debug_frame_;
+    fde_list eh_frame_;
+    // low_pc昇順
+    std::vector<fde_entry> fde_list_;
+    size_t pointer_size_;
+    bool is_big_endian_;
+    uint16_t sp_reg_;
+    // .eh_frameのアドレス(DW_EH_PE_pcrelの基点)
+    std::optional<Dwarf_Addr> eh_frame_addr_;
+    // (アドレスサイズ, offsetサイズ) ごとの式キャッシュ
+    // コンパイル結果は構築済みCFIテーブルから参照するため、reset()まで破棄しない
+    std::map<std::pair<size_t, size_t>, dw_expr_cache> cache_map_;
+    dw_expr_evaluator evaluator_;
+    size_t table_count_;
+
+public:
+    dwarf_cfi()
+        : dw_dbg_(nullptr),
+          dw_error_(nullptr),
+          debug_frame_(),
+          eh_frame_(),
+          fde_list_(),
+          pointer_size_(4),
+          is_big_endian_(false),
+          sp_reg_(no_reg),
+          eh_frame_addr_(),
+          cache_map_(),
+          evaluator_(),
+          table_count_(0) {
+    }
+    ~dwarf_cfi() {
+        reset(nullptr);
+    }
+    dwarf_cfi(dwarf_cfi const &)            = delete;
+    dwarf_cfi &operator=(dwarf_cfi const &) = delete;
+
+    // dbgのCFIを読み込む。dbgがnullptrのときは解放のみ行う
+    // dwarf_finish() より前に reset(nullptr) すること
+    void reset(Dwarf_Debug dbg) {
+        if (dw_dbg_ != nullptr) {
+            dealloc(debug_frame_);
+            dealloc(eh_frame_);
+        }
+        fde_list_.clear();
+        cache_map_.clear();
+        eh_frame_addr_.reset();
+        table_count_ = 0;
+        dw_dbg_      = dbg;
+        if (dw_dbg_ == nullptr) {
+            return;
+        }
+        load_machine_architecture();
+        load_eh_frame_addr();
+        load(debug_frame_, false);
+        load(eh_frame_, true);
+        // 同じ範囲は.debug_frameを優先する(stable_sortで先に登録した方が前になる)
+        std::stable_sort(fde_list_.begin(), fde_list_.end(), [](fde_entry const &lhs, fde_entry const &rhs) { return lhs.low_pc < rhs.low_pc; });
+    }
+
+    // スタックポインタのDWARFレジスタ番号
+    // 呼び出し元のスタックポインタはCFAとして復元する。未知のアーキテクチャではno_reg
+    void sp_reg(uint16_t reg_no) {
+        sp_reg_ = reg_no;
+    }
+    uint16_t sp_reg() const {
+        return sp_reg_;
+    }
+
+    // pcを含むFDEのCFIテーブルを返す。該当なしのときはnullptr
+    cfi_row_table const *find(Dwarf_Addr pc) {
+        auto entry = find_fde(pc);
+        if (entry == nullptr) {
+            return nullptr;
+        }
+        if (!entry->table) {
+            entry->table = build_table(*entry);
+            table_count_++;
+        }
+        return entry->table.get();
+    }
+
+    // 現在フレームのCFA(DW_OP_call_frame_cfa の値)を返す
+    // is_top: 停止位置のフレーム(例外発生/割り込み位置)のときtrue
+    std::optional<uint64_t> get_cfa(register_snapshot const &regs, memory_image const &mem, bool is_top) {
+        auto pc    = lookup_pc(regs, is_top);
+        auto table = find(pc);
+        if (table == nullptr) {
+            return std::nullopt;
+        }
+        auto row = table->find(pc);
+        if (row == nullptr) {
+            return std::nullopt;
+        }
+        dw_expr_context ctx;
+        ctx.read_reg = [&regs](uint64_t reg_no) { return regs.get(reg_no); };
+        ctx.read_mem = [&mem](uint64_t addr, size_t size) { return mem.read(addr, size); };
+        return eval_cfa(*row, regs, ctx);
+    }
+
+    // 1フレーム巻き戻す
+    // regs: 現在フレームのレジスタ, is_top: 停止位置のフレームのときtrue
+    // 戻り値: 呼び出し元フレームのレジスタ。巻き戻せないときはnullopt
+    std::optional<register_snapshot> unwind(register_snapshot const &regs, memory_image const &mem, bool is_top, Dwarf_Addr *cfa_out = nullptr) {
+        auto pc    = lookup_pc(regs, is_top);
+        auto table = find(pc);
+        if (table == nullptr) {
+            return std::nullopt;
+        }
+        auto row = table->find(pc);
+        if (row == nullptr) {
+            return std::nullopt;
+        }
+
+        dw_expr_context ctx;
+        ctx.read_reg = [&regs](uint64_t reg_no) { return regs.get(reg_no); };
+        ctx.read_mem = [&mem](uint64_t addr, size_t size) { return mem.read(addr, size); };
+
+        // CFA算出
+        auto cfa_result = eval_cfa(*row, regs, ctx);
+        if (!cfa_result) {
+            return std::nullopt;
+        }
+        uint64_t cfa = *cfa_result;
+        ctx.cfa      = cfa;
+        if (cfa_out != nullptr) {
+            *cfa_out = cfa;
+        }
+
+        // ルールのないレジスタはsame_valueとして引き継ぐ
+        register_snapshot caller = regs;
+        if (sp_reg_ != no_reg) {
+            caller.set(sp_reg_, cfa);
+        }
+        for (auto &rule : table->rules(*row)) {
+            switch (rule.type) {
+                case cfi_rule::undefined:
+                    caller.unset(rule.reg_no);
+                    break;
+                case cfi_rule::same_value:
+                    break;
+                case cfi_rule::saved_offset:
+                    set_or_unset(caller, rule.reg_no, mem.read(mask(cfa + static_cast<uint64_t>(rule.offset)), pointer_size_));
+                    break;
+                case cfi_rule::val_offset:
+                    caller.set(rule.reg_no, mask(cfa + static_cast<uint64_t>(rule.offset)));
+                    break;
+                case cfi_rule::reg:
+                    set_or_unset(caller, rule.reg_no, regs.get(rule.src_reg));
+                    break;
+                case cfi_rule::expression:
+                case cfi_rule::val_expression: {
+                    auto result = evaluator_.eval(*rule.expr, ctx, {cfa});
+                    std::optional<uint64_t> value;
+                    if (result && (result->is_address() || result->loc == dw_expr_result::stack_value)) {
+                        value = result->value;
+                        if (rule.type == cfi_rule::expression) {
+                            value = mem.read(*value, pointer_size_);
+                        }
+                    }
+                    set_or_unset(caller, rule.reg_no, value);
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+
+        // 戻りアドレス
+        auto ra = caller.get(table->ra_reg);
+        if (!ra || *ra == 0) {
+            return std::nullopt;
+        }
+        caller.pc = *ra;
+        return caller;
+    }
+
+    // regsの位置からスタックを遡る
+    // funcsを指定したときは各フレームの関数を解決する
+    std::vector<cfi_frame> backtrace(register_snapshot const &regs, memory_image const &mem, func_index const *funcs = nullptr,
+                                     size_t max_frames = 256) {
+        std::vector<cfi_frame> frame_list;
+        register_snapshot current = regs;
+        std::optional<Dwarf_Addr> prev_cfa;
+        for (size_t depth = 0; depth < max_frames; depth++) {
+            bool is_top    = (depth == 0);
+            Dwarf_Addr cfa = 0;
+            auto caller    = unwind(current, mem, is_top, &cfa);
+            auto func      = (funcs != nullptr) ? funcs->find(lookup_pc(current, is_top)) : nullptr;
+            frame_list.emplace_back(current.pc, cfa, func, current);
+            if (!caller) {
+                break;
+            }
+            // スタックは単調に遡るはず。CFAが進まないときは壊れているとみなして打ち切る
+            if (prev_cfa && cfa <= *prev_cfa) {
+                break;
+            }
+            prev_cfa = cfa;
+            current  = std::move(*caller);
+        }
+        return frame_list;
+    }
+
+    size_t fde_count() const {
+        return fde_list_.size();
+    }
+    // 構築済みCFIテーブル数
+    size_t table_count() const {
+        return table_count_;
+    }
+    // コンパイル済み式の数
+    size_t expr_count() const {
+        size_t count = 0;
+        for (auto &[key, cache] : cache_map_) {
+            count += cache.size();
+        }
+        return count;
+    }
+
+    // CIEの初期命令とFDEの命令列から[low_pc, high_pc)のCFIテーブルを構築する
+    // instr_addr: instr先頭のアドレス(DW_EH_PE_pcrelの基点)。不明なときはnullopt
+    // テーブルが参照する式はreset()まで有効
+    std::unique_ptr<cfi_row_table> build_table(cie_param param, Dwarf_Addr low_pc, Dwarf_Addr high_pc, Dwarf_Small const *instr,
+                                               Dwarf_Unsigned instr_len, std::optional<Dwarf_Addr> instr_addr = std::nullopt) {
+        auto table     = std::make_unique<cfi_row_table>();
+        table->low_pc  = low_pc;
+        table->high_pc = high_pc;
+        table->ra_reg  = param.ra_reg;
+        // .debug_frameと.eh_frameでoffsetサイズの異なるCIEが混在しても、作成済みの式は破棄しない
+        auto &cache = cache_map_[std::make_pair(pointer_size_, param.offset_size)];
+        cache.pointer_size(pointer_size_);
+        cache.offset_size(param.offset_size);
+        param.expr_cache = &cache;
+
+        // CIEの初期命令 -> FDEの命令 の順に実行する
+        cfa_state state;
+        Dwarf_Addr loc = low_pc;
+        execute(param, param.init_instr, param.init_instr_len, std::nullopt, state, nullptr, *table, loc);
+        cfa_state initial = state;
+        execute(param, instr, instr_len, instr_addr, state, &initial, *table, loc);
+        emit_row(state, *table, loc);
+        return table;
+    }
+
+    // フレーム内の位置を表すPC
+    // 呼び出し元フレームのpcは戻りアドレス(call命令の次)を指すので、call命令内のアドレスにする
+    static Dwarf_Addr lookup_pc(register_snapshot const &regs, bool is_top) {
+        return (is_top || regs.pc == 0) ? regs.pc : regs.pc - 1;
+    }
+
+private:
+    std::optional<uint64_t> eval_cfa(cfi_row_table::row const &row, register_snapshot const &regs, dw_expr_context const &ctx) {
+        if (row.cfa_expr != nullptr) {
+            auto result = evaluator_.eval(*row.cfa_expr, ctx);
+            if (!result || !(result->is_address() || result->loc == dw_expr_result::stack_value)) {
+                return std::nullopt;
+            }
+            return result->value;
+        }
+        auto base = regs.get(row.cfa_reg);
+        if (!base) {
+            return std::nullopt;
+        }
+        return mask(*base + static_cast<uint64_t>(row.cfa_offset));
+    }
+
+    void dealloc(fde_list &list) {
+        if (list.cie_data != nullptr || list.fde_data != nullptr) {
+            dwarf_dealloc_fde_cie_list(dw_dbg_, list.cie_data, list.cie_count, list.fde_data, list.fde_count);
+        }
+        list = fde_list();
+    }
+
+    void load_machine_architecture() {
+        elf::machine_architecture arch;
+        auto result = dwarf_machine_architecture(dw_dbg_, &arch.ftype, &arch.obj_pointersize, &arch.obj_is_big_endian, &arch.obj_machine,
+                                                 &arch.obj_flags, &arch.path_source, &arch.ub_offset, &arch.ub_count, &arch.ub_index,
+                                                 &arch.comdat_groupnumber);
+        if (result != DW_DLV_OK) {
+            return;
+        }
+        pointer_size_  = arch.obj_pointersize;
+        is_big_endian_ = (arch.obj_is_big_endian != 0);
+        sp_reg_        = get_sp_reg(arch.obj_machine);
+        evaluator_.pointer_size(pointer_size_);
+    }
+
+    void load_eh_frame_addr() {
+        Dwarf_Addr addr;
+        Dwarf_Unsigned size;
+        auto result = dwarf_get_section_info_by_name(dw_dbg_, ".eh_frame", &addr, &size, &dw_error_);
+        if (result == DW_DLV_ERROR) {
+            utility::error_happen(&dw_error_);
+        }
+        if (result == DW_DLV_OK) {
+            eh_frame_addr_ = addr;
+        }
+    }
+
+    // psABIで定義されたスタックポインタのDWARFレジスタ番号
+    static uint16_t get_sp_reg(Dwarf_Unsigned machine) {
+        switch (machine) {
+            case elf::EM_386:
+                return 4;  // esp
+            case elf::EM_X86_64:
+                return 7;  // rsp
+            case elf::EM_ARM:
+                return 13;  // sp
+            case elf::EM_AARCH64:
+                return 31;  // sp
+            case elf::EM_RISCV:
+                return 2;  // x2
+            case elf::EM_PPC:
+            case elf::EM_PPC64:
+                return 1;  // r1
+            case elf::EM_MIPS:
+                return 29;  // $sp
+            case elf::EM_RX:
+                return 0;  // r0
+            default:
+                return no_reg;
+        }
+    }
+
+    void load(fde_list &list, bool is_eh) {
+        int result;
+        if (is_eh) {
+            result = dwarf_get_fde_list_eh(dw_dbg_, &list.cie_data, &list.cie_count, &list.fde_data, &list.fde_count, &dw_error_);
+        } else {
+            result = dwarf_get_fde_list(dw_dbg_, &list.cie_data, &list.cie_count, &list.fde_data, &list.fde_count, &dw_error_);
+        }
+        if (result == DW_DLV_ERROR) {
+            utility::error_happen(&dw_error_);
+        }
+        if (result != DW_DLV_OK) {
+            // セクションなし
+            list = fde_list();
+            return;
+        }
+        fde_list_.reserve(fde_list_.size() + static_cast<size_t>(list.fde_count));
+        for (Dwarf_Signed i = 0; i < list.fde_count; i++) {
+            Dwarf_Fde fde = list.fde_data[i];
+            Dwarf_Addr low_pc;
+            Dwarf_Unsigned func_length;
+            Dwarf_Small *fde_bytes;
+            Dwarf_Unsigned fde_byte_length;
+            Dwarf_Off cie_offset;
+            Dwarf_Signed cie_index;
+            Dwarf_Off fde_offset;
+            result = dwarf_get_fde_range(fde, &low_pc, &func_length, &fde_bytes, &fde_byte_length, &cie_offset, &cie_index, &fde_offset, &dw_error_);
+            if (result == DW_DLV_ERROR) {
+                utility::error_happen(&dw_error_);
+            }
+            if (result == DW_DLV_OK && func_length > 0) {
+                fde_list_.emplace_back(low_pc, low_pc + func_length, fde, is_eh, fde_bytes, fde_offset);
+            }
+        }
+    }
+
+    fde_entry *find_fde(Dwarf_Addr pc) {
+        auto it = std::upper_bound(fde_list_.begin(), fde_list_.end(), pc,
+                                   [](Dwarf_Addr value, fde_entry const &elem) { return value < elem.low_pc; });
+        // 同じlow_pcのFDEが複数あるときは先頭(.debug_frame)を使う
+        while (it != fde_list_.begin()) {
+            --it;
+            if (pc < it->high_pc) {
+                while (it != fde_list_.begin() && (it - 1)->low_pc == it->low_pc) {
+                    --it;
+                }
+                return &*it;
+            }
+            if (it == fde_list_.begin() || (it - 1)->low_pc != it->low_pc) {
+                break;
+            }
+        }
+        return nullptr;
+    }
+
+    std::unique_ptr<cfi_row_table> build_table(fde_entry const &entry) {
+        auto table     = std::make_unique<cfi_row_table>();
+        table->low_pc  = entry.low_pc;
+        table->high_pc = entry.high_pc;
+
+        // 取得に失敗したときは行のないテーブルにする(find()の結果はnullptr)
+        int result;
+        Dwarf_Cie cie;
+        result = dwarf_get_cie_of_fde(entry.fde, &cie, &dw_error_);
+        if (result != DW_DLV_OK) {
+            if (result == DW_DLV_ERROR) {
+                utility::error_happen(&dw_error_);
+            }
+            return table;
+        }
+        cie_param param;
+        Dwarf_Unsigned bytes_in_cie = 0;
+        Dwarf_Small version         = 0;
+        char *augmenter             = nullptr;
+        Dwarf_Half offset_size      = 0;
+        result = dwarf_get_cie_info_b(cie, &bytes_in_cie, &version, &augmenter, &param.code_align, &param.data_align, &param.ra_reg,
+                                      &param.init_instr, &param.init_instr_len, &offset_size, &dw_error_);
+        if (result != DW_DLV_OK) {
+            if (result == DW_DLV_ERROR) {
+                utility::error_happen(&dw_error_);
+            }
+            return table;
+        }
+        Dwarf_Small *instr       = nullptr;
+        Dwarf_Unsigned instr_len = 0;
+        result                   = dwarf_get_fde_instr_bytes(entry.fde, &instr, &instr_len, &dw_error_);
+        if (result != DW_DLV_OK) {
+            if (result == DW_DLV_ERROR) {
+                utility::error_happen(&dw_error_);
+            }
+            return table;
+        }
+        param.is_eh       = entry.is_eh;
+        param.offset_size = offset_size;
+        if (entry.is_eh) {
+            param.fde_encoding = get_fde_encoding(cie, augmenter);
+        }
+        // FDE命令列先頭のアドレス
+        std::optional<Dwarf_Addr> instr_addr;
+        if (entry.is_eh && eh_frame_addr_) {
+            instr_addr = *eh_frame_addr_ + entry.fde_offset + static_cast<Dwarf_Addr>(instr - entry.fde_bytes);
+        }
+        return build_table(param, entry.low_pc, entry.high_pc, instr, instr_len, instr_addr);
+    }
+
+    // CIEのaugmentation('z'形式)からFDE内アドレスのエンコード('R')を取り出す
+    // augmentation dataは文字列の各文字に対応するデータを順に並べたもの
+    uint8_t get_fde_encoding(Dwarf_Cie cie, char const *augmenter) {
+        if (augmenter == nullptr || augmenter[0] != 'z') {
+            return DW_EH_PE_absptr;
+        }
+        Dwarf_Small *data   = nullptr;
+        Dwarf_Unsigned size = 0;
+        auto result         = dwarf_get_cie_augmentation_data(cie, &data, &size, &dw_error_);
+        if (result != DW_DLV_OK) {
+            if (result == DW_DLV_ERROR) {
+                utility::error_happen(&dw_error_);
+            }
+            return DW_EH_PE_absptr;
+        }
+        size_t pos = 0;
+        for (auto ch = augmenter + 1; *ch != '\0'; ch++) {
+            switch (*ch) {
+                case 'R':
+                    return (pos < size) ? data[pos] : DW_EH_PE_absptr;
+                case 'L':
+                    // LSDAのエンコード
+                    pos++;
+                    break;
+                case 'P': {
+                    // personalityルーチンのエンコードとアドレス
+                    if (pos >= size) {
+                        return DW_EH_PE_absptr;
+                    }
+                    uint8_t encoding = data[pos++];
+                    auto len         = get_encoded_size(encoding, data + pos, size - pos);
+                    if (!len) {
+                        return DW_EH_PE_absptr;
+                    }
+                    pos += *len;
+                    break;
+                }
+                default:
+                    // 'S', 'B' 等はデータを持たない
+                    break;
+            }
+        }
+        return DW_EH_PE_absptr;
+    }
+    // DW_EH_PE_*でエンコードされた値のバイト数。未対応のときはnullopt
+    std::optional<size_t> get_encoded_size(uint8_t encoding, Dwarf_Small const *data, size_t size) const {
+        switch (encoding & 0x0F) {
+            case DW_EH_PE_absptr:
+                return pointer_size_;
+            case DW_EH_PE_udata2:
+            case DW_EH_PE_sdata2:
+                return 2;
+            case DW_EH_PE_udata4:
+            case DW_EH_PE_sdata4:
+                return 4;
+            case DW_EH_PE_udata8:
+            case DW_EH_PE_sdata8:
+                return 8;
+            case DW_EH_PE_uleb128:
+            case DW_EH_PE_sleb128: {
+                auto res = leb128::decode_unsigned(data, size);
+                if (!res.is_valid) {
+                    return std::nullopt;
+                }
+                return res.used_bytes;
+            }
+            default:
+                return std::nullopt;
+        }
+    }
+
+    // 現在の状態を行として追加する
+    void emit_row(cfa_state const &state, cfi_row_table &table, Dwarf_Addr loc) {
+        if (loc >= table.high_pc) {
+            return;
+        }
+        // 同じアドレスの行は上書きする
+        if (!table.row_list.empty() && table.row_list.back().loc == loc) {
+            table.row_list.pop_back();
+        }
+        cfi_row_table::row row;
+        row.loc        = loc;
+        row.cfa_reg    = state.cfa_reg;
+        row.cfa_offset = state.cfa_offset;
+        row.cfa_expr   = state.cfa_expr;
+        // 直前の行とルールが同じならルール配列を共有する
+        if (!table.row_list.empty()) {
+            auto &prev = table.row_list.back();
+            auto rules = table.rules(prev);
+            if (std::equal(rules.begin(), rules.end(), state.rules.begin(), state.rules.end())) {
+                row.rule_begin = prev.rule_begin;
+                row.rule_count = prev.rule_count;
+                table.row_list.push_back(row);
+                return;
+            }
+        }
+        row.rule_begin = static_cast<uint32_t>(table.rule_list.size());
+        row.rule_count = static_cast<uint32_t>(state.rules.size());
+        table.rule_list.insert(table.rule_list.end(), state.rules.begin(), state.rules.end());
+        table.row_list.push_back(row);
+    }
+
+    static void set_rule(cfa_state &state, cfi_rule const &rule) {
+        auto it = std::lower_bound(state.rules.begin(), state.rules.end(), rule.reg_no,
+                                   [](cfi_rule const &elem, uint16_t value) { return elem.reg_no < value; });
+        if (it != state.rules.end() && it->reg_no == rule.reg_no) {
+            *it = rule;
+        } else {
+            state.rules.insert(it, rule);
+        }
+    }
+    // DW_CFA_restore: CIEの初期命令実行後のルールに戻す
+    static void restore_rule(cfa_state &state, cfa_state const *initial, uint16_t reg_no) {
+        if (initial != nullptr) {
+            for (auto &rule : initial->rules) {
+                if (rule.reg_no == reg_no) {
+                    set_rule(state, rule);
+                    return;
+                }
+            }
+        }
+        auto it = std::lower_bound(state.rules.begin(), state.rules.end(), reg_no,
+                                   [](cfi_rule const &elem, uint16_t value) { return elem.reg_no < value; });
+        if (it != state.rules.end() && it->reg_no == reg_no) {
+            state.rules.erase(it);
+        }
+    }
+
+    // CFA命令列を実行する
+    // instr_addr: instr先頭のアドレス(DW_EH_PE_pcrelの基点)。不明なときはnullopt
+    // initial: CIEの初期命令実行後の状態(CIEの初期命令実行中はnullptr)
+    void execute(cie_param const &param, Dwarf_Small const *instr, Dwarf_Unsigned len, std::optional<Dwarf_Addr> instr_addr, cfa_state &state,
+                 cfa_state const *initial, cfi_row_table &table, Dwarf_Addr &loc) {
+        std::vector<cfa_state> state_stack;
+        size_t pos = 0;
+        // オペランド読み出し
+        bool is_valid = true;
+        auto uleb     = [&]() -> uint64_t {
+            auto res = leb128::decode_unsigned(instr + pos, len - pos);
+            if (!res.is_valid) {
+                is_valid = false;
+            }
+            pos += res.used_bytes;
+            return res.value;
+        };
+        auto sleb = [&]() -> int64_t {
+            auto res = leb128::decode_signed(instr + pos, len - pos);
+            if (!res.is_valid) {
+                is_valid = false;
+            }
+            pos += res.used_bytes;
+            return static_cast<int64_t>(res.value);
+        };
+        auto fixed = [&](size_t size) -> uint64_t {
+            if (len - pos < size) {
+                is_valid = false;
+                pos      = len;
+                return 0;
+            }
+            uint64_t value = 0;
+            for (size_t i = 0; i < size; i++) {
+                size_t index = is_big_endian_ ? i : (size - 1 - i);
+                value        = (value << 8) | instr[pos + index];
+            }
+            pos += size;
+            return value;
+        };
+        auto block = [&]() -> dw_expr_program const * {
+            auto size = uleb();
+            if (len - pos < size) {
+                is_valid = false;
+                pos      = len;
+                return nullptr;
+            }
+            auto &prog = param.expr_cache->get(instr + pos, size);
+            pos += size;
+            return &prog;
+        };
+        // DW_CFA_set_loc のアドレス
+        // .debug_frameはアドレスサイズの値、.eh_frameはCIEのaugmentation('R')で指定されたエンコード
+        auto address = [&]() -> std::optional<Dwarf_Addr> {
+            if (!param.is_eh) {
+                return fixed(pointer_size_);
+            }
+            Dwarf_Addr base = 0;
+            switch (param.fde_encoding & 0x70) {
+                case DW_EH_PE_absptr:
+                    break;
+                case DW_EH_PE_pcrel:
+                    if (!instr_addr) {
+                        return std::nullopt;
+                    }
+                    base = *instr_addr + pos;
+                    break;
+                case DW_EH_PE_funcrel:
+                    base = table.low_pc;
+                    break;
+                default:
+                    // textrel/datarel/aligned は基点が分からないので未対応
+                    return std::nullopt;
+            }
+            if ((param.fde_encoding & 0x80) != 0) {
+                // DW_EH_PE_indirect: メモリ上の値を指す。未対応
+                return std::nullopt;
+            }
+            uint64_t value;
+            switch (param.fde_encoding & 0x0F) {
+                case DW_EH_PE_absptr:
+                    value = fixed(pointer_size_);
+                    break;
+                case DW_EH_PE_udata2:
+                    value = fixed(2);
+                    break;
+                case DW_EH_PE_udata4:
+                    value = fixed(4);
+                    break;
+                case DW_EH_PE_udata8:
+                    value = fixed(8);
+                    break;
+                case DW_EH_PE_sdata2:
+                    value = static_cast<uint64_t>(static_cast<int64_t>(static_cast<int16_t>(fixed(2))));
+                    break;
+                case DW_EH_PE_sdata4:
+                    value = static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(fixed(4))));
+                    break;
+                case DW_EH_PE_sdata8:
+                    value = fixed(8);
+                    break;
+                case DW_EH_PE_uleb128:
+                    value = uleb();
+                    break;
+                case DW_EH_PE_sleb128:
+                    value = static_cast<uint64_t>(sleb());
+                    break;
+                default:
+                    return std::nullopt;
+            }
+            return mask(base + value);
+        };
+        auto advance = [&](Dwarf_Addr new_loc) {
+            if (new_loc > loc) {
+                emit_row(state, table, loc);
+                loc = new_loc;
+            }
+        };
+        auto factored = [&](int64_t value) -> int64_t { return value * param.data_align; };
+
+        while (pos < len && is_valid) {
+            uint8_t op = instr[pos++];
+            // 上位2bitにopcode、下位6bitにオペランドを持つ命令
+            uint8_t low6 = op & 0x3F;
+            switch (op & 0xC0) {
+                case DW_CFA_advance_loc:
+                    advance(loc + low6 * param.code_align);
+                    continue;
+                case DW_CFA_offset: {
+                    cfi_rule rule(low6, cfi_rule::saved_offset);
+                    rule.offset = factored(static_cast<int64_t>(uleb()));
+                    set_rule(state, rule);
+                    continue;
+                }
+                case DW_CFA_restore:
+                    restore_rule(state, initial, low6);
+                    continue;
+                default:
+                    break;
+            }
+            switch (op) {
+                case DW_CFA_nop:
+                    break;
+                case DW_CFA_set_loc: {
+                    auto new_loc = address();
+                    if (!new_loc) {
+                        is_valid = false;
+                        break;
+                    }
+                    advance(*new_loc);
+                    break;
+                }
+                case DW_CFA_advance_loc1:
+                    advance(loc + fixed(1) * param.code_align);
+                    break;
+                case DW_CFA_advance_loc2:
+                    advance(loc + fixed(2) * param.code_align);
+                    break;
+                case DW_CFA_advance_loc4:
+                    advance(loc + fixed(4) * param.code_align);
+                    break;
+                case DW_CFA_MIPS_advance_loc8:
+                    advance(loc + fixed(8) * param.code_align);
+                    break;
+                case DW_CFA_offset_extended: {
+                    cfi_rule rule(static_cast<uint16_t>(uleb()), cfi_rule::saved_offset);
+                    rule.offset = factored(static_cast<int64_t>(uleb()));
+                    set_rule(state, rule);
+                    break;
+                }
+                case DW_CFA_offset_extended_sf: {
+                    cfi_rule rule(static_cast<uint16_t>(uleb()), cfi_rule::saved_offset);
+                    rule.offset = factored(sleb());
+                    set_rule(state, rule);
+                    break;
+                }
+                case DW_CFA_GNU_negative_offset_extended: {
+                    cfi_rule rule(static_cast<uint16_t>(uleb()), cfi_rule::saved_offset);
+                    rule.offset = -factored(static_cast<int64_t>(uleb()));
+                    set_rule(state, rule);
+                    break;
+                }
+                case DW_CFA_val_offset: {
+                    cfi_rule rule(static_cast<uint16_t>(uleb()), cfi_rule::val_offset);
+                    rule.offset = factored(static_cast<int64_t>(uleb()));
+                    set_rule(state, rule);
+                    break;
+                }
+                case DW_CFA_val_offset_sf: {
+                    cfi_rule rule(static_cast<uint16_t>(uleb()), cfi_rule::val_offset);
+                    rule.offset = factored(sleb());
+                    set_rule(state, rule);
+                    break;
+                }
+                case DW_CFA_restore_extended:
+                    restore_rule(state, initial, static_cast<uint16_t>(uleb()));
+                    break;
+                case DW_CFA_undefined:
+                    set_rule(state, cfi_rule(static_cast<uint16_t>(uleb()), cfi_rule::undefined));
+                    break;
+                case DW_CFA_same_value:
+                    set_rule(state, cfi_rule(static_cast<uint16_t>(uleb()), cfi_rule::same_value));
+                    break;
+                case DW_CFA_register: {
+                    cfi_rule rule(static_cast<uint16_t>(uleb()), cfi_rule::reg);
+                    rule.src_reg = static_cast<uint16_t>(uleb());
+                    set_rule(state, rule);
+                    break;
+                }
+                case DW_CFA_expression: {
+                    cfi_rule rule(static_cast<uint16_t>(uleb()), cfi_rule::expression);
+                    rule.expr = block();
+                    if (rule.expr != nullptr) {
+                        set_rule(state, rule);
+                    }
+                    break;
+                }
+                case DW_CFA_val_expression: {
+                    cfi_rule rule(static_cast<uint16_t>(uleb()), cfi_rule::val_expression);
+                    rule.expr = block();
+                    if (rule.expr != nullptr) {
+                        set_rule(state, rule);
+                    }
+                    break;
+                }
+                case DW_CFA_remember_state:
+                    state_stack.push_back(state);
+                    break;
+                case DW_CFA_restore_state:
+                    // CFAルールも含めて戻す(GCC/GDBと同じ扱い)
+                    if (!state_stack.empty()) {
+                        state = std::move(state_stack.back());
+                        state_stack.pop_back();
+                    }
+                    break;
+                case DW_CFA_def_cfa:
+                    state.cfa_reg    = static_cast<uint16_t>(uleb());
+                    state.cfa_offset = static_cast<int64_t>(uleb());
+                    state.cfa_expr   = nullptr;
+                    break;
+                case DW_CFA_def_cfa_sf:
+                    state.cfa_reg    = static_cast<uint16_t>(uleb());
+                    state.cfa_offset = factored(sleb());
+                    state.cfa_expr   = nullptr;
+                    break;
+                case DW_CFA_def_cfa_register:
+                    state.cfa_reg  = static_cast<uint16_t>(uleb());
+                    state.cfa_expr = nullptr;
+                    break;
+                case DW_CFA_def_cfa_offset:
+                    state.cfa_offset = static_cast<int64_t>(uleb());
+                    break;
+                case DW_CFA_def_cfa_offset_sf:
+                    state.cfa_offset = factored(sleb());
+                    break;
+                case DW_CFA_def_cfa_expression:
+                    state.cfa_expr = block();
+                    break;
+                case DW_CFA_GNU_args_size:
+                    // スタック調整量。巻き戻しには不要
+                    uleb();
+                    break;
+                case DW_CFA_GNU_window_save:
+                    // SPARCのレジスタウィンドウ/AArch64のPAC状態。未対応
+                    break;
+                default:
+                    fprintf(stderr, "no impl : DW_CFA : 0x%02X\n", op);
+                    is_valid = false;
+                    break;
+            }
+        }
+    }
+
+    uint64_t mask(uint64_t value) const {
+        return (pointer_size_ >= 8) ? value : (value & ((1ull << (pointer_size_ * 8)) - 1));
+    }
+    static void set_or_unset(register_snapshot &regs, uint16_t reg_no, std::optional<uint64_t> value) {
+        if (value) {
+            regs.set(reg_no, *value);
+        } else {
+            regs.unset(reg_no);
+        }
+    }
+};
+
+}  // namespace util_dwarf
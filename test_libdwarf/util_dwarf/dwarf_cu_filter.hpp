@@ -0,0 +1,138 @@
+#pragma once
+
+#define LIBDWARF_STATIC 1
+#include <dwarf.h>
+#include <libdwarf.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "dwarf_info.hpp"
+
+namespace util_dwarf {
+
+// compile unit単位の解析対象フィルタ
+// CUのDIE(DW_TAG_compile_unit)の属性だけで判定するので、対象外のCUは.debug_lineとDIEツリーを読まずに次のCUへ進む
+// 条件の種類(パス/言語/producer)毎に、includeが空でなければいずれかに一致すること、excludeのいずれにも一致しないことを要求する
+// パスはDW_AT_nameとDW_AT_comp_dirのどちらかが一致すればよい。'/'と'\'は同一視する
+struct dwarf_cu_filter
+{
+    std::vector<std::string> path_include;
+    std::vector<std::string> path_exclude;
+    std::vector<Dwarf_Unsigned> language_include;  // DW_LANG_*
+    std::vector<Dwarf_Unsigned> language_exclude;
+    std::vector<std::string> producer_include;
+    std::vector<std::string> producer_exclude;
+
+    dwarf_cu_filter() : path_include(), path_exclude(), language_include(), language_exclude(), producer_include(), producer_exclude() {
+    }
+    ~dwarf_cu_filter();
+
+    bool empty() const {
+        return path_include.empty() && path_exclude.empty() && language_include.empty() && language_exclude.empty() && producer_include.empty() &&
+               producer_exclude.empty();
+    }
+
+    bool match(dwarf_info::compile_unit_info const &cu) const {
+        // パス
+        auto match_path = [&cu](std::string const &pattern) {
+            return glob_match(pattern, cu.name) || glob_match(pattern, cu.comp_dir);
+        };
+        if (!path_include.empty() && std::none_of(path_include.begin(), path_include.end(), match_path)) {
+            return false;
+        }
+        if (std::any_of(path_exclude.begin(), path_exclude.end(), match_path)) {
+            return false;
+        }
+        // 言語
+        auto has_language = [&cu](std::vector<Dwarf_Unsigned> const &list) {
+            return std::find(list.begin(), list.end(), cu.language) != list.end();
+        };
+        if (!language_include.empty() && !has_language(language_include)) {
+            return false;
+        }
+        if (has_language(language_exclude)) {
+            return false;
+        }
+        // producer
+        auto match_producer = [&cu](std::string const &pattern) {
+            return glob_match(pattern, cu.producer);
+        };
+        if (!producer_include.empty() && std::none_of(producer_include.begin(), producer_include.end(), match_producer)) {
+            return false;
+        }
+        if (std::any_of(producer_exclude.begin(), producer_exclude.end(), match_producer)) {
+            return false;
+        }
+        return true;
+    }
+
+    // '*' : 0文字以上の任意の文字列, '?' : 任意の1文字
+    static bool glob_match(std::string_view pattern, std::string_view str) {
+        size_t p      = 0;
+        size_t s      = 0;
+        size_t star_p = std::string_view::npos;
+        size_t star_s = 0;
+        while (s < str.size()) {
+            if (p < pattern.size() && pattern[p] == '*') {
+                // '*'の位置を覚えておき、まず0文字に一致させる
+                star_p = p++;
+                star_s = s;
+            } else if (p < pattern.size() && (pattern[p] == '?' || is_same_char(pattern[p], str[s]))) {
+                p++;
+                s++;
+            } else if (star_p != std::string_view::npos) {
+                // 直前の'*'に1文字多く一致させてやり直す
+                p = star_p + 1;
+                s = ++star_s;
+            } else {
+                return false;
+            }
+        }
+        while (p < pattern.size() && pattern[p] == '*') {
+            p++;
+        }
+        return p == pattern.size();
+    }
+
+    // DW_LANG_*の名前("C99", "DW_LANG_C99")または数値から言語コードを得る
+    static bool parse_language(std::string_view str, Dwarf_Unsigned &lang) {
+        if (str.empty()) {
+            return false;
+        }
+        char *end;
+        std::string buff(str);
+        auto value = std::strtoull(buff.c_str(), &end, 0);
+        if (*end == '\0') {
+            lang = value;
+            return true;
+        }
+        if (!str.starts_with("DW_LANG_")) {
+            buff = "DW_LANG_" + buff;
+        }
+        for (unsigned int i = 0; i <= 0xFFFF; i++) {
+            char const *name = nullptr;
+            if (dwarf_get_LANG_name(i, &name) == DW_DLV_OK && buff == name) {
+                lang = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    static bool is_same_char(char a, char b) {
+        if ((a == '/' || a == '\\') && (b == '/' || b == '\\')) {
+            return true;
+        }
+        return a == b;
+    }
+};
+// vector<string>を複数持ち破棄が展開しきれないので、inline指定しない(-Winline)
+dwarf_cu_filter::~dwarf_cu_filter() {
+}
+
+}  // namespace util_dwarf
@@ -0,0 +1,1130 @@
+#pragma once
+
+#define LIBDWARF_STATIC 1
+#include <dwarf.h>
+#include <libdwarf.h>
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "LEB128.hpp"
+#include "utility.hpp"
+
+namespace util_dwarf {
+
+// DWARF expression 中間表現(IR)
+// バイト列を1度だけデコードしてオペランド展開済みの命令列にする
+// 評価時はバイト列の再解析を行わない
+//   - lit_N/const_N/constu/consts/const_type は DW_OP_constu に正規化
+//   - reg_N は DW_OP_regx、breg_N/regval_type は DW_OP_bregx に正規化
+//   - GNU拡張は対応するDWARF5のopeコードに正規化
+//   - DW_OP_skip/bra の分岐先はbyte offsetから命令indexに変換
+struct dw_expr_op
+{
+    uint8_t code;  // DW_OP_*
+    uint64_t operand1;
+    uint64_t operand2;
+
+    dw_expr_op(uint8_t code_, uint64_t ope1 = 0, uint64_t ope2 = 0) : code(code_), operand1(ope1), operand2(ope2) {
+    }
+};
+
+// コンパイル済みDWARF expression
+class dw_expr_program {
+public:
+    // 頻出パターン
+    // 評価時に命令列を実行せずに結果を返す
+    enum shape : uint8_t
+    {
+        general,       // 汎用評価
+        constant,      // DW_OP_addr <n> / DW_OP_constu <n> : n
+        plus_uconst,   // DW_OP_plus_uconst <n> : 初期値 + n (DW_AT_data_member_location)
+        frame_offset,  // DW_OP_fbreg <n> : frame_base + n
+        reg_offset,    // DW_OP_bregx <r> <n> : reg(r) + n
+        reg,           // DW_OP_regx <r> : レジスタ
+    };
+    // 評価に必要な実行時情報
+    enum require : uint32_t
+    {
+        req_none        = 0,
+        req_reg         = 1 << 0,   // レジスタ値
+        req_mem         = 1 << 1,   // メモリ読み出し
+        req_frame_base  = 1 << 2,   // DW_OP_fbreg
+        req_cfa         = 1 << 3,   // DW_OP_call_frame_cfa
+        req_object      = 1 << 4,   // DW_OP_push_object_address
+        req_tls         = 1 << 5,   // DW_OP_form_tls_address
+        req_call        = 1 << 6,   // DW_OP_call2/call4/call_ref
+        req_addr_index  = 1 << 7,   // DW_OP_addrx/constx
+        req_entry_value = 1 << 8,   // DW_OP_entry_value
+        req_initial     = 1 << 9,   // 評価前にstackに値が積まれている前提
+        req_location    = 1 << 10,  // 結果がメモリアドレス以外(reg/stack_value/implicit/piece)になりうる
+    };
+    enum error : uint8_t
+    {
+        err_none,
+        err_truncated,  // オペランドが途切れている
+        err_no_impl,    // 未対応opeコード
+        err_branch,     // 分岐先が命令境界でない
+    };
+
+    std::vector<uint8_t> bytes;  // 元のバイト列(キャッシュキー、implicit_value/entry_valueのデータ参照先)
+    std::vector<dw_expr_op> ops;
+    shape form;
+    uint32_t needs;       // require の組み合わせ
+    uint64_t fast_value;  // shape別の定数/offset
+    uint64_t fast_reg;    // shape別のレジスタ番号
+    error err;
+    uint8_t err_code;  // エラーが発生したopeコード
+    size_t op_count;   // 元のバイト列に含まれるopeコード数
+
+    dw_expr_program(uint8_t const *buff, size_t buff_size)
+        : bytes(buff, buff + buff_size),
+          ops(),
+          form(general),
+          needs(req_none),
+          fast_value(0),
+          fast_reg(0),
+          err(err_none),
+          err_code(0),
+          op_count(0) {
+    }
+
+    bool is_valid() const {
+        return err == err_none;
+    }
+    // 実行時情報なしで評価できる
+    bool is_static() const {
+        return (needs & ~req_initial) == req_none;
+    }
+    std::string_view key() const {
+        return std::string_view(reinterpret_cast<char const *>(bytes.data()), bytes.size());
+    }
+};
+
+// DWARF expression コンパイラ
+class dw_expr_compiler {
+    // オペランド読み出し
+    struct reader
+    {
+        uint8_t const *buff;
+        size_t size;
+        size_t pos;
+        bool is_ok;
+
+        reader(uint8_t const *buff_, size_t size_) : buff(buff_), size(size_), pos(0), is_ok(true) {
+        }
+
+        uint64_t fixed(size_t n) {
+            if (!is_ok || pos + n > size) {
+                is_ok = false;
+                return 0;
+            }
+            auto value = utility::concat_le<uint64_t>(buff, pos, pos + n);
+            pos += n;
+            return value;
+        }
+        uint64_t fixed_signed(size_t n) {
+            auto value = fixed(n);
+            if (n < 8) {
+                auto shift = static_cast<unsigned int>(64 - n * 8);
+                value      = static_cast<uint64_t>(static_cast<int64_t>(value << shift) >> shift);
+            }
+            return value;
+        }
+        uint64_t uleb() {
+            if (!is_ok) {
+                return 0;
+            }
+            ULEB128 leb(buff + pos, size - pos);
+            is_ok = leb.is_valid;
+            pos += leb.used_bytes;
+            return leb.value;
+        }
+        uint64_t sleb() {
+            if (!is_ok) {
+                return 0;
+            }
+            SLEB128 leb(buff + pos, size - pos);
+            is_ok = leb.is_valid;
+            pos += leb.used_bytes;
+            return static_cast<uint64_t>(leb.value);
+        }
+        // n byteを読み飛ばす(データは元のバイト列から参照する)
+        size_t skip(uint64_t n) {
+            auto begin = pos;
+            if (!is_ok || n > size - pos) {
+                is_ok = false;
+                return begin;
+            }
+            pos += static_cast<size_t>(n);
+            return begin;
+        }
+    };
+
+public:
+    // pointer_size: DW_OP_addr のオペランドサイズ
+    // offset_size : DW_OP_call_ref/implicit_pointer のオペランドサイズ(32bit DWARF:4, 64bit DWARF:8)
+    static std::unique_ptr<dw_expr_program> compile(uint8_t const *buff, size_t buff_size, size_t pointer_size, size_t offset_size) {
+        auto prog = std::make_unique<dw_expr_program>(buff, buff_size);
+        // 分岐先解決用: opeコード先頭byte offset -> 命令index
+        std::vector<std::pair<size_t, size_t>> branch_list;
+        std::vector<size_t> index_of(buff_size + 1, SIZE_MAX);
+
+        auto &ops = prog->ops;
+        reader rd(prog->bytes.data(), prog->bytes.size());
+        while (rd.is_ok && rd.pos < rd.size) {
+            index_of[rd.pos] = ops.size();
+            uint8_t code     = rd.buff[rd.pos++];
+            prog->op_count++;
+
+            if (DW_OP_lit0 <= code && code <= DW_OP_lit31) {
+                ops.emplace_back(DW_OP_constu, code - DW_OP_lit0);
+                continue;
+            }
+            if (DW_OP_reg0 <= code && code <= DW_OP_reg31) {
+                ops.emplace_back(DW_OP_regx, code - DW_OP_reg0);
+                prog->needs |= dw_expr_program::req_location;
+                continue;
+            }
+            if (DW_OP_breg0 <= code && code <= DW_OP_breg31) {
+                ops.emplace_back(DW_OP_bregx, code - DW_OP_breg0, rd.sleb());
+                prog->needs |= dw_expr_program::req_reg;
+                continue;
+            }
+
+            switch (code) {
+                case DW_OP_addr:
+                    ops.emplace_back(DW_OP_addr, rd.fixed(pointer_size));
+                    break;
+                case DW_OP_const1u:
+                    ops.emplace_back(DW_OP_constu, rd.fixed(1));
+                    break;
+                case DW_OP_const1s:
+                    ops.emplace_back(DW_OP_constu, rd.fixed_signed(1));
+                    break;
+                case DW_OP_const2u:
+                    ops.emplace_back(DW_OP_constu, rd.fixed(2));
+                    break;
+                case DW_OP_const2s:
+                    ops.emplace_back(DW_OP_constu, rd.fixed_signed(2));
+                    break;
+                case DW_OP_const4u:
+                    ops.emplace_back(DW_OP_constu, rd.fixed(4));
+                    break;
+                case DW_OP_const4s:
+                    ops.emplace_back(DW_OP_constu, rd.fixed_signed(4));
+                    break;
+                case DW_OP_const8u:
+                    ops.emplace_back(DW_OP_constu, rd.fixed(8));
+                    break;
+                case DW_OP_const8s:
+                    ops.emplace_back(DW_OP_constu, rd.fixed_signed(8));
+                    break;
+                case DW_OP_constu:
+                    ops.emplace_back(DW_OP_constu, rd.uleb());
+                    break;
+                case DW_OP_consts:
+                    ops.emplace_back(DW_OP_constu, rd.sleb());
+                    break;
+                case DW_OP_const_type:
+                case DW_OP_GNU_const_type: {
+                    // 型付き定数: 型は無視して汎用型として扱う
+                    rd.uleb();
+                    auto size = rd.fixed(1);
+                    if (size > 8) {
+                        return set_error(std::move(prog), dw_expr_program::err_no_impl, code);
+                    }
+                    ops.emplace_back(DW_OP_constu, rd.fixed(static_cast<size_t>(size)));
+                    break;
+                }
+
+                case DW_OP_dup:
+                case DW_OP_drop:
+                case DW_OP_over:
+                case DW_OP_swap:
+                case DW_OP_rot:
+                case DW_OP_abs:
+                case DW_OP_and:
+                case DW_OP_div:
+                case DW_OP_minus:
+                case DW_OP_mod:
+                case DW_OP_mul:
+                case DW_OP_neg:
+                case DW_OP_not:
+                case DW_OP_or:
+                case DW_OP_plus:
+                case DW_OP_shl:
+                case DW_OP_shr:
+                case DW_OP_shra:
+                case DW_OP_xor:
+                case DW_OP_eq:
+                case DW_OP_ge:
+                case DW_OP_gt:
+                case DW_OP_le:
+                case DW_OP_lt:
+                case DW_OP_ne:
+                    ops.emplace_back(code);
+                    break;
+                case DW_OP_nop:
+                case DW_OP_GNU_uninit:
+                    // 命令を生成しない
+                    break;
+                case DW_OP_convert:
+                case DW_OP_GNU_convert:
+                case DW_OP_reinterpret:
+                case DW_OP_GNU_reinterpret:
+                    // 型変換: 汎用型のみ扱うため命令を生成しない
+                    rd.uleb();
+                    break;
+                case DW_OP_pick:
+                    ops.emplace_back(DW_OP_pick, rd.fixed(1));
+                    break;
+                case DW_OP_plus_uconst:
+                    ops.emplace_back(DW_OP_plus_uconst, rd.uleb());
+                    break;
+                case DW_OP_skip:
+                case DW_OP_bra: {
+                    // 分岐先は命令直後からの相対byte offset
+                    auto offset = static_cast<int64_t>(rd.fixed_signed(2));
+                    auto target = static_cast<int64_t>(rd.pos) + offset;
+                    if (target < 0 || target > static_cast<int64_t>(rd.size)) {
+                        return set_error(std::move(prog), dw_expr_program::err_branch, code);
+                    }
+                    branch_list.emplace_back(ops.size(), static_cast<size_t>(target));
+                    ops.emplace_back(code);
+                    break;
+                }
+
+                case DW_OP_deref:
+                    ops.emplace_back(DW_OP_deref_size, pointer_size);
+                    prog->needs |= dw_expr_program::req_mem;
+                    break;
+                case DW_OP_deref_size:
+                    ops.emplace_back(DW_OP_deref_size, rd.fixed(1));
+                    prog->needs |= dw_expr_program::req_mem;
+                    break;
+                case DW_OP_deref_type:
+                case DW_OP_GNU_deref_type: {
+                    auto size = rd.fixed(1);
+                    rd.uleb();
+                    ops.emplace_back(DW_OP_deref_size, size);
+                    prog->needs |= dw_expr_program::req_mem;
+                    break;
+                }
+                case DW_OP_xderef:
+                    ops.emplace_back(DW_OP_xderef_size, pointer_size);
+                    prog->needs |= dw_expr_program::req_mem;
+                    break;
+                case DW_OP_xderef_size:
+                    ops.emplace_back(DW_OP_xderef_size, rd.fixed(1));
+                    prog->needs |= dw_expr_program::req_mem;
+                    break;
+                case DW_OP_xderef_type: {
+                    auto size = rd.fixed(1);
+                    rd.uleb();
+                    ops.emplace_back(DW_OP_xderef_size, size);
+                    prog->needs |= dw_expr_program::req_mem;
+                    break;
+                }
+
+                case DW_OP_regx:
+                    ops.emplace_back(DW_OP_regx, rd.uleb());
+                    prog->needs |= dw_expr_program::req_location;
+                    break;
+                case DW_OP_bregx: {
+                    auto reg_no = rd.uleb();
+                    ops.emplace_back(DW_OP_bregx, reg_no, rd.sleb());
+                    prog->needs |= dw_expr_program::req_reg;
+                    break;
+                }
+                case DW_OP_regval_type:
+                case DW_OP_GNU_regval_type: {
+                    // レジスタ値 = bregx <r> 0
+                    auto reg_no = rd.uleb();
+                    rd.uleb();
+                    ops.emplace_back(DW_OP_bregx, reg_no, 0);
+                    prog->needs |= dw_expr_program::req_reg;
+                    break;
+                }
+                case DW_OP_fbreg:
+                    ops.emplace_back(DW_OP_fbreg, rd.sleb());
+                    prog->needs |= dw_expr_program::req_frame_base;
+                    break;
+                case DW_OP_call_frame_cfa:
+                    ops.emplace_back(code);
+                    prog->needs |= dw_expr_program::req_cfa;
+                    break;
+                case DW_OP_push_object_address:
+                    ops.emplace_back(code);
+                    prog->needs |= dw_expr_program::req_object;
+                    break;
+                case DW_OP_form_tls_address:
+                case DW_OP_GNU_push_tls_address:
+                    ops.emplace_back(DW_OP_form_tls_address);
+                    prog->needs |= dw_expr_program::req_tls;
+                    break;
+                case DW_OP_addrx:
+                case DW_OP_GNU_addr_index:
+                    ops.emplace_back(DW_OP_addrx, rd.uleb());
+                    prog->needs |= dw_expr_program::req_addr_index;
+                    break;
+                case DW_OP_constx:
+                case DW_OP_GNU_const_index:
+                    ops.emplace_back(DW_OP_constx, rd.uleb());
+                    prog->needs |= dw_expr_program::req_addr_index;
+                    break;
+                case DW_OP_call2:
+                    ops.emplace_back(code, rd.fixed(2));
+                    prog->needs |= dw_expr_program::req_call;
+                    break;
+                case DW_OP_call4:
+                    ops.emplace_back(code, rd.fixed(4));
+                    prog->needs |= dw_expr_program::req_call;
+                    break;
+                case DW_OP_call_ref:
+                    ops.emplace_back(code, rd.fixed(offset_size));
+                    prog->needs |= dw_expr_program::req_call;
+                    break;
+                case DW_OP_entry_value:
+                case DW_OP_GNU_entry_value: {
+                    // operand1: 部分式のbyte数, operand2: 部分式の開始位置
+                    auto len   = rd.uleb();
+                    auto begin = rd.skip(len);
+                    ops.emplace_back(DW_OP_entry_value, len, begin);
+                    prog->needs |= dw_expr_program::req_entry_value;
+                    break;
+                }
+
+                case DW_OP_piece:
+                    ops.emplace_back(DW_OP_piece, rd.uleb());
+                    prog->needs |= dw_expr_program::req_location;
+                    break;
+                case DW_OP_bit_piece: {
+                    auto size = rd.uleb();
+                    ops.emplace_back(DW_OP_bit_piece, size, rd.uleb());
+                    prog->needs |= dw_expr_program::req_location;
+                    break;
+                }
+                case DW_OP_implicit_value: {
+                    // operand1: データbyte数, operand2: データ開始位置
+                    auto len   = rd.uleb();
+                    auto begin = rd.skip(len);
+                    ops.emplace_back(DW_OP_implicit_value, len, begin);
+                    prog->needs |= dw_expr_program::req_location;
+                    break;
+                }
+                case DW_OP_stack_value:
+                    ops.emplace_back(code);
+                    prog->needs |= dw_expr_program::req_location;
+                    break;
+                case DW_OP_implicit_pointer:
+                case DW_OP_GNU_implicit_pointer: {
+                    auto die = rd.fixed(offset_size);
+                    ops.emplace_back(DW_OP_implicit_pointer, die, rd.sleb());
+                    prog->needs |= dw_expr_program::req_location;
+                    break;
+                }
+
+                default:
+                    return set_error(std::move(prog), dw_expr_program::err_no_impl, code);
+            }
+            if (!rd.is_ok) {
+                return set_error(std::move(prog), dw_expr_program::err_truncated, code);
+            }
+        }
+        if (!rd.is_ok) {
+            return set_error(std::move(prog), dw_expr_program::err_truncated, rd.buff[rd.size - 1]);
+        }
+        index_of[rd.size] = ops.size();
+
+        // 分岐先を命令indexに変換
+        for (auto &[index, target] : branch_list) {
+            if (index_of[target] == SIZE_MAX) {
+                return set_error(std::move(prog), dw_expr_program::err_branch, ops[index].code);
+            }
+            ops[index].operand1 = index_of[target];
+        }
+
+        classify(*prog);
+        return prog;
+    }
+
+private:
+    static std::unique_ptr<dw_expr_program> set_error(std::unique_ptr<dw_expr_program> prog, dw_expr_program::error err, uint8_t code) {
+        prog->ops.clear();
+        prog->err      = err;
+        prog->err_code = code;
+        return prog;
+    }
+
+    // 頻出パターンの判定
+    static void classify(dw_expr_program &prog) {
+        auto &ops = prog.ops;
+        // 先頭命令がstackの値を消費するか
+        if (!ops.empty()) {
+            switch (ops[0].code) {
+                case DW_OP_addr:
+                case DW_OP_constu:
+                case DW_OP_regx:
+                case DW_OP_bregx:
+                case DW_OP_fbreg:
+                case DW_OP_call_frame_cfa:
+                case DW_OP_push_object_address:
+                case DW_OP_addrx:
+                case DW_OP_constx:
+                case DW_OP_entry_value:
+                case DW_OP_implicit_value:
+                case DW_OP_implicit_pointer:
+                case DW_OP_call2:
+                case DW_OP_call4:
+                case DW_OP_call_ref:
+                case DW_OP_skip:
+                    break;
+                default:
+                    prog.needs |= dw_expr_program::req_initial;
+                    break;
+            }
+        }
+
+        auto is_const = [](dw_expr_op const &op) { return op.code == DW_OP_addr || op.code == DW_OP_constu; };
+        if (ops.size() == 1) {
+            auto &op = ops[0];
+            if (is_const(op)) {
+                prog.form       = dw_expr_program::constant;
+                prog.fast_value = op.operand1;
+            } else if (op.code == DW_OP_plus_uconst) {
+                prog.form       = dw_expr_program::plus_uconst;
+                prog.fast_value = op.operand1;
+            } else if (op.code == DW_OP_fbreg) {
+                prog.form       = dw_expr_program::frame_offset;
+                prog.fast_value = op.operand1;
+            } else if (op.code == DW_OP_bregx) {
+                prog.form       = dw_expr_program::reg_offset;
+                prog.fast_reg   = op.operand1;
+                prog.fast_value = op.operand2;
+            } else if (op.code == DW_OP_regx) {
+                prog.form     = dw_expr_program::reg;
+                prog.fast_reg = op.operand1;
+            }
+        } else if (ops.size() == 2 && is_const(ops[0]) && ops[1].code == DW_OP_plus_uconst) {
+            // DW_OP_addr <n>; DW_OP_plus_uconst <m>
+            prog.form       = dw_expr_program::constant;
+            prog.fast_value = ops[0].operand1 + ops[1].operand1;
+        }
+    }
+};
+
+// コンパイル済みDWARF expressionのキャッシュ
+// バイト列の内容をキーにする
+class dw_expr_cache {
+    using map_t = std::unordered_map<std::string_view, std::unique_ptr<dw_expr_program>>;
+    map_t map_;
+    size_t pointer_size_;
+    size_t offset_size_;
+    uint64_t hit_count_;
+    uint64_t miss_count_;
+
+public:
+    dw_expr_cache() : map_(), pointer_size_(4), offset_size_(4), hit_count_(0), miss_count_(0) {
+    }
+
+    // オペランドサイズが変わるとコンパイル結果が変わるためキャッシュを破棄する
+    void pointer_size(size_t size) {
+        if (pointer_size_ != size) {
+            map_.clear();
+            pointer_size_ = size;
+        }
+    }
+    void offset_size(size_t size) {
+        if (offset_size_ != size) {
+            map_.clear();
+            offset_size_ = size;
+        }
+    }
+    size_t pointer_size() const {
+        return pointer_size_;
+    }
+
+    // コンパイルエラーも結果としてキャッシュする
+    dw_expr_program const &get(uint8_t const *buff, size_t buff_size) {
+        std::string_view key(reinterpret_cast<char const *>(buff), buff_size);
+        auto it = map_.find(key);
+        if (it != map_.end()) {
+            hit_count_++;
+            return *it->second;
+        }
+        miss_count_++;
+        auto prog = dw_expr_compiler::compile(buff, buff_size, pointer_size_, offset_size_);
+        auto &ref = *prog;
+        // キーはprogramが保持するバイト列を参照する
+        map_.emplace(ref.key(), std::move(prog));
+        return ref;
+    }
+    dw_expr_program const &get(std::vector<uint8_t> const &expr) {
+        return get(expr.data(), expr.size());
+    }
+
+    void clear() {
+        map_.clear();
+    }
+    size_t size() const {
+        return map_.size();
+    }
+    uint64_t hit_count() const {
+        return hit_count_;
+    }
+    uint64_t miss_count() const {
+        return miss_count_;
+    }
+};
+
+// 評価時の実行時情報
+// 不要な情報は未設定のままでよい。必要な情報が無い式は評価失敗になる
+struct dw_expr_context
+{
+    using read_reg_t    = std::function<std::optional<uint64_t>(uint64_t reg_no)>;
+    using read_mem_t    = std::function<std::optional<uint64_t>(uint64_t addr, size_t size)>;
+    using read_index_t  = std::function<std::optional<uint64_t>(uint64_t index)>;
+    using tls_address_t = std::function<std::optional<uint64_t>(uint64_t offset)>;
+    // DW_OP_call2/call4: CU先頭からのoffset, DW_OP_call_ref: .debug_info先頭からのoffset
+    // 対象DIEのDW_AT_locationを返す。DW_AT_locationを持たないときはnullptr(何もしない)
+    using call_t = std::function<dw_expr_program const *(uint8_t code, uint64_t die_offset)>;
+    // 関数エントリ時点での部分式の値
+    using entry_value_t = std::function<std::optional<uint64_t>(uint8_t const *expr, size_t size)>;
+
+    read_reg_t read_reg;
+    read_mem_t read_mem;
+    read_index_t read_addr;  // .debug_addr[index]
+    tls_address_t tls_address;
+    call_t call;
+    entry_value_t entry_value;
+    std::optional<uint64_t> frame_base;
+    std::optional<uint64_t> cfa;
+    std::optional<uint64_t> object_address;
+
+    dw_expr_context() : read_reg(), read_mem(), read_addr(), tls_address(), call(), entry_value(), frame_base(), cfa(), object_address() {
+    }
+};
+
+// 評価結果
+struct dw_expr_result
+{
+    enum kind : uint8_t
+    {
+        memory,            // value: メモリアドレス
+        stack_value,       // value: 値そのもの(DW_OP_stack_value)
+        reg,               // value: レジスタ番号
+        implicit_value,    // data/size: 値のバイト列
+        implicit_pointer,  // value: 参照先DIE offset, offset: 参照先内offset
+        empty,             // 値なし(最適化で消えた部分)
+    };
+    struct piece
+    {
+        kind loc;
+        uint64_t value;
+        int64_t offset;
+        uint8_t const *data;
+        uint64_t size_bits;    // DW_OP_piece はbyte数*8
+        uint64_t offset_bits;  // DW_OP_bit_piece のみ
+    };
+
+    kind loc;
+    uint64_t value;
+    int64_t offset;
+    uint8_t const *data;
+    size_t size;
+    std::vector<piece> pieces;  // DW_OP_piece/bit_piece で構成されるとき
+
+    dw_expr_result() : loc(empty), value(0), offset(0), data(nullptr), size(0), pieces() {
+    }
+    dw_expr_result(kind loc_, uint64_t value_) : loc(loc_), value(value_), offset(0), data(nullptr), size(0), pieces() {
+    }
+
+    bool is_address() const {
+        return loc == memory && pieces.empty();
+    }
+};
+
+// DWARF expression 評価器
+// スタックは固定長配列、値はアドレスサイズの汎用型(generic type)として扱う
+class dw_expr_evaluator {
+    static constexpr size_t stack_max      = 64;
+    static constexpr size_t call_depth_max = 16;
+    // 無限ループ対策
+    static constexpr size_t step_max = 100000;
+
+    std::array<uint64_t, stack_max> stack_;
+    size_t sp_;
+    size_t pointer_size_;
+    uint64_t addr_mask_;
+    size_t step_;
+
+public:
+    dw_expr_evaluator() : stack_(), sp_(0), pointer_size_(0), addr_mask_(0), step_(0) {
+        pointer_size(4);
+    }
+
+    void pointer_size(size_t size) {
+        pointer_size_ = size;
+        addr_mask_    = (size >= 8) ? ~0ull : ((1ull << (size * 8)) - 1);
+    }
+
+    // initial: 評価前にstackに積む値(DW_AT_data_member_locationのときは構造体の先頭アドレス)
+    std::optional<dw_expr_result> eval(dw_expr_program const &prog, dw_expr_context const &ctx, std::initializer_list<uint64_t> initial = {}) {
+        if (!prog.is_valid()) {
+            return std::nullopt;
+        }
+        // 頻出パターン
+        switch (prog.form) {
+            case dw_expr_program::constant:
+                return dw_expr_result(dw_expr_result::memory, prog.fast_value & addr_mask_);
+            case dw_expr_program::plus_uconst:
+                if (initial.size() > 0) {
+                    return dw_expr_result(dw_expr_result::memory, (*(initial.end() - 1) + prog.fast_value) & addr_mask_);
+                }
+                break;
+            case dw_expr_program::frame_offset:
+                if (ctx.frame_base) {
+                    return dw_expr_result(dw_expr_result::memory, (*ctx.frame_base + prog.fast_value) & addr_mask_);
+                }
+                return std::nullopt;
+            case dw_expr_program::reg_offset:
+                if (ctx.read_reg) {
+                    if (auto reg = ctx.read_reg(prog.fast_reg); reg) {
+                        return dw_expr_result(dw_expr_result::memory, (*reg + prog.fast_value) & addr_mask_);
+                    }
+                }
+                return std::nullopt;
+            case dw_expr_program::reg:
+                return dw_expr_result(dw_expr_result::reg, prog.fast_reg);
+            case dw_expr_program::general:
+            default:
+                break;
+        }
+
+        sp_   = 0;
+        step_ = 0;
+        for (auto value : initial) {
+            if (!push(value)) {
+                return std::nullopt;
+            }
+        }
+        dw_expr_result result;
+        if (!run(prog, ctx, result, 0)) {
+            return std::nullopt;
+        }
+        return result;
+    }
+
+    // 定数式を評価する(実行時情報なし)
+    std::optional<dw_expr_result> eval(dw_expr_program const &prog, std::initializer_list<uint64_t> initial = {}) {
+        static dw_expr_context const empty_ctx;
+        return eval(prog, empty_ctx, initial);
+    }
+
+private:
+    bool push(uint64_t value) {
+        if (sp_ >= stack_max) {
+            return false;
+        }
+        stack_[sp_++] = value & addr_mask_;
+        return true;
+    }
+    bool pop(uint64_t &value) {
+        if (sp_ == 0) {
+            return false;
+        }
+        value = stack_[--sp_];
+        return true;
+    }
+    // アドレスサイズで符号拡張
+    int64_t to_signed(uint64_t value) const {
+        if (pointer_size_ >= 8) {
+            return static_cast<int64_t>(value);
+        }
+        auto shift = static_cast<unsigned int>(64 - pointer_size_ * 8);
+        return static_cast<int64_t>(value << shift) >> shift;
+    }
+
+    // 現在のstack topから場所を確定する
+    // stackが空のときは値なし(最適化で消えた)とする
+    void take_location(dw_expr_result::kind &loc, uint64_t &value) {
+        if (loc == dw_expr_result::memory || loc == dw_expr_result::stack_value) {
+            if (!pop(value)) {
+                loc = dw_expr_result::empty;
+            }
+        }
+    }
+
+    bool run(dw_expr_program const &prog, dw_expr_context const &ctx, dw_expr_result &result, size_t depth) {
+        auto &ops  = prog.ops;
+        size_t idx = 0;
+        // 場所の種類: 位置記述子(reg/stack_value/implicit)が現れたら次のpieceまで有効
+        auto loc                = dw_expr_result::memory;
+        uint64_t loc_val        = 0;
+        int64_t loc_ofs         = 0;
+        uint8_t const *loc_data = nullptr;
+        size_t loc_size         = 0;
+        bool loc_fixed          = false;  // reg/implicit: stackを使わず確定済み
+        uint64_t a, b, c;
+
+        while (idx < ops.size()) {
+            if (++step_ > step_max) {
+                return false;
+            }
+            auto &op = ops[idx++];
+            switch (op.code) {
+                case DW_OP_addr:
+                case DW_OP_constu:
+                    if (!push(op.operand1)) {
+                        return false;
+                    }
+                    break;
+
+                // stack操作
+                case DW_OP_dup:
+                    if (sp_ == 0 || !push(stack_[sp_ - 1])) {
+                        return false;
+                    }
+                    break;
+                case DW_OP_drop:
+                    if (!pop(a)) {
+                        return false;
+                    }
+                    break;
+                case DW_OP_over:
+                    if (sp_ < 2 || !push(stack_[sp_ - 2])) {
+                        return false;
+                    }
+                    break;
+                case DW_OP_pick:
+                    if (op.operand1 >= sp_ || !push(stack_[sp_ - 1 - op.operand1])) {
+                        return false;
+                    }
+                    break;
+                case DW_OP_swap:
+                    if (sp_ < 2) {
+                        return false;
+                    }
+                    std::swap(stack_[sp_ - 1], stack_[sp_ - 2]);
+                    break;
+                case DW_OP_rot:
+                    // [.., c, b, a] -> [.., a, c, b]
+                    if (sp_ < 3) {
+                        return false;
+                    }
+                    a               = stack_[sp_ - 1];
+                    stack_[sp_ - 1] = stack_[sp_ - 2];
+                    stack_[sp_ - 2] = stack_[sp_ - 3];
+                    stack_[sp_ - 3] = a;
+                    break;
+
+                // 算術/論理演算
+                case DW_OP_abs:
+                    if (!pop(a)) {
+                        return false;
+                    }
+                    // INT64_MINの符号反転は符号付きではオーバーフローするので、符号なしで折り返す
+                    push(to_signed(a) < 0 ? 0 - a : a);
+                    break;
+                case DW_OP_neg:
+                    if (!pop(a)) {
+                        return false;
+                    }
+                    push(0 - a);
+                    break;
+                case DW_OP_not:
+                    if (!pop(a)) {
+                        return false;
+                    }
+                    push(~a);
+                    break;
+                case DW_OP_plus_uconst:
+                    if (!pop(a)) {
+                        return false;
+                    }
+                    push(a + op.operand1);
+                    break;
+                case DW_OP_and:
+                case DW_OP_div:
+                case DW_OP_minus:
+                case DW_OP_mod:
+                case DW_OP_mul:
+                case DW_OP_or:
+                case DW_OP_plus:
+                case DW_OP_shl:
+                case DW_OP_shr:
+                case DW_OP_shra:
+                case DW_OP_xor:
+                case DW_OP_eq:
+                case DW_OP_ge:
+                case DW_OP_gt:
+                case DW_OP_le:
+                case DW_OP_lt:
+                case DW_OP_ne:
+                    // b: 2番目, a: top
+                    if (!pop(a) || !pop(b)) {
+                        return false;
+                    }
+                    if (!binary_op(op.code, b, a, c)) {
+                        return false;
+                    }
+                    push(c);
+                    break;
+
+                // 分岐
+                case DW_OP_skip:
+                    idx = static_cast<size_t>(op.operand1);
+                    break;
+                case DW_OP_bra:
+                    if (!pop(a)) {
+                        return false;
+                    }
+                    if (a != 0) {
+                        idx = static_cast<size_t>(op.operand1);
+                    }
+                    break;
+                case DW_OP_call2:
+                case DW_OP_call4:
+                case DW_OP_call_ref: {
+                    if (!ctx.call || depth >= call_depth_max) {
+                        return false;
+                    }
+                    // 呼び出し先は同じstackで評価する
+                    auto callee = ctx.call(op.code, op.operand1);
+                    if (callee != nullptr) {
+                        if (!callee->is_valid() || !run(*callee, ctx, result, depth + 1)) {
+                            return false;
+                        }
+                    }
+                    break;
+                }
+
+                // 実行時情報
+                case DW_OP_regx:
+                    loc       = dw_expr_result::reg;
+                    loc_val   = op.operand1;
+                    loc_fixed = true;
+                    break;
+                case DW_OP_bregx: {
+                    if (!ctx.read_reg) {
+                        return false;
+                    }
+                    auto reg = ctx.read_reg(op.operand1);
+                    if (!reg || !push(*reg + op.operand2)) {
+                        return false;
+                    }
+                    break;
+                }
+                case DW_OP_fbreg:
+                    if (!ctx.frame_base || !push(*ctx.frame_base + op.operand1)) {
+                        return false;
+                    }
+                    break;
+                case DW_OP_call_frame_cfa:
+                    if (!ctx.cfa || !push(*ctx.cfa)) {
+                        return false;
+                    }
+                    break;
+                case DW_OP_push_object_address:
+                    if (!ctx.object_address || !push(*ctx.object_address)) {
+                        return false;
+                    }
+                    break;
+                case DW_OP_form_tls_address: {
+                    if (!ctx.tls_address || !pop(a)) {
+                        return false;
+                    }
+                    auto addr = ctx.tls_address(a);
+                    if (!addr || !push(*addr)) {
+                        return false;
+                    }
+                    break;
+                }
+                case DW_OP_addrx:
+                case DW_OP_constx: {
+                    if (!ctx.read_addr) {
+                        return false;
+                    }
+                    auto addr = ctx.read_addr(op.operand1);
+                    if (!addr || !push(*addr)) {
+                        return false;
+                    }
+                    break;
+                }
+                case DW_OP_entry_value: {
+                    if (!ctx.entry_value) {
+                        return false;
+                    }
+                    auto value = ctx.entry_value(prog.bytes.data() + op.operand2, static_cast<size_t>(op.operand1));
+                    if (!value || !push(*value)) {
+                        return false;
+                    }
+                    break;
+                }
+                case DW_OP_deref_size: {
+                    if (!ctx.read_mem || !pop(a) || op.operand1 == 0 || op.operand1 > 8) {
+                        return false;
+                    }
+                    auto value = ctx.read_mem(a, static_cast<size_t>(op.operand1));
+                    if (!value || !push(*value)) {
+                        return false;
+                    }
+                    break;
+                }
+                case DW_OP_xderef_size: {
+                    // アドレス空間識別子は無視する
+                    if (!ctx.read_mem || !pop(a) || !pop(b) || op.operand1 == 0 || op.operand1 > 8) {
+                        return false;
+                    }
+                    auto value = ctx.read_mem(a, static_cast<size_t>(op.operand1));
+                    if (!value || !push(*value)) {
+                        return false;
+                    }
+                    break;
+                }
+
+                // 位置記述子
+                case DW_OP_stack_value:
+                    loc = dw_expr_result::stack_value;
+                    break;
+                case DW_OP_implicit_value:
+                    loc       = dw_expr_result::implicit_value;
+                    loc_data  = prog.bytes.data() + op.operand2;
+                    loc_size  = static_cast<size_t>(op.operand1);
+                    loc_fixed = true;
+                    break;
+                case DW_OP_implicit_pointer:
+                    loc       = dw_expr_result::implicit_pointer;
+                    loc_val   = op.operand1;
+                    loc_ofs   = static_cast<int64_t>(op.operand2);
+                    loc_fixed = true;
+                    break;
+                case DW_OP_piece:
+                case DW_OP_bit_piece: {
+                    if (!loc_fixed) {
+                        take_location(loc, loc_val);
+                    }
+                    auto &piece       = result.pieces.emplace_back();
+                    piece.loc         = loc;
+                    piece.value       = loc_val;
+                    piece.offset      = loc_ofs;
+                    piece.data        = loc_data;
+                    piece.size_bits   = (op.code == DW_OP_piece) ? op.operand1 * 8 : op.operand1;
+                    piece.offset_bits = (op.code == DW_OP_piece) ? 0 : op.operand2;
+                    // 次のpieceへ
+                    loc       = dw_expr_result::memory;
+                    loc_val   = 0;
+                    loc_ofs   = 0;
+                    loc_data  = nullptr;
+                    loc_fixed = false;
+                    break;
+                }
+
+                default:
+                    return false;
+            }
+        }
+
+        // 呼び出し先の式は場所を確定しない
+        if (depth > 0) {
+            return true;
+        }
+        if (!result.pieces.empty()) {
+            // pieceの後ろに余りがあるのは不正
+            result.loc = dw_expr_result::memory;
+            return !loc_fixed;
+        }
+        if (!loc_fixed) {
+            take_location(loc, loc_val);
+        }
+        result.loc    = loc;
+        result.value  = loc_val;
+        result.offset = loc_ofs;
+        result.data   = loc_data;
+        result.size   = loc_size;
+        return true;
+    }
+
+    bool binary_op(uint8_t code, uint64_t lhs, uint64_t rhs, uint64_t &out) const {
+        switch (code) {
+            case DW_OP_and:
+                out = lhs & rhs;
+                break;
+            case DW_OP_div:
+                // 符号付き除算
+                if (rhs == 0) {
+                    return false;
+                }
+                // INT64_MIN / -1 はオーバーフロー(SIGFPE)するので、符号反転を折り返した値にする
+                if (to_signed(rhs) == -1) {
+                    out = 0 - lhs;
+                    break;
+                }
+                out = static_cast<uint64_t>(to_signed(lhs) / to_signed(rhs));
+                break;
+            case DW_OP_minus:
+                out = lhs - rhs;
+                break;
+            case DW_OP_mod:
+                if (rhs == 0) {
+                    return false;
+                }
+                out = lhs % rhs;
+                break;
+            case DW_OP_mul:
+                out = lhs * rhs;
+                break;
+            case DW_OP_or:
+                out = lhs | rhs;
+                break;
+            case DW_OP_plus:
+                out = lhs + rhs;
+                break;
+            case DW_OP_shl:
+                out = (rhs >= 64) ? 0 : (lhs << rhs);
+                break;
+            case DW_OP_shr:
+                out = (rhs >= 64) ? 0 : (lhs >> rhs);
+                break;
+            case DW_OP_shra:
+                out = static_cast<uint64_t>(to_signed(lhs) >> ((rhs >= 63) ? 63 : rhs));
+                break;
+            case DW_OP_xor:
+                out = lhs ^ rhs;
+                break;
+            // 比較は符号付き
+            case DW_OP_eq:
+                out = (to_signed(lhs) == to_signed(rhs)) ? 1 : 0;
+                break;
+            case DW_OP_ge:
+                out = (to_signed(lhs) >= to_signed(rhs)) ? 1 : 0;
+                break;
+            case DW_OP_gt:
+                out = (to_signed(lhs) > to_signed(rhs)) ? 1 : 0;
+                break;
+            case DW_OP_le:
+                out = (to_signed(lhs) <= to_signed(rhs)) ? 1 : 0;
+                break;
+            case DW_OP_lt:
+                out = (to_signed(lhs) < to_signed(rhs)) ? 1 : 0;
+                break;
+            case DW_OP_ne:
+                out = (to_signed(lhs) != to_signed(rhs)) ? 1 : 0;
+                break;
+            default:
+                return false;
+        }
+        return true;
+    }
+};
+
+}  // namespace util_dwarf
@@ -5,7 +5,9 @@
 #include <libdwarf.h>
 
 #include <optional>
+#include <utility>
 #include <variant>
+#include <vector>
 
 #include "LEB128.hpp"
 #include "dwarf_analyze_info.hpp"
@@ -37,7 +39,7 @@ dw_form_result_t get_DW_FORM_block(dwarf_analyze_info &info) {
     // ULEB128を取得
     ULEB128 uleb(buff_ptr, buff_len);
     // blockを取得
-    if (buff_len == (uleb.used_bytes + uleb.value)) {
+    if (uleb.is_valid && buff_len == (uleb.used_bytes + uleb.value)) {
         // ULEB128が示すデータ長がblockサイズと同じならそのまま取り出す
         // dataをlittle endianで結合
         form_result = utility::concat_le<Dwarf_Unsigned>(buff_ptr, uleb.used_bytes, buff_len);
@@ -148,6 +150,116 @@ std::optional<DW_FORM_ref_result_t> get_DW_FORM_ref(dwarf_analyze_info &info) {
     }
     return std::optional<DW_FORM_ref_result_t>(ref_value);
 }
+// DW_FORM_ref_sig8
+// type unitのsignatureから型DIE offsetを引く
+std::optional<Dwarf_Off> get_DW_FORM_ref_sig8(dwarf_analyze_info &info) {
+    Dwarf_Sig8 sig;
+    int result;
+    result = dwarf_formsig8(info.dw_attr, &sig, &info.dw_error);
+    if (result != DW_DLV_OK) {
+        utility::error_happen(&info.dw_error);
+        return std::nullopt;
+    }
+    if (info.type_sig_tbl == nullptr) {
+        return std::nullopt;
+    }
+    auto offset = info.type_sig_tbl->find(sig);
+    if (!offset) {
+        auto key = dwarf_info::type_signature_index::key(sig);
+        fprintf(stderr, "warning: type signature not found : 0x%016llX\n", static_cast<unsigned long long>(key));
+    }
+    return offset;
+}
+// DW_FORM_addr, DW_FORM_addrx*
+std::optional<Dwarf_Unsigned> get_DW_FORM_addr(dwarf_analyze_info &info, Dwarf_Half form) {
+    int result;
+    if (form != DW_FORM_addr) {
+        // .debug_addrのindex
+        Dwarf_Unsigned index;
+        result = dwarf_get_debug_addr_index(info.dw_attr, &index, &info.dw_error);
+        if (result != DW_DLV_OK) {
+            utility::error_happen(&info.dw_error);
+            return std::nullopt;
+        }
+        auto addr = info.unit_base.address(index);
+        if (addr) {
+            return addr;
+        }
+        // テーブルが無効ならlibdwarfで解決する
+    }
+    Dwarf_Addr addr;
+    result = dwarf_formaddr(info.dw_attr, &addr, &info.dw_error);
+    if (result != DW_DLV_OK) {
+        utility::error_happen(&info.dw_error);
+        return std::nullopt;
+    }
+    return addr;
+}
+// DW_FORM_rnglistx
+// .debug_rnglists先頭からのoffsetを返す。テーブルが無効のときはlibdwarfで解決する
+std::optional<Dwarf_Unsigned> get_DW_FORM_rnglistx(dwarf_analyze_info &info) {
+    Dwarf_Unsigned index;
+    int result;
+    result = dwarf_formudata(info.dw_attr, &index, &info.dw_error);
+    if (result != DW_DLV_OK) {
+        utility::error_happen(&info.dw_error);
+        return std::nullopt;
+    }
+    auto offset = info.unit_base.rnglist_offset(index);
+    if (offset) {
+        return offset;
+    }
+    Dwarf_Rnglists_Head head  = nullptr;
+    Dwarf_Unsigned count      = 0;
+    Dwarf_Unsigned rle_offset = 0;
+    result                    = dwarf_rnglists_get_rle_head(info.dw_attr, DW_FORM_rnglistx, index, &head, &count, &rle_offset, &info.dw_error);
+    if (result != DW_DLV_OK) {
+        if (result == DW_DLV_ERROR) {
+            utility::error_happen(&info.dw_error);
+        }
+        return std::nullopt;
+    }
+    dwarf_dealloc_rnglists_head(head);
+    return rle_offset;
+}
+// 文字列クラスのform
+// DW_FORM_strx* は.debug_str_offsetsから直接引く。それ以外とテーブルが無効のときはlibdwarfで解決する
+char const *get_DW_FORM_string(dwarf_analyze_info &info) {
+    Dwarf_Half form;
+    int result;
+    result = dwarf_whatform(info.dw_attr, &form, &info.dw_error);
+    if (result != DW_DLV_OK) {
+        utility::error_happen(&info.dw_error);
+        return nullptr;
+    }
+    switch (form) {
+        case DW_FORM_strx:
+        case DW_FORM_strx1:
+        case DW_FORM_strx2:
+        case DW_FORM_strx3:
+        case DW_FORM_strx4:
+        case DW_FORM_GNU_str_index: {
+            Dwarf_Unsigned index;
+            result = dwarf_get_debug_str_index(info.dw_attr, &index, &info.dw_error);
+            if (result != DW_DLV_OK) {
+                utility::error_happen(&info.dw_error);
+                return nullptr;
+            }
+            auto str = info.unit_base.str(index);
+            if (str != nullptr) {
+                return str;
+            }
+        } break;
+        default:
+            break;
+    }
+    char *str = nullptr;
+    result    = dwarf_formstring(info.dw_attr, &str, &info.dw_error);
+    if (result != DW_DLV_OK) {
+        utility::error_happen(&info.dw_error);
+    }
+    return str;
+}
 // DW_FORM_sec_offset
 std::optional<DW_FORM_ref_result_t> get_DW_FORM_sec_offset(dwarf_analyze_info &info) {
     DW_FORM_ref_result_t ref_value;
@@ -189,6 +301,175 @@ dw_form_result_t get_DW_FORM_exprloc(dwarf_analyze_info &info) {
     return form_result;
 }
 
+// 位置リスト(loclistptr/loclist)のformならセクションoffsetを返す
+// DW_FORM_loclistxはunitのテーブルで.debug_loclistsのoffsetに変換する。テーブルが無効のときはindexのまま返す
+// exprloc等の式のときはnullopt
+std::optional<Dwarf_Unsigned> get_DW_FORM_loclist(dwarf_analyze_info &info) {
+    Dwarf_Half form;
+    int result;
+    result = dwarf_whatform(info.dw_attr, &form, &info.dw_error);
+    if (result != DW_DLV_OK) {
+        utility::error_happen(&info.dw_error);
+        return std::nullopt;
+    }
+    switch (form) {
+        case DW_FORM_data4:
+        case DW_FORM_data8:
+            // DWARF2/3はdata4/data8がloclistptr
+            if (info.cu_info_header.version_stamp >= 4) {
+                return std::nullopt;
+            }
+            [[fallthrough]];
+        case DW_FORM_loclistx: {
+            Dwarf_Unsigned value = 0;
+            result               = dwarf_formudata(info.dw_attr, &value, &info.dw_error);
+            if (result != DW_DLV_OK) {
+                utility::error_happen(&info.dw_error);
+                return std::nullopt;
+            }
+            if (form == DW_FORM_loclistx) {
+                auto offset = info.unit_base.loclist_offset(value);
+                if (offset) {
+                    return *offset;
+                }
+            }
+            return value;
+        }
+        case DW_FORM_sec_offset: {
+            auto ret = get_DW_FORM_sec_offset(info);
+            if (ret) {
+                return ret->return_offset;
+            }
+            return std::nullopt;
+        }
+        default:
+            return std::nullopt;
+    }
+}
+
+// DW_AT_ranges のアドレス範囲 [begin, end) をrange_listに追加する
+// DWARF5は.debug_rnglists、DWARF4以前は.debug_rangesを参照する
+bool get_DW_FORM_rangelist(dwarf_analyze_info &info, std::vector<std::pair<Dwarf_Addr, Dwarf_Addr>> &range_list) {
+    Dwarf_Half form;
+    int result;
+    result = dwarf_whatform(info.dw_attr, &form, &info.dw_error);
+    if (result != DW_DLV_OK) {
+        utility::error_happen(&info.dw_error);
+        return false;
+    }
+    Dwarf_Unsigned value = 0;
+    if (form == DW_FORM_sec_offset) {
+        auto ret = get_DW_FORM_sec_offset(info);
+        if (!ret) {
+            return false;
+        }
+        value = ret->return_offset;
+    } else {
+        result = dwarf_formudata(info.dw_attr, &value, &info.dw_error);
+        if (result != DW_DLV_OK) {
+            utility::error_happen(&info.dw_error);
+            return false;
+        }
+    }
+
+    if (info.cu_info_header.version_stamp >= 5) {
+        // libdwarfがbase address/addrxを解決したアドレス(cooked)を使う
+        Dwarf_Rnglists_Head head  = nullptr;
+        Dwarf_Unsigned count      = 0;
+        Dwarf_Unsigned rle_offset = 0;
+        result                    = dwarf_rnglists_get_rle_head(info.dw_attr, form, value, &head, &count, &rle_offset, &info.dw_error);
+        if (result != DW_DLV_OK) {
+            if (result == DW_DLV_ERROR) {
+                utility::error_happen(&info.dw_error);
+            }
+            return false;
+        }
+        for (Dwarf_Unsigned i = 0; i < count; i++) {
+            unsigned int entry_len    = 0;
+            unsigned int rle          = 0;
+            Dwarf_Unsigned raw1       = 0;
+            Dwarf_Unsigned raw2       = 0;
+            Dwarf_Bool is_unavailable = 0;
+            Dwarf_Unsigned begin      = 0;
+            Dwarf_Unsigned end        = 0;
+            result                    = dwarf_get_rnglists_entry_fields_a(head, i, &entry_len, &rle, &raw1, &raw2, &is_unavailable, &begin, &end,
+                                                                          &info.dw_error);
+            if (result != DW_DLV_OK) {
+                dwarf_dealloc_rnglists_head(head);
+                if (result == DW_DLV_ERROR) {
+                    utility::error_happen(&info.dw_error);
+                }
+                return false;
+            }
+            switch (rle) {
+                case DW_RLE_offset_pair:
+                case DW_RLE_startx_endx:
+                case DW_RLE_startx_length:
+                case DW_RLE_start_end:
+                case DW_RLE_start_length:
+                    if (!is_unavailable && begin < end) {
+                        range_list.emplace_back(begin, end);
+                    }
+                    break;
+                default:
+                    // DW_RLE_base_address(x), DW_RLE_end_of_list
+                    break;
+            }
+        }
+        dwarf_dealloc_rnglists_head(head);
+        return true;
+    }
+
+    // .debug_ranges のエントリはbase addressからのoffset。初期値はCUのlow_pc
+    Dwarf_Ranges *range_buf   = nullptr;
+    Dwarf_Signed range_count  = 0;
+    Dwarf_Unsigned byte_count = 0;
+    Dwarf_Off real_offset     = 0;
+    result                    = dwarf_get_ranges_b(info.dw_dbg, value, nullptr, &real_offset, &range_buf, &range_count, &byte_count, &info.dw_error);
+    if (result != DW_DLV_OK) {
+        if (result == DW_DLV_ERROR) {
+            utility::error_happen(&info.dw_error);
+        }
+        return false;
+    }
+    Dwarf_Addr base = (info.cu_info != nullptr) ? info.cu_info->low_pc.value_or(0) : 0;
+    for (Dwarf_Signed i = 0; i < range_count; i++) {
+        auto &range = range_buf[i];
+        if (range.dwr_type == DW_RANGES_ADDRESS_SELECTION) {
+            base = range.dwr_addr2;
+        } else if (range.dwr_type == DW_RANGES_ENTRY && range.dwr_addr1 < range.dwr_addr2) {
+            range_list.emplace_back(base + range.dwr_addr1, base + range.dwr_addr2);
+        }
+    }
+    dwarf_dealloc_ranges(info.dw_dbg, range_buf, range_count);
+    return true;
+}
+
+// formがconstantクラスか判定する
+// DWARF4以降のDW_AT_high_pcはconstantクラスのときlow_pcからのoffsetを表す
+bool is_DW_FORM_constant_class(dwarf_analyze_info &info) {
+    Dwarf_Half form;
+    int result;
+    result = dwarf_whatform(info.dw_attr, &form, &info.dw_error);
+    if (result != DW_DLV_OK) {
+        utility::error_happen(&info.dw_error);
+        return false;
+    }
+    switch (form) {
+        case DW_FORM_data1:
+        case DW_FORM_data2:
+        case DW_FORM_data4:
+        case DW_FORM_data8:
+        case DW_FORM_data16:
+        case DW_FORM_udata:
+        case DW_FORM_sdata:
+        case DW_FORM_implicit_const:
+            return true;
+        default:
+            return false;
+    }
+}
+
 template <typename T>
 dw_form_result_t get_DW_FORM(dwarf_analyze_info &info) {
     Dwarf_Half form;
@@ -216,19 +497,50 @@ dw_form_result_t get_DW_FORM(dwarf_analyze_info &info) {
         case DW_FORM_ref_udata: {
             auto ret = get_DW_FORM_ref(info);
             if (ret) {
-                T addr = ret->return_offset;
-                if (ret->is_info == true) {
-                    // .debug_info のheader offsetを加算する
-                    addr += info.cu_info_header.cu_header_offset;
-                } else {
-                    // .debug_types の先頭からのoffsetを加算する
-                    // 暫定：debug_typesが出現することがあるか？
-                    addr += info.cu_info_header.cu_offset;
+                // unitのheader offsetを加算する
+                T addr = ret->return_offset + info.cu_info_header.cu_header_offset;
+                if (ret->is_info != true) {
+                    // .debug_types内のoffsetは.debug_infoと区別する
+                    addr |= dwarf_info::debug_types_offset;
                 }
                 return dw_form_result_t(addr);
             }
         } break;
 
+        case DW_FORM_ref_sig8: {
+            auto ret = get_DW_FORM_ref_sig8(info);
+            if (ret) {
+                return dw_form_result_t(static_cast<T>(*ret));
+            }
+        } break;
+
+        case DW_FORM_addr:
+        case DW_FORM_addrx:
+        case DW_FORM_addrx1:
+        case DW_FORM_addrx2:
+        case DW_FORM_addrx3:
+        case DW_FORM_addrx4:
+        case DW_FORM_GNU_addr_index: {
+            auto ret = get_DW_FORM_addr(info, form);
+            if (ret) {
+                return dw_form_result_t(static_cast<T>(*ret));
+            }
+        } break;
+
+        case DW_FORM_rnglistx: {
+            auto ret = get_DW_FORM_rnglistx(info);
+            if (ret) {
+                return dw_form_result_t(static_cast<T>(*ret));
+            }
+        } break;
+
+        case DW_FORM_loclistx: {
+            auto ret = get_DW_FORM_loclist(info);
+            if (ret) {
+                return dw_form_result_t(static_cast<T>(*ret));
+            }
+        } break;
+
         case DW_FORM_indirect:
             break;
 
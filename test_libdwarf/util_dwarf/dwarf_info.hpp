@@ -5,11 +5,14 @@
 #include <libdwarf.h>
 
 #include <cstdint>
+#include <cstring>
 #include <list>
 #include <map>
 #include <memory>
 #include <optional>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "architecture.hpp"
@@ -29,6 +32,9 @@ using block = std::vector<uint8_t>;
 
 struct dwarf_info
 {
+    // .debug_types(DWARF4 type unit)のDIE offsetは.debug_infoのoffsetと重複するため、最上位bitを立てて区別する
+    static constexpr Dwarf_Off debug_types_offset = Dwarf_Off(1) << 63;
+
     // compile_unitから取得する情報
     struct cu_info_header
     {
@@ -78,10 +84,23 @@ struct dwarf_info
         std::string comp_dir;
         std::optional<Dwarf_Unsigned> low_pc;
         std::optional<Dwarf_Unsigned> high_pc;
+        bool high_pc_is_offset;  // high_pcがlow_pcからのoffset(DWARF4以降のconstantクラス)
         bool use_UTF8;
         Dwarf_Unsigned ranges;  // .debug_rangesへの参照
+        bool is_type_unit;      // DW_TAG_type_unit(.debug_types, DW_UT_type)
 
-        compile_unit_info() : name(), producer(), language(), stmt_list(0), comp_dir(), low_pc(), high_pc(), use_UTF8(false), ranges(0) {
+        compile_unit_info()
+            : name(),
+              producer(),
+              language(),
+              stmt_list(0),
+              comp_dir(),
+              low_pc(),
+              high_pc(),
+              high_pc_is_offset(false),
+              use_UTF8(false),
+              ranges(0),
+              is_type_unit(false) {
         }
         ~compile_unit_info() {
         }
@@ -98,6 +117,9 @@ struct dwarf_info
         Dwarf_Unsigned decl_column;
         std::optional<Dwarf_Off> type;  // reference
         std::optional<dw_op_value> location;
+        // DW_AT_location が位置リストのとき、.debug_loc/.debug_loclists のoffset(DW_FORM_loclistxはindex)
+        // 内容は dwarf_location_resolver で遅延デコードする
+        std::optional<Dwarf_Unsigned> location_list;
         bool declaration;  // 不完全型のときtrue
         Dwarf_Unsigned const_value;
         Dwarf_Unsigned sibling;
@@ -109,6 +131,9 @@ struct dwarf_info
         std::string decl_file_path;
         bool is_parameter;
         bool is_local_var;
+        // locationをDWARFではなくシンボルテーブルから補完したときtrue
+        bool is_symbol_location;
+        Dwarf_Unsigned symbol_size;
 
         var_info()
             : name(),
@@ -119,6 +144,7 @@ struct dwarf_info
               decl_column(0),
               type(),
               location(),
+              location_list(),
               declaration(false),
               const_value(0),
               sibling(0),
@@ -126,7 +152,9 @@ struct dwarf_info
               specification(),
               decl_file_path(),
               is_parameter(false),
-              is_local_var(false) {
+              is_local_var(false),
+              is_symbol_location(false),
+              symbol_size(0) {
         }
         ~var_info() {
         }
@@ -177,7 +205,7 @@ struct dwarf_info
         Dwarf_Unsigned data_bit_offset;
         Dwarf_Off data_member_location;
         Dwarf_Unsigned binary_scale;
-        Dwarf_Unsigned signature;
+        std::optional<Dwarf_Off> definition;  // DW_AT_signature: type unitの型定義DIE offset
         Dwarf_Unsigned accessibility;
         std::optional<Dwarf_Unsigned> count;
         std::optional<Dwarf_Unsigned> upper_bound;
@@ -225,7 +253,7 @@ struct dwarf_info
               data_bit_offset(0),
               data_member_location(0),
               binary_scale(0),
-              signature(0),
+              definition(),
               accessibility(0),
               encoding(0),
               endianity(0),
@@ -240,6 +268,26 @@ struct dwarf_info
         }
     };
 
+    // 関数内のDW_TAG_lexical_block
+    // ブロック内のローカル変数は、pcがブロックの範囲内のときだけ有効
+    struct lexical_block_info
+    {
+        std::optional<Dwarf_Unsigned> low_pc;
+        std::optional<Dwarf_Unsigned> high_pc;
+        bool high_pc_is_offset;  // high_pcがlow_pcからのoffset(DWARF4以降のconstantクラス)
+        // DW_AT_ranges のアドレス範囲 [begin, end)
+        std::vector<std::pair<Dwarf_Addr, Dwarf_Addr>> range_list;
+        // 外側のブロック(func_info::block_listのindex)。関数直下のブロックはnullopt
+        std::optional<size_t> parent;
+        // var_tblに登録したブロック内ローカル変数のoffset
+        std::list<Dwarf_Off> local_var_list;
+
+        lexical_block_info() : low_pc(), high_pc(), high_pc_is_offset(false), range_list(), parent(), local_var_list() {
+        }
+        ~lexical_block_info() {
+        }
+    };
+
     // 関数情報
     struct func_info
     {
@@ -251,9 +299,11 @@ struct dwarf_info
         Dwarf_Unsigned decl_column;
         std::optional<Dwarf_Unsigned> low_pc;
         std::optional<Dwarf_Unsigned> high_pc;
+        bool high_pc_is_offset;  // high_pcがlow_pcからのoffset(DWARF4以降のconstantクラス)
         std::optional<dw_op_value> return_addr;
         std::optional<dw_op_value> frame_base;
-        std::optional<Dwarf_Off> type;  // reference
+        std::optional<Dwarf_Unsigned> frame_base_list;  // DW_AT_frame_base が位置リストのときのoffset
+        std::optional<Dwarf_Off> type;                  // reference
         std::optional<Dwarf_Off> location;
         bool declaration;  // 関数宣言のみが存在するときtrue?
         Dwarf_Unsigned const_value;
@@ -265,7 +315,9 @@ struct dwarf_info
         using var_node_t = Dwarf_Off;
         using var_list_t = std::list<var_node_t>;
         var_list_t param_list;
-        var_list_t local_var_list;
+        var_list_t local_var_list;  // 関数直下のローカル変数
+        // ネストしたlexical_block。外側のブロックが先に並ぶ
+        std::vector<lexical_block_info> block_list;
 
         // 付加情報
         compile_unit_info *cu_info;
@@ -281,8 +333,10 @@ struct dwarf_info
               decl_column(0),
               low_pc(),
               high_pc(),
+              high_pc_is_offset(false),
               return_addr(),
               frame_base(),
+              frame_base_list(),
               type(),
               location(),
               declaration(false),
@@ -292,6 +346,7 @@ struct dwarf_info
               specification(),
               param_list(),
               local_var_list(),
+              block_list(),
               decl_file_path(),
               has_definition(false) {
         }
@@ -315,10 +370,37 @@ struct dwarf_info
 
         // type_map操作関数
         T &make_new_info(Dwarf_Off offset) {
-            auto result = container.try_emplace(offset, T());
+            auto result = container.try_emplace(offset);
             return result.first->second;
         }
     };
+    // type unitのsignature索引
+    // DW_FORM_ref_sig8 の参照先(type unitの型DIE offset)を引く
+    struct type_signature_index
+    {
+        std::unordered_map<uint64_t, Dwarf_Off> container;
+
+        type_signature_index() : container() {
+        }
+
+        static uint64_t key(Dwarf_Sig8 const &sig) {
+            uint64_t value;
+            std::memcpy(&value, sig.signature, sizeof(value));
+            return value;
+        }
+
+        void add(Dwarf_Sig8 const &sig, Dwarf_Off offset) {
+            container.try_emplace(key(sig), offset);
+        }
+        std::optional<Dwarf_Off> find(Dwarf_Sig8 const &sig) const {
+            auto it = container.find(key(sig));
+            if (it == container.end()) {
+                return std::nullopt;
+            }
+            return it->second;
+        }
+    };
+
     // CompileUnitリスト
     using cu_info_container = info_container<compile_unit_info>;
     // 変数情報リスト
@@ -337,6 +419,8 @@ struct dwarf_info
     var_info_container var_tbl;
     type_info_container type_tbl;
     func_info_container func_tbl;
+    // type unitのsignature -> 型DIE offset
+    type_signature_index type_sig_tbl;
 
     // 必要ならバッファするように変更
     // cu_info_container cu_tbl;
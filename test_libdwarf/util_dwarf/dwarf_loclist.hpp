@@ -0,0 +1,406 @@
+#pragma once
+
+#define LIBDWARF_STATIC 1
+#include <dwarf.h>
+#include <libdwarf.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "LEB128.hpp"
+#include "dwarf_expr_ir.hpp"
+#include "utility.hpp"
+
+namespace util_dwarf {
+
+// 位置リスト
+// PC範囲ごとのコンパイル済みDWARF expressionをlow_pc昇順に保持する
+class dw_location_list {
+public:
+    struct range
+    {
+        Dwarf_Addr low_pc;   // 範囲に含む
+        Dwarf_Addr high_pc;  // 範囲に含まない
+        dw_expr_program const *expr;
+
+        range(Dwarf_Addr low, Dwarf_Addr high, dw_expr_program const *expr_) : low_pc(low), high_pc(high), expr(expr_) {
+        }
+    };
+
+private:
+    std::vector<range> range_list_;
+    // range_list_[0..i] のhigh_pc最大値。範囲が重なるときの探索打ち切りに使う
+    std::vector<Dwarf_Addr> max_high_pc_;
+    // DW_LLE_default_location: どの範囲にも該当しないときの場所
+    dw_expr_program const *default_expr_;
+
+public:
+    dw_location_list() : range_list_(), max_high_pc_(), default_expr_(nullptr) {
+    }
+
+    void add(Dwarf_Addr low_pc, Dwarf_Addr high_pc, dw_expr_program const *expr) {
+        if (low_pc < high_pc) {
+            range_list_.emplace_back(low_pc, high_pc, expr);
+        }
+    }
+    void set_default(dw_expr_program const *expr) {
+        default_expr_ = expr;
+    }
+    // 全範囲を追加したら呼び出す
+    void finish() {
+        std::stable_sort(range_list_.begin(), range_list_.end(), [](range const &lhs, range const &rhs) { return lhs.low_pc < rhs.low_pc; });
+        max_high_pc_.resize(range_list_.size());
+        Dwarf_Addr max_high = 0;
+        for (size_t i = 0; i < range_list_.size(); i++) {
+            max_high        = std::max(max_high, range_list_[i].high_pc);
+            max_high_pc_[i] = max_high;
+        }
+    }
+
+    // pcにおける場所を返す。該当なし(変数が存在しない)のときはnullptr
+    dw_expr_program const *find(Dwarf_Addr pc) const {
+        // low_pc <= pc となる最後の範囲から遡る
+        auto it = std::upper_bound(range_list_.begin(), range_list_.end(), pc, [](Dwarf_Addr value, range const &elem) { return value < elem.low_pc; });
+        auto i  = static_cast<size_t>(it - range_list_.begin());
+        while (i > 0 && pc < max_high_pc_[i - 1]) {
+            i--;
+            if (pc < range_list_[i].high_pc) {
+                return range_list_[i].expr;
+            }
+        }
+        return default_expr_;
+    }
+
+    std::vector<range> const &get_range_list() const {
+        return range_list_;
+    }
+    dw_expr_program const *get_default() const {
+        return default_expr_;
+    }
+    bool empty() const {
+        return range_list_.empty() && default_expr_ == nullptr;
+    }
+};
+
+// DW_AT_location/DW_AT_frame_base の遅延デコード
+// 解析時は位置リストへの参照だけを記録し、問い合わせがあった変数についてだけ
+// DIEを再取得してlibdwarfで位置リストを展開、各エントリの式をコンパイルする
+// 結果はDIE offset + DW_AT_* ごとにキャッシュする
+// 単一のDWARF expression(exprloc)も全PC範囲のエントリ1つとして扱う
+class dwarf_location_resolver {
+    Dwarf_Debug dw_dbg_;
+    Dwarf_Error dw_error_;
+    // (アドレスサイズ, offsetサイズ) ごとのキャッシュ
+    // コンパイル結果は位置リストから参照するため破棄しない
+    std::map<std::pair<Dwarf_Half, Dwarf_Half>, dw_expr_cache> cache_map_;
+    std::map<std::pair<Dwarf_Off, Dwarf_Half>, std::unique_ptr<dw_location_list>> list_map_;
+
+public:
+    dwarf_location_resolver() : dw_dbg_(nullptr), dw_error_(nullptr), cache_map_(), list_map_() {
+    }
+
+    // 対象のDwarf_Debugを設定する。キャッシュは破棄する
+    void reset(Dwarf_Debug dbg) {
+        dw_dbg_ = dbg;
+        list_map_.clear();
+        cache_map_.clear();
+    }
+
+    // die_offsetのDIEが持つattrの位置リストを返す
+    // attrを持たない、デコードできないときはnullptr
+    dw_location_list const *get(Dwarf_Off die_offset, Dwarf_Half attr = DW_AT_location, bool is_info = true) {
+        auto key = std::make_pair(die_offset, attr);
+        auto it  = list_map_.find(key);
+        if (it == list_map_.end()) {
+            it = list_map_.emplace(key, decode(die_offset, attr, is_info)).first;
+        }
+        return it->second.get();
+    }
+
+    // die_offsetの変数がpcで存在する場所を返す。存在しないときはnullptr
+    dw_expr_program const *find(Dwarf_Off die_offset, Dwarf_Addr pc, Dwarf_Half attr = DW_AT_location, bool is_info = true) {
+        auto list = get(die_offset, attr, is_info);
+        if (list == nullptr) {
+            return nullptr;
+        }
+        return list->find(pc);
+    }
+
+    // デコード済みの位置リスト数
+    size_t size() const {
+        return list_map_.size();
+    }
+
+private:
+    std::unique_ptr<dw_location_list> decode(Dwarf_Off die_offset, Dwarf_Half attr, bool is_info) {
+        if (dw_dbg_ == nullptr) {
+            return nullptr;
+        }
+        Dwarf_Die die = nullptr;
+        int result    = dwarf_offdie_b(dw_dbg_, die_offset, is_info, &die, &dw_error_);
+        if (result != DW_DLV_OK) {
+            if (result == DW_DLV_ERROR) {
+                utility::error_happen(&dw_error_);
+            }
+            return nullptr;
+        }
+        std::unique_ptr<dw_location_list> list;
+        Dwarf_Attribute dw_attr = nullptr;
+        result                  = dwarf_attr(die, attr, &dw_attr, &dw_error_);
+        if (result == DW_DLV_OK) {
+            list = decode_attr(die, dw_attr);
+            dwarf_dealloc_attribute(dw_attr);
+        } else if (result == DW_DLV_ERROR) {
+            utility::error_happen(&dw_error_);
+        }
+        dwarf_dealloc_die(die);
+        return list;
+    }
+
+    std::unique_ptr<dw_location_list> decode_attr(Dwarf_Die die, Dwarf_Attribute dw_attr) {
+        // 式のオペランドサイズ
+        Dwarf_Half addr_size   = 0;
+        Dwarf_Half version     = 0;
+        Dwarf_Half offset_size = 0;
+        if (dwarf_get_die_address_size(die, &addr_size, &dw_error_) != DW_DLV_OK) {
+            utility::error_happen(&dw_error_);
+            return nullptr;
+        }
+        dwarf_get_version_of_die(die, &version, &offset_size);
+        auto &cache = cache_map_[std::make_pair(addr_size, offset_size)];
+        cache.pointer_size(addr_size);
+        cache.offset_size(offset_size);
+
+        Dwarf_Loc_Head_c head = nullptr;
+        Dwarf_Unsigned count  = 0;
+        int result            = dwarf_get_loclist_c(dw_attr, &head, &count, &dw_error_);
+        if (result != DW_DLV_OK) {
+            if (result == DW_DLV_ERROR) {
+                utility::error_happen(&dw_error_);
+            }
+            return nullptr;
+        }
+        unsigned int kind = DW_LKIND_unknown;
+        dwarf_get_loclist_head_kind(head, &kind, &dw_error_);
+
+        auto list = std::make_unique<dw_location_list>();
+        std::vector<uint8_t> buff;
+        for (Dwarf_Unsigned i = 0; i < count; i++) {
+            Dwarf_Small lle_value      = 0;
+            Dwarf_Unsigned raw_low     = 0;
+            Dwarf_Unsigned raw_high    = 0;
+            Dwarf_Bool addr_unavail    = false;
+            Dwarf_Addr low_pc          = 0;
+            Dwarf_Addr high_pc         = 0;
+            Dwarf_Unsigned op_count    = 0;
+            Dwarf_Locdesc_c locdesc    = nullptr;
+            Dwarf_Small source         = 0;
+            Dwarf_Unsigned expr_offset = 0;
+            Dwarf_Unsigned desc_offset = 0;
+            result = dwarf_get_locdesc_entry_d(head, i, &lle_value, &raw_low, &raw_high, &addr_unavail, &low_pc, &high_pc, &op_count, &locdesc, &source,
+                                               &expr_offset, &desc_offset, &dw_error_);
+            if (result != DW_DLV_OK) {
+                if (result == DW_DLV_ERROR) {
+                    utility::error_happen(&dw_error_);
+                }
+                break;
+            }
+            // base address, end of list はPC範囲を持たない
+            if (lle_value == DW_LLE_end_of_list || lle_value == DW_LLE_base_address || lle_value == DW_LLE_base_addressx) {
+                continue;
+            }
+            // split DWARFで.debug_addrを参照できない
+            if (addr_unavail) {
+                continue;
+            }
+            // 空の式は「この範囲では値なし」なので登録しない
+            if (op_count == 0) {
+                continue;
+            }
+            buff.clear();
+            if (!encode(locdesc, op_count, addr_size, offset_size, buff)) {
+                continue;
+            }
+            auto &prog = cache.get(buff.data(), buff.size());
+            if (!prog.is_valid()) {
+                continue;
+            }
+            if (kind == DW_LKIND_expression) {
+                // 単一の式: 全PC範囲
+                list->set_default(&prog);
+            } else if (lle_value == DW_LLE_default_location) {
+                list->set_default(&prog);
+            } else {
+                list->add(low_pc, high_pc, &prog);
+            }
+        }
+        dwarf_dealloc_loc_head_c(head);
+        list->finish();
+        return list;
+    }
+
+    // libdwarfがデコードした命令列をバイト列に再エンコードする
+    // キャッシュキーを内容ベースで共有するため、LEB128は最短形式に揃える
+    // DW_OP_skip/bra の分岐offsetは再エンコード後の位置で付け直す
+    bool encode(Dwarf_Locdesc_c locdesc, Dwarf_Unsigned op_count, Dwarf_Half addr_size, Dwarf_Half offset_size, std::vector<uint8_t> &out) {
+        // 元の位置 -> 再エンコード後の位置
+        std::vector<std::pair<Dwarf_Unsigned, size_t>> offset_map;
+        // (分岐オペランド位置, 元の分岐先)
+        std::vector<std::pair<size_t, Dwarf_Unsigned>> branch_list;
+
+        for (Dwarf_Unsigned i = 0; i < op_count; i++) {
+            Dwarf_Small op          = 0;
+            Dwarf_Unsigned opd1     = 0;
+            Dwarf_Unsigned opd2     = 0;
+            Dwarf_Unsigned opd3     = 0;
+            Dwarf_Unsigned op_begin = 0;
+            int result              = dwarf_get_location_op_value_c(locdesc, i, &op, &opd1, &opd2, &opd3, &op_begin, &dw_error_);
+            if (result != DW_DLV_OK) {
+                if (result == DW_DLV_ERROR) {
+                    utility::error_happen(&dw_error_);
+                }
+                return false;
+            }
+            offset_map.emplace_back(op_begin, out.size());
+            out.push_back(op);
+
+            if ((DW_OP_lit0 <= op && op <= DW_OP_lit31) || (DW_OP_reg0 <= op && op <= DW_OP_reg31)) {
+                continue;
+            }
+            if (DW_OP_breg0 <= op && op <= DW_OP_breg31) {
+                leb128::encode_signed(out, static_cast<int64_t>(opd1));
+                continue;
+            }
+            switch (op) {
+                case DW_OP_addr:
+                    put_fixed(out, opd1, addr_size);
+                    break;
+                case DW_OP_const1u:
+                case DW_OP_const1s:
+                case DW_OP_pick:
+                case DW_OP_deref_size:
+                case DW_OP_xderef_size:
+                    put_fixed(out, opd1, 1);
+                    break;
+                case DW_OP_const2u:
+                case DW_OP_const2s:
+                case DW_OP_call2:
+                    put_fixed(out, opd1, 2);
+                    break;
+                case DW_OP_const4u:
+                case DW_OP_const4s:
+                case DW_OP_call4:
+                    put_fixed(out, opd1, 4);
+                    break;
+                case DW_OP_const8u:
+                case DW_OP_const8s:
+                    put_fixed(out, opd1, 8);
+                    break;
+                case DW_OP_call_ref:
+                    put_fixed(out, opd1, offset_size);
+                    break;
+                case DW_OP_constu:
+                case DW_OP_plus_uconst:
+                case DW_OP_regx:
+                case DW_OP_piece:
+                case DW_OP_addrx:
+                case DW_OP_constx:
+                case DW_OP_GNU_addr_index:
+                case DW_OP_GNU_const_index:
+                case DW_OP_convert:
+                case DW_OP_GNU_convert:
+                case DW_OP_reinterpret:
+                case DW_OP_GNU_reinterpret:
+                    leb128::encode_unsigned(out, opd1);
+                    break;
+                case DW_OP_consts:
+                case DW_OP_fbreg:
+                    leb128::encode_signed(out, static_cast<int64_t>(opd1));
+                    break;
+                case DW_OP_bregx:
+                    leb128::encode_unsigned(out, opd1);
+                    leb128::encode_signed(out, static_cast<int64_t>(opd2));
+                    break;
+                case DW_OP_bit_piece:
+                case DW_OP_regval_type:
+                case DW_OP_GNU_regval_type:
+                    leb128::encode_unsigned(out, opd1);
+                    leb128::encode_unsigned(out, opd2);
+                    break;
+                case DW_OP_deref_type:
+                case DW_OP_GNU_deref_type:
+                case DW_OP_xderef_type:
+                    put_fixed(out, opd1, 1);
+                    leb128::encode_unsigned(out, opd2);
+                    break;
+                case DW_OP_implicit_pointer:
+                case DW_OP_GNU_implicit_pointer:
+                    put_fixed(out, opd1, offset_size);
+                    leb128::encode_signed(out, static_cast<int64_t>(opd2));
+                    break;
+                case DW_OP_skip:
+                case DW_OP_bra: {
+                    // 元の分岐先 = 命令直後 + 符号付き16bit offset
+                    auto offset = static_cast<int16_t>(opd1);
+                    branch_list.emplace_back(out.size(), static_cast<Dwarf_Unsigned>(static_cast<int64_t>(op_begin) + 3 + offset));
+                    put_fixed(out, 0, 2);
+                    break;
+                }
+                case DW_OP_implicit_value:
+                case DW_OP_entry_value:
+                case DW_OP_GNU_entry_value:
+                    // opd1: byte数, opd2: データへのポインタ
+                    leb128::encode_unsigned(out, opd1);
+                    put_block(out, opd2, opd1);
+                    break;
+                case DW_OP_const_type:
+                case DW_OP_GNU_const_type:
+                    // opd1: 型DIE offset, opd2: byte数, opd3: データへのポインタ
+                    leb128::encode_unsigned(out, opd1);
+                    put_fixed(out, opd2, 1);
+                    put_block(out, opd3, opd2);
+                    break;
+                default:
+                    // オペランドなし、または未対応(コンパイル時に検出する)
+                    break;
+            }
+        }
+
+        // 分岐先を付け直す
+        for (auto &[pos, target] : branch_list) {
+            auto it = std::find_if(offset_map.begin(), offset_map.end(), [target](auto const &elem) { return elem.first == target; });
+            size_t new_target;
+            if (it != offset_map.end()) {
+                new_target = it->second;
+            } else if (offset_map.empty() || target > offset_map.back().first) {
+                // 式の末尾
+                new_target = out.size();
+            } else {
+                return false;
+            }
+            auto offset  = static_cast<int64_t>(new_target) - static_cast<int64_t>(pos + 2);
+            out[pos]     = static_cast<uint8_t>(offset & 0xFF);
+            out[pos + 1] = static_cast<uint8_t>((offset >> 8) & 0xFF);
+        }
+        return true;
+    }
+
+    static void put_fixed(std::vector<uint8_t> &out, Dwarf_Unsigned value, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+        }
+    }
+    static void put_block(std::vector<uint8_t> &out, Dwarf_Unsigned ptr, Dwarf_Unsigned size) {
+        auto data = reinterpret_cast<uint8_t const *>(static_cast<uintptr_t>(ptr));
+        if (data != nullptr) {
+            out.insert(out.end(), data, data + size);
+        }
+    }
+};
+
+}  // namespace util_dwarf
@@ -0,0 +1,325 @@
+#pragma once
+
+#define LIBDWARF_STATIC 1
+#include <dwarf.h>
+#include <libdwarf.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace util_dwarf {
+
+// 解析処理のプロファイラ
+// dwarf_analyze_option::profiler, debug_info::option::profiler に設定したときだけ計測する
+// 未設定(nullptr)のときは各計測箇所でポインタチェックのみ行う
+class dwarf_profiler {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // 計測フェーズ
+    enum phase : uint32_t
+    {
+        analyze,       // dwarf_analyzer::analyze 全体
+        debug_line,    // .debug_line 解析
+        compile_unit,  // DW_TAG_compile_unit のattribute解析
+        die_tree,      // CU配下のDIE解析
+        build_var,     // debug_info::build_var_info
+        build_type,    // debug_info::build_type_info
+        output,        // 出力処理
+        phase_max,
+    };
+
+    struct phase_info
+    {
+        uint64_t count;
+        clock::duration wall;
+        std::clock_t cpu;
+
+        phase_info() : count(0), wall(0), cpu(0) {
+        }
+    };
+
+    // CU毎の計測情報
+    struct cu_time
+    {
+        Dwarf_Off offset;
+        std::string name;
+        clock::duration wall;
+        uint64_t die_count;
+
+        cu_time(Dwarf_Off offset_) : offset(offset_), name(), wall(0), die_count(0) {
+        }
+    };
+
+    // trace event (Chrome trace event format の complete event)
+    struct trace_event
+    {
+        char const *name;  // nullptrのときはCUイベント
+        size_t cu_idx;
+        clock::time_point begin;
+        clock::duration dur;
+
+        trace_event(char const *name_, size_t cu_idx_, clock::time_point begin_, clock::duration dur_)
+            : name(name_), cu_idx(cu_idx_), begin(begin_), dur(dur_) {
+        }
+    };
+
+    // フェーズ計測用スコープ
+    // profilerがnullptrなら何もしない
+    class scope {
+        dwarf_profiler *prof_;
+        phase phase_;
+        clock::time_point begin_;
+        std::clock_t cpu_begin_;
+
+    public:
+        scope(dwarf_profiler *prof, phase ph) : prof_(prof), phase_(ph), begin_(), cpu_begin_(0) {
+            if (prof_ != nullptr) {
+                begin_     = clock::now();
+                cpu_begin_ = std::clock();
+            }
+        }
+        ~scope() {
+            if (prof_ != nullptr) {
+                prof_->end_phase(phase_, begin_, cpu_begin_);
+            }
+        }
+        scope(scope const &)            = delete;
+        scope &operator=(scope const &) = delete;
+    };
+
+private:
+    static constexpr size_t half_max = 0x10000;
+
+    clock::time_point start_;
+    phase_info phase_tbl_[phase_max];
+    std::vector<cu_time> cu_list_;
+    clock::time_point cu_begin_;
+    std::vector<trace_event> trace_list_;
+    // DW_TAG_*, DW_FORM_* は Dwarf_Half なので直接インデックスにする
+    std::vector<uint64_t> tag_count_;
+    std::vector<uint64_t> form_count_;
+    std::map<std::string, uint64_t> no_impl_count_;
+    uint64_t expr_eval_count_;
+    uint64_t expr_op_count_;
+    uint64_t expr_compile_count_;
+
+public:
+    dwarf_profiler()
+        : start_(clock::now()),
+          phase_tbl_(),
+          cu_list_(),
+          cu_begin_(),
+          trace_list_(),
+          tag_count_(half_max, 0),
+          form_count_(half_max, 0),
+          no_impl_count_(),
+          expr_eval_count_(0),
+          expr_op_count_(0),
+          expr_compile_count_(0) {
+    }
+    ~dwarf_profiler() {
+    }
+
+    static char const *phase_name(phase ph) {
+        switch (ph) {
+            case analyze:
+                return "analyze";
+            case debug_line:
+                return "debug_line";
+            case compile_unit:
+                return "compile_unit";
+            case die_tree:
+                return "die_tree";
+            case build_var:
+                return "build_var_info";
+            case build_type:
+                return "build_type_info";
+            case output:
+                return "output";
+            case phase_max:
+            default:
+                return "unknown";
+        }
+    }
+
+    void end_phase(phase ph, clock::time_point begin, std::clock_t cpu_begin) {
+        auto end   = clock::now();
+        auto &info = phase_tbl_[ph];
+        info.count++;
+        info.wall += end - begin;
+        info.cpu += std::clock() - cpu_begin;
+        trace_list_.emplace_back(phase_name(ph), 0, begin, end - begin);
+    }
+
+    // CU計測
+    void begin_cu(Dwarf_Off offset) {
+        cu_list_.emplace_back(offset);
+        cu_begin_ = clock::now();
+    }
+    void end_cu(std::string const *name) {
+        auto end = clock::now();
+        auto &cu = cu_list_.back();
+        cu.wall  = end - cu_begin_;
+        if (name != nullptr) {
+            cu.name = *name;
+        }
+        trace_list_.emplace_back(nullptr, cu_list_.size() - 1, cu_begin_, cu.wall);
+    }
+
+    // カウンタ
+    void count_die(Dwarf_Half tag) {
+        tag_count_[tag]++;
+        if (!cu_list_.empty()) {
+            cu_list_.back().die_count++;
+        }
+    }
+    void count_form(Dwarf_Half form) {
+        form_count_[form]++;
+    }
+    // is_compiled: キャッシュになくコンパイルしたときtrue
+    void count_expr(size_t op_count, bool is_compiled) {
+        expr_eval_count_++;
+        expr_op_count_ += op_count;
+        if (is_compiled) {
+            expr_compile_count_++;
+        }
+    }
+    void count_no_impl(char const *where, char const *name, unsigned int code) {
+        std::string key(where);
+        key += " : ";
+        key += (name != nullptr) ? name : "<unknown>";
+        key += " (" + std::to_string(code) + ")";
+        no_impl_count_[key]++;
+    }
+
+    phase_info const &get_phase(phase ph) const {
+        return phase_tbl_[ph];
+    }
+    std::vector<cu_time> const &get_cu_list() const {
+        return cu_list_;
+    }
+
+    // 集計結果をテーブル形式で出力する
+    void print_summary(FILE *fp, size_t cu_top = 10) const {
+        fprintf(fp, "== profile ==\n");
+        fprintf(fp, "%-16s %8s %12s %12s\n", "phase", "count", "wall[ms]", "cpu[ms]");
+        for (uint32_t i = 0; i < phase_max; i++) {
+            auto &info = phase_tbl_[i];
+            fprintf(fp, "%-16s %8llu %12.3f %12.3f\n", phase_name(static_cast<phase>(i)), static_cast<unsigned long long>(info.count), to_ms(info.wall),
+                    static_cast<double>(info.cpu) * 1000.0 / CLOCKS_PER_SEC);
+        }
+
+        // CU: 時間がかかった順
+        std::vector<cu_time const *> cu_sorted;
+        cu_sorted.reserve(cu_list_.size());
+        for (auto &cu : cu_list_) {
+            cu_sorted.push_back(&cu);
+        }
+        std::sort(cu_sorted.begin(), cu_sorted.end(), [](cu_time const *a, cu_time const *b) { return a->wall > b->wall; });
+        fprintf(fp, "\n-- compile unit : %zu (top %zu) --\n", cu_sorted.size(), std::min(cu_top, cu_sorted.size()));
+        fprintf(fp, "%12s %8s %10s  %s\n", "wall[ms]", "DIEs", "offset", "name");
+        for (size_t i = 0; i < cu_sorted.size() && i < cu_top; i++) {
+            auto &cu = *cu_sorted[i];
+            fprintf(fp, "%12.3f %8llu 0x%08llX  %s\n", to_ms(cu.wall), static_cast<unsigned long long>(cu.die_count),
+                    static_cast<unsigned long long>(cu.offset), cu.name.c_str());
+        }
+
+        fprintf(fp, "\n-- DIE count by tag --\n");
+        print_count_tbl(fp, tag_count_, dwarf_get_TAG_name);
+        fprintf(fp, "\n-- attribute count by form --\n");
+        print_count_tbl(fp, form_count_, dwarf_get_FORM_name);
+
+        fprintf(fp, "\n-- no impl --\n");
+        for (auto &[key, count] : no_impl_count_) {
+            fprintf(fp, "%10llu  %s\n", static_cast<unsigned long long>(count), key.c_str());
+        }
+
+        fprintf(fp, "\n-- DWARF expression --\n");
+        fprintf(fp, "eval : %llu, DW_OP : %llu, compile : %llu\n", static_cast<unsigned long long>(expr_eval_count_),
+                static_cast<unsigned long long>(expr_op_count_), static_cast<unsigned long long>(expr_compile_count_));
+    }
+
+    // Chrome trace event format (chrome://tracing, Perfetto) で出力する
+    bool write_trace(char const *path) const {
+        FILE *fp = fopen(path, "w");
+        if (fp == nullptr) {
+            fprintf(stderr, "cannot open file : %s\n", path);
+            return false;
+        }
+        fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        bool is_first = true;
+        for (auto &ev : trace_list_) {
+            if (!is_first) {
+                fprintf(fp, ",\n");
+            }
+            is_first = false;
+            auto ts  = std::chrono::duration_cast<std::chrono::microseconds>(ev.begin - start_).count();
+            auto dur = std::chrono::duration_cast<std::chrono::microseconds>(ev.dur).count();
+            if (ev.name != nullptr) {
+                fprintf(fp, "{\"name\":\"%s\",\"cat\":\"phase\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":1}", ev.name,
+                        static_cast<long long>(ts), static_cast<long long>(dur));
+            } else {
+                auto &cu = cu_list_[ev.cu_idx];
+                fprintf(fp, "{\"name\":\"");
+                write_json_str(fp, cu.name);
+                fprintf(fp, "\",\"cat\":\"cu\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":1,\"args\":{\"offset\":%llu,\"dies\":%llu}}",
+                        static_cast<long long>(ts), static_cast<long long>(dur), static_cast<unsigned long long>(cu.offset),
+                        static_cast<unsigned long long>(cu.die_count));
+            }
+        }
+        fprintf(fp, "\n]}\n");
+        fclose(fp);
+        return true;
+    }
+
+private:
+    static double to_ms(clock::duration dur) {
+        return std::chrono::duration<double, std::milli>(dur).count();
+    }
+
+    template <typename Func>
+    static void print_count_tbl(FILE *fp, std::vector<uint64_t> const &tbl, Func &&get_name) {
+        // 件数の多い順
+        std::vector<std::pair<uint64_t, unsigned int>> list;
+        for (size_t i = 0; i < tbl.size(); i++) {
+            if (tbl[i] != 0) {
+                list.emplace_back(tbl[i], static_cast<unsigned int>(i));
+            }
+        }
+        std::sort(list.begin(), list.end(), [](auto const &a, auto const &b) { return a.first > b.first; });
+        for (auto &[count, code] : list) {
+            char const *name = nullptr;
+            get_name(code, &name);
+            fprintf(fp, "%10llu  %s (0x%X)\n", static_cast<unsigned long long>(count), (name != nullptr) ? name : "<unknown>", code);
+        }
+    }
+
+    static void write_json_str(FILE *fp, std::string const &str) {
+        for (auto c : str) {
+            switch (c) {
+                case '"':
+                    fputs("\\\"", fp);
+                    break;
+                case '\\':
+                    fputs("\\\\", fp);
+                    break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        fprintf(fp, "\\u%04X", static_cast<unsigned int>(c));
+                    } else {
+                        fputc(c, fp);
+                    }
+                    break;
+            }
+        }
+    }
+};
+
+}  // namespace util_dwarf
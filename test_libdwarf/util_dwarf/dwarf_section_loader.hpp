@@ -0,0 +1,548 @@
+#pragma once
+
+#define LIBDWARF_STATIC 1
+#include <dwarf.h>
+#include <libdwarf.h>
+#include <zlib.h>
+#include <zstd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "elf_section.hpp"
+#include "mapped_file.hpp"
+#include "work_stealing_pool.hpp"
+
+namespace util_dwarf {
+
+// 圧縮debugセクションの展開オプション
+struct section_loader_option
+{
+    // 展開に使うスレッドプール。nullptrのときは呼び出しスレッドで展開する
+    work_stealing_pool *pool;
+    // 展開結果のキャッシュ先ディレクトリ(作成済みであること)。空のときはキャッシュしない
+    std::string cache_dir;
+
+    section_loader_option() : pool(nullptr), cache_dir() {
+    }
+};
+
+// libdwarfへセクションを渡すオブジェクトアクセス(dwarf_object_init_b用)
+// libdwarfのELF読み込みは圧縮セクション(SHF_COMPRESSED/.zdebug_*)を参照時に1つずつ展開するため、
+// open時に圧縮debugセクションをまとめてpool上で並列に展開し、展開後のデータをlibdwarfへ渡す
+// zstdで複数フレームに分かれているセクションはフレーム単位で分割して並列に展開する(zlibは1ストリームなので分割できない)
+// cache_dirを指定すると展開結果をファイルへ保存し、次回以降はmmapして展開を省略する
+// キャッシュは展開元(ELFのパス/更新日時/サイズ、セクションのファイル内位置/圧縮サイズ)で識別し、圧縮データ全体のハッシュは取らない
+// 再配置が必要なオブジェクト(ET_REL)と圧縮debugセクションが無いELFは扱わないので、open()がfalseのときはdwarf_init_pathで開く
+class dwarf_section_loader {
+public:
+    struct stats
+    {
+        size_t section_count;  // 展開した圧縮セクション数
+        size_t task_count;     // 展開タスク数
+        size_t cache_hit_count;
+        uint64_t compressed_bytes;
+        uint64_t decompressed_bytes;
+
+        stats() : section_count(0), task_count(0), cache_hit_count(0), compressed_bytes(0), decompressed_bytes(0) {
+        }
+    };
+
+private:
+    // Elf_Chdr::ch_type
+    static constexpr uint32_t elfcompress_zlib = 1;
+    static constexpr uint32_t elfcompress_zstd = 2;
+    // これより小さいzstdフレームは隣接フレームとまとめて1タスクにする
+    static constexpr size_t min_task_bytes = size_t(1) << 20;
+    // キャッシュファイル先頭の識別子。形式を変えたら更新する
+    static constexpr char cache_magic[8] = {'D', 'W', 'S', 'C', 'A', 'C', 'H', '1'};
+    // 展開データの開始位置の境界
+    static constexpr size_t cache_data_align = 16;
+
+    // キャッシュファイルのヘッダ。直後に展開元ELFのパス(path_size byte)が続き、cache_data_align境界から展開データが続く
+    // 読み込み時にすべて一致することを確認してから使う
+    struct cache_header
+    {
+        char magic[8];
+        int64_t mtime;
+        uint64_t file_size;
+        uint64_t section_offset;
+        uint64_t src_size;
+        uint64_t dst_size;
+        uint32_t format;
+        uint32_t path_size;
+    };
+
+    // 展開単位。zstdは連続するフレームの範囲、zlibはセクション全体
+    struct chunk
+    {
+        size_t src_offset;
+        size_t src_size;
+        size_t dst_offset;
+        size_t dst_size;
+    };
+
+    struct compressed_section
+    {
+        size_t index;  // セクション番号
+        uint32_t format;
+        uint64_t file_offset;  // セクションのファイル内位置
+        uint8_t const *src;    // 圧縮データ(圧縮ヘッダを除く)
+        size_t src_size;
+        size_t dst_size;
+        std::unique_ptr<uint8_t[]> buff;
+        mapped_file cache;
+        size_t cache_data_offset;  // キャッシュファイル内の展開データ位置
+        bool is_cache_hit;
+        std::atomic<bool> is_error;
+
+        compressed_section()
+            : index(0),
+              format(0),
+              file_offset(0),
+              src(nullptr),
+              src_size(0),
+              dst_size(0),
+              buff(),
+              cache(),
+              cache_data_offset(0),
+              is_cache_hit(false),
+              is_error(false) {
+        }
+    };
+
+    // キャッシュの識別に使う展開元ELFの情報
+    struct cache_source
+    {
+        std::string path;  // 絶対パス
+        int64_t mtime;
+        uint64_t file_size;
+
+        cache_source() : path(), mtime(0), file_size(0) {
+        }
+    };
+
+    elf::section_reader reader_;
+    // libdwarfへ見せるセクション情報。圧縮セクションは展開後のサイズ/データに置き換える
+    std::vector<elf::section_reader::section> section_list_;
+    std::vector<std::unique_ptr<compressed_section>> compressed_list_;
+    cache_source source_;
+    Dwarf_Obj_Access_Interface_a interface_;
+    stats stats_;
+
+public:
+    dwarf_section_loader() : reader_(), section_list_(), compressed_list_(), source_(), interface_(), stats_() {
+    }
+    ~dwarf_section_loader() {
+        close();
+    }
+    dwarf_section_loader(dwarf_section_loader const &)            = delete;
+    dwarf_section_loader &operator=(dwarf_section_loader const &) = delete;
+
+    bool open(char const *path, section_loader_option const &opt) {
+        if (!reader_.open(path)) {
+            return false;
+        }
+        if (reader_.file_type() == elf::section_reader::et_rel) {
+            close();
+            return false;
+        }
+        section_list_ = reader_.sections();
+        for (size_t i = 0; i < section_list_.size(); i++) {
+            collect(i);
+        }
+        if (compressed_list_.empty()) {
+            close();
+            return false;
+        }
+        bool is_cache = !opt.cache_dir.empty() && get_cache_source(path);
+        if (is_cache) {
+            load_cache(opt);
+        }
+        if (!decompress(opt.pool)) {
+            close();
+            return false;
+        }
+        if (is_cache) {
+            store_cache(opt);
+        }
+        for (auto &cs : compressed_list_) {
+            section_list_[cs->index].data = cs->is_cache_hit ? cs->cache.data() + cs->cache_data_offset : cs->buff.get();
+        }
+
+        interface_.ai_object  = this;
+        interface_.ai_methods = &methods;
+        return true;
+    }
+    void close() {
+        compressed_list_.clear();
+        section_list_.clear();
+        source_ = cache_source();
+        reader_.close();
+        stats_ = stats();
+    }
+
+    bool is_open() const {
+        return reader_.is_open();
+    }
+    elf::section_reader const &reader() const {
+        return reader_;
+    }
+    // 展開後のセクション情報(セクション番号順)
+    std::vector<elf::section_reader::section> const &sections() const {
+        return section_list_;
+    }
+    // dwarf_object_init_bへ渡す。close()まで有効
+    Dwarf_Obj_Access_Interface_a *interface() {
+        return &interface_;
+    }
+    stats const &get_stats() const {
+        return stats_;
+    }
+
+    // 展開後のセクション。.zdebug_*は.debug_*の名前で参照する
+    elf::section_reader::section const *find(std::string_view name) const {
+        for (auto const &sec : section_list_) {
+            if (sec.name == name) {
+                return &sec;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    // 圧縮debugセクションを登録し、libdwarfへ見せるセクション情報を展開後のものにする
+    void collect(size_t index) {
+        auto &sec      = section_list_[index];
+        bool is_zdebug = sec.name.starts_with(".zdebug_");
+        if (sec.data == nullptr || !(is_zdebug || (sec.is_compressed && sec.name.starts_with(".debug_")))) {
+            return;
+        }
+        auto cs         = std::make_unique<compressed_section>();
+        cs->index       = index;
+        cs->file_offset = sec.offset;
+        size_t header_size;
+        if (is_zdebug) {
+            // "ZLIB" + 展開後サイズ(8byte, big endian)
+            header_size = 12;
+            if (sec.size < header_size || std::memcmp(sec.data, "ZLIB", 4) != 0) {
+                return;
+            }
+            cs->format   = elfcompress_zlib;
+            cs->dst_size = static_cast<size_t>(elf::section_reader::read(sec.data + 4, 8, true));
+        } else {
+            // Elf64_Chdr : ch_type(4), ch_reserved(4), ch_size(8), ch_addralign(8)
+            // Elf32_Chdr : ch_type(4), ch_size(4), ch_addralign(4)
+            header_size = reader_.is_64bit() ? 24 : 12;
+            if (sec.size < header_size) {
+                return;
+            }
+            cs->format   = static_cast<uint32_t>(reader_.read(sec.data, 4));
+            cs->dst_size = static_cast<size_t>(reader_.is_64bit() ? reader_.read(sec.data + 8, 8) : reader_.read(sec.data + 4, 4));
+        }
+        if (cs->format != elfcompress_zlib && cs->format != elfcompress_zstd) {
+            // 未対応形式はlibdwarfに任せる
+            fprintf(stderr, "dwarf_section_loader : unknown compression type(%u) : %s\n", cs->format, sec.name.c_str());
+            return;
+        }
+        cs->src      = sec.data + header_size;
+        cs->src_size = static_cast<size_t>(sec.size - header_size);
+
+        if (is_zdebug) {
+            sec.name = ".debug_" + sec.name.substr(std::string_view(".zdebug_").size());
+        }
+        sec.size          = cs->dst_size;
+        sec.flags        &= ~elf::section_reader::shf_compressed;
+        sec.is_compressed = false;
+        sec.data          = nullptr;
+        stats_.section_count++;
+        stats_.compressed_bytes   += cs->src_size;
+        stats_.decompressed_bytes += cs->dst_size;
+        compressed_list_.push_back(std::move(cs));
+    }
+
+    template <typename Func>
+    static void run(work_stealing_pool *pool, Func &&func) {
+        if (pool != nullptr) {
+            pool->submit(std::forward<Func>(func));
+        } else {
+            func();
+        }
+    }
+    static void wait(work_stealing_pool *pool) {
+        if (pool != nullptr) {
+            pool->wait();
+        }
+    }
+
+    bool decompress(work_stealing_pool *pool) {
+        for (auto &cs : compressed_list_) {
+            if (cs->is_cache_hit) {
+                continue;
+            }
+            cs->buff = std::make_unique_for_overwrite<uint8_t[]>(cs->dst_size);
+            std::vector<chunk> chunk_list;
+            if (cs->format == elfcompress_zstd) {
+                chunk_list = split_zstd(*cs);
+            } else {
+                chunk_list.push_back(chunk{0, cs->src_size, 0, cs->dst_size});
+            }
+            stats_.task_count += chunk_list.size();
+            for (auto const &c : chunk_list) {
+                auto ptr = cs.get();
+                run(pool, [ptr, c] { decompress_chunk(*ptr, c); });
+            }
+        }
+        wait(pool);
+
+        bool is_ok = true;
+        for (auto &cs : compressed_list_) {
+            if (cs->is_error) {
+                fprintf(stderr, "dwarf_section_loader : decompress failed : %s\n", section_list_[cs->index].name.c_str());
+                is_ok = false;
+            }
+        }
+        return is_ok;
+    }
+
+    // zstdのフレーム境界で分割する
+    // フレームヘッダに展開後サイズが無い、フレームの合計が展開後サイズと一致しない等のときはセクション全体を1つにする
+    static std::vector<chunk> split_zstd(compressed_section const &cs) {
+        std::vector<chunk> chunk_list;
+        chunk whole{0, cs.src_size, 0, cs.dst_size};
+        size_t src_pos = 0;
+        size_t dst_pos = 0;
+        while (src_pos < cs.src_size) {
+            auto frame_src = ZSTD_findFrameCompressedSize(cs.src + src_pos, cs.src_size - src_pos);
+            if (ZSTD_isError(frame_src)) {
+                return {whole};
+            }
+            auto frame_dst = ZSTD_getFrameContentSize(cs.src + src_pos, frame_src);
+            if (frame_dst == ZSTD_CONTENTSIZE_UNKNOWN || frame_dst == ZSTD_CONTENTSIZE_ERROR || frame_dst > cs.dst_size - dst_pos) {
+                return {whole};
+            }
+            // 小さいフレームは直前のタスクにまとめる(連続するフレームは1回のZSTD_decompressで展開できる)
+            if (!chunk_list.empty() && chunk_list.back().dst_size < min_task_bytes) {
+                chunk_list.back().src_size += frame_src;
+                chunk_list.back().dst_size += static_cast<size_t>(frame_dst);
+            } else {
+                chunk_list.push_back(chunk{src_pos, frame_src, dst_pos, static_cast<size_t>(frame_dst)});
+            }
+            src_pos += frame_src;
+            dst_pos += static_cast<size_t>(frame_dst);
+        }
+        if (dst_pos != cs.dst_size || chunk_list.empty()) {
+            return {whole};
+        }
+        return chunk_list;
+    }
+
+    static void decompress_chunk(compressed_section &cs, chunk c) {
+        auto src = cs.src + c.src_offset;
+        auto dst = cs.buff.get() + c.dst_offset;
+        bool is_ok;
+        if (cs.format == elfcompress_zstd) {
+            auto result = ZSTD_decompress(dst, c.dst_size, src, c.src_size);
+            is_ok       = !ZSTD_isError(result) && result == c.dst_size;
+        } else {
+            uLongf dst_len = static_cast<uLongf>(c.dst_size);
+            auto result    = uncompress(dst, &dst_len, src, static_cast<uLong>(c.src_size));
+            is_ok          = (result == Z_OK) && dst_len == c.dst_size;
+        }
+        if (!is_ok) {
+            cs.is_error = true;
+        }
+    }
+
+    // キャッシュの識別に使う展開元ELFの情報を取得する。取得できないときはキャッシュを使わない
+    bool get_cache_source(char const *path) {
+        std::error_code ec;
+        auto abs_path = std::filesystem::absolute(path, ec);
+        if (ec) {
+            return false;
+        }
+        auto mtime = std::filesystem::last_write_time(abs_path, ec);
+        if (ec) {
+            return false;
+        }
+        auto file_size = std::filesystem::file_size(abs_path, ec);
+        if (ec) {
+            return false;
+        }
+        source_.path      = abs_path.lexically_normal().string();
+        source_.mtime     = static_cast<int64_t>(mtime.time_since_epoch().count());
+        source_.file_size = static_cast<uint64_t>(file_size);
+        return true;
+    }
+
+    cache_header make_cache_header(compressed_section const &cs) const {
+        cache_header header;
+        std::memcpy(header.magic, cache_magic, sizeof(header.magic));
+        header.mtime          = source_.mtime;
+        header.file_size      = source_.file_size;
+        header.section_offset = cs.file_offset;
+        header.src_size       = cs.src_size;
+        header.dst_size       = cs.dst_size;
+        header.format         = cs.format;
+        header.path_size      = static_cast<uint32_t>(source_.path.size());
+        return header;
+    }
+
+    // ヘッダ+パスの後ろの展開データ位置
+    size_t get_cache_data_offset() const {
+        auto size = sizeof(cache_header) + source_.path.size();
+        return (size + cache_data_align - 1) / cache_data_align * cache_data_align;
+    }
+
+    // ファイル名は識別情報のハッシュ(FNV-1a)。衝突してもヘッダの照合で弾く
+    std::string cache_path(section_loader_option const &opt, cache_header const &header) const {
+        uint64_t h   = 0xcbf29ce484222325ull;
+        auto combine = [&h](uint64_t value) {
+            h ^= value;
+            h *= 0x100000001b3ull;
+        };
+        for (auto c : source_.path) {
+            combine(static_cast<unsigned char>(c));
+        }
+        combine(static_cast<uint64_t>(header.mtime));
+        combine(header.file_size);
+        combine(header.section_offset);
+        combine(header.src_size);
+        combine(header.dst_size);
+        combine(header.format);
+        char name[64];
+        snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(h));
+        return opt.cache_dir + "/" + name;
+    }
+
+    // キャッシュのヘッダと展開元パスが一致するか
+    bool verify_cache(compressed_section const &cs, size_t data_offset) const {
+        auto expected = make_cache_header(cs);
+        if (cs.cache.size() != data_offset + cs.dst_size) {
+            return false;
+        }
+        cache_header header;
+        std::memcpy(&header, cs.cache.data(), sizeof(header));
+        if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.mtime != expected.mtime ||
+            header.file_size != expected.file_size || header.section_offset != expected.section_offset || header.src_size != expected.src_size ||
+            header.dst_size != expected.dst_size || header.format != expected.format || header.path_size != expected.path_size) {
+            return false;
+        }
+        return std::memcmp(cs.cache.data() + sizeof(header), source_.path.data(), source_.path.size()) == 0;
+    }
+
+    // キャッシュの検索。ヘッダの照合だけなので並列化しない
+    void load_cache(section_loader_option const &opt) {
+        auto data_offset = get_cache_data_offset();
+        for (auto &cs : compressed_list_) {
+            if (cs->dst_size == 0 || !cs->cache.open(cache_path(opt, make_cache_header(*cs)).c_str())) {
+                continue;
+            }
+            if (!verify_cache(*cs, data_offset)) {
+                cs->cache.close();
+                continue;
+            }
+            cs->cache_data_offset = data_offset;
+            cs->is_cache_hit      = true;
+            stats_.cache_hit_count++;
+        }
+    }
+
+    // 展開したセクションをキャッシュへ書き出す
+    // 一時ファイルに書いてからrenameするので、書き込み途中のファイルを他プロセスが読むことはない
+    void store_cache(section_loader_option const &opt) {
+        for (auto &cs : compressed_list_) {
+            if (cs->is_cache_hit || cs->dst_size == 0) {
+                continue;
+            }
+            auto ptr    = cs.get();
+            auto header = make_cache_header(*cs);
+            run(opt.pool, [this, ptr, header, &opt] {
+                auto path     = cache_path(opt, header);
+                auto tmp_path = path + ".tmp";
+                FILE *fp      = fopen(tmp_path.c_str(), "wb");
+                if (fp == nullptr) {
+                    fprintf(stderr, "dwarf_section_loader : cannot open file : %s\n", tmp_path.c_str());
+                    return;
+                }
+                // ヘッダ, 展開元パス, 境界までの0埋め, 展開データ
+                std::vector<uint8_t> prefix(get_cache_data_offset(), 0);
+                std::memcpy(prefix.data(), &header, sizeof(header));
+                std::memcpy(prefix.data() + sizeof(header), source_.path.data(), source_.path.size());
+                bool is_ok = (fwrite(prefix.data(), 1, prefix.size(), fp) == prefix.size());
+                is_ok      = is_ok && (fwrite(ptr->buff.get(), 1, ptr->dst_size, fp) == ptr->dst_size);
+                is_ok      = (fclose(fp) == 0) && is_ok;
+                if (!is_ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+                    std::remove(tmp_path.c_str());
+                }
+            });
+        }
+        wait(opt.pool);
+    }
+
+    // Dwarf_Obj_Access_Methods_a
+    static int get_section_info(void *obj, Dwarf_Unsigned index, Dwarf_Obj_Access_Section_a *ret, int *error) {
+        auto self = static_cast<dwarf_section_loader *>(obj);
+        if (index >= self->section_list_.size()) {
+            *error = DW_DLE_MDE;
+            return DW_DLV_ERROR;
+        }
+        auto const &sec   = self->section_list_[index];
+        ret->as_name      = sec.name.c_str();
+        ret->as_type      = sec.type;
+        ret->as_flags     = sec.flags;
+        ret->as_addr      = sec.addr;
+        ret->as_offset    = sec.offset;
+        ret->as_size      = sec.size;
+        ret->as_link      = sec.link;
+        ret->as_info      = sec.info;
+        ret->as_addralign = sec.addralign;
+        ret->as_entrysize = sec.entsize;
+        return DW_DLV_OK;
+    }
+    static Dwarf_Small get_byte_order(void *obj) {
+        return static_cast<dwarf_section_loader *>(obj)->reader_.is_big_endian() ? DW_END_big : DW_END_little;
+    }
+    static Dwarf_Small get_length_size(void *obj) {
+        // libdwarfのELF読み込みと同じくELFクラスのサイズを返す
+        return static_cast<dwarf_section_loader *>(obj)->reader_.is_64bit() ? 8 : 4;
+    }
+    static Dwarf_Small get_pointer_size(void *obj) {
+        return static_cast<dwarf_section_loader *>(obj)->reader_.is_64bit() ? 8 : 4;
+    }
+    static Dwarf_Unsigned get_filesize(void *obj) {
+        return static_cast<dwarf_section_loader *>(obj)->reader_.file_size();
+    }
+    static Dwarf_Unsigned get_section_count(void *obj) {
+        return static_cast<dwarf_section_loader *>(obj)->section_list_.size();
+    }
+    static int load_section(void *obj, Dwarf_Unsigned index, Dwarf_Small **data, int *error) {
+        auto self = static_cast<dwarf_section_loader *>(obj);
+        if (index >= self->section_list_.size()) {
+            *error = DW_DLE_MDE;
+            return DW_DLV_ERROR;
+        }
+        auto const &sec = self->section_list_[index];
+        if (sec.data == nullptr) {
+            return DW_DLV_NO_ENTRY;
+        }
+        // libdwarfは再配置しない限り書き換えない
+        *data = const_cast<Dwarf_Small *>(sec.data);
+        return DW_DLV_OK;
+    }
+
+    // 再配置はしない(ET_RELは扱わない)
+    static constexpr Dwarf_Obj_Access_Methods_a methods = {
+        get_section_info, get_byte_order, get_length_size, get_pointer_size, get_filesize, get_section_count, load_section, nullptr,
+    };
+};
+
+}  // namespace util_dwarf
@@ -0,0 +1,101 @@
+#pragma once
+
+#define LIBDWARF_STATIC 1
+#include <dwarf.h>
+#include <libdwarf.h>
+
+#include <cstdint>
+#include <optional>
+
+#include "elf_section.hpp"
+
+namespace util_dwarf {
+
+// DWARF5のindex形式form(strx/addrx/rnglistx/loclistx)の参照先テーブル
+// unit毎に DW_AT_str_offsets_base/addr_base/rnglists_base/loclists_base が指すテーブル先頭を
+// mmapしたセクション内の生ポインタで保持し、index -> 値 を範囲チェックと1回のloadで解決する
+// セクションが見つからない/圧縮されている等でテーブルが無効のときはnulloptを返すので、呼び出し側でlibdwarfにフォールバックする
+struct dwarf_unit_base
+{
+    struct table
+    {
+        uint8_t const *base;  // base属性が指す位置(最初の要素)
+        size_t count;         // セクション末尾までの要素数
+        uint8_t entry_size;
+
+        table() : base(nullptr), count(0), entry_size(0) {
+        }
+    };
+
+    table str_offsets;  // .debug_str_offsets : .debug_str内のoffset
+    table addr;         // .debug_addr        : アドレス
+    table rnglists;     // .debug_rnglists    : rnglists_baseからのoffset
+    table loclists;     // .debug_loclists    : loclists_baseからのoffset
+    Dwarf_Off rnglists_base;
+    Dwarf_Off loclists_base;
+    char const *debug_str;
+    size_t debug_str_size;
+    bool is_big_endian;
+
+    dwarf_unit_base()
+        : str_offsets(),
+          addr(),
+          rnglists(),
+          loclists(),
+          rnglists_base(0),
+          loclists_base(0),
+          debug_str(nullptr),
+          debug_str_size(0),
+          is_big_endian(false) {
+    }
+
+    // sectionのbase位置から要素サイズentry_sizeのテーブルを作る
+    static table make_table(elf::section_reader::section const *sec, std::optional<Dwarf_Off> base, size_t entry_size) {
+        table tbl;
+        if (sec == nullptr || sec->data == nullptr || sec->is_compressed || !base || *base > sec->size || entry_size == 0) {
+            return tbl;
+        }
+        tbl.base       = sec->data + *base;
+        tbl.count      = static_cast<size_t>((sec->size - *base) / entry_size);
+        tbl.entry_size = static_cast<uint8_t>(entry_size);
+        return tbl;
+    }
+
+    std::optional<uint64_t> load(table const &tbl, Dwarf_Unsigned index) const {
+        if (index >= tbl.count) {
+            return std::nullopt;
+        }
+        return elf::section_reader::read(tbl.base + index * tbl.entry_size, tbl.entry_size, is_big_endian);
+    }
+
+    // DW_FORM_strx*
+    char const *str(Dwarf_Unsigned index) const {
+        auto offset = load(str_offsets, index);
+        if (!offset || debug_str == nullptr || *offset >= debug_str_size) {
+            return nullptr;
+        }
+        return debug_str + *offset;
+    }
+    // DW_FORM_addrx*
+    std::optional<Dwarf_Unsigned> address(Dwarf_Unsigned index) const {
+        return load(addr, index);
+    }
+    // DW_FORM_rnglistx : .debug_rnglists先頭からのoffset
+    std::optional<Dwarf_Off> rnglist_offset(Dwarf_Unsigned index) const {
+        auto offset = load(rnglists, index);
+        if (!offset) {
+            return std::nullopt;
+        }
+        return rnglists_base + *offset;
+    }
+    // DW_FORM_loclistx : .debug_loclists先頭からのoffset
+    std::optional<Dwarf_Off> loclist_offset(Dwarf_Unsigned index) const {
+        auto offset = load(loclists, index);
+        if (!offset) {
+            return std::nullopt;
+        }
+        return loclists_base + *offset;
+    }
+};
+
+}  // namespace util_dwarf
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+namespace util_dwarf {
+
+namespace elf {
+
+// ELFのセクションヘッダを読み、セクションデータをmmap領域の生ポインタで参照する
+// ELF32/ELF64, little/big endianに対応する
+// SHF_COMPRESSEDのセクションはdataが圧縮データを指すので is_compressed で判定する
+class section_reader {
+public:
+    static constexpr uint16_t et_rel         = 1;
+    static constexpr uint32_t sht_nobits     = 8;
+    static constexpr uint64_t shf_compressed = 0x800;
+
+    struct section
+    {
+        std::string name;
+        uint32_t type;    // SHT_*
+        uint64_t flags;   // SHF_*
+        uint64_t addr;    // ロードアドレス
+        uint64_t offset;  // ファイル先頭からのoffset
+        uint64_t size;
+        uint32_t link;
+        uint32_t info;
+        uint64_t addralign;
+        uint64_t entsize;
+        uint8_t const *data;  // SHT_NOBITS/範囲外のときnullptr
+        bool is_compressed;
+
+        section()
+            : name(),
+              type(0),
+              flags(0),
+              addr(0),
+              offset(0),
+              size(0),
+              link(0),
+              info(0),
+              addralign(0),
+              entsize(0),
+              data(nullptr),
+              is_compressed(false) {
+        }
+    };
+
+private:
+    mapped_file file_;
+    std::vector<section> section_list_;
+    bool is_64bit_;
+    bool is_big_endian_;
+    uint16_t file_type_;
+
+public:
+    section_reader() : file_(), section_list_(), is_64bit_(false), is_big_endian_(false), file_type_(0) {
+    }
+
+    bool open(char const *path) {
+        if (!file_.open(path)) {
+            return false;
+        }
+        if (!parse()) {
+            fprintf(stderr, "elf::section_reader : invalid ELF : %s\n", path);
+            close();
+            return false;
+        }
+        return true;
+    }
+    void close() {
+        section_list_.clear();
+        file_.close();
+    }
+
+    bool is_open() const {
+        return file_.is_open();
+    }
+    bool is_64bit() const {
+        return is_64bit_;
+    }
+    bool is_big_endian() const {
+        return is_big_endian_;
+    }
+    // e_type(ET_*)
+    uint16_t file_type() const {
+        return file_type_;
+    }
+    size_t file_size() const {
+        return file_.size();
+    }
+    std::vector<section> const &sections() const {
+        return section_list_;
+    }
+
+    // 同名セクションが複数あるときは最初のもの
+    section const *find(std::string_view name) const {
+        for (auto const &sec : section_list_) {
+            if (sec.name == name) {
+                return &sec;
+            }
+        }
+        return nullptr;
+    }
+
+    // ELFのエンディアンで値を読む
+    uint64_t read(uint8_t const *ptr, size_t size) const {
+        return read(ptr, size, is_big_endian_);
+    }
+    static uint64_t read(uint8_t const *ptr, size_t size, bool is_big_endian) {
+        if (is_big_endian == (std::endian::native == std::endian::big)) {
+            switch (size) {
+                case 1:
+                    return *ptr;
+                case 2: {
+                    uint16_t value;
+                    std::memcpy(&value, ptr, sizeof(value));
+                    return value;
+                }
+                case 4: {
+                    uint32_t value;
+                    std::memcpy(&value, ptr, sizeof(value));
+                    return value;
+                }
+                case 8: {
+                    uint64_t value;
+                    std::memcpy(&value, ptr, sizeof(value));
+                    return value;
+                }
+                default:
+                    break;
+            }
+        }
+        // ネイティブと異なるエンディアン、または半端なサイズ
+        uint64_t value = 0;
+        for (size_t i = 0; i < size; i++) {
+            size_t pos = is_big_endian ? i : (size - 1 - i);
+            value      = (value << 8) | ptr[pos];
+        }
+        return value;
+    }
+
+private:
+    bool parse() {
+        auto base = file_.data();
+        auto size = file_.size();
+        // e_ident
+        if (size < 16 || std::memcmp(base, "\x7f" "ELF", 4) != 0) {
+            return false;
+        }
+        is_64bit_      = (base[4] == 2);
+        is_big_endian_ = (base[5] == 2);
+        if ((base[4] != 1 && base[4] != 2) || (base[5] != 1 && base[5] != 2)) {
+            return false;
+        }
+        file_type_ = static_cast<uint16_t>(read(base + 0x10, 2));
+
+        // ELFヘッダ
+        uint64_t shoff;
+        uint64_t shentsize;
+        uint64_t shnum;
+        uint64_t shstrndx;
+        if (is_64bit_) {
+            if (size < 0x40) {
+                return false;
+            }
+            shoff     = read(base + 0x28, 8);
+            shentsize = read(base + 0x3A, 2);
+            shnum     = read(base + 0x3C, 2);
+            shstrndx  = read(base + 0x3E, 2);
+        } else {
+            if (size < 0x34) {
+                return false;
+            }
+            shoff     = read(base + 0x20, 4);
+            shentsize = read(base + 0x2E, 2);
+            shnum     = read(base + 0x30, 2);
+            shstrndx  = read(base + 0x32, 2);
+        }
+        if (shoff == 0) {
+            // セクションヘッダなし
+            return true;
+        }
+        if (shentsize < (is_64bit_ ? 0x40u : 0x28u) || shoff > size) {
+            return false;
+        }
+        // セクション数が0xff00以上のときは先頭セクションヘッダに格納されている
+        if (shnum == 0 || shstrndx == 0xFFFF) {
+            if (shoff + shentsize > size) {
+                return false;
+            }
+            auto first = read_header(base + shoff);
+            if (shnum == 0) {
+                shnum = first.size;
+            }
+            if (shstrndx == 0xFFFF) {
+                shstrndx = first.link;
+            }
+        }
+        if (shnum > (size - shoff) / shentsize) {
+            return false;
+        }
+
+        section_list_.reserve(shnum);
+        std::vector<uint32_t> name_list;
+        name_list.reserve(shnum);
+        for (uint64_t i = 0; i < shnum; i++) {
+            auto ptr = base + shoff + i * shentsize;
+            name_list.push_back(static_cast<uint32_t>(read(ptr, 4)));
+            auto &sec = section_list_.emplace_back(read_header(ptr));
+            if (sec.type != sht_nobits && sec.offset <= size && sec.size <= size - sec.offset) {
+                sec.data = base + sec.offset;
+            }
+            sec.is_compressed = (sec.flags & shf_compressed) != 0;
+        }
+
+        // セクション名
+        if (shstrndx < section_list_.size() && section_list_[shstrndx].data != nullptr) {
+            auto const &strtab = section_list_[shstrndx];
+            auto strtab_data   = reinterpret_cast<char const *>(strtab.data);
+            for (size_t i = 0; i < section_list_.size(); i++) {
+                if (name_list[i] < strtab.size) {
+                    section_list_[i].name = std::string(strtab_data + name_list[i], strnlen(strtab_data + name_list[i], strtab.size - name_list[i]));
+                }
+            }
+        }
+        return true;
+    }
+
+    section read_header(uint8_t const *ptr) const {
+        section sec;
+        if (is_64bit_) {
+            sec.type      = static_cast<uint32_t>(read(ptr + 0x04, 4));
+            sec.flags     = read(ptr + 0x08, 8);
+            sec.addr      = read(ptr + 0x10, 8);
+            sec.offset    = read(ptr + 0x18, 8);
+            sec.size      = read(ptr + 0x20, 8);
+            sec.link      = static_cast<uint32_t>(read(ptr + 0x28, 4));
+            sec.info      = static_cast<uint32_t>(read(ptr + 0x2C, 4));
+            sec.addralign = read(ptr + 0x30, 8);
+            sec.entsize   = read(ptr + 0x38, 8);
+        } else {
+            sec.type      = static_cast<uint32_t>(read(ptr + 0x04, 4));
+            sec.flags     = read(ptr + 0x08, 4);
+            sec.addr      = read(ptr + 0x0C, 4);
+            sec.offset    = read(ptr + 0x10, 4);
+            sec.size      = read(ptr + 0x14, 4);
+            sec.link      = static_cast<uint32_t>(read(ptr + 0x18, 4));
+            sec.info      = static_cast<uint32_t>(read(ptr + 0x1C, 4));
+            sec.addralign = read(ptr + 0x20, 4);
+            sec.entsize   = read(ptr + 0x24, 4);
+        }
+        return sec;
+    }
+};
+
+}  // namespace elf
+
+}  // namespace util_dwarf
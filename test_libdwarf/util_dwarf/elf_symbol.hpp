@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "elf_section.hpp"
+
+namespace util_dwarf {
+
+namespace elf {
+
+// .symtab/.dynsymのデータオブジェクト(STT_OBJECT)をシンボル名で引く索引
+// キーはmmap領域の文字列テーブルを参照するので、section_readerを閉じるまで有効
+// 同名のシンボルはglobal/weakをlocalより優先する。同じ優先度で異なるアドレスのものが複数あるときは曖昧として引けなくする
+class symbol_table {
+public:
+    static constexpr uint32_t sht_symtab = 2;
+    static constexpr uint32_t sht_dynsym = 11;
+    static constexpr uint8_t stt_object  = 1;
+    static constexpr uint8_t stb_local   = 0;
+
+    struct symbol
+    {
+        uint64_t address;
+        uint64_t size;
+        bool is_local;
+        bool is_ambiguous;
+
+        symbol() : address(0), size(0), is_local(false), is_ambiguous(false) {
+        }
+    };
+
+private:
+    std::unordered_map<std::string_view, symbol> index_;
+
+public:
+    symbol_table() : index_() {
+    }
+
+    void clear() {
+        index_.clear();
+    }
+    size_t size() const {
+        return index_.size();
+    }
+
+    // section_listのSHT_SYMTAB/SHT_DYNSYMをすべて登録する
+    // st_valueをアドレスとして扱うので、ET_REL(st_valueがセクション内offset)のファイルには使わない
+    void build(std::vector<section_reader::section> const &section_list, bool is_64bit, bool is_big_endian) {
+        index_.clear();
+        for (auto const &sec : section_list) {
+            if (sec.type != sht_symtab && sec.type != sht_dynsym) {
+                continue;
+            }
+            if (sec.data == nullptr || sec.is_compressed || sec.link >= section_list.size()) {
+                continue;
+            }
+            auto const &strtab = section_list[sec.link];
+            if (strtab.data == nullptr || strtab.is_compressed) {
+                continue;
+            }
+            add(sec, strtab, is_64bit, is_big_endian);
+        }
+    }
+
+    // 見つからない、または曖昧なときはnullptr
+    symbol const *find(std::string_view name) const {
+        if (name.empty()) {
+            return nullptr;
+        }
+        auto it = index_.find(name);
+        if (it == index_.end() || it->second.is_ambiguous) {
+            return nullptr;
+        }
+        return &it->second;
+    }
+
+private:
+    void add(section_reader::section const &symtab, section_reader::section const &strtab, bool is_64bit, bool is_big_endian) {
+        // Elf64_Sym : st_name(4), st_info(1), st_other(1), st_shndx(2), st_value(8), st_size(8)
+        // Elf32_Sym : st_name(4), st_value(4), st_size(4), st_info(1), st_other(1), st_shndx(2)
+        size_t entry_size = is_64bit ? 24 : 16;
+        if (symtab.entsize >= entry_size) {
+            entry_size = static_cast<size_t>(symtab.entsize);
+        }
+        auto str     = reinterpret_cast<char const *>(strtab.data);
+        size_t count = static_cast<size_t>(symtab.size / entry_size);
+        index_.reserve(index_.size() + count);
+        // 先頭は未定義シンボル
+        for (size_t i = 1; i < count; i++) {
+            auto ptr         = symtab.data + i * entry_size;
+            auto name_offset = section_reader::read(ptr, 4, is_big_endian);
+            uint8_t info;
+            uint16_t shndx;
+            symbol sym;
+            if (is_64bit) {
+                info        = ptr[4];
+                shndx       = static_cast<uint16_t>(section_reader::read(ptr + 6, 2, is_big_endian));
+                sym.address = section_reader::read(ptr + 8, 8, is_big_endian);
+                sym.size    = section_reader::read(ptr + 16, 8, is_big_endian);
+            } else {
+                sym.address = section_reader::read(ptr + 4, 4, is_big_endian);
+                sym.size    = section_reader::read(ptr + 8, 4, is_big_endian);
+                info        = ptr[12];
+                shndx       = static_cast<uint16_t>(section_reader::read(ptr + 14, 2, is_big_endian));
+            }
+            // SHN_UNDEF, SHN_COMMON等の特殊セクションはアドレスが確定していない
+            // SHN_ABSは固定アドレスの変数定義に使われるので対象とする
+            if ((info & 0x0F) != stt_object || shndx == 0 || (shndx >= 0xFF00 && shndx != 0xFFF1)) {
+                continue;
+            }
+            if (name_offset >= strtab.size) {
+                continue;
+            }
+            auto name_ptr = str + name_offset;
+            std::string_view name(name_ptr, strnlen(name_ptr, static_cast<size_t>(strtab.size - name_offset)));
+            if (name.empty()) {
+                continue;
+            }
+            sym.is_local = ((info >> 4) == stb_local);
+            insert(name, sym);
+        }
+    }
+
+    void insert(std::string_view name, symbol const &sym) {
+        auto [it, is_new] = index_.try_emplace(name, sym);
+        if (is_new) {
+            return;
+        }
+        auto &cur = it->second;
+        if (cur.is_local && !sym.is_local) {
+            // global/weakを優先する
+            cur = sym;
+        } else if (cur.is_local == sym.is_local && cur.address != sym.address) {
+            // .symtabと.dynsymの重複は同じアドレスになる
+            cur.is_ambiguous = true;
+        }
+    }
+};
+
+}  // namespace elf
+
+}  // namespace util_dwarf
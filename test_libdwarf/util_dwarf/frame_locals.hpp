@@ -0,0 +1,462 @@
+#pragma once
+
+#define LIBDWARF_STATIC 1
+#include <dwarf.h>
+#include <libdwarf.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <variant>
+#include <vector>
+
+#include "dwarf_cfi.hpp"
+#include "dwarf_expr_ir.hpp"
+#include "dwarf_info.hpp"
+#include "dwarf_loclist.hpp"
+#include "func_index.hpp"
+#include "target_snapshot.hpp"
+
+namespace util_dwarf {
+
+// 停止位置における変数の値
+struct frame_variable
+{
+    enum state : uint8_t
+    {
+        available,      // 値を取得できた
+        optimized_out,  // このPCでは場所がない(位置リストの範囲外、DW_AT_locationなし)
+        unavailable,    // 場所はあるが値を取得できない(レジスタ/メモリがスナップショットにない、未対応の式)
+    };
+    using value_type = std::variant<std::monostate, uint64_t, int64_t, double>;
+
+    Dwarf_Off offset;  // var_tblのキー
+    dwarf_info::var_info const *var;
+    state status;
+    std::optional<uint64_t> address;  // メモリ上にあるときのアドレス
+    std::vector<uint8_t> data;        // 型のbyte_size分の値(ターゲットのエンディアン)
+    value_type value;                 // スカラ型(base/pointer/enum)のときデコードした値
+
+    frame_variable(Dwarf_Off offset_, dwarf_info::var_info const *var_)
+        : offset(offset_), var(var_), status(optimized_out), address(), data(), value() {
+    }
+};
+
+// 停止位置の関数フレーム
+struct frame_locals_view
+{
+    func_index::entry const *func;
+    std::optional<uint64_t> cfa;
+    std::optional<uint64_t> frame_base;  // DW_AT_frame_base の評価結果
+    std::vector<frame_variable> param_list;
+    std::vector<frame_variable> local_var_list;
+
+    frame_locals_view() : func(nullptr), cfa(), frame_base(), param_list(), local_var_list() {
+    }
+};
+
+// レジスタスナップショットとメモリイメージから、停止位置の関数の引数/ローカル変数を評価する
+// DW_OP_fbreg/bregN/regN 等の実行時情報が必要な式はコンパイル結果をキャッシュして評価する
+class frame_locals {
+    // 型の修飾をたどる上限(循環参照対策)
+    static constexpr size_t type_depth_max = 32;
+
+    dwarf_info const &dw_info_;
+    func_index const &funcs_;
+    // 位置リスト(var_info::location_list, func_info::frame_base_list)。nullptrのときは評価しない
+    dwarf_location_resolver *resolver_;
+    // DW_OP_call_frame_cfa 用。nullptrのときはCFAを必要とする式を評価できない
+    dwarf_cfi *cfi_;
+    dw_expr_cache cache_;
+    dw_expr_evaluator evaluator_;
+    size_t pointer_size_;
+
+public:
+    frame_locals(dwarf_info const &dw_info, func_index const &funcs, dwarf_location_resolver *resolver = nullptr, dwarf_cfi *cfi = nullptr)
+        : dw_info_(dw_info),
+          funcs_(funcs),
+          resolver_(resolver),
+          cfi_(cfi),
+          cache_(),
+          evaluator_(),
+          pointer_size_(dw_info.machine_arch.obj_pointersize) {
+        if (pointer_size_ == 0) {
+            pointer_size_ = 4;
+        }
+        cache_.pointer_size(pointer_size_);
+        evaluator_.pointer_size(pointer_size_);
+    }
+
+    // regs.pcを含む関数の引数/ローカル変数を評価する
+    // is_top: 停止位置のフレームのときtrue。呼び出し元フレーム(dwarf_cfi::backtrace の2番目以降)はfalse
+    // 関数が見つからないときはnullopt
+    std::optional<frame_locals_view> get(register_snapshot const &regs, memory_image const &mem, bool is_top = true) {
+        Dwarf_Addr pc = dwarf_cfi::lookup_pc(regs, is_top);
+        auto func     = funcs_.find(pc);
+        if (func == nullptr) {
+            return std::nullopt;
+        }
+
+        frame_locals_view view;
+        view.func = func;
+        if (cfi_ != nullptr) {
+            view.cfa = cfi_->get_cfa(regs, mem, is_top);
+        }
+
+        dw_expr_context ctx;
+        ctx.read_reg = [&regs](uint64_t reg_no) { return regs.get(reg_no); };
+        ctx.read_mem = [&mem](uint64_t addr, size_t size) { return mem.read(addr, size); };
+        ctx.cfa      = view.cfa;
+
+        // DW_AT_frame_base
+        view.frame_base = eval_frame_base(func->offset, *func->func, pc, regs, ctx);
+        ctx.frame_base  = view.frame_base;
+
+        // 引数/ローカル変数
+        view.param_list.reserve(func->func->param_list.size());
+        for (auto offset : func->func->param_list) {
+            view.param_list.push_back(eval_variable(offset, pc, regs, mem, ctx));
+        }
+        view.local_var_list.reserve(func->func->local_var_list.size());
+        for (auto offset : func->func->local_var_list) {
+            view.local_var_list.push_back(eval_variable(offset, pc, regs, mem, ctx));
+        }
+        // lexical_block内の変数はpcを含むブロックのものだけ評価する
+        // block_listは外側のブロックが先に並ぶので、親ブロックの判定は済んでいる
+        auto &block_list = func->func->block_list;
+        std::vector<bool> is_active(block_list.size(), false);
+        for (size_t i = 0; i < block_list.size(); i++) {
+            auto &block = block_list[i];
+            if (block.parent && !is_active[*block.parent]) {
+                continue;
+            }
+            if (!is_in_block(block, pc)) {
+                continue;
+            }
+            is_active[i] = true;
+            for (auto offset : block.local_var_list) {
+                view.local_var_list.push_back(eval_variable(offset, pc, regs, mem, ctx));
+            }
+        }
+        return view;
+    }
+    // dwarf_cfi::backtrace の結果の1フレームを評価する
+    std::optional<frame_locals_view> get(cfi_frame const &frame, memory_image const &mem, bool is_top) {
+        return get(frame.regs, mem, is_top);
+    }
+
+    dw_expr_cache &cache() {
+        return cache_;
+    }
+
+private:
+    // pcがlexical_blockの範囲内か
+    // pc範囲を持たないブロック(抽象インスタンス等)は外側のスコープと同じ扱いにする
+    static bool is_in_block(dwarf_info::lexical_block_info const &block, Dwarf_Addr pc) {
+        for (auto &[begin, end] : block.range_list) {
+            if (begin <= pc && pc < end) {
+                return true;
+            }
+        }
+        if (block.low_pc && block.high_pc) {
+            Dwarf_Addr low  = *block.low_pc;
+            Dwarf_Addr high = *block.high_pc;
+            if (block.high_pc_is_offset) {
+                high += low;
+            }
+            return low <= pc && pc < high;
+        }
+        return block.range_list.empty();
+    }
+
+    // 即値(固定アドレス)の取得。Dwarf_Signedで保持しているときはビット列をそのままアドレスとする
+    static std::optional<uint64_t> get_immediate(dw_op_value const &op) {
+        if (auto value = std::get_if<Dwarf_Unsigned>(&op.value)) {
+            return *value;
+        }
+        if (auto value = std::get_if<Dwarf_Signed>(&op.value)) {
+            return static_cast<uint64_t>(*value);
+        }
+        return std::nullopt;
+    }
+
+    std::optional<uint64_t> eval_frame_base(Dwarf_Off offset, dwarf_info::func_info const &func, Dwarf_Addr pc, register_snapshot const &regs,
+                                            dw_expr_context const &ctx) {
+        dw_expr_program const *prog = nullptr;
+        if (func.frame_base) {
+            if (func.frame_base->is_immediate) {
+                return get_immediate(*func.frame_base);
+            }
+            prog = &cache_.get(func.frame_base->expr.data(), func.frame_base->expr.size());
+        } else if (func.frame_base_list && resolver_ != nullptr) {
+            prog = resolver_->find(offset, pc, DW_AT_frame_base);
+        }
+        if (prog == nullptr) {
+            return std::nullopt;
+        }
+        auto result = evaluator_.eval(*prog, ctx);
+        if (!result || !result->pieces.empty()) {
+            return std::nullopt;
+        }
+        switch (result->loc) {
+            case dw_expr_result::memory:
+            case dw_expr_result::stack_value:
+                return result->value;
+            case dw_expr_result::reg:
+                // DW_OP_regN: レジスタの値がフレームベース
+                return regs.get(result->value);
+            case dw_expr_result::implicit_value:
+            case dw_expr_result::implicit_pointer:
+            case dw_expr_result::empty:
+            default:
+                return std::nullopt;
+        }
+    }
+
+    frame_variable eval_variable(Dwarf_Off offset, Dwarf_Addr pc, register_snapshot const &regs, memory_image const &mem,
+                                 dw_expr_context const &ctx) {
+        auto it = dw_info_.var_tbl.container.find(offset);
+        if (it == dw_info_.var_tbl.container.end()) {
+            return frame_variable(offset, nullptr);
+        }
+        auto &var = it->second;
+        frame_variable result(offset, &var);
+
+        // 場所
+        std::optional<dw_expr_result> loc;
+        if (var.location) {
+            if (var.location->is_immediate) {
+                // staticローカル変数等の固定アドレス
+                auto address = get_immediate(*var.location);
+                if (!address) {
+                    result.status = frame_variable::unavailable;
+                    return result;
+                }
+                loc = dw_expr_result(dw_expr_result::memory, *address);
+            } else {
+                loc = evaluator_.eval(cache_.get(var.location->expr.data(), var.location->expr.size()), ctx);
+                if (!loc) {
+                    result.status = frame_variable::unavailable;
+                    return result;
+                }
+            }
+        } else if (var.location_list && resolver_ != nullptr) {
+            auto prog = resolver_->find(offset, pc);
+            if (prog != nullptr) {
+                loc = evaluator_.eval(*prog, ctx);
+                if (!loc) {
+                    result.status = frame_variable::unavailable;
+                    return result;
+                }
+            }
+        }
+        if (!loc) {
+            return result;
+        }
+
+        // 値の取得
+        auto type     = (var.type) ? find_type(*var.type) : nullptr;
+        size_t size   = (type != nullptr) ? get_type_size(*type) : 0;
+        bool is_valid = false;
+        if (!loc->pieces.empty()) {
+            is_valid = read_pieces(*loc, regs, mem, result.data);
+        } else {
+            if (size == 0) {
+                // 型不明はアドレスサイズとして扱う
+                size = pointer_size_;
+            }
+            if (loc->loc == dw_expr_result::memory) {
+                result.address = loc->value;
+            }
+            is_valid = read_location(loc->loc, loc->value, loc->data, loc->size, size, regs, mem, result.data);
+        }
+        if (!is_valid) {
+            result.status = (loc->loc == dw_expr_result::empty && loc->pieces.empty()) ? frame_variable::optimized_out : frame_variable::unavailable;
+            result.data.clear();
+            return result;
+        }
+        result.status = frame_variable::available;
+        if (type != nullptr) {
+            result.value = decode_value(*type, result.data, mem.is_big_endian());
+        }
+        return result;
+    }
+
+    // 1つの場所からsize byteを読み出してdataに追加する
+    bool read_location(dw_expr_result::kind kind, uint64_t value, uint8_t const *implicit_data, size_t implicit_size, size_t size,
+                       register_snapshot const &regs, memory_image const &mem, std::vector<uint8_t> &data) {
+        switch (kind) {
+            case dw_expr_result::memory: {
+                auto pos = data.size();
+                data.resize(pos + size);
+                return mem.read(value, data.data() + pos, size);
+            }
+            case dw_expr_result::reg: {
+                auto reg_value = regs.get(value);
+                if (!reg_value) {
+                    return false;
+                }
+                append_value(data, *reg_value, size, mem.is_big_endian());
+                return true;
+            }
+            case dw_expr_result::stack_value:
+                append_value(data, value, size, mem.is_big_endian());
+                return true;
+            case dw_expr_result::implicit_value: {
+                // 足りない部分は0で埋める
+                auto pos = data.size();
+                data.resize(pos + size, 0);
+                std::memcpy(data.data() + pos, implicit_data, std::min(size, implicit_size));
+                return true;
+            }
+            case dw_expr_result::implicit_pointer:
+            case dw_expr_result::empty:
+            default:
+                // 参照先の値を持たない
+                return false;
+        }
+    }
+
+    // DW_OP_piece で構成される値を連結する(byte単位のpieceのみ対応)
+    bool read_pieces(dw_expr_result const &loc, register_snapshot const &regs, memory_image const &mem, std::vector<uint8_t> &data) {
+        for (auto &piece : loc.pieces) {
+            if (piece.size_bits % 8 != 0 || piece.offset_bits != 0) {
+                return false;
+            }
+            size_t size = piece.size_bits / 8;
+            if (!read_location(piece.loc, piece.value, piece.data, size, size, regs, mem, data)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // valueの下位size byteをターゲットのエンディアンでdataに追加する
+    static void append_value(std::vector<uint8_t> &data, uint64_t value, size_t size, bool is_big_endian) {
+        for (size_t i = 0; i < size; i++) {
+            size_t shift = (is_big_endian ? (size - 1 - i) : i) * 8;
+            data.push_back((shift < 64) ? static_cast<uint8_t>(value >> shift) : 0);
+        }
+    }
+
+    dwarf_info::type_info const *find_type(Dwarf_Off offset) const {
+        auto it = dw_info_.type_tbl.container.find(offset);
+        if (it == dw_info_.type_tbl.container.end()) {
+            return nullptr;
+        }
+        return &it->second;
+    }
+
+    // typedef/const/volatile/restrictを外した型
+    dwarf_info::type_info const *strip_type(dwarf_info::type_info const *type) const {
+        constexpr auto qualifier =
+            dwarf_info::type_tag::typedef_ | dwarf_info::type_tag::const_ | dwarf_info::type_tag::volatile_ | dwarf_info::type_tag::restrict_;
+        for (size_t depth = 0; type != nullptr && depth < type_depth_max; depth++) {
+            if ((type->tag & qualifier) == 0 || !type->type) {
+                return type;
+            }
+            type = find_type(*type->type);
+        }
+        return type;
+    }
+
+    size_t get_type_size(dwarf_info::type_info const &type_) const {
+        auto type = strip_type(&type_);
+        if (type == nullptr) {
+            return 0;
+        }
+        if (type->byte_size != 0) {
+            return type->byte_size;
+        }
+        if ((type->tag & (dwarf_info::type_tag::pointer | dwarf_info::type_tag::reference)) != 0) {
+            return pointer_size_;
+        }
+        if ((type->tag & dwarf_info::type_tag::array) != 0 && type->type) {
+            // 要素サイズ * 各次元の要素数
+            auto elem = find_type(*type->type);
+            if (elem == nullptr) {
+                return 0;
+            }
+            size_t size = get_type_size(*elem);
+            for (auto child : type->child_list) {
+                if (child->count) {
+                    size *= *child->count;
+                } else if (child->upper_bound) {
+                    size *= *child->upper_bound - child->lower_bound.value_or(0) + 1;
+                }
+            }
+            return size;
+        }
+        if ((type->tag & dwarf_info::type_tag::enum_) != 0 && type->type) {
+            // 基底型
+            auto base = find_type(*type->type);
+            return (base != nullptr) ? get_type_size(*base) : 0;
+        }
+        return 0;
+    }
+
+    // スカラ型の値をデコードする。struct/union/array等はmonostate
+    frame_variable::value_type decode_value(dwarf_info::type_info const &type_, std::vector<uint8_t> const &data, bool is_big_endian) const {
+        auto type = strip_type(&type_);
+        if (type == nullptr || data.empty() || data.size() > 8) {
+            return std::monostate();
+        }
+        uint64_t raw = 0;
+        for (size_t i = 0; i < data.size(); i++) {
+            size_t index = is_big_endian ? i : (data.size() - 1 - i);
+            raw          = (raw << 8) | data[index];
+        }
+        auto sign_extend = [&](uint64_t value) -> int64_t {
+            size_t bits = data.size() * 8;
+            if (bits < 64) {
+                auto shift = static_cast<unsigned int>(64 - bits);
+                return static_cast<int64_t>(value << shift) >> shift;
+            }
+            return static_cast<int64_t>(value);
+        };
+
+        if ((type->tag & (dwarf_info::type_tag::pointer | dwarf_info::type_tag::reference)) != 0) {
+            return raw;
+        }
+        Dwarf_Unsigned encoding = type->encoding;
+        if ((type->tag & dwarf_info::type_tag::enum_) != 0 && encoding == 0) {
+            // 列挙型の符号は基底型に従う。基底型なしはsignedとみなす
+            auto base = (type->type) ? strip_type(find_type(*type->type)) : nullptr;
+            encoding  = (base != nullptr && base->encoding != 0) ? base->encoding : DW_ATE_signed;
+        }
+        if ((type->tag & (dwarf_info::type_tag::base | dwarf_info::type_tag::enum_)) == 0) {
+            return std::monostate();
+        }
+        switch (encoding) {
+            case DW_ATE_signed:
+            case DW_ATE_signed_char:
+            case DW_ATE_signed_fixed:
+                return sign_extend(raw);
+            case DW_ATE_float:
+                if (data.size() == sizeof(float)) {
+                    float value;
+                    auto bits = static_cast<uint32_t>(raw);
+                    std::memcpy(&value, &bits, sizeof(value));
+                    return static_cast<double>(value);
+                }
+                if (data.size() == sizeof(double)) {
+                    double value;
+                    std::memcpy(&value, &raw, sizeof(value));
+                    return value;
+                }
+                return std::monostate();
+            case DW_ATE_boolean:
+            case DW_ATE_unsigned:
+            case DW_ATE_unsigned_char:
+            case DW_ATE_unsigned_fixed:
+            case DW_ATE_address:
+            case DW_ATE_UTF:
+                return raw;
+            default:
+                return std::monostate();
+        }
+    }
+};
+
+}  // namespace util_dwarf
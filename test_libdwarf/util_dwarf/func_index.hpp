@@ -0,0 +1,105 @@
+#pragma once
+
+#define LIBDWARF_STATIC 1
+#include <dwarf.h>
+#include <libdwarf.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "dwarf_info.hpp"
+
+namespace util_dwarf {
+
+// 関数のPC範囲 [low_pc, high_pc) を返す
+// high_pcがlow_pcからのoffsetのときは終了アドレスに変換する
+inline std::optional<std::pair<Dwarf_Addr, Dwarf_Addr>> get_func_pc_range(dwarf_info::func_info const &func) {
+    if (!func.low_pc || !func.high_pc) {
+        return std::nullopt;
+    }
+    Dwarf_Addr low  = *func.low_pc;
+    Dwarf_Addr high = *func.high_pc;
+    if (func.high_pc_is_offset) {
+        high += low;
+    }
+    if (low >= high) {
+        return std::nullopt;
+    }
+    return std::make_pair(low, high);
+}
+
+// PC -> 関数 の索引
+// dwarf_info::func_tbl から定義を持つ関数のPC範囲をlow_pc昇順に並べて二分探索する
+class func_index {
+public:
+    struct entry
+    {
+        Dwarf_Addr low_pc;   // 範囲に含む
+        Dwarf_Addr high_pc;  // 範囲に含まない
+        Dwarf_Off offset;    // func_tblのキー(DIE offset)
+        dwarf_info::func_info const *func;
+
+        entry(Dwarf_Addr low, Dwarf_Addr high, Dwarf_Off offset_, dwarf_info::func_info const *func_)
+            : low_pc(low), high_pc(high), offset(offset_), func(func_) {
+        }
+    };
+
+private:
+    std::vector<entry> entry_list_;
+    // entry_list_[0..i] のhigh_pc最大値。範囲が重なるときの探索打ち切りに使う
+    std::vector<Dwarf_Addr> max_high_pc_;
+
+public:
+    func_index() : entry_list_(), max_high_pc_() {
+    }
+
+    void build(dwarf_info const &dw_info) {
+        entry_list_.clear();
+        for (auto &[offset, func] : dw_info.func_tbl.container) {
+            if (!func.has_definition) {
+                continue;
+            }
+            auto range = get_func_pc_range(func);
+            if (range) {
+                entry_list_.emplace_back(range->first, range->second, offset, &func);
+            }
+        }
+        std::stable_sort(entry_list_.begin(), entry_list_.end(), [](entry const &lhs, entry const &rhs) { return lhs.low_pc < rhs.low_pc; });
+        max_high_pc_.resize(entry_list_.size());
+        Dwarf_Addr max_high = 0;
+        for (size_t i = 0; i < entry_list_.size(); i++) {
+            max_high        = std::max(max_high, entry_list_[i].high_pc);
+            max_high_pc_[i] = max_high;
+        }
+    }
+
+    // pcを含む関数を返す。該当なしのときはnullptr
+    // 範囲が重なるときはlow_pcが最も大きい(内側の)関数を返す
+    entry const *find(Dwarf_Addr pc) const {
+        auto it = std::upper_bound(entry_list_.begin(), entry_list_.end(), pc,
+                                   [](Dwarf_Addr value, entry const &elem) { return value < elem.low_pc; });
+        auto i  = static_cast<size_t>(it - entry_list_.begin());
+        while (i > 0 && pc < max_high_pc_[i - 1]) {
+            i--;
+            if (pc < entry_list_[i].high_pc) {
+                return &entry_list_[i];
+            }
+        }
+        return nullptr;
+    }
+
+    std::vector<entry> const &get_entry_list() const {
+        return entry_list_;
+    }
+    size_t size() const {
+        return entry_list_.size();
+    }
+    bool empty() const {
+        return entry_list_.empty();
+    }
+};
+
+}  // namespace util_dwarf
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace util_dwarf {
+
+// 有向グラフの強連結成分分解(Tarjan)
+// 深いグラフでスタックを使い切らないよう再帰呼び出しせずに処理する
+struct graph_scc
+{
+    // ノード毎の成分番号
+    // 成分番号は帰りがけ順になる: 成分Aから成分Bへ辺があれば B < A (参照先の成分ほど小さい番号)
+    std::vector<uint32_t> comp_of;
+    uint32_t comp_count;
+
+    graph_scc() : comp_of(), comp_count(0) {
+    }
+
+    // edge_begin[i] から edge_begin[i+1] までの edge_list がノードiの辺(参照先ノード番号)
+    // edge_begin はノード数+1 個の要素を持つ
+    void build(std::vector<uint32_t> const &edge_begin, std::vector<uint32_t> const &edge_list) {
+        static constexpr uint32_t unvisited = UINT32_MAX;
+        uint32_t node_count                 = static_cast<uint32_t>(edge_begin.size() - 1);
+
+        std::vector<uint32_t> index(node_count, unvisited);
+        std::vector<uint32_t> low(node_count, 0);
+        std::vector<bool> on_stack(node_count, false);
+        std::vector<uint32_t> stack;
+        // 呼び出しスタック: (ノード, 次に辿る辺)
+        std::vector<std::pair<uint32_t, uint32_t>> call_stack;
+        uint32_t counter = 0;
+
+        comp_of.assign(node_count, unvisited);
+        comp_count = 0;
+
+        auto visit = [&](uint32_t v) {
+            index[v]    = counter;
+            low[v]      = counter;
+            on_stack[v] = true;
+            counter++;
+            stack.push_back(v);
+            call_stack.emplace_back(v, edge_begin[v]);
+        };
+
+        for (uint32_t root = 0; root < node_count; root++) {
+            if (index[root] != unvisited) {
+                continue;
+            }
+            visit(root);
+            while (!call_stack.empty()) {
+                auto [v, pos] = call_stack.back();
+                if (pos < edge_begin[v + 1]) {
+                    call_stack.back().second++;
+                    auto w = edge_list[pos];
+                    if (index[w] == unvisited) {
+                        visit(w);
+                    } else if (on_stack[w]) {
+                        low[v] = std::min(low[v], index[w]);
+                    }
+                    continue;
+                }
+                // 全辺を辿り終えた
+                if (low[v] == index[v]) {
+                    // vが成分の根
+                    uint32_t w;
+                    do {
+                        w = stack.back();
+                        stack.pop_back();
+                        on_stack[w] = false;
+                        comp_of[w]  = comp_count;
+                    } while (w != v);
+                    comp_count++;
+                }
+                call_stack.pop_back();
+                if (!call_stack.empty()) {
+                    auto u = call_stack.back().first;
+                    low[u] = std::min(low[u], low[v]);
+                }
+            }
+        }
+    }
+};
+
+}  // namespace util_dwarf
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace util_dwarf {
+
+// 読み込み専用でファイルをメモリマップする
+// ファイル全体を1つの連続領域として参照できる
+class mapped_file {
+    uint8_t const *data_;
+    size_t size_;
+#if defined(_WIN32)
+    HANDLE file_;
+    HANDLE mapping_;
+#else
+    int fd_;
+#endif
+
+public:
+    mapped_file()
+        : data_(nullptr),
+          size_(0),
+#if defined(_WIN32)
+          file_(INVALID_HANDLE_VALUE),
+          mapping_(nullptr)
+#else
+          fd_(-1)
+#endif
+    {
+    }
+    ~mapped_file() {
+        close();
+    }
+
+    mapped_file(mapped_file const &)            = delete;
+    mapped_file &operator=(mapped_file const &) = delete;
+
+    bool open(char const *path) {
+        if (data_ != nullptr) {
+            fprintf(stderr, "mapped_file : already open : %s\n", path);
+            return false;
+        }
+#if defined(_WIN32)
+        file_ = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file_, &file_size) || file_size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_ == nullptr) {
+            close();
+            return false;
+        }
+        data_ = static_cast<uint8_t const *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (data_ == nullptr) {
+            close();
+            return false;
+        }
+        size_ = static_cast<size_t>(file_size.QuadPart);
+#else
+        fd_ = ::open(path, O_RDONLY);
+        if (fd_ < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd_, &st) != 0 || st.st_size == 0) {
+            close();
+            return false;
+        }
+        void *ptr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (ptr == MAP_FAILED) {
+            close();
+            return false;
+        }
+        data_ = static_cast<uint8_t const *>(ptr);
+        size_ = static_cast<size_t>(st.st_size);
+#endif
+        return true;
+    }
+
+    void close() {
+#if defined(_WIN32)
+        if (data_ != nullptr) {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_ != nullptr) {
+            CloseHandle(mapping_);
+            mapping_ = nullptr;
+        }
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+            file_ = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (data_ != nullptr) {
+            munmap(const_cast<uint8_t *>(data_), size_);
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    uint8_t const *data() const {
+        return data_;
+    }
+    size_t size() const {
+        return size_;
+    }
+    bool is_open() const {
+        return data_ != nullptr;
+    }
+};
+
+}  // namespace util_dwarf
@@ -0,0 +1,360 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "debug_info.hpp"
+#include "dwarf_info.hpp"
+#include "memmap_diff.hpp"
+#include "memmap_export.hpp"
+#include "string_dictionary.hpp"
+#include "work_stealing_pool.hpp"
+
+namespace util_dwarf {
+
+// 複数スレッドから登録できる文字列辞書
+// 文字列のハッシュでシャードを選び、シャード毎のロックで登録する
+// id = (シャード内id << shard_bits) | シャード番号
+class shared_string_pool {
+public:
+    using id_type = string_dictionary::id_type;
+
+private:
+    static constexpr size_t shard_bits  = 4;
+    static constexpr size_t shard_count = size_t(1) << shard_bits;
+
+    struct shard
+    {
+        mutable std::mutex mtx;
+        string_dictionary dict;
+
+        shard() : mtx(), dict() {
+        }
+    };
+
+    std::unique_ptr<shard[]> shard_list_;
+
+public:
+    shared_string_pool() : shard_list_(new shard[shard_count]) {
+    }
+
+    id_type intern(std::string_view str) {
+        auto index = std::hash<std::string_view>()(str) % shard_count;
+        auto &s    = shard_list_[index];
+        std::lock_guard<std::mutex> lock(s.mtx);
+        return static_cast<id_type>((s.dict.intern(str) << shard_bits) | index);
+    }
+
+    // 登録済み文字列の参照。参照先は本オブジェクトが破棄されるまで有効
+    std::string_view operator[](id_type id) const {
+        auto &s = shard_list_[id & (shard_count - 1)];
+        std::lock_guard<std::mutex> lock(s.mtx);
+        return s.dict[id >> shard_bits];
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (size_t i = 0; i < shard_count; i++) {
+            std::lock_guard<std::mutex> lock(shard_list_[i].mtx);
+            total += shard_list_[i].dict.size();
+        }
+        return total;
+    }
+    // 全文字列の合計文字数
+    size_t total_chars() const {
+        size_t total = 0;
+        for (size_t i = 0; i < shard_count; i++) {
+            std::lock_guard<std::mutex> lock(shard_list_[i].mtx);
+            total += shard_list_[i].dict.total_chars();
+        }
+        return total;
+    }
+};
+
+// 複数ELFで共有する型レイアウト
+// named struct/unionのレイアウト(型名, サイズ, member配置)を構造で重複排除して1つだけ保持する
+// 製品バリエーション間で共通ヘッダの型は同一レイアウトになるので、ELF数に比例して増えない
+class shared_type_store {
+public:
+    using id_type     = uint32_t;
+    using str_id_type = shared_string_pool::id_type;
+
+    struct member
+    {
+        str_id_type name_id;
+        str_id_type type_id;
+        Dwarf_Off offset;
+        Dwarf_Unsigned byte_size;
+        Dwarf_Unsigned bit_offset;
+        Dwarf_Unsigned bit_size;
+
+        bool operator==(member const &) const = default;
+    };
+
+    struct layout
+    {
+        str_id_type name_id;
+        Dwarf_Unsigned byte_size;
+        std::vector<member> members;
+
+        layout() : name_id(0), byte_size(0), members() {
+        }
+
+        bool operator==(layout const &) const = default;
+
+        uint64_t hash() const {
+            // FNV-1a をフィールド単位で適用する
+            uint64_t h   = 0xcbf29ce484222325ull;
+            auto combine = [&h](uint64_t value) {
+                h ^= value;
+                h *= 0x100000001b3ull;
+            };
+            combine(name_id);
+            combine(byte_size);
+            for (auto const &mem : members) {
+                combine(mem.name_id);
+                combine(mem.type_id);
+                combine(mem.offset);
+                combine(mem.byte_size);
+                combine((mem.bit_offset << 32) | mem.bit_size);
+            }
+            return h;
+        }
+    };
+
+private:
+    mutable std::mutex mtx_;
+    // dequeは要素追加で既存要素のアドレスが変わらない
+    std::deque<layout> layout_list_;
+    // hash -> 同一hashのレイアウトid
+    std::unordered_map<uint64_t, std::vector<id_type>> index_;
+
+public:
+    shared_type_store() : mtx_(), layout_list_(), index_() {
+    }
+
+    // 同一レイアウトが登録済みならそのidを返す
+    // is_newには新規登録したかを返す
+    id_type intern(layout &&lay, bool &is_new) {
+        auto h = lay.hash();
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto &id_list = index_[h];
+        for (auto id : id_list) {
+            if (layout_list_[id] == lay) {
+                is_new = false;
+                return id;
+            }
+        }
+        auto id = static_cast<id_type>(layout_list_.size());
+        layout_list_.push_back(std::move(lay));
+        id_list.push_back(id);
+        is_new = true;
+        return id;
+    }
+
+    // 参照先は本オブジェクトが破棄されるまで有効
+    layout const &operator[](id_type id) const {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return layout_list_[id];
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return layout_list_.size();
+    }
+};
+
+// 複数ELFの一括解析
+// 1つのスレッドプール上でELF毎にタスクを実行し、出力する文字列(名前/型名)は全ELFで共有する
+// 型情報(debug_info)の構築はELF毎に独立して行い、ELF間では共有しない
+// ELF毎の解析結果(dwarf_info/debug_info)は出力を抽出したら破棄するので、ピークメモリは同時実行数で決まる
+// is_collect_typesのときは、構築後の型レイアウトをshared_type_storeに登録してELF間の型の重複/差分を集計する
+// 集計用の追加メモリになるので、既定では登録しない
+class memmap_batch {
+public:
+    using str_id_type = shared_string_pool::id_type;
+
+    // memmapの1行
+    struct row
+    {
+        Dwarf_Off address;
+        Dwarf_Unsigned byte_size;
+        uint16_t bit_offset;
+        uint16_t bit_size;
+        memmap_format::flag::type flags;
+        str_id_type name_id;
+        str_id_type type_id;
+    };
+
+    // 1ELF分の出力
+    struct image_result
+    {
+        std::string path;
+        bool is_ok;
+        std::vector<row> rows;
+        // 使用している型レイアウト(shared_type_store::id_type)
+        std::vector<shared_type_store::id_type> layout_list;
+        // このELFで初めて登録された型レイアウト数
+        size_t new_layout_count;
+
+        image_result() : path(), is_ok(false), rows(), layout_list(), new_layout_count(0) {
+        }
+    };
+
+private:
+    bool is_collect_types_;
+    shared_string_pool strings_;
+    shared_type_store types_;
+    std::vector<image_result> result_list_;
+
+public:
+    memmap_batch(bool is_collect_types = false) : is_collect_types_(is_collect_types), strings_(), types_(), result_list_() {
+    }
+    ~memmap_batch() {
+    }
+
+    // path_listのELFをpool上で並列に解析する
+    // ELF単位で並列化するので、型情報の構築(debug_info::option::pool)は各ELF内では並列化しない
+    // (ワーカー内からpool.wait()できないため、同じpoolを各ELFの型情報構築に渡せない)
+    // 解析に失敗したELFは image_result::is_ok が false になる。他のELFの解析は継続する
+    bool run(std::vector<std::string> const &path_list, work_stealing_pool &pool, dwarf_analyze_option da_opt, debug_info::option di_opt) {
+        // プロファイラはスレッドセーフではないので使わない
+        da_opt.profiler = nullptr;
+        di_opt.profiler = nullptr;
+        di_opt.pool     = nullptr;
+
+        result_list_.clear();
+        result_list_.resize(path_list.size());
+        for (size_t i = 0; i < path_list.size(); i++) {
+            result_list_[i].path = path_list[i];
+            pool.submit([this, i, da_opt, di_opt] { process(result_list_[i], da_opt, di_opt); });
+        }
+        pool.wait();
+
+        bool is_ok = true;
+        for (auto const &result : result_list_) {
+            is_ok &= result.is_ok;
+        }
+        return is_ok;
+    }
+
+    std::vector<image_result> const &results() const {
+        return result_list_;
+    }
+    shared_string_pool const &strings() const {
+        return strings_;
+    }
+    shared_type_store const &types() const {
+        return types_;
+    }
+
+    // 1ELF分のmemmapをテキストで出力する
+    void write_text(FILE *fp, image_result const &result) const {
+        for (auto const &r : result.rows) {
+            auto type = strings_[r.type_id];
+            auto name = strings_[r.name_id];
+            fprintf(fp, "0x%08llX\t%.*s\t%llu\t%.*s\n", static_cast<unsigned long long>(r.address), static_cast<int>(type.size()), type.data(),
+                    static_cast<unsigned long long>(r.byte_size), static_cast<int>(name.size()), name.data());
+        }
+    }
+
+    void print_summary(FILE *fp) const {
+        size_t layout_ref = 0;
+        fprintf(fp, "%8s %8s %8s  %s\n", "rows", "types", "new", "path");
+        for (auto const &result : result_list_) {
+            if (!result.is_ok) {
+                fprintf(fp, "%8s %8s %8s  %s\n", "-", "-", "-", result.path.c_str());
+                continue;
+            }
+            fprintf(fp, "%8zu %8zu %8zu  %s\n", result.rows.size(), result.layout_list.size(), result.new_layout_count, result.path.c_str());
+            layout_ref += result.layout_list.size();
+        }
+        fprintf(fp, "shared: %zu strings (%zu chars)\n", strings_.size(), strings_.total_chars());
+        if (is_collect_types_) {
+            fprintf(fp, "shared: %zu type layouts for %zu references\n", types_.size(), layout_ref);
+        }
+    }
+
+private:
+    void process(image_result &result, dwarf_analyze_option da_opt, debug_info::option di_opt) {
+        try {
+            memmap_image image;
+            if (!image.load(result.path.c_str(), da_opt, di_opt)) {
+                return;
+            }
+            collect_rows(*image.dbg_info, result);
+            if (is_collect_types_) {
+                collect_layouts(*image.dbg_info, result);
+            }
+            result.is_ok = true;
+        } catch (std::exception const &e) {
+            fprintf(stderr, "memmap_batch : %s : %s\n", result.path.c_str(), e.what());
+        }
+    }
+
+    void collect_rows(debug_info &dbg_info, image_result &result) {
+        dbg_info.get_var_info([this, &result](debug_info::var_info_view &view) -> bool {
+            row r;
+            r.address    = view.address;
+            r.byte_size  = view.byte_size;
+            r.bit_offset = static_cast<uint16_t>(view.bit_offset);
+            r.bit_size   = static_cast<uint16_t>(view.bit_size);
+            r.flags      = memmap_format::flag::make(view);
+            r.name_id    = strings_.intern(view.tag_name != nullptr ? std::string_view(*view.tag_name) : std::string_view());
+            r.type_id    = strings_.intern(view.tag_type != nullptr ? std::string_view(*view.tag_type) : std::string_view());
+            result.rows.push_back(r);
+            return true;
+        });
+    }
+
+    void collect_layouts(debug_info &dbg_info, image_result &result) {
+        // 対象はmemmap_diffと同じくnamed struct/unionそのもの
+        std::unordered_set<shared_type_store::id_type> used;
+        for (auto &[offset, type] : dbg_info.type_map) {
+            if ((type.tag & dwarf_info::type_tag::struct_union) == 0) {
+                continue;
+            }
+            if ((type.tag & (dwarf_info::type_tag::pointer | dwarf_info::type_tag::array | dwarf_info::type_tag::member)) != 0) {
+                continue;
+            }
+            if (type.name == nullptr || type.member_list.empty()) {
+                continue;
+            }
+            shared_type_store::layout lay;
+            lay.name_id   = strings_.intern(*type.name);
+            lay.byte_size = type.byte_size;
+            lay.members.reserve(type.member_list.size());
+            for (auto mem : type.member_list) {
+                shared_type_store::member m;
+                m.name_id = strings_.intern((mem->name != nullptr) ? std::string_view(*mem->name) : std::string_view());
+                m.type_id = strings_.intern((mem->sub_info != nullptr && mem->sub_info->name != nullptr) ? std::string_view(*mem->sub_info->name)
+                                                                                                          : std::string_view());
+                m.offset     = mem->data_member_location;
+                m.byte_size  = mem->byte_size;
+                m.bit_offset = mem->bit_offset;
+                m.bit_size   = mem->bit_size;
+                lay.members.push_back(m);
+            }
+            bool is_new = false;
+            auto id     = types_.intern(std::move(lay), is_new);
+            if (used.insert(id).second) {
+                result.layout_list.push_back(id);
+                if (is_new) {
+                    result.new_layout_count++;
+                }
+            }
+        }
+    }
+};
+
+}  // namespace util_dwarf
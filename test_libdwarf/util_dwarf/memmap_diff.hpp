@@ -0,0 +1,448 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <format>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "debug_info.hpp"
+#include "dwarf_analyzer.hpp"
+#include "dwarf_info.hpp"
+#include "string_dictionary.hpp"
+
+namespace util_dwarf {
+
+// 1ELF分の解析結果
+// debug_infoはdw_infoを参照するので同じ寿命で保持する
+struct memmap_image
+{
+    std::string path;
+    dwarf_info dw_info;
+    std::unique_ptr<debug_info> dbg_info;
+
+    memmap_image() : path(), dw_info(), dbg_info() {
+    }
+    ~memmap_image();
+
+    bool load(char const *file_path, dwarf_analyze_option da_opt, debug_info::option di_opt) {
+        path = file_path;
+        dwarf_analyzer analyzer;
+        if (!analyzer.open(file_path)) {
+            fprintf(stderr, "memmap_image : cannot open : %s\n", file_path);
+            return false;
+        }
+        analyzer.analyze(dw_info, da_opt);
+        dbg_info = std::make_unique<debug_info>(dw_info, di_opt);
+        dbg_info->build();
+        analyzer.close();
+        return true;
+    }
+};
+// dwarf_info/debug_infoの破棄は展開しきれないので、inline指定しない(-Winline)
+memmap_image::~memmap_image() {
+}
+
+// 2つのELFのmemmapを構造比較する
+// 各ELFのmemmapをフラット化して、メンバパス(var.member[N].x)をキーにハッシュ結合する
+class memmap_diff {
+public:
+    // フラット化したmemmapの1行
+    struct entry
+    {
+        Dwarf_Off address;
+        Dwarf_Unsigned byte_size;
+        Dwarf_Unsigned bit_offset;
+        Dwarf_Unsigned bit_size;
+        string_dictionary::id_type type_id;
+    };
+
+    // フラット化したmemmap
+    // name_dict のid == entries のindex
+    struct flat_map
+    {
+        string_dictionary name_dict;
+        string_dictionary type_dict;
+        std::vector<entry> entries;
+
+        // 異なるCUの同名static変数等はパスが重複するので、重複したパスだけ変数の宣言位置(file:line)で修飾して別キーにする
+        // 宣言位置でも区別できないとき(ヘッダ内のstatic変数等)はさらにCU名で修飾する
+        // 出現順に依存しないので、リンク順やCUの並びが変わっても同じ変数同士が対応する
+        void build(debug_info &dbg_info) {
+            struct row
+            {
+                std::string name;
+                std::string decl;  // 変数の宣言位置。memberの行は変数のものを引き継ぐ
+                std::string_view cu_name;
+                entry e;
+            };
+            std::vector<row> row_list;
+            std::string root;
+            std::string root_decl;
+            std::string_view root_cu;
+            dbg_info.get_var_info([this, &row_list, &root, &root_decl, &root_cu](debug_info::var_info_view &view) -> bool {
+                row r;
+                r.name = *view.tag_name;
+                // 変数の行の後ろに、その変数のmember/要素の行(var.x, var[N])が続く
+                bool is_child = !root.empty() && r.name.size() > root.size() && r.name.starts_with(root) &&
+                                (r.name[root.size()] == '.' || r.name[root.size()] == '[');
+                if (!is_child) {
+                    root = r.name;
+                    root_decl.clear();
+                    std::format_to(std::back_inserter(root_decl), "{}:{}",
+                                   (view.var_decl_file_path != nullptr) ? std::string_view(*view.var_decl_file_path) : std::string_view(),
+                                   view.var_decl_line);
+                    root_cu = (view.cu_info != nullptr) ? std::string_view(view.cu_info->name) : std::string_view();
+                }
+                r.decl         = root_decl;
+                r.cu_name      = root_cu;
+                r.e.address    = view.address;
+                r.e.byte_size  = view.byte_size;
+                r.e.bit_offset = view.bit_offset;
+                r.e.bit_size   = view.bit_size;
+                r.e.type_id    = type_dict.intern(view.tag_type != nullptr ? std::string_view(*view.tag_type) : std::string_view());
+                row_list.push_back(std::move(r));
+                return true;
+            });
+
+            // 名前 -> 出現数, 重複した名前の 名前@宣言位置 -> 出現数
+            std::unordered_map<std::string_view, uint32_t> name_count;
+            for (auto const &r : row_list) {
+                name_count[r.name]++;
+            }
+            std::unordered_map<std::string, uint32_t> decl_count;
+            for (auto const &r : row_list) {
+                if (name_count[r.name] > 1) {
+                    decl_count[r.name + "@" + r.decl]++;
+                }
+            }
+
+            std::string key;
+            for (auto const &r : row_list) {
+                key = r.name;
+                if (name_count[r.name] > 1) {
+                    key += "@";
+                    key += r.decl;
+                    if (decl_count[key] > 1) {
+                        key += "@";
+                        key += r.cu_name;
+                    }
+                }
+                auto id = name_dict.intern(key);
+                // CU名でも区別できないときは出現順の連番を付ける
+                auto base = key.size();
+                for (uint32_t count = 2; id < entries.size(); count++) {
+                    key.resize(base);
+                    std::format_to(std::back_inserter(key), "#{}", count);
+                    id = name_dict.intern(key);
+                }
+                entries.push_back(r.e);
+            }
+        }
+    };
+
+    // 型レイアウト(struct/unionのmember配置)
+    struct member_layout
+    {
+        std::string_view name;
+        std::string_view type;
+        Dwarf_Off offset;
+        Dwarf_Unsigned byte_size;
+        Dwarf_Unsigned bit_offset;
+        Dwarf_Unsigned bit_size;
+    };
+    struct type_layout
+    {
+        Dwarf_Unsigned byte_size;
+        std::vector<member_layout> members;
+    };
+    using layout_map_t = std::unordered_map<std::string_view, type_layout>;
+
+    // 差分種別
+    struct change
+    {
+        using type = uint8_t;
+
+        static constexpr type none    = 0x00;
+        static constexpr type added   = 0x01;
+        static constexpr type removed = 0x02;
+        static constexpr type moved   = 0x04;
+        static constexpr type resized = 0x08;
+        static constexpr type retyped = 0x10;
+    };
+
+    struct var_diff
+    {
+        change::type kind;
+        std::string_view name;
+        entry const *old_entry;  // addedのときnullptr
+        entry const *new_entry;  // removedのときnullptr
+    };
+
+    struct type_diff
+    {
+        change::type kind;
+        std::string_view type_name;
+        std::string_view member_name;  // 空ならtype自体の変化
+        member_layout const *old_member;
+        member_layout const *new_member;
+        Dwarf_Unsigned old_size;
+        Dwarf_Unsigned new_size;
+    };
+
+    std::vector<var_diff> var_diffs;
+    std::vector<type_diff> type_diffs;
+
+private:
+    memmap_image old_image_;
+    memmap_image new_image_;
+    flat_map old_map_;
+    flat_map new_map_;
+    layout_map_t old_layout_;
+    layout_map_t new_layout_;
+
+public:
+    memmap_diff() {
+    }
+    ~memmap_diff() {
+    }
+
+    // 2つのELFを並列に解析して比較する
+    bool run(char const *old_path, char const *new_path, dwarf_analyze_option da_opt, debug_info::option di_opt) {
+        auto prepare = [da_opt, di_opt](memmap_image &image, flat_map &map, layout_map_t &layout, char const *path) -> bool {
+            if (!image.load(path, da_opt, di_opt)) {
+                return false;
+            }
+            map.build(*image.dbg_info);
+            make_layout_map(*image.dbg_info, layout);
+            return true;
+        };
+        auto old_result = std::async(std::launch::async, prepare, std::ref(old_image_), std::ref(old_map_), std::ref(old_layout_), old_path);
+        bool new_ok     = prepare(new_image_, new_map_, new_layout_, new_path);
+        bool old_ok     = old_result.get();
+        if (!old_ok || !new_ok) {
+            return false;
+        }
+
+        diff_var();
+        diff_type();
+        return true;
+    }
+
+    void print(FILE *fp) const {
+        for (auto const &d : var_diffs) {
+            print_var_diff(fp, d);
+        }
+        for (auto const &d : type_diffs) {
+            print_type_diff(fp, d);
+        }
+        fprintf(fp, "summary: %zu var changes, %zu type layout changes\n", var_diffs.size(), type_diffs.size());
+    }
+
+private:
+    void diff_var() {
+        // oldをビルド側、newをプローブ側としてハッシュ結合する
+        // name_dictがそのままname -> indexのハッシュになっている
+        std::vector<bool> matched(old_map_.entries.size(), false);
+        std::unordered_map<std::string_view, size_t> old_index;
+        old_index.reserve(old_map_.entries.size());
+        for (size_t i = 0; i < old_map_.entries.size(); i++) {
+            old_index.emplace(old_map_.name_dict[static_cast<string_dictionary::id_type>(i)], i);
+        }
+
+        for (size_t i = 0; i < new_map_.entries.size(); i++) {
+            auto name       = new_map_.name_dict[static_cast<string_dictionary::id_type>(i)];
+            auto const &cur = new_map_.entries[i];
+            auto it         = old_index.find(name);
+            if (it == old_index.end()) {
+                var_diffs.push_back(var_diff{change::added, name, nullptr, &cur});
+                continue;
+            }
+            matched[it->second] = true;
+            auto const &prev    = old_map_.entries[it->second];
+            change::type kind   = change::none;
+            if (prev.address != cur.address || prev.bit_offset != cur.bit_offset) {
+                kind |= change::moved;
+            }
+            if (prev.byte_size != cur.byte_size || prev.bit_size != cur.bit_size) {
+                kind |= change::resized;
+            }
+            if (old_map_.type_dict[prev.type_id] != new_map_.type_dict[cur.type_id]) {
+                kind |= change::retyped;
+            }
+            if (kind != change::none) {
+                var_diffs.push_back(var_diff{kind, name, &prev, &cur});
+            }
+        }
+
+        for (size_t i = 0; i < old_map_.entries.size(); i++) {
+            if (!matched[i]) {
+                var_diffs.push_back(var_diff{change::removed, old_map_.name_dict[static_cast<string_dictionary::id_type>(i)], &old_map_.entries[i], nullptr});
+            }
+        }
+    }
+
+    void diff_type() {
+        for (auto const &[name, cur] : new_layout_) {
+            auto it = old_layout_.find(name);
+            if (it == old_layout_.end()) {
+                type_diffs.push_back(type_diff{change::added, name, {}, nullptr, nullptr, 0, cur.byte_size});
+                continue;
+            }
+            auto const &prev = it->second;
+            if (prev.byte_size != cur.byte_size) {
+                type_diffs.push_back(type_diff{change::resized, name, {}, nullptr, nullptr, prev.byte_size, cur.byte_size});
+            }
+            diff_member(name, prev, cur);
+        }
+        for (auto const &[name, prev] : old_layout_) {
+            if (!new_layout_.contains(name)) {
+                type_diffs.push_back(type_diff{change::removed, name, {}, nullptr, nullptr, prev.byte_size, 0});
+            }
+        }
+    }
+
+    void diff_member(std::string_view type_name, type_layout const &prev, type_layout const &cur) {
+        // memberは数十個程度なので線形探索で結合する
+        std::vector<bool> matched(prev.members.size(), false);
+        for (auto const &mem : cur.members) {
+            member_layout const *found = nullptr;
+            for (size_t i = 0; i < prev.members.size(); i++) {
+                if (!matched[i] && prev.members[i].name == mem.name) {
+                    matched[i] = true;
+                    found      = &prev.members[i];
+                    break;
+                }
+            }
+            if (found == nullptr) {
+                type_diffs.push_back(type_diff{change::added, type_name, mem.name, nullptr, &mem, 0, 0});
+                continue;
+            }
+            change::type kind = change::none;
+            if (found->offset != mem.offset || found->bit_offset != mem.bit_offset) {
+                kind |= change::moved;
+            }
+            if (found->byte_size != mem.byte_size || found->bit_size != mem.bit_size) {
+                kind |= change::resized;
+            }
+            if (found->type != mem.type) {
+                kind |= change::retyped;
+            }
+            if (kind != change::none) {
+                type_diffs.push_back(type_diff{kind, type_name, mem.name, found, &mem, 0, 0});
+            }
+        }
+        for (size_t i = 0; i < prev.members.size(); i++) {
+            if (!matched[i]) {
+                type_diffs.push_back(type_diff{change::removed, type_name, prev.members[i].name, &prev.members[i], nullptr, 0, 0});
+            }
+        }
+    }
+
+    static void make_layout_map(debug_info &dbg_info, layout_map_t &layout) {
+        // named struct/unionのmember配置を収集する
+        // 同名型が複数CUに出現する場合は最初のものを採用する
+        for (auto &[offset, type] : dbg_info.type_map) {
+            if ((type.tag & dwarf_info::type_tag::struct_union) == 0) {
+                continue;
+            }
+            if ((type.tag & (dwarf_info::type_tag::pointer | dwarf_info::type_tag::array | dwarf_info::type_tag::member)) != 0) {
+                continue;
+            }
+            if (type.name == nullptr || type.member_list.empty()) {
+                continue;
+            }
+            auto [it, inserted] = layout.try_emplace(std::string_view(*type.name));
+            if (!inserted) {
+                continue;
+            }
+            auto &dst     = it->second;
+            dst.byte_size = type.byte_size;
+            dst.members.reserve(type.member_list.size());
+            for (auto mem : type.member_list) {
+                member_layout m;
+                m.name = (mem->name != nullptr) ? std::string_view(*mem->name) : std::string_view();
+                m.type = std::string_view();
+                if (mem->sub_info != nullptr && mem->sub_info->name != nullptr) {
+                    m.type = *mem->sub_info->name;
+                }
+                m.offset     = mem->data_member_location;
+                m.byte_size  = mem->byte_size;
+                m.bit_offset = mem->bit_offset;
+                m.bit_size   = mem->bit_size;
+                dst.members.push_back(m);
+            }
+        }
+    }
+
+    void print_var_diff(FILE *fp, var_diff const &d) const {
+        auto name = std::string(d.name);
+        if (d.kind == change::added) {
+            fprintf(fp, "added   0x%08llX %6llu %s\n", d.new_entry->address, d.new_entry->byte_size, name.c_str());
+            return;
+        }
+        if (d.kind == change::removed) {
+            fprintf(fp, "removed 0x%08llX %6llu %s\n", d.old_entry->address, d.old_entry->byte_size, name.c_str());
+            return;
+        }
+        if ((d.kind & change::moved) != 0) {
+            fprintf(fp, "moved   %s : 0x%08llX -> 0x%08llX\n", name.c_str(), d.old_entry->address, d.new_entry->address);
+        }
+        if ((d.kind & change::resized) != 0) {
+            fprintf(fp, "resized %s : %llu -> %llu\n", name.c_str(), size_of(*d.old_entry), size_of(*d.new_entry));
+        }
+        if ((d.kind & change::retyped) != 0) {
+            auto old_type = std::string(old_map_.type_dict[d.old_entry->type_id]);
+            auto new_type = std::string(new_map_.type_dict[d.new_entry->type_id]);
+            fprintf(fp, "retyped %s : %s -> %s\n", name.c_str(), old_type.c_str(), new_type.c_str());
+        }
+    }
+
+    void print_type_diff(FILE *fp, type_diff const &d) const {
+        auto type_name = std::string(d.type_name);
+        if (d.member_name.empty()) {
+            if (d.kind == change::added) {
+                fprintf(fp, "type added   %s (%llu)\n", type_name.c_str(), d.new_size);
+            } else if (d.kind == change::removed) {
+                fprintf(fp, "type removed %s (%llu)\n", type_name.c_str(), d.old_size);
+            } else {
+                fprintf(fp, "type resized %s : %llu -> %llu\n", type_name.c_str(), d.old_size, d.new_size);
+            }
+            return;
+        }
+        auto member_name = std::string(d.member_name);
+        if (d.kind == change::added) {
+            fprintf(fp, "type %s : member added   %s (+0x%llX)\n", type_name.c_str(), member_name.c_str(), d.new_member->offset);
+            return;
+        }
+        if (d.kind == change::removed) {
+            fprintf(fp, "type %s : member removed %s (+0x%llX)\n", type_name.c_str(), member_name.c_str(), d.old_member->offset);
+            return;
+        }
+        if ((d.kind & change::moved) != 0) {
+            fprintf(fp, "type %s : member moved   %s : +0x%llX -> +0x%llX\n", type_name.c_str(), member_name.c_str(), d.old_member->offset,
+                    d.new_member->offset);
+        }
+        if ((d.kind & change::resized) != 0) {
+            fprintf(fp, "type %s : member resized %s : %llu -> %llu\n", type_name.c_str(), member_name.c_str(), d.old_member->byte_size,
+                    d.new_member->byte_size);
+        }
+        if ((d.kind & change::retyped) != 0) {
+            auto old_type = std::string(d.old_member->type);
+            auto new_type = std::string(d.new_member->type);
+            fprintf(fp, "type %s : member retyped %s : %s -> %s\n", type_name.c_str(), member_name.c_str(), old_type.c_str(), new_type.c_str());
+        }
+    }
+
+    static Dwarf_Unsigned size_of(entry const &e) {
+        // bitfieldはbit数で比較表示する
+        return (e.bit_size != 0) ? e.bit_size : e.byte_size;
+    }
+};
+
+}  // namespace util_dwarf
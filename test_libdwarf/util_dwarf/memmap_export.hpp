@@ -0,0 +1,500 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "debug_info.hpp"
+#include "mapped_file.hpp"
+#include "string_dictionary.hpp"
+
+namespace util_dwarf {
+
+// memmapのカラムナ形式バイナリファイル定義
+//
+// [file_header][column_desc * column_count][column data ...]
+//
+// - 各カラムは row_count 個の固定長要素の配列
+// - 名前/型名は辞書エンコードし、行ごとには辞書idのみ持つ
+//   辞書は [offset(uint32) * (辞書数 + 1)] と [文字列データ] の2カラムで表現する
+// - 行はaddress昇順にソート済み。addressカラムを二分探索できる
+// - カラム先頭は8byte境界に揃えているので、ファイルをmmapしてそのまま参照できる
+// - 数値はすべて書き込み環境のネイティブエンディアン。endianフィールドで判定する
+namespace memmap_format {
+
+static constexpr char magic[4]         = {'D', 'W', 'M', 'M'};
+static constexpr uint16_t version      = 1;
+static constexpr uint16_t endian_check = 0x0102;
+static constexpr size_t alignment      = 8;
+
+struct file_header
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t endian;
+    uint32_t column_count;
+    uint32_t reserved;
+    uint64_t row_count;
+};
+
+struct column_desc
+{
+    uint32_t id;         // column_id
+    uint32_t elem_size;  // 要素1つのbyte数
+    uint64_t offset;     // ファイル先頭からのoffset
+    uint64_t size;       // カラム全体のbyte数
+};
+
+enum column_id : uint32_t
+{
+    col_address = 0,     // uint64_t
+    col_byte_size,       // uint64_t
+    col_bit_offset,      // uint16_t
+    col_bit_size,        // uint16_t
+    col_encoding,        // uint8_t  DW_ATE_*
+    col_pointer_depth,   // uint8_t
+    col_flags,           // uint16_t flag::*
+    col_name_id,         // uint32_t
+    col_type_id,         // uint32_t
+    col_name_dict_offset,  // uint32_t * (辞書数 + 1)
+    col_name_dict_data,    // char
+    col_type_dict_offset,  // uint32_t * (辞書数 + 1)
+    col_type_dict_data,    // char
+    column_max,
+};
+
+// 各カラムの要素サイズ
+inline uint32_t column_elem_size(column_id id) {
+    switch (id) {
+        case col_address:
+        case col_byte_size:
+            return sizeof(uint64_t);
+        case col_bit_offset:
+        case col_bit_size:
+        case col_flags:
+            return sizeof(uint16_t);
+        case col_encoding:
+        case col_pointer_depth:
+            return sizeof(uint8_t);
+        case col_name_id:
+        case col_type_id:
+        case col_name_dict_offset:
+        case col_type_dict_offset:
+            return sizeof(uint32_t);
+        case col_name_dict_data:
+        case col_type_dict_data:
+            return sizeof(char);
+        case column_max:
+        default:
+            return 0;
+    }
+}
+
+// col_flagsのビット定義
+struct flag
+{
+    using type = uint16_t;
+
+    static constexpr type none          = 0x0000;
+    static constexpr type array         = 0x0001;
+    static constexpr type struct_       = 0x0002;
+    static constexpr type union_        = 0x0004;
+    static constexpr type enum_         = 0x0008;
+    static constexpr type const_        = 0x0010;
+    static constexpr type struct_member = 0x0020;
+    static constexpr type union_member  = 0x0040;
+    static constexpr type bitfield      = 0x0080;
+    static constexpr type unnamed       = 0x0100;
+
+    static type make(debug_info::var_info_view const &view) {
+        type flags = none;
+        if (view.is_array)
+            flags |= array;
+        if (view.is_struct)
+            flags |= struct_;
+        if (view.is_union)
+            flags |= union_;
+        if (view.is_enum)
+            flags |= enum_;
+        if (view.is_const)
+            flags |= const_;
+        if (view.is_struct_member)
+            flags |= struct_member;
+        if (view.is_union_member)
+            flags |= union_member;
+        if (view.is_bitfield)
+            flags |= bitfield;
+        if (view.is_unnamed)
+            flags |= unnamed;
+        return flags;
+    }
+};
+
+}  // namespace memmap_format
+
+// debug_info::get_var_info で得られる var_info_view を収集してカラムナ形式で書き出す
+class memmap_export {
+public:
+    struct row
+    {
+        Dwarf_Off address;
+        Dwarf_Unsigned byte_size;
+        uint16_t bit_offset;
+        uint16_t bit_size;
+        uint8_t encoding;
+        uint8_t pointer_depth;
+        uint16_t flags;
+        uint32_t name_id;
+        uint32_t type_id;
+    };
+
+private:
+    std::vector<row> rows_;
+    string_dictionary name_dict_;
+    string_dictionary type_dict_;
+
+public:
+    memmap_export() : rows_(), name_dict_(), type_dict_() {
+    }
+    ~memmap_export() {
+    }
+
+    // get_var_infoのコールバックから呼び出す
+    // view内の文字列は使いまわされるので辞書にコピーしておく
+    void add(debug_info::var_info_view const &view) {
+        row r;
+        r.address       = view.address;
+        r.byte_size     = view.byte_size;
+        r.bit_offset    = static_cast<uint16_t>(view.bit_offset);
+        r.bit_size      = static_cast<uint16_t>(view.bit_size);
+        r.encoding      = static_cast<uint8_t>(view.encoding);
+        r.pointer_depth = static_cast<uint8_t>(view.pointer_depth);
+        r.flags         = memmap_format::flag::make(view);
+        r.name_id       = name_dict_.intern(view.tag_name != nullptr ? std::string_view(*view.tag_name) : std::string_view());
+        r.type_id       = type_dict_.intern(view.tag_type != nullptr ? std::string_view(*view.tag_type) : std::string_view());
+        rows_.push_back(r);
+    }
+
+    size_t size() const {
+        return rows_.size();
+    }
+
+    bool write(char const *path) {
+        using namespace memmap_format;
+
+        // address順にソートする
+        // 同一アドレス(union member, bitfield等)は出現順を維持する
+        std::stable_sort(rows_.begin(), rows_.end(), [](row const &a, row const &b) -> bool { return a.address < b.address; });
+
+        FILE *fp = fopen(path, "wb");
+        if (fp == nullptr) {
+            fprintf(stderr, "memmap_export : cannot open file : %s\n", path);
+            return false;
+        }
+
+        // カラム配置を決定する
+        std::vector<column_desc> columns(column_max);
+        uint64_t pos = align(sizeof(file_header) + sizeof(column_desc) * column_max);
+        auto layout  = [&columns, &pos](column_id id, size_t elem_size, size_t count) {
+            auto &col     = columns[id];
+            col.id        = id;
+            col.elem_size = static_cast<uint32_t>(elem_size);
+            col.offset    = pos;
+            col.size      = elem_size * count;
+            pos           = align(pos + col.size);
+        };
+        auto const n = rows_.size();
+        layout(col_address, sizeof(uint64_t), n);
+        layout(col_byte_size, sizeof(uint64_t), n);
+        layout(col_bit_offset, sizeof(uint16_t), n);
+        layout(col_bit_size, sizeof(uint16_t), n);
+        layout(col_encoding, sizeof(uint8_t), n);
+        layout(col_pointer_depth, sizeof(uint8_t), n);
+        layout(col_flags, sizeof(uint16_t), n);
+        layout(col_name_id, sizeof(uint32_t), n);
+        layout(col_type_id, sizeof(uint32_t), n);
+        layout(col_name_dict_offset, sizeof(uint32_t), name_dict_.size() + 1);
+        layout(col_name_dict_data, sizeof(char), name_dict_.total_chars());
+        layout(col_type_dict_offset, sizeof(uint32_t), type_dict_.size() + 1);
+        layout(col_type_dict_data, sizeof(char), type_dict_.total_chars());
+
+        // header
+        file_header header;
+        std::memcpy(header.magic, memmap_format::magic, sizeof(header.magic));
+        header.version      = memmap_format::version;
+        header.endian       = endian_check;
+        header.column_count = column_max;
+        header.reserved     = 0;
+        header.row_count    = n;
+
+        bool is_ok = true;
+        is_ok &= fwrite(&header, sizeof(header), 1, fp) == 1;
+        is_ok &= fwrite(columns.data(), sizeof(column_desc), columns.size(), fp) == columns.size();
+        uint64_t written = sizeof(header) + sizeof(column_desc) * columns.size();
+
+        // 各カラムを順番に書き出す
+        write_column<uint64_t>(fp, columns[col_address], written, is_ok, [](row const &r) { return r.address; });
+        write_column<uint64_t>(fp, columns[col_byte_size], written, is_ok, [](row const &r) { return r.byte_size; });
+        write_column<uint16_t>(fp, columns[col_bit_offset], written, is_ok, [](row const &r) { return r.bit_offset; });
+        write_column<uint16_t>(fp, columns[col_bit_size], written, is_ok, [](row const &r) { return r.bit_size; });
+        write_column<uint8_t>(fp, columns[col_encoding], written, is_ok, [](row const &r) { return r.encoding; });
+        write_column<uint8_t>(fp, columns[col_pointer_depth], written, is_ok, [](row const &r) { return r.pointer_depth; });
+        write_column<uint16_t>(fp, columns[col_flags], written, is_ok, [](row const &r) { return r.flags; });
+        write_column<uint32_t>(fp, columns[col_name_id], written, is_ok, [](row const &r) { return r.name_id; });
+        write_column<uint32_t>(fp, columns[col_type_id], written, is_ok, [](row const &r) { return r.type_id; });
+        write_dictionary(fp, name_dict_, columns[col_name_dict_offset], columns[col_name_dict_data], written, is_ok);
+        write_dictionary(fp, type_dict_, columns[col_type_dict_offset], columns[col_type_dict_data], written, is_ok);
+
+        fclose(fp);
+        if (!is_ok) {
+            fprintf(stderr, "memmap_export : write error : %s\n", path);
+        }
+        return is_ok;
+    }
+
+private:
+    static uint64_t align(uint64_t pos) {
+        return (pos + memmap_format::alignment - 1) & ~static_cast<uint64_t>(memmap_format::alignment - 1);
+    }
+
+    static void write_padding(FILE *fp, uint64_t to, uint64_t &written, bool &is_ok) {
+        static constexpr uint8_t zero[memmap_format::alignment] = {0};
+        if (to > written) {
+            is_ok &= fwrite(zero, 1, to - written, fp) == (to - written);
+            written = to;
+        }
+    }
+
+    template <typename T, typename Func>
+    void write_column(FILE *fp, memmap_format::column_desc const &col, uint64_t &written, bool &is_ok, Func &&get) {
+        // 1カラム分をまとめてバッファに展開してから書き出す
+        write_padding(fp, col.offset, written, is_ok);
+        std::vector<T> buff;
+        buff.reserve(rows_.size());
+        for (auto const &r : rows_) {
+            buff.push_back(static_cast<T>(get(r)));
+        }
+        is_ok &= fwrite(buff.data(), sizeof(T), buff.size(), fp) == buff.size();
+        written += col.size;
+    }
+
+    void write_dictionary(FILE *fp, string_dictionary const &dict, memmap_format::column_desc const &offset_col,
+                          memmap_format::column_desc const &data_col, uint64_t &written, bool &is_ok) {
+        // offset[i]..offset[i+1] がid=iの文字列になる
+        write_padding(fp, offset_col.offset, written, is_ok);
+        std::vector<uint32_t> offsets;
+        offsets.reserve(dict.size() + 1);
+        uint32_t pos = 0;
+        for (size_t i = 0; i < dict.size(); i++) {
+            offsets.push_back(pos);
+            pos += static_cast<uint32_t>(dict[static_cast<string_dictionary::id_type>(i)].size());
+        }
+        offsets.push_back(pos);
+        is_ok &= fwrite(offsets.data(), sizeof(uint32_t), offsets.size(), fp) == offsets.size();
+        written += offset_col.size;
+
+        write_padding(fp, data_col.offset, written, is_ok);
+        for (size_t i = 0; i < dict.size(); i++) {
+            auto str = dict[static_cast<string_dictionary::id_type>(i)];
+            if (!str.empty()) {
+                is_ok &= fwrite(str.data(), 1, str.size(), fp) == str.size();
+            }
+        }
+        written += data_col.size;
+    }
+};
+
+// カラムナ形式memmapの参照
+// メモリ上(mmap領域)のデータをパースせずにそのまま参照する
+// attach時にカラム配置と辞書idを検証するので、壊れた/別形式のファイルでも範囲外を読まない
+class memmap_table_view {
+    using column_desc = memmap_format::column_desc;
+
+    uint64_t row_count_;
+    uint8_t const *base_;
+    // column_id -> column_desc
+    std::array<column_desc const *, memmap_format::column_max> columns_;
+
+public:
+    memmap_table_view() : row_count_(0), base_(nullptr), columns_() {
+    }
+
+    bool attach(uint8_t const *data, size_t size) {
+        using namespace memmap_format;
+        if (data == nullptr || size < sizeof(file_header)) {
+            return false;
+        }
+        auto header = reinterpret_cast<file_header const *>(data);
+        if (std::memcmp(header->magic, memmap_format::magic, sizeof(header->magic)) != 0) {
+            fprintf(stderr, "memmap_table_view : invalid magic\n");
+            return false;
+        }
+        if (header->version != memmap_format::version || header->endian != endian_check) {
+            fprintf(stderr, "memmap_table_view : unsupported version or endian\n");
+            return false;
+        }
+        if (header->column_count != column_max || size - sizeof(file_header) < sizeof(column_desc) * header->column_count) {
+            fprintf(stderr, "memmap_table_view : invalid column count\n");
+            return false;
+        }
+        // カラム配置
+        std::array<column_desc const *, column_max> columns{};
+        auto desc_list = reinterpret_cast<column_desc const *>(data + sizeof(file_header));
+        for (uint32_t i = 0; i < header->column_count; i++) {
+            auto &col = desc_list[i];
+            if (col.id >= column_max || columns[col.id] != nullptr) {
+                fprintf(stderr, "memmap_table_view : invalid or duplicate column id : %u\n", col.id);
+                return false;
+            }
+            auto id = static_cast<column_id>(col.id);
+            if (col.elem_size != column_elem_size(id) || col.size % col.elem_size != 0) {
+                fprintf(stderr, "memmap_table_view : invalid element size : column %u\n", col.id);
+                return false;
+            }
+            if (col.offset > size || col.size > size - col.offset || col.offset % col.elem_size != 0) {
+                fprintf(stderr, "memmap_table_view : column out of range : column %u\n", col.id);
+                return false;
+            }
+            columns[id] = &col;
+        }
+        // 行毎のカラムは row_count 個
+        auto row_count = header->row_count;
+        for (auto id : {col_address, col_byte_size, col_bit_offset, col_bit_size, col_encoding, col_pointer_depth, col_flags, col_name_id,
+                        col_type_id}) {
+            auto &col = *columns[id];
+            if (row_count > col.size / col.elem_size || col.size != row_count * col.elem_size) {
+                fprintf(stderr, "memmap_table_view : column size mismatch : column %u\n", col.id);
+                return false;
+            }
+        }
+        base_      = data;
+        columns_   = columns;
+        row_count_ = row_count;
+        if (!check_dictionary(col_name_id, col_name_dict_offset, col_name_dict_data) ||
+            !check_dictionary(col_type_id, col_type_dict_offset, col_type_dict_data)) {
+            fprintf(stderr, "memmap_table_view : invalid dictionary\n");
+            detach();
+            return false;
+        }
+        return true;
+    }
+
+    void detach() {
+        row_count_ = 0;
+        base_      = nullptr;
+        columns_   = {};
+    }
+
+    size_t size() const {
+        return static_cast<size_t>(row_count_);
+    }
+
+    template <typename T>
+    T const *column(memmap_format::column_id id) const {
+        return reinterpret_cast<T const *>(base_ + columns_[id]->offset);
+    }
+
+    uint64_t address(size_t row) const {
+        return column<uint64_t>(memmap_format::col_address)[row];
+    }
+    uint64_t byte_size(size_t row) const {
+        return column<uint64_t>(memmap_format::col_byte_size)[row];
+    }
+    uint16_t bit_offset(size_t row) const {
+        return column<uint16_t>(memmap_format::col_bit_offset)[row];
+    }
+    uint16_t bit_size(size_t row) const {
+        return column<uint16_t>(memmap_format::col_bit_size)[row];
+    }
+    uint8_t encoding(size_t row) const {
+        return column<uint8_t>(memmap_format::col_encoding)[row];
+    }
+    uint8_t pointer_depth(size_t row) const {
+        return column<uint8_t>(memmap_format::col_pointer_depth)[row];
+    }
+    uint16_t flags(size_t row) const {
+        return column<uint16_t>(memmap_format::col_flags)[row];
+    }
+    std::string_view name(size_t row) const {
+        return dict_string(memmap_format::col_name_dict_offset, memmap_format::col_name_dict_data,
+                           column<uint32_t>(memmap_format::col_name_id)[row]);
+    }
+    std::string_view type(size_t row) const {
+        return dict_string(memmap_format::col_type_dict_offset, memmap_format::col_type_dict_data,
+                           column<uint32_t>(memmap_format::col_type_id)[row]);
+    }
+
+    // address以上となる最初の行
+    size_t lower_bound(uint64_t addr) const {
+        auto begin = column<uint64_t>(memmap_format::col_address);
+        auto end   = begin + row_count_;
+        return static_cast<size_t>(std::lower_bound(begin, end, addr) - begin);
+    }
+    // [addr_begin, addr_end) に含まれる行範囲 [first, second)
+    std::pair<size_t, size_t> range(uint64_t addr_begin, uint64_t addr_end) const {
+        return std::make_pair(lower_bound(addr_begin), lower_bound(addr_end));
+    }
+
+private:
+    // offsetカラムが単調増加で文字列データ内に収まり、全行の辞書idが辞書数未満であること
+    bool check_dictionary(memmap_format::column_id id_col, memmap_format::column_id offset_col, memmap_format::column_id data_col) const {
+        auto offset_count = columns_[offset_col]->size / sizeof(uint32_t);
+        if (offset_count == 0) {
+            return false;
+        }
+        auto offsets = column<uint32_t>(offset_col);
+        if (offsets[0] != 0) {
+            return false;
+        }
+        for (size_t i = 1; i < offset_count; i++) {
+            if (offsets[i] < offsets[i - 1]) {
+                return false;
+            }
+        }
+        if (offsets[offset_count - 1] > columns_[data_col]->size) {
+            return false;
+        }
+        auto dict_count = offset_count - 1;
+        auto ids        = column<uint32_t>(id_col);
+        return std::all_of(ids, ids + row_count_, [dict_count](uint32_t id) { return id < dict_count; });
+    }
+
+    std::string_view dict_string(memmap_format::column_id offset_col, memmap_format::column_id data_col, uint32_t id) const {
+        auto offsets = column<uint32_t>(offset_col);
+        auto data    = column<char>(data_col);
+        return std::string_view(data + offsets[id], offsets[id + 1] - offsets[id]);
+    }
+};
+
+// カラムナ形式memmapファイルをmmapして参照する
+class memmap_reader {
+    mapped_file file_;
+    memmap_table_view view_;
+
+public:
+    memmap_reader() : file_(), view_() {
+    }
+
+    bool open(char const *path) {
+        if (!file_.open(path)) {
+            fprintf(stderr, "memmap_reader : cannot open file : %s\n", path);
+            return false;
+        }
+        if (!view_.attach(file_.data(), file_.size())) {
+            file_.close();
+            return false;
+        }
+        return true;
+    }
+
+    memmap_table_view const &view() const {
+        return view_;
+    }
+};
+
+}  // namespace util_dwarf
@@ -0,0 +1,529 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// x86のGCC/Clangではビルドの-marchに関係なくAVX2版を生成し、実行時にCPUを判定して切り替える
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define UTIL_DWARF_MEMMAP_AVX2 1
+#include <immintrin.h>
+#endif
+
+#include "debug_info.hpp"
+#include "memmap_export.hpp"
+#include "string_dictionary.hpp"
+
+namespace util_dwarf {
+
+// 行選択ビットマップ
+// 行iの選択状態は words[i / 64] の bit(i % 64)
+class memmap_selection {
+    std::vector<uint64_t> words_;
+    size_t row_count_;
+
+public:
+    memmap_selection() : words_(), row_count_(0) {
+    }
+    memmap_selection(size_t row_count, bool is_all) : words_((row_count + 63) / 64, is_all ? ~uint64_t(0) : 0), row_count_(row_count) {
+        clear_tail();
+    }
+
+    size_t size() const {
+        return row_count_;
+    }
+    std::vector<uint64_t> &words() {
+        return words_;
+    }
+    std::vector<uint64_t> const &words() const {
+        return words_;
+    }
+
+    bool test(size_t row) const {
+        return ((words_[row / 64] >> (row % 64)) & 1) != 0;
+    }
+    // 選択行数
+    size_t count() const {
+        size_t total = 0;
+        for (auto word : words_) {
+            total += static_cast<size_t>(std::popcount(word));
+        }
+        return total;
+    }
+
+    memmap_selection &operator&=(memmap_selection const &other) {
+        for (size_t i = 0; i < words_.size(); i++) {
+            words_[i] &= other.words_[i];
+        }
+        return *this;
+    }
+    memmap_selection &operator|=(memmap_selection const &other) {
+        for (size_t i = 0; i < words_.size(); i++) {
+            words_[i] |= other.words_[i];
+        }
+        return *this;
+    }
+    // otherの選択行を除外する
+    memmap_selection &exclude(memmap_selection const &other) {
+        for (size_t i = 0; i < words_.size(); i++) {
+            words_[i] &= ~other.words_[i];
+        }
+        return *this;
+    }
+    memmap_selection &invert() {
+        for (auto &word : words_) {
+            word = ~word;
+        }
+        clear_tail();
+        return *this;
+    }
+
+    // 選択行を昇順に列挙する
+    template <typename Func>
+    void for_each(Func &&func) const {
+        for (size_t i = 0; i < words_.size(); i++) {
+            auto word = words_[i];
+            while (word != 0) {
+                func(i * 64 + static_cast<size_t>(std::countr_zero(word)));
+                word &= word - 1;
+            }
+        }
+    }
+
+private:
+    // 行数を超える部分のbitは常に0にしておく
+    void clear_tail() {
+        if (row_count_ % 64 != 0) {
+            words_.back() &= (uint64_t(1) << (row_count_ % 64)) - 1;
+        }
+    }
+};
+
+// memmapのカラムナテーブル
+// get_var_infoの結果を1度だけカラム毎の配列に展開しておき、集計クエリはカラムを走査して処理する
+//   フィルタ: カラムと定数の比較結果を行選択ビットマップで返す。CPUがAVX2に対応していれば64/32bitカラムをSIMDで比較する
+//   フラグ  : memmap_format::flag のbit毎に行ビットマップを持つ
+//   集計    : 選択行をキーカラム(辞書id等)でハッシュgroup-byする
+class memmap_table {
+public:
+    using id_type   = string_dictionary::id_type;
+    using flag      = memmap_format::flag;
+    using selection = memmap_selection;
+
+    // 辞書idなし(ファイル情報なし等)
+    static constexpr id_type no_id = UINT32_MAX;
+    // memmap_format::flag のbit数
+    static constexpr size_t flag_count = 9;
+
+    enum class cmp_op
+    {
+        eq,
+        ne,
+        lt,
+        le,
+        gt,
+        ge,
+    };
+
+    struct aggregate
+    {
+        uint64_t count;
+        uint64_t sum;
+        uint64_t min;
+        uint64_t max;
+
+        aggregate() : count(0), sum(0), min(UINT64_MAX), max(0) {
+        }
+    };
+
+    // カラム
+    std::vector<uint64_t> address;
+    std::vector<uint64_t> byte_size;
+    std::vector<uint16_t> bit_offset;
+    std::vector<uint16_t> bit_size;
+    std::vector<uint8_t> encoding;
+    std::vector<uint8_t> pointer_depth;
+    std::vector<id_type> cu_id;
+    std::vector<id_type> file_id;
+    std::vector<id_type> name_id;
+    std::vector<id_type> type_id;
+
+private:
+    size_t row_count_;
+    // フラグのbit毎の行ビットマップ
+    std::vector<uint64_t> flag_bits_[flag_count];
+    string_dictionary cu_dict_;
+    string_dictionary file_dict_;
+    string_dictionary name_dict_;
+    string_dictionary type_dict_;
+
+public:
+    memmap_table()
+        : address(),
+          byte_size(),
+          bit_offset(),
+          bit_size(),
+          encoding(),
+          pointer_depth(),
+          cu_id(),
+          file_id(),
+          name_id(),
+          type_id(),
+          row_count_(0),
+          flag_bits_(),
+          cu_dict_(),
+          file_dict_(),
+          name_dict_(),
+          type_dict_() {
+    }
+    ~memmap_table() {
+    }
+
+    // debug_info::get_var_info の全行を展開する
+    void build(debug_info &dbg_info) {
+        dbg_info.get_var_info([this](debug_info::var_info_view &view) -> bool {
+            add(view);
+            return true;
+        });
+    }
+
+    // get_var_infoのコールバックから呼び出す
+    // view内の文字列は使いまわされるので辞書にコピーしておく
+    void add(debug_info::var_info_view const &view) {
+        address.push_back(view.address);
+        byte_size.push_back(view.byte_size);
+        bit_offset.push_back(static_cast<uint16_t>(view.bit_offset));
+        bit_size.push_back(static_cast<uint16_t>(view.bit_size));
+        encoding.push_back(static_cast<uint8_t>(view.encoding));
+        pointer_depth.push_back(static_cast<uint8_t>(view.pointer_depth));
+        cu_id.push_back((view.cu_info != nullptr) ? cu_dict_.intern(view.cu_info->name) : no_id);
+        file_id.push_back((view.var_decl_file_path != nullptr) ? file_dict_.intern(*view.var_decl_file_path) : no_id);
+        name_id.push_back(name_dict_.intern(view.tag_name != nullptr ? std::string_view(*view.tag_name) : std::string_view()));
+        type_id.push_back(type_dict_.intern(view.tag_type != nullptr ? std::string_view(*view.tag_type) : std::string_view()));
+
+        // フラグをbit毎のビットマップに振り分ける
+        auto flags = flag::make(view);
+        if (row_count_ % 64 == 0) {
+            for (auto &bits : flag_bits_) {
+                bits.push_back(0);
+            }
+        }
+        for (size_t i = 0; i < flag_count; i++) {
+            flag_bits_[i].back() |= static_cast<uint64_t>((flags >> i) & 1) << (row_count_ % 64);
+        }
+        row_count_++;
+    }
+
+    size_t size() const {
+        return row_count_;
+    }
+
+    void clear() {
+        address.clear();
+        byte_size.clear();
+        bit_offset.clear();
+        bit_size.clear();
+        encoding.clear();
+        pointer_depth.clear();
+        cu_id.clear();
+        file_id.clear();
+        name_id.clear();
+        type_id.clear();
+        for (auto &bits : flag_bits_) {
+            bits.clear();
+        }
+        row_count_ = 0;
+        cu_dict_.clear();
+        file_dict_.clear();
+        name_dict_.clear();
+        type_dict_.clear();
+    }
+
+    string_dictionary const &cu_dict() const {
+        return cu_dict_;
+    }
+    string_dictionary const &file_dict() const {
+        return file_dict_;
+    }
+    string_dictionary const &name_dict() const {
+        return name_dict_;
+    }
+    string_dictionary const &type_dict() const {
+        return type_dict_;
+    }
+
+    std::string_view cu(size_t row) const {
+        return dict_string(cu_dict_, cu_id[row]);
+    }
+    std::string_view file(size_t row) const {
+        return dict_string(file_dict_, file_id[row]);
+    }
+    std::string_view name(size_t row) const {
+        return dict_string(name_dict_, name_id[row]);
+    }
+    std::string_view type(size_t row) const {
+        return dict_string(type_dict_, type_id[row]);
+    }
+    flag::type flags(size_t row) const {
+        flag::type result = flag::none;
+        for (size_t i = 0; i < flag_count; i++) {
+            result |= static_cast<flag::type>(((flag_bits_[i][row / 64] >> (row % 64)) & 1) << i);
+        }
+        return result;
+    }
+
+    // 全行
+    selection all() const {
+        return selection(row_count_, true);
+    }
+
+    // flagsで指定したフラグをすべて持つ行
+    selection where_flag(flag::type flags) const {
+        selection result(row_count_, true);
+        auto &words = result.words();
+        for (size_t i = 0; i < flag_count; i++) {
+            if (((flags >> i) & 1) == 0) {
+                continue;
+            }
+            auto &bits = flag_bits_[i];
+            for (size_t w = 0; w < words.size(); w++) {
+                words[w] &= bits[w];
+            }
+        }
+        return result;
+    }
+    // flagsで指定したフラグのいずれかを持つ行
+    selection where_any_flag(flag::type flags) const {
+        selection result(row_count_, false);
+        auto &words = result.words();
+        for (size_t i = 0; i < flag_count; i++) {
+            if (((flags >> i) & 1) == 0) {
+                continue;
+            }
+            auto &bits = flag_bits_[i];
+            for (size_t w = 0; w < words.size(); w++) {
+                words[w] |= bits[w];
+            }
+        }
+        return result;
+    }
+
+    // column[row] <op> value を満たす行
+    // Tはcolumnだけから推論する(where(byte_size, cmp_op::gt, 64) のようにリテラルを渡せる)
+    template <typename T>
+    selection where(std::vector<T> const &column, cmp_op op, std::type_identity_t<T> value) const {
+        static_assert(std::is_unsigned_v<T>, "memmap_table column must be unsigned");
+        selection result(row_count_, false);
+        auto out = result.words().data();
+#if defined(UTIL_DWARF_MEMMAP_AVX2)
+        if constexpr (sizeof(T) == 8 || sizeof(T) == 4) {
+            if (has_avx2()) {
+                scan_avx2(column.data(), row_count_, op, value, out);
+                return result;
+            }
+        }
+#endif
+        switch (op) {
+            case cmp_op::eq:
+                scan(column.data(), row_count_, out, [value](T v) { return v == value; });
+                break;
+            case cmp_op::ne:
+                scan(column.data(), row_count_, out, [value](T v) { return v != value; });
+                break;
+            case cmp_op::lt:
+                scan(column.data(), row_count_, out, [value](T v) { return v < value; });
+                break;
+            case cmp_op::le:
+                scan(column.data(), row_count_, out, [value](T v) { return v <= value; });
+                break;
+            case cmp_op::gt:
+                scan(column.data(), row_count_, out, [value](T v) { return v > value; });
+                break;
+            case cmp_op::ge:
+                scan(column.data(), row_count_, out, [value](T v) { return v >= value; });
+                break;
+            default:
+                break;
+        }
+        return result;
+    }
+    // [lower, upper) に含まれる行
+    template <typename T>
+    selection where_range(std::vector<T> const &column, std::type_identity_t<T> lower, std::type_identity_t<T> upper) const {
+        auto result = where(column, cmp_op::ge, lower);
+        result &= where(column, cmp_op::lt, upper);
+        return result;
+    }
+    // 辞書の文字列に一致する行。辞書に登録されていなければ空の選択
+    selection where_str(std::vector<id_type> const &column, string_dictionary const &dict, std::string_view str) const {
+        auto id = dict.find(str);
+        if (!id) {
+            return selection(row_count_, false);
+        }
+        return where(column, cmp_op::eq, *id);
+    }
+
+    // 選択行をkeyカラムでグループ化してvalueカラムを集計する
+    template <typename K, typename V>
+    std::unordered_map<K, aggregate> group_by(std::vector<K> const &key, std::vector<V> const &value, selection const &sel) const {
+        std::unordered_map<K, aggregate> result;
+        sel.for_each([&](size_t row) {
+            auto &agg = result[key[row]];
+            auto v    = static_cast<uint64_t>(value[row]);
+            agg.count++;
+            agg.sum += v;
+            agg.min = std::min(agg.min, v);
+            agg.max = std::max(agg.max, v);
+        });
+        return result;
+    }
+    // 選択行のvalueカラムを集計する
+    template <typename V>
+    aggregate sum(std::vector<V> const &value, selection const &sel) const {
+        aggregate agg;
+        sel.for_each([&](size_t row) {
+            auto v = static_cast<uint64_t>(value[row]);
+            agg.count++;
+            agg.sum += v;
+            agg.min = std::min(agg.min, v);
+            agg.max = std::max(agg.max, v);
+        });
+        return agg;
+    }
+
+private:
+    static std::string_view dict_string(string_dictionary const &dict, id_type id) {
+        if (id == no_id) {
+            return std::string_view();
+        }
+        return dict[id];
+    }
+
+    // 64行毎に判定結果を1wordへ詰める
+    // 内側のループは分岐を持たないのでコンパイラが自動ベクトル化できる
+    template <typename T, typename Pred>
+    static void scan(T const *data, size_t count, uint64_t *out, Pred &&pred) {
+        size_t full = count / 64;
+        for (size_t w = 0; w < full; w++) {
+            auto base     = data + w * 64;
+            uint64_t bits = 0;
+            for (size_t j = 0; j < 64; j++) {
+                bits |= static_cast<uint64_t>(pred(base[j])) << j;
+            }
+            out[w] = bits;
+        }
+        if (count % 64 != 0) {
+            auto base     = data + full * 64;
+            uint64_t bits = 0;
+            for (size_t j = 0; j < count % 64; j++) {
+                bits |= static_cast<uint64_t>(pred(base[j])) << j;
+            }
+            out[full] = bits;
+        }
+    }
+
+#if defined(UTIL_DWARF_MEMMAP_AVX2)
+    static bool has_avx2() {
+        static bool const is_supported = __builtin_cpu_supports("avx2");
+        return is_supported;
+    }
+
+    // AVX2の比較命令は符号付きなので、符号bitを反転して符号なし比較にする
+    // target属性の関数からはlambdaにAVX2命令をインライン展開できないので、比較は関数で書く
+    template <typename T>
+    __attribute__((target("avx2"))) static void scan_avx2(T const *data, size_t count, cmp_op op, T value, uint64_t *out) {
+        constexpr size_t lanes = 32 / sizeof(T);
+        size_t full            = count / 64;
+        __m256i sign;
+        __m256i rhs;
+        if constexpr (sizeof(T) == 8) {
+            sign = _mm256_set1_epi64x(INT64_MIN);
+            rhs  = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(value)), sign);
+        } else {
+            sign = _mm256_set1_epi32(INT32_MIN);
+            rhs  = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int32_t>(value)), sign);
+        }
+        for (size_t w = 0; w < full; w++) {
+            auto base     = data + w * 64;
+            uint64_t bits = 0;
+            for (size_t j = 0; j < 64; j += lanes) {
+                auto lhs   = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(base + j)), sign);
+                auto mask  = compare_avx2<T>(lhs, rhs, op);
+                uint64_t m = (sizeof(T) == 8) ? static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(mask)))
+                                              : static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(mask)));
+                bits |= m << j;
+            }
+            out[w] = bits;
+        }
+        // 端数は1行ずつ
+        if (count % 64 != 0) {
+            auto base     = data + full * 64;
+            uint64_t bits = 0;
+            for (size_t j = 0; j < count % 64; j++) {
+                bits |= static_cast<uint64_t>(compare(base[j], op, value)) << j;
+            }
+            out[full] = bits;
+        }
+    }
+    template <typename T>
+    __attribute__((target("avx2"))) static __m256i compare_avx2(__m256i lhs, __m256i rhs, cmp_op op) {
+        auto ones = _mm256_set1_epi32(-1);
+        switch (op) {
+            case cmp_op::eq:
+                return cmpeq_avx2<T>(lhs, rhs);
+            case cmp_op::ne:
+                return _mm256_xor_si256(cmpeq_avx2<T>(lhs, rhs), ones);
+            case cmp_op::lt:
+                return cmpgt_avx2<T>(rhs, lhs);
+            case cmp_op::le:
+                return _mm256_xor_si256(cmpgt_avx2<T>(lhs, rhs), ones);
+            case cmp_op::gt:
+                return cmpgt_avx2<T>(lhs, rhs);
+            case cmp_op::ge:
+            default:
+                return _mm256_xor_si256(cmpgt_avx2<T>(rhs, lhs), ones);
+        }
+    }
+    template <typename T>
+    __attribute__((target("avx2"))) static __m256i cmpeq_avx2(__m256i a, __m256i b) {
+        if constexpr (sizeof(T) == 8) {
+            return _mm256_cmpeq_epi64(a, b);
+        } else {
+            return _mm256_cmpeq_epi32(a, b);
+        }
+    }
+    template <typename T>
+    __attribute__((target("avx2"))) static __m256i cmpgt_avx2(__m256i a, __m256i b) {
+        if constexpr (sizeof(T) == 8) {
+            return _mm256_cmpgt_epi64(a, b);
+        } else {
+            return _mm256_cmpgt_epi32(a, b);
+        }
+    }
+#endif
+
+    template <typename T>
+    static bool compare(T lhs, cmp_op op, T rhs) {
+        switch (op) {
+            case cmp_op::eq:
+                return lhs == rhs;
+            case cmp_op::ne:
+                return lhs != rhs;
+            case cmp_op::lt:
+                return lhs < rhs;
+            case cmp_op::le:
+                return lhs <= rhs;
+            case cmp_op::gt:
+                return lhs > rhs;
+            case cmp_op::ge:
+            default:
+                return lhs >= rhs;
+        }
+    }
+};
+
+}  // namespace util_dwarf
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+// windows.hより後
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "debug_info.hpp"
+#include "dwarf_info.hpp"
+
+namespace util_dwarf {
+
+// dwarf_info, debug_info のメモリ使用量集計
+// 各テーブルを走査してコンテナのノードサイズ、ヒープ確保された文字列/配列のサイズを積算する
+// アロケータは差し替えないため、値はmalloc管理領域を含まない推定値になる
+class memory_accounting {
+public:
+    // 集計区分
+    enum category : uint32_t
+    {
+        cu_tbl,           // dwarf_info::cu_tbl
+        var_tbl,          // dwarf_info::var_tbl
+        type_tbl,         // dwarf_info::type_tbl
+        func_tbl,         // dwarf_info::func_tbl
+        var_map,          // debug_info::var_tbl
+        type_map,         // debug_info::type_map
+        node_arena,       // debug_info::arena (arrayの要素型, 子要素リスト)
+        string,           // 上記に含まれる文字列のヒープ領域
+        category_max,
+    };
+
+    struct usage
+    {
+        uint64_t count;
+        uint64_t bytes;
+
+        usage() : count(0), bytes(0) {
+        }
+    };
+
+    struct snapshot
+    {
+        std::string phase;
+        usage tbl[category_max];
+        uint64_t total;
+        uint64_t process_peak;  // プロセスのピーク常駐メモリ(取得できないときは0)
+
+        snapshot(char const *phase_) : phase(phase_), tbl(), total(0), process_peak(0) {
+        }
+    };
+
+private:
+    std::vector<snapshot> snapshot_list_;
+    usage peak_[category_max];
+    uint64_t peak_total_;
+
+public:
+    memory_accounting() : snapshot_list_(), peak_(), peak_total_(0) {
+    }
+    ~memory_accounting() {
+    }
+
+    static char const *category_name(category cat) {
+        switch (cat) {
+            case cu_tbl:
+                return "cu_tbl";
+            case var_tbl:
+                return "var_tbl";
+            case type_tbl:
+                return "type_tbl";
+            case func_tbl:
+                return "func_tbl";
+            case var_map:
+                return "var_map";
+            case type_map:
+                return "type_map";
+            case node_arena:
+                return "node_arena";
+            case string:
+                return "string";
+            case category_max:
+            default:
+                return "unknown";
+        }
+    }
+
+    // 現時点の使用量を記録する
+    // dbg_infoを構築していないフェーズではnullptrを渡す
+    snapshot const &take(char const *phase, dwarf_info const &dw_info, debug_info const *dbg_info) {
+        auto &snap = snapshot_list_.emplace_back(phase);
+        count_dwarf_info(snap, dw_info);
+        if (dbg_info != nullptr) {
+            count_debug_info(snap, *dbg_info);
+        }
+        for (uint32_t i = 0; i < category_max; i++) {
+            snap.total += snap.tbl[i].bytes;
+            if (peak_[i].bytes < snap.tbl[i].bytes) {
+                peak_[i] = snap.tbl[i];
+            }
+        }
+        if (peak_total_ < snap.total) {
+            peak_total_ = snap.total;
+        }
+        snap.process_peak = get_process_peak();
+        return snap;
+    }
+
+    std::vector<snapshot> const &get_snapshot_list() const {
+        return snapshot_list_;
+    }
+    usage const &get_peak(category cat) const {
+        return peak_[cat];
+    }
+
+    void print(FILE *fp) const {
+        fprintf(fp, "== memory ==\n");
+        fprintf(fp, "%-16s", "category");
+        for (auto &snap : snapshot_list_) {
+            fprintf(fp, " %12s %10s", snap.phase.c_str(), "count");
+        }
+        fprintf(fp, " %12s %10s\n", "peak", "count");
+        for (uint32_t i = 0; i < category_max; i++) {
+            fprintf(fp, "%-16s", category_name(static_cast<category>(i)));
+            for (auto &snap : snapshot_list_) {
+                fprintf(fp, " %12s %10llu", to_str(snap.tbl[i].bytes).c_str(), static_cast<unsigned long long>(snap.tbl[i].count));
+            }
+            fprintf(fp, " %12s %10llu\n", to_str(peak_[i].bytes).c_str(), static_cast<unsigned long long>(peak_[i].count));
+        }
+        fprintf(fp, "%-16s", "total");
+        for (auto &snap : snapshot_list_) {
+            fprintf(fp, " %12s %10s", to_str(snap.total).c_str(), "");
+        }
+        fprintf(fp, " %12s\n", to_str(peak_total_).c_str());
+        fprintf(fp, "%-16s", "process peak");
+        for (auto &snap : snapshot_list_) {
+            fprintf(fp, " %12s %10s", to_str(snap.process_peak).c_str(), "");
+        }
+        fprintf(fp, "\n");
+    }
+
+private:
+    // 標準ライブラリのノードサイズ概算
+    // std::map : 値 + rb-treeノードヘッダ(color, parent, left, right)
+    // std::list: 値 + prev/next
+    template <typename K, typename V>
+    static constexpr uint64_t map_node_size = sizeof(std::pair<K const, V>) + 4 * sizeof(void *);
+    template <typename T>
+    static constexpr uint64_t list_node_size = sizeof(T) + 2 * sizeof(void *);
+
+    static uint64_t string_heap(std::string const &str) {
+        // SSO領域に収まっているときはヒープ確保なし
+        auto ptr  = str.data();
+        auto self = reinterpret_cast<char const *>(&str);
+        if (ptr >= self && ptr < self + sizeof(str)) {
+            return 0;
+        }
+        return str.capacity() + 1;
+    }
+    static uint64_t expr_heap(std::optional<dw_op_value> const &value) {
+        if (!value) {
+            return 0;
+        }
+        return value->expr.heap_size();
+    }
+
+    static void add_str(snapshot &snap, std::string const &str) {
+        auto bytes = string_heap(str);
+        if (bytes != 0) {
+            snap.tbl[string].count++;
+            snap.tbl[string].bytes += bytes;
+        }
+    }
+
+    static void count_dwarf_info(snapshot &snap, dwarf_info const &dw_info) {
+        using info = dwarf_info;
+        for (auto &[offset, cu] : dw_info.cu_tbl.container) {
+            auto &u = snap.tbl[cu_tbl];
+            u.count++;
+            u.bytes += map_node_size<Dwarf_Off, info::compile_unit_info>;
+            add_str(snap, cu.name);
+            add_str(snap, cu.producer);
+            add_str(snap, cu.comp_dir);
+        }
+        for (auto &[offset, var] : dw_info.var_tbl.container) {
+            auto &u = snap.tbl[var_tbl];
+            u.count++;
+            u.bytes += map_node_size<Dwarf_Off, info::var_info> + expr_heap(var.location);
+            add_str(snap, var.name);
+            add_str(snap, var.linkage_name);
+            add_str(snap, var.decl_file_path);
+        }
+        for (auto &[offset, type] : dw_info.type_tbl.container) {
+            auto &u = snap.tbl[type_tbl];
+            u.count++;
+            u.bytes += map_node_size<Dwarf_Off, info::type_info>;
+            u.bytes += type.child_list.size() * list_node_size<info::type_info::child_node_t>;
+            u.bytes += type.param_list.size() * list_node_size<info::type_info::param_node_t>;
+            u.bytes += type.member_func_list.size() * list_node_size<info::type_info::func_node_t>;
+            add_str(snap, type.name);
+            add_str(snap, type.decl_file_path);
+        }
+        for (auto &[offset, func] : dw_info.func_tbl.container) {
+            auto &u = snap.tbl[func_tbl];
+            u.count++;
+            u.bytes += map_node_size<Dwarf_Off, info::func_info> + expr_heap(func.return_addr) + expr_heap(func.frame_base);
+            u.bytes += (func.param_list.size() + func.local_var_list.size()) * list_node_size<info::func_info::var_node_t>;
+            u.bytes += func.block_list.capacity() * sizeof(info::lexical_block_info);
+            for (auto &block : func.block_list) {
+                u.bytes += block.range_list.capacity() * sizeof(block.range_list[0]);
+                u.bytes += block.local_var_list.size() * list_node_size<Dwarf_Off>;
+            }
+            add_str(snap, func.name);
+            add_str(snap, func.linkage_name);
+            add_str(snap, func.decl_file_path);
+        }
+    }
+
+    static void count_debug_info(snapshot &snap, debug_info const &dbg_info) {
+        // debug_infoの文字列はdwarf_info側を参照しているため文字列は集計しない
+        // 合成した型名(pointer/関数ポインタ)のみtype_name_rendererが保持する
+        {
+            auto &u = snap.tbl[var_map];
+            u.count += dbg_info.var_tbl.size();
+            u.bytes += dbg_info.var_tbl.size() * (map_node_size<Dwarf_Off, debug_info::var_map_node_t> + sizeof(debug_info::var_info));
+        }
+        {
+            auto &u = snap.tbl[type_map];
+            u.count += dbg_info.type_map.size();
+            u.bytes += dbg_info.type_map.size() * map_node_size<Dwarf_Unsigned, debug_info::type_info>;
+        }
+        {
+            // ブロック単位で確保するので未使用領域を含む
+            auto &u = snap.tbl[node_arena];
+            u.count += dbg_info.arena.alloc_count();
+            u.bytes += dbg_info.arena.reserved_bytes();
+        }
+        add_str(snap, dbg_info.name_void);
+        add_str(snap, dbg_info.name_unnamed);
+        auto &type_name_dict = dbg_info.type_names().dictionary();
+        for (string_dictionary::id_type id = 0; id < type_name_dict.size(); id++) {
+            add_str(snap, type_name_dict.str(id));
+        }
+    }
+
+    static uint64_t get_process_peak() {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS pmc;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+            return pmc.PeakWorkingSetSize;
+        }
+        return 0;
+#else
+        struct rusage ru;
+        if (getrusage(RUSAGE_SELF, &ru) != 0) {
+            return 0;
+        }
+#if defined(__APPLE__)
+        // macOSはbyte単位
+        return static_cast<uint64_t>(ru.ru_maxrss);
+#else
+        // Linuxはkbyte単位
+        return static_cast<uint64_t>(ru.ru_maxrss) * 1024;
+#endif
+#endif
+    }
+
+    static std::string to_str(uint64_t bytes) {
+        char buff[32];
+        if (bytes >= (1ull << 20)) {
+            snprintf(buff, sizeof(buff), "%.1fMiB", static_cast<double>(bytes) / (1 << 20));
+        } else if (bytes >= (1ull << 10)) {
+            snprintf(buff, sizeof(buff), "%.1fKiB", static_cast<double>(bytes) / (1 << 10));
+        } else {
+            snprintf(buff, sizeof(buff), "%lluB", static_cast<unsigned long long>(bytes));
+        }
+        return buff;
+    }
+};
+
+}  // namespace util_dwarf
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace util_dwarf {
+
+// バンプアロケータ
+// 固定サイズのブロックから先頭順に切り出す。個別解放はせず、arenaの破棄/clear()でブロック単位に解放する
+// デストラクタを呼ばないので、trivially destructibleな型のみ格納できる
+class node_arena {
+    static constexpr size_t block_size_default = 64 * 1024;
+
+    struct block
+    {
+        std::unique_ptr<std::byte[]> buff;
+        size_t size;
+
+        block(size_t size_) : buff(new std::byte[size_]), size(size_) {
+        }
+    };
+
+    std::vector<block> block_list_;
+    // 現在ブロックの空き領域
+    std::byte *pos_;
+    size_t remain_;
+    // 統計
+    size_t alloc_count_;
+    size_t used_bytes_;
+
+public:
+    node_arena() : block_list_(), pos_(nullptr), remain_(0), alloc_count_(0), used_bytes_(0) {
+    }
+    node_arena(node_arena const &)            = delete;
+    node_arena &operator=(node_arena const &) = delete;
+
+    void *allocate(size_t size, size_t align) {
+        auto addr  = reinterpret_cast<uintptr_t>(pos_);
+        size_t pad = (align - (addr % align)) % align;
+        if (pos_ == nullptr || remain_ < size + pad) {
+            // 新規ブロック
+            // 大きい要求はそれ専用のブロックにする
+            block_list_.emplace_back(std::max(block_size_default, size + align));
+            pos_    = block_list_.back().buff.get();
+            remain_ = block_list_.back().size;
+            addr    = reinterpret_cast<uintptr_t>(pos_);
+            pad     = (align - (addr % align)) % align;
+        }
+        auto result = pos_ + pad;
+        pos_        = result + size;
+        remain_ -= size + pad;
+        alloc_count_++;
+        used_bytes_ += size;
+        return result;
+    }
+
+    template <typename T, typename... Args>
+    T *create(Args &&...args) {
+        static_assert(std::is_trivially_destructible_v<T>, "node_arena does not call destructors");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // 連続領域を確保する。要素は値初期化する
+    template <typename T>
+    std::span<T> create_array(size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>, "node_arena does not call destructors");
+        if (count == 0) {
+            return std::span<T>();
+        }
+        auto ptr = static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+        for (size_t i = 0; i < count; i++) {
+            new (ptr + i) T();
+        }
+        return std::span<T>(ptr, count);
+    }
+
+    // otherのブロックを引き取る。確保済み領域のアドレスは変わらない
+    void merge(node_arena &other) {
+        if (other.block_list_.empty()) {
+            return;
+        }
+        // ブロックのバッファは移動しないので、空き領域のポインタはそのまま使える
+        // 現在ブロックとotherの現在ブロックのうち、空き領域の大きい方から続けて切り出す
+        block_list_.insert(block_list_.end(), std::make_move_iterator(other.block_list_.begin()), std::make_move_iterator(other.block_list_.end()));
+        if (pos_ == nullptr || other.remain_ > remain_) {
+            pos_    = other.pos_;
+            remain_ = other.remain_;
+        }
+        alloc_count_ += other.alloc_count_;
+        used_bytes_ += other.used_bytes_;
+        other.block_list_.clear();
+        other.pos_         = nullptr;
+        other.remain_      = 0;
+        other.alloc_count_ = 0;
+        other.used_bytes_  = 0;
+    }
+
+    void clear() {
+        block_list_.clear();
+        pos_         = nullptr;
+        remain_      = 0;
+        alloc_count_ = 0;
+        used_bytes_  = 0;
+    }
+
+    size_t alloc_count() const {
+        return alloc_count_;
+    }
+    size_t used_bytes() const {
+        return used_bytes_;
+    }
+    // 確保済みブロックの合計サイズ
+    size_t reserved_bytes() const {
+        size_t total = 0;
+        for (auto &blk : block_list_) {
+            total += blk.size;
+        }
+        return total;
+    }
+    size_t block_count() const {
+        return block_list_.size();
+    }
+};
+
+}  // namespace util_dwarf
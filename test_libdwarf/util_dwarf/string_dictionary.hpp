@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace util_dwarf {
+
+// 文字列辞書
+// 同一文字列に同一idを割り当てる。idは登録順の連番になる
+class string_dictionary {
+public:
+    using id_type = uint32_t;
+
+private:
+    // keyのstring_viewはstorage_内の文字列を参照する
+    // dequeは要素追加で既存要素のアドレスが変わらない
+    std::deque<std::string> storage_;
+    std::unordered_map<std::string_view, id_type> index_;
+    size_t total_chars_;
+
+public:
+    string_dictionary() : storage_(), index_(), total_chars_(0) {
+    }
+    ~string_dictionary() {
+    }
+
+    id_type intern(std::string_view str) {
+        auto it = index_.find(str);
+        if (it != index_.end()) {
+            return it->second;
+        }
+        auto id = static_cast<id_type>(storage_.size());
+        storage_.emplace_back(str);
+        index_.emplace(std::string_view(storage_.back()), id);
+        total_chars_ += str.size();
+        return id;
+    }
+
+    // 登録済みならidを返す
+    std::optional<id_type> find(std::string_view str) const {
+        auto it = index_.find(str);
+        if (it == index_.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    std::string_view operator[](id_type id) const {
+        return storage_[id];
+    }
+    // 登録済み文字列の参照。参照先はclear()まで有効
+    std::string const &str(id_type id) const {
+        return storage_[id];
+    }
+    size_t size() const {
+        return storage_.size();
+    }
+    // 全文字列の合計文字数
+    size_t total_chars() const {
+        return total_chars_;
+    }
+
+    void clear() {
+        index_.clear();
+        storage_.clear();
+        total_chars_ = 0;
+    }
+};
+
+}  // namespace util_dwarf
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+namespace util_dwarf {
+
+// ターゲット停止時のメモリイメージ
+// RAMダンプ等を開始アドレス付きのセグメントとして登録し、任意アドレスを読み出す
+class memory_image {
+public:
+    struct segment
+    {
+        uint64_t addr;
+        std::vector<uint8_t> data;
+
+        segment(uint64_t addr_, uint8_t const *buff, size_t size) : addr(addr_), data(buff, buff + size) {
+        }
+    };
+
+private:
+    // addr昇順
+    std::vector<segment> segment_list_;
+    bool is_big_endian_;
+
+public:
+    memory_image(bool is_big_endian = false) : segment_list_(), is_big_endian_(is_big_endian) {
+    }
+
+    void big_endian(bool is_big_endian) {
+        is_big_endian_ = is_big_endian;
+    }
+    bool is_big_endian() const {
+        return is_big_endian_;
+    }
+
+    // セグメント追加
+    // セグメントが重なるときは開始アドレスが大きい方(同じときは後から追加した方)を優先する
+    void add(uint64_t addr, uint8_t const *buff, size_t size) {
+        if (size == 0) {
+            return;
+        }
+        auto it = std::upper_bound(segment_list_.begin(), segment_list_.end(), addr,
+                                   [](uint64_t value, segment const &elem) { return value < elem.addr; });
+        segment_list_.emplace(it, addr, buff, size);
+    }
+    void add(uint64_t addr, std::vector<uint8_t> const &data) {
+        add(addr, data.data(), data.size());
+    }
+
+    // [addr, addr+size) を含むセグメントのデータ先頭を返す。該当なしのときはnullptr
+    uint8_t const *data(uint64_t addr, size_t size) const {
+        auto it = std::upper_bound(segment_list_.begin(), segment_list_.end(), addr,
+                                   [](uint64_t value, segment const &elem) { return value < elem.addr; });
+        // addrより前から始まるセグメントを後ろから確認する
+        while (it != segment_list_.begin()) {
+            --it;
+            uint64_t pos = addr - it->addr;
+            if (pos < it->data.size() && size <= it->data.size() - pos) {
+                return it->data.data() + pos;
+            }
+        }
+        return nullptr;
+    }
+
+    // addrからsize byte(1-8)を整数として読み出す
+    std::optional<uint64_t> read(uint64_t addr, size_t size) const {
+        if (size == 0 || size > 8) {
+            return std::nullopt;
+        }
+        auto buff = data(addr, size);
+        if (buff == nullptr) {
+            return std::nullopt;
+        }
+        uint64_t value = 0;
+        for (size_t i = 0; i < size; i++) {
+            size_t index = is_big_endian_ ? i : (size - 1 - i);
+            value        = (value << 8) | buff[index];
+        }
+        return value;
+    }
+
+    // addrからsize byteをそのままコピーする
+    bool read(uint64_t addr, void *dst, size_t size) const {
+        auto buff = data(addr, size);
+        if (buff == nullptr) {
+            return false;
+        }
+        std::memcpy(dst, buff, size);
+        return true;
+    }
+
+    std::vector<segment> const &get_segment_list() const {
+        return segment_list_;
+    }
+    bool empty() const {
+        return segment_list_.empty();
+    }
+};
+
+// レジスタスナップショット
+// DWARFレジスタ番号で管理する。値不明のレジスタはnullopt
+class register_snapshot {
+    std::vector<std::optional<uint64_t>> reg_list_;
+
+public:
+    uint64_t pc;
+
+    register_snapshot() : reg_list_(), pc(0) {
+    }
+
+    void set(uint64_t reg_no, uint64_t value) {
+        if (reg_no >= reg_list_.size()) {
+            reg_list_.resize(reg_no + 1);
+        }
+        reg_list_[reg_no] = value;
+    }
+    void unset(uint64_t reg_no) {
+        if (reg_no < reg_list_.size()) {
+            reg_list_[reg_no].reset();
+        }
+    }
+    std::optional<uint64_t> get(uint64_t reg_no) const {
+        if (reg_no < reg_list_.size()) {
+            return reg_list_[reg_no];
+        }
+        return std::nullopt;
+    }
+    size_t size() const {
+        return reg_list_.size();
+    }
+};
+
+}  // namespace util_dwarf
@@ -0,0 +1,420 @@
+#pragma once
+
+#define LIBDWARF_STATIC 1
+#include <dwarf.h>
+#include <libdwarf.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "dwarf_info.hpp"
+#include "string_dictionary.hpp"
+
+namespace util_dwarf {
+
+// 型名の生成
+// dwarf_info::type_tbl の型を文字列化する。dwarf_infoは変更しない
+// 結果は型(DIE offset)と表記ごとにキャッシュし、文字列はstring_dictionaryに1度だけ登録する
+//   get(): debug_infoの型名表記(uint32_t*, int(*)(unsigned char, uint8_t)。配列は要素型名、cv修飾なし)
+//   get_c(): C言語の宣言子表記(const char *volatile, int (*)(unsigned char, uint8_t), uint8_t [4][2], struct node *)
+class type_name_renderer {
+public:
+    struct option
+    {
+        using type = uint32_t;
+
+        enum mode : type
+        {
+            none,
+            prior_typedef = 1 << 0,  // typedefの名前を優先する
+        };
+
+        bool is_prior_typedef;
+
+        option(type flags = none) : is_prior_typedef(false) {
+            set(flags);
+        }
+
+        void set(type flags) {
+            if (check(flags, prior_typedef)) {
+                is_prior_typedef = true;
+            }
+        }
+        void unset(type flags) {
+            if (check(flags, prior_typedef)) {
+                is_prior_typedef = false;
+            }
+        }
+
+    private:
+        bool check(type flags, mode flag) {
+            return ((flags & flag) == flag);
+        }
+    };
+
+private:
+    using type_tag = dwarf_info::type_tag;
+    using id_type  = string_dictionary::id_type;
+
+    // 名前なし
+    static constexpr id_type no_name = UINT32_MAX;
+    // 型をたどる上限(循環参照対策)
+    static constexpr size_t depth_max = 64;
+
+    struct entry
+    {
+        id_type id;
+        uint16_t tag;  // 参照先をたどって集約したtype_tag(debug_info::type_info::tagと同じ)
+    };
+
+    dwarf_info const &dw_info_;
+    option opt_;
+    string_dictionary dict_;
+    std::unordered_map<Dwarf_Off, entry> cache_;
+    // C言語の宣言子表記のキャッシュ
+    std::unordered_map<Dwarf_Off, id_type> c_cache_;
+    // 生成中の型(循環参照検出)
+    std::unordered_set<Dwarf_Off> building_;
+    std::string name_void_;
+    std::string name_unnamed_;
+    std::string name_funcptr_;
+
+public:
+    type_name_renderer(dwarf_info const &dw_info, option opt = option())
+        : dw_info_(dw_info),
+          opt_(opt),
+          dict_(),
+          cache_(),
+          c_cache_(),
+          building_(),
+          name_void_("void"),
+          name_unnamed_("<unnamed>"),
+          name_funcptr_("<funcptr>") {
+    }
+
+    // 型名を返す。名前を持たない型(unnamed struct等)は空文字列
+    std::string_view name(Dwarf_Off offset) {
+        auto ptr = get(offset);
+        if (ptr == nullptr) {
+            return std::string_view();
+        }
+        return *ptr;
+    }
+    // 型名を返す。名前を持たない型はnullptr
+    // 戻り値は本オブジェクトが破棄されるまで有効
+    std::string const *get(Dwarf_Off offset) {
+        auto it = cache_.find(offset);
+        if (it == cache_.end()) {
+            render(offset, 0);
+            it = cache_.find(offset);
+        }
+        if (it == cache_.end() || it->second.id == no_name) {
+            return nullptr;
+        }
+        return &dict_.str(it->second.id);
+    }
+    // C言語の宣言子表記の型名を返す。名前を持たない型は<unnamed>, 型なしはvoidになる
+    // 戻り値は本オブジェクトが破棄されるまで有効
+    std::string const &get_c(Dwarf_Off offset) {
+        return dict_.str(render_c_name(offset, 0));
+    }
+
+    string_dictionary const &dictionary() const {
+        return dict_;
+    }
+    size_t size() const {
+        return cache_.size() + c_cache_.size();
+    }
+    void clear() {
+        cache_.clear();
+        c_cache_.clear();
+        dict_.clear();
+    }
+
+private:
+    dwarf_info::type_info const *find_type(Dwarf_Off offset) const {
+        auto it = dw_info_.type_tbl.container.find(offset);
+        if (it == dw_info_.type_tbl.container.end()) {
+            return nullptr;
+        }
+        return &it->second;
+    }
+
+    id_type intern(std::string const &name) {
+        if (name.empty()) {
+            return no_name;
+        }
+        return dict_.intern(name);
+    }
+    id_type intern_or(id_type id, std::string const &name) {
+        if (id != no_name) {
+            return id;
+        }
+        return intern(name);
+    }
+
+    // debug_infoの型名表記
+    // debug_info::build_type_info と同じく参照先の名前を引き継ぎ、型ごとに名前を適用する
+    entry render(Dwarf_Off offset, size_t depth) {
+        auto it = cache_.find(offset);
+        if (it != cache_.end()) {
+            return it->second;
+        }
+        auto type = find_type(offset);
+        if (type == nullptr || depth > depth_max || building_.contains(offset)) {
+            // 循環参照中は名前なしとして扱う(キャッシュしない)
+            return entry{no_name, 0};
+        }
+        building_.insert(offset);
+
+        entry child{no_name, 0};
+        if (type->type) {
+            child = render(*type->type, depth + 1);
+        }
+        entry result{child.id, static_cast<uint16_t>(child.tag | type->tag)};
+        bool is_complete = true;
+        switch (type->tag) {
+            case type_tag::member:
+                result.id = (type->name.size() > 0) ? intern(type->name) : child.id;
+                break;
+
+            case type_tag::typedef_:
+                if (opt_.is_prior_typedef) {
+                    result.id = (type->name.size() > 0) ? intern(type->name) : child.id;
+                } else {
+                    result.id = intern_or(child.id, type->name);
+                }
+                break;
+
+            case type_tag::const_:
+            case type_tag::volatile_:
+            case type_tag::restrict_:
+                break;
+
+            case type_tag::pointer:
+                if (type->name.size() > 0) {
+                    result.id = intern(type->name);
+                } else if ((child.tag & type_tag::func) == 0) {
+                    std::string name(name_or(child.id, name_void_));
+                    name += '*';
+                    result.id = intern(name);
+                }
+                break;
+
+            case type_tag::func:
+                if (type->name.size() > 0) {
+                    result.id = intern(type->name);
+                } else {
+                    // 関数ポインタ表示: 返り値型(*)(引数型, ...)
+                    std::string name(name_or(child.id, name_void_));
+                    name += "(*)(";
+                    bool is_first = true;
+                    for (auto param_offset : type->param_list) {
+                        auto var_it = dw_info_.var_tbl.container.find(param_offset);
+                        if (var_it == dw_info_.var_tbl.container.end() || !var_it->second.type) {
+                            continue;
+                        }
+                        if (building_.contains(*var_it->second.type)) {
+                            // 引数型が構築中(循環参照)
+                            is_complete = false;
+                            break;
+                        }
+                        auto param = render(*var_it->second.type, depth + 1);
+                        if (!is_first) {
+                            name += ", ";
+                        }
+                        name += name_or(param.id, name_unnamed_);
+                        is_first = false;
+                    }
+                    name += ')';
+                    result.id = is_complete ? intern(name) : intern(name_funcptr_);
+                }
+                break;
+
+            default:
+                // base, enum, struct, union, array, subrange, parameter, reference
+                result.id = intern_or(child.id, type->name);
+                break;
+        }
+
+        building_.erase(offset);
+        cache_.emplace(offset, result);
+        return result;
+    }
+
+    std::string_view name_or(id_type id, std::string const &alt) const {
+        if (id == no_name) {
+            return alt;
+        }
+        return dict_[id];
+    }
+
+    // C言語の宣言子表記(宣言子なし)
+    // 引数型は複数の関数ポインタ型に繰り返し現れるので、型ごとに1度だけ生成する
+    id_type render_c_name(Dwarf_Off offset, size_t depth) {
+        auto it = c_cache_.find(offset);
+        if (it != c_cache_.end()) {
+            return it->second;
+        }
+        std::string decl;
+        render_c(offset, decl, 0, depth);
+        auto id = dict_.intern(decl);
+        c_cache_.emplace(offset, id);
+        return id;
+    }
+
+    // C言語の宣言子表記
+    // decl: 内側の宣言子("*", "(*)[4]" 等), quals: 外側から適用されたcv修飾
+    void render_c(Dwarf_Off offset, std::string &decl, uint16_t quals, size_t depth) {
+        auto type = (depth > depth_max) ? nullptr : find_type(offset);
+        if (type == nullptr) {
+            render_c_leaf(name_void_, decl, quals);
+            return;
+        }
+        switch (type->tag) {
+            case type_tag::const_:
+            case type_tag::volatile_:
+            case type_tag::restrict_:
+                render_c_next(*type, decl, static_cast<uint16_t>(quals | type->tag), depth);
+                return;
+
+            case type_tag::typedef_:
+                if (opt_.is_prior_typedef || !type->type) {
+                    render_c_leaf(type->name, decl, quals);
+                } else {
+                    render_c_next(*type, decl, quals, depth);
+                }
+                return;
+
+            case type_tag::pointer:
+            case type_tag::reference: {
+                std::string inner((type->tag == type_tag::pointer) ? "*" : "&");
+                append_quals(inner, quals, false);
+                if (!decl.empty()) {
+                    if (quals != 0) {
+                        inner += ' ';
+                    }
+                    inner += decl;
+                }
+                decl = std::move(inner);
+                render_c_next(*type, decl, 0, depth);
+                return;
+            }
+
+            case type_tag::array: {
+                wrap_decl(decl);
+                for (auto subrange : type->child_list) {
+                    decl += '[';
+                    if (subrange->count) {
+                        decl += std::to_string(*subrange->count);
+                    } else if (subrange->upper_bound) {
+                        decl += std::to_string(*subrange->upper_bound - subrange->lower_bound.value_or(0) + 1);
+                    }
+                    decl += ']';
+                }
+                // 配列へのcv修飾は要素型に適用される
+                render_c_next(*type, decl, quals, depth);
+                return;
+            }
+
+            case type_tag::func: {
+                wrap_decl(decl);
+                decl += '(';
+                bool is_first = true;
+                for (auto param_offset : type->param_list) {
+                    auto var_it = dw_info_.var_tbl.container.find(param_offset);
+                    if (var_it == dw_info_.var_tbl.container.end()) {
+                        continue;
+                    }
+                    if (!is_first) {
+                        decl += ", ";
+                    }
+                    if (var_it->second.type) {
+                        decl += dict_.str(render_c_name(*var_it->second.type, depth + 1));
+                    } else {
+                        decl += name_void_;
+                    }
+                    is_first = false;
+                }
+                if (is_first && type->prototyped) {
+                    decl += name_void_;
+                }
+                decl += ')';
+                render_c_next(*type, decl, 0, depth);
+                return;
+            }
+
+            case type_tag::member:
+            case type_tag::parameter:
+            case type_tag::subrange:
+                render_c_next(*type, decl, quals, depth);
+                return;
+
+            case type_tag::struct_:
+            case type_tag::union_:
+            case type_tag::enum_: {
+                std::string name((type->tag == type_tag::struct_) ? "struct " : (type->tag == type_tag::union_) ? "union " : "enum ");
+                name += (type->name.size() > 0) ? type->name : name_unnamed_;
+                render_c_leaf(name, decl, quals);
+                return;
+            }
+
+            default:
+                // base
+                render_c_leaf((type->name.size() > 0) ? type->name : name_unnamed_, decl, quals);
+                return;
+        }
+    }
+    void render_c_next(dwarf_info::type_info const &type, std::string &decl, uint16_t quals, size_t depth) {
+        if (type.type) {
+            render_c(*type.type, decl, quals, depth + 1);
+        } else {
+            render_c_leaf(name_void_, decl, quals);
+        }
+    }
+    // 型指定子: [cv修飾] 名前 [宣言子]
+    void render_c_leaf(std::string const &name, std::string &decl, uint16_t quals) {
+        std::string result;
+        append_quals(result, quals, true);
+        result += name;
+        if (!decl.empty()) {
+            result += ' ';
+            result += decl;
+        }
+        decl = std::move(result);
+    }
+    // ポインタ宣言子に配列/関数の宣言子を続けるときは括弧が必要
+    static void wrap_decl(std::string &decl) {
+        if (!decl.empty() && (decl.front() == '*' || decl.front() == '&')) {
+            decl.insert(decl.begin(), '(');
+            decl += ')';
+        }
+    }
+    static void append_quals(std::string &out, uint16_t quals, bool is_prefix) {
+        static constexpr std::pair<uint16_t, char const *> qual_tbl[] = {
+            {type_tag::const_, "const"},
+            {type_tag::volatile_, "volatile"},
+            {type_tag::restrict_, "restrict"},
+        };
+        // 前置: "const volatile "、後置(ポインタ宣言子): "*const volatile"
+        bool is_first = true;
+        for (auto &[tag, str] : qual_tbl) {
+            if ((quals & tag) == 0) {
+                continue;
+            }
+            if (!is_prefix && !is_first) {
+                out += ' ';
+            }
+            out += str;
+            if (is_prefix) {
+                out += ' ';
+            }
+            is_first = false;
+        }
+    }
+};
+
+}  // namespace util_dwarf
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace util_dwarf {
+
+// work-stealingスレッドプール
+// スレッド毎にタスクキューを持ち、自キューは後ろから(LIFO)、他スレッドのキューは前から(FIFO)取り出す
+// ワーカー内からsubmitしたタスクは自キューに積むので、依存関係を辿って次のタスクを投入する用途で局所性が高くなる
+class work_stealing_pool {
+public:
+    using task_type = std::function<void()>;
+
+private:
+    struct worker_queue
+    {
+        std::mutex mtx;
+        std::deque<task_type> task_list;
+
+        worker_queue() : mtx(), task_list() {
+        }
+    };
+
+    std::vector<std::unique_ptr<worker_queue>> queue_list_;
+    std::vector<std::thread> thread_list_;
+    // スリープ/完了待ち用
+    std::mutex mtx_;
+    std::condition_variable cv_task_;
+    std::condition_variable cv_done_;
+    // 未完了タスク数(実行中を含む)
+    std::atomic<size_t> pending_;
+    // キューに積まれているタスク数
+    std::atomic<size_t> queued_;
+    // ワーカー外からsubmitしたときの投入先
+    std::atomic<size_t> next_queue_;
+    bool is_stop_;
+    // タスクで発生した最初の例外。wait()で再送出する
+    std::exception_ptr error_;
+
+    // 実行中スレッドが所属するプールとキュー番号
+    static inline thread_local work_stealing_pool *current_pool_ = nullptr;
+    static inline thread_local size_t current_index_             = 0;
+
+public:
+    // thread_countが0のときはハードウェアスレッド数
+    explicit work_stealing_pool(size_t thread_count = 0)
+        : queue_list_(),
+          thread_list_(),
+          mtx_(),
+          cv_task_(),
+          cv_done_(),
+          pending_(0),
+          queued_(0),
+          next_queue_(0),
+          is_stop_(false),
+          error_() {
+        if (thread_count == 0) {
+            thread_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+        }
+        for (size_t i = 0; i < thread_count; i++) {
+            queue_list_.push_back(std::make_unique<worker_queue>());
+        }
+        for (size_t i = 0; i < thread_count; i++) {
+            thread_list_.emplace_back([this, i] { worker(i); });
+        }
+    }
+    ~work_stealing_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            is_stop_ = true;
+        }
+        cv_task_.notify_all();
+        for (auto &th : thread_list_) {
+            th.join();
+        }
+    }
+    work_stealing_pool(work_stealing_pool const &)            = delete;
+    work_stealing_pool &operator=(work_stealing_pool const &) = delete;
+
+    size_t size() const {
+        return thread_list_.size();
+    }
+
+    void submit(task_type task) {
+        size_t index;
+        if (current_pool_ == this) {
+            index = current_index_;
+        } else {
+            index = next_queue_.fetch_add(1, std::memory_order_relaxed) % queue_list_.size();
+        }
+        pending_.fetch_add(1);
+        {
+            auto &queue = *queue_list_[index];
+            std::lock_guard<std::mutex> lock(queue.mtx);
+            queue.task_list.push_back(std::move(task));
+        }
+        queued_.fetch_add(1);
+        {
+            // ワーカーのスリープ判定との競合を防ぐ
+            std::lock_guard<std::mutex> lock(mtx_);
+        }
+        cv_task_.notify_one();
+    }
+
+    // submitしたタスク(タスク内からsubmitしたタスクを含む)がすべて完了するまで待つ
+    // タスクが例外を送出していたら最初の例外を再送出する
+    // ワーカー内から呼び出してはいけない
+    void wait() {
+        std::exception_ptr error;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            cv_done_.wait(lock, [this] { return pending_.load() == 0; });
+            std::swap(error, error_);
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // 実行中スレッドがこのプールのワーカーか
+    bool is_worker() const {
+        return current_pool_ == this;
+    }
+    // 実行中ワーカーの番号(0 ～ size()-1)。ワーカー内からのみ呼び出す
+    size_t worker_index() const {
+        return current_index_;
+    }
+
+private:
+    void worker(size_t index) {
+        current_pool_  = this;
+        current_index_ = index;
+        while (true) {
+            task_type task;
+            if (pop(index, task) || steal(index, task)) {
+                run(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mtx_);
+            cv_task_.wait(lock, [this] { return is_stop_ || queued_.load() > 0; });
+            if (is_stop_ && queued_.load() == 0) {
+                break;
+            }
+        }
+        current_pool_ = nullptr;
+    }
+
+    bool pop(size_t index, task_type &task) {
+        auto &queue = *queue_list_[index];
+        std::lock_guard<std::mutex> lock(queue.mtx);
+        if (queue.task_list.empty()) {
+            return false;
+        }
+        task = std::move(queue.task_list.back());
+        queue.task_list.pop_back();
+        queued_.fetch_sub(1);
+        return true;
+    }
+
+    bool steal(size_t index, task_type &task) {
+        for (size_t i = 1; i < queue_list_.size(); i++) {
+            auto &queue = *queue_list_[(index + i) % queue_list_.size()];
+            std::lock_guard<std::mutex> lock(queue.mtx);
+            if (queue.task_list.empty()) {
+                continue;
+            }
+            task = std::move(queue.task_list.front());
+            queue.task_list.pop_front();
+            queued_.fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+
+    void run(task_type &task) {
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+        if (pending_.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            cv_done_.notify_all();
+        }
+    }
+};
+
+}  // namespace util_dwarf